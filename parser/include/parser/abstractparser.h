@@ -1,6 +1,10 @@
 #ifndef CC_PARSER_ABSTRACTPARSER_H
 #define CC_PARSER_ABSTRACTPARSER_H
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -18,7 +22,8 @@ public:
    * Constructor, initialize the parsers
    * @param ctx_ - Parser context options
    */
-  AbstractParser(ParserContext& ctx_) : _ctx(ctx_){} 
+  AbstractParser(ParserContext& ctx_)
+    : _ctx(ctx_), _jobs(ctx_.options["jobs"].as<int>()) {}
   
   /**
    * Destructor
@@ -54,9 +59,111 @@ public:
   {
     return false;
   }
-  
+
+  /**
+   * Returns the names of the plugins (e.g. cppparser) whose parse() has to
+   * finish before the parse() of this plugin starts. Plugins which don't
+   * depend on each other are parsing concurrently. Dependencies on plugins
+   * which are not loaded are ignored.
+   */
+  virtual std::vector<std::string> getDependencies() const
+  {
+    return {};
+  }
+
+  /**
+   * Returns true if the plugin can parse a part of the project in a run with
+   * the --shard option: it parses only the work for which
+   * ParserContext::inShard() is true and stores all of its results in the
+   * database, so the shards can be merged. Only these plugins run on the
+   * shards, the others run when the shards are merged.
+   */
+  virtual bool isShardable() const
+  {
+    return false;
+  }
+
+  /**
+   * Entry point of a worker process. A plugin may start copies of the parser
+   * with its own command line and the --worker option to do a part of its
+   * parse() in separate processes. The worker gets a parser context of its
+   * own and doesn't prepare the workspace and the database.
+   * @return The exit code of the worker process.
+   */
+  virtual int runWorker()
+  {
+    return 1;
+  }
+
+  /**
+   * Sets the number of threads the plugin may use during parse(). The --jobs
+   * threads are shared between the plugins parsing at the same time, and
+   * the share of a plugin may change while it is parsing, e.g. it gets the
+   * threads of the plugins which have finished.
+   */
+  void setJobs(int jobs_)
+  {
+    {
+      std::lock_guard<std::mutex> lock(_jobsMutex);
+      _jobs = jobs_;
+    }
+    _jobsChanged.notify_all();
+  }
+
 protected:
+  /**
+   * Counts a thread of the plugin as working while it exists. A plugin can
+   * start a thread for each of the --jobs threads and take a slot for each
+   * unit of work: only as many slots are taken at the same time as the
+   * current share of the plugin, so the plugin follows the changes of its
+   * share.
+   */
+  class JobSlot
+  {
+  public:
+    JobSlot(AbstractParser& parser_) : _parser(parser_)
+    {
+      std::unique_lock<std::mutex> lock(_parser._jobsMutex);
+      _parser._jobsChanged.wait(lock,
+        [this]{ return _parser._busyJobs < _parser._jobs; });
+      ++_parser._busyJobs;
+    }
+
+    ~JobSlot()
+    {
+      {
+        std::lock_guard<std::mutex> lock(_parser._jobsMutex);
+        --_parser._busyJobs;
+      }
+      _parser._jobsChanged.notify_one();
+    }
+
+    JobSlot(const JobSlot&) = delete;
+    JobSlot& operator=(const JobSlot&) = delete;
+
+  private:
+    AbstractParser& _parser;
+  };
+
+  /**
+   * The largest number of threads the plugin may get: all --jobs threads.
+   */
+  int maxJobs() const
+  {
+    return std::max(_ctx.options["jobs"].as<int>(), 1);
+  }
+
   ParserContext& _ctx;
+
+  /**
+   * The number of threads the plugin may use during parse().
+   */
+  std::atomic<int> _jobs;
+
+private:
+  std::mutex _jobsMutex;
+  std::condition_variable _jobsChanged;
+  int _busyJobs = 0;
 };
 
 } // parser
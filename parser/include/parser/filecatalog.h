@@ -0,0 +1,149 @@
+#ifndef CC_PARSER_FILECATALOG_H
+#define CC_PARSER_FILECATALOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <magic.h>
+
+#include <util/parserutil.h>
+
+namespace cc
+{
+namespace parser
+{
+
+/**
+ * The files and directories under the input paths of the parser, collected
+ * by a single parallel traversal. The plugins iterate over the catalog
+ * instead of walking the input directories again. The walk only runs when
+ * the catalog is first used, so a run whose plugins don't need it doesn't
+ * pay for it. The entries don't change after the walk, so the catalog can be
+ * read from several threads.
+ *
+ * The walk only records what the directory entries yield cheaply. The files
+ * are classified by libmagic only when a plugin first asks for their MIME
+ * type, after its cheaper filters, and the result is kept in the entry for
+ * the other plugins.
+ */
+class FileCatalog
+{
+public:
+  struct Entry
+  {
+    /**
+     * Path of the entity. The input paths are canonized before the walk, so
+     * this is the canonical path unless a symbolic link is on the way.
+     */
+    std::string path;
+    util::DirEntryType type;
+
+    /**
+     * Size of the file in bytes, 0 for directories.
+     */
+    std::uint64_t size;
+
+    /**
+     * Last modification time.
+     */
+    std::time_t mtime;
+
+    /**
+     * MIME type of the file as determined by libmagic, e.g. "text/x-c". It is
+     * filled by FileCatalog::mimeType() on the first call, read it through
+     * that function.
+     */
+    mutable std::string mime;
+  };
+
+  /**
+   * Creates an empty catalog.
+   */
+  FileCatalog();
+
+  /**
+   * Creates a catalog of the entities under the given paths. The content of
+   * version control directories (e.g. .git) is not collected, only the
+   * directories themselves.
+   * @param paths_ Directories or files. Paths which don't exist are skipped.
+   * @param threadCount_ The number of threads walking the directories.
+   */
+  FileCatalog(
+    std::vector<std::string> paths_,
+    std::size_t threadCount_);
+
+  ~FileCatalog();
+
+  FileCatalog(const FileCatalog&) = delete;
+  FileCatalog& operator=(const FileCatalog&) = delete;
+
+  /**
+   * The entities of the catalog sorted by their path. The first call walks
+   * the input paths.
+   */
+  const std::vector<Entry>& entries() const;
+
+  /**
+   * Looks up an entity by its path. The first call walks the input paths.
+   * @return The entry or nullptr if the path is not in the catalog.
+   */
+  const Entry* find(const std::string& path_) const;
+
+  /**
+   * Returns true if the input paths are already walked, i.e. the catalog can
+   * be read without waiting for the walk.
+   */
+  bool isCollected() const;
+
+  /**
+   * Returns the MIME type of an entry of the catalog. libmagic runs only on
+   * the first call for an entry, the result is stored in the entry. This
+   * function is thread safe.
+   * @return The MIME type or an empty string if libmagic fails.
+   */
+  const std::string& mimeType(const Entry& entry_) const;
+
+  /**
+   * Returns true if the entry is a regular file with a text MIME type.
+   */
+  bool isPlainText(const Entry& entry_) const;
+
+  /**
+   * Returns true if the MIME type returned by libmagic is a text type.
+   */
+  static bool isPlainTextMime(const char* mime_);
+
+private:
+  void collect() const;
+
+  std::vector<std::string> _paths;
+  std::size_t _threadCount;
+
+  mutable std::once_flag _collectFlag;
+  mutable std::atomic<bool> _collected;
+  mutable std::vector<Entry> _entries;
+
+  /**
+   * Guards the computation of the MIME type of the entry with the same
+   * index.
+   */
+  mutable std::unique_ptr<std::once_flag[]> _mimeFlags;
+
+  /**
+   * libmagic cookie, opened at the first classification. libmagic is not
+   * thread safe, so it is used under _magicMutex.
+   */
+  mutable std::once_flag _magicFlag;
+  mutable std::mutex _magicMutex;
+  mutable ::magic_t _magicCookie;
+};
+
+} // parser
+} // cc
+
+#endif // CC_PARSER_FILECATALOG_H
@@ -0,0 +1,341 @@
+#ifndef CC_PARSER_FILEPARSER_H
+#define CC_PARSER_FILEPARSER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <model/file.h>
+#include <model/file-odb.hxx>
+
+#include <parser/abstractparser.h>
+#include <parser/filecatalog.h>
+#include <parser/parsercontext.h>
+#include <parser/sourcemanager.h>
+
+#include <util/logutil.h>
+#include <util/odbtransaction.h>
+#include <util/threadpool.h>
+
+namespace cc
+{
+namespace parser
+{
+
+/**
+ * Base class of the plugins which compute something for each file of the
+ * project independently. The plugin computes the result of a single file in
+ * parseFile() and stores it in persist(), the framework provides the rest:
+ *
+ *  - the files of the file catalog are parsed on the threads of the plugin,
+ *  - the results are persisted in batches, one transaction per batch,
+ *  - on incremental parsing the results of the changed and deleted files are
+ *    removed by cleanupDatabase(), and the files whose results are still in
+ *    the database are skipped,
+ *  - the number of parsed files and the time spent on parsing and persisting
+ *    are logged at the end.
+ *
+ * @tparam TResult The result of parsing a file.
+ */
+template <typename TResult>
+class FileParser : public AbstractParser
+{
+public:
+  /**
+   * @param ctx_ Parser context.
+   * @param name_ Name of the plugin in the log messages, e.g. metricsparser.
+   * @param batchSize_ The number of files whose results are persisted in a
+   * single transaction.
+   */
+  FileParser(
+    ParserContext& ctx_,
+    std::string name_,
+    std::size_t batchSize_ = 100)
+    : AbstractParser(ctx_),
+      _name(std::move(name_)),
+      _batchSize(std::max<std::size_t>(batchSize_, 1))
+  {
+  }
+
+  virtual bool cleanupDatabase() override
+  {
+    // The parsed files are loaded here, because the plugins can't call the
+    // virtual getParsedFiles() from the constructor.
+    loadParsedFiles();
+
+    if (_parsedFiles.empty() || _ctx.fileStatus.empty())
+      return true;
+
+    std::vector<model::FileId> fileIds(
+      _parsedFiles.begin(), _parsedFiles.end());
+
+    try
+    {
+      util::OdbTransaction {_ctx.db} ([&, this]
+      {
+        for (std::size_t i = 0; i < fileIds.size(); i += inClauseChunkSize)
+        {
+          auto begin = fileIds.begin() + i;
+          auto end = fileIds.begin()
+            + std::min(i + inClauseChunkSize, fileIds.size());
+
+          for (const model::File& file : _ctx.db->query<model::File>(
+            odb::query<model::File>::id.in_range(begin, end)))
+          {
+            auto it = _ctx.fileStatus.find(file.path);
+            if (it != _ctx.fileStatus.end() &&
+                (it->second == IncrementalStatus::DELETED ||
+                 it->second == IncrementalStatus::MODIFIED ||
+                 it->second == IncrementalStatus::ACTION_CHANGED))
+            {
+              LOG(info) << '[' << _name << "] Database cleanup: "
+                << file.path;
+
+              cleanupFile(file.id);
+              _parsedFiles.erase(file.id);
+            }
+          }
+        }
+      });
+    }
+    catch (odb::database_exception&)
+    {
+      LOG(fatal) << "Transaction failed in " << _name << '!';
+      return false;
+    }
+
+    return true;
+  }
+
+  virtual bool parse() override
+  {
+    loadParsedFiles();
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    _parsedCount = 0;
+    _skippedCount = 0;
+    _batchCount = 0;
+    _parseTime = 0;
+    _persistTime = 0;
+    _failed = false;
+
+    // Only as many threads parse at the same time as the current share of
+    // the plugin, which grows when the plugins parsing concurrently finish.
+    std::unique_ptr<util::JobQueueThreadPool<std::string>> pool =
+      util::make_thread_pool<std::string>(
+        maxJobs(), [this](const std::string& path_)
+        {
+          JobSlot slot(*this);
+          parsePath(path_);
+        });
+
+    for (const FileCatalog::Entry& entry : _ctx.fileCatalog->entries())
+      if (accept(entry))
+        pool->enqueue(entry.path);
+
+    pool->wait();
+
+    // The last, partial batch.
+    std::vector<std::pair<model::FileId, TResult>> batch;
+    {
+      std::lock_guard<std::mutex> lock(_batchMutex);
+      batch.swap(_batch);
+    }
+    persistBatch(batch);
+
+    const auto wallTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - startTime);
+
+    LOG(info) << '[' << _name << "] Parsed " << _parsedCount << " file(s), "
+      << "skipped " << _skippedCount << " already parsed file(s) in "
+      << wallTime.count() << " ms ("
+      << (wallTime.count() ? _parsedCount * 1000 / wallTime.count() : 0)
+      << " files/s). Parsing: " << _parseTime / 1000 << " ms, persisting "
+      << _batchCount << " batch(es): " << _persistTime / 1000
+      << " ms, summed over the threads.";
+
+    return !_failed && finishParse();
+  }
+
+protected:
+  /**
+   * Returns true if the file of the file catalog has to be parsed. By default
+   * every regular file is parsed.
+   */
+  virtual bool accept(const FileCatalog::Entry& entry_) const
+  {
+    return entry_.type == util::DirEntryType::RegularFile;
+  }
+
+  /**
+   * Computes the result of a file. This function is called from several
+   * threads at the same time, so it must not modify the plugin.
+   * @return False if nothing has to be persisted for the file.
+   */
+  virtual bool parseFile(const model::FilePtr& file_, TResult& result_) = 0;
+
+  /**
+   * Stores the result of a file. This function is called inside a
+   * transaction, on one thread at a time.
+   */
+  virtual void persist(model::FileId file_, const TResult& result_) = 0;
+
+  /**
+   * Returns the files whose results are stored in the database. These files
+   * are skipped unless they are changed. Called inside a transaction.
+   */
+  virtual std::unordered_set<model::FileId> getParsedFiles() = 0;
+
+  /**
+   * Removes the results of a changed or deleted file. Called inside a
+   * transaction.
+   */
+  virtual void cleanupFile(model::FileId file_) = 0;
+
+  /**
+   * Called after the results of all files are persisted, e.g. to compute
+   * project level data from them.
+   * @return False if it failed.
+   */
+  virtual bool finishParse()
+  {
+    return true;
+  }
+
+  const std::string _name;
+
+private:
+  void loadParsedFiles()
+  {
+    if (_parsedFilesLoaded)
+      return;
+
+    util::OdbTransaction {_ctx.db} ([this]
+    {
+      _parsedFiles = getParsedFiles();
+    });
+    _parsedFilesLoaded = true;
+  }
+
+  void parsePath(const std::string& path_)
+  {
+    model::FilePtr file = _ctx.srcMgr.getFile(path_);
+    if (!file)
+      return;
+
+    bool parsed;
+    {
+      std::lock_guard<std::mutex> lock(_parsedFilesMutex);
+      parsed = _parsedFiles.count(file->id);
+    }
+
+    if (parsed)
+    {
+      LOG(debug) << '[' << _name << "] Already parsed: " << file->path;
+      ++_skippedCount;
+      return;
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    TResult result;
+    bool hasResult = parseFile(file, result);
+
+    _parseTime += std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - startTime).count();
+    ++_parsedCount;
+
+    if (!hasResult)
+      return;
+
+    // The thread which fills a batch persists it.
+    std::vector<std::pair<model::FileId, TResult>> batch;
+    {
+      std::lock_guard<std::mutex> lock(_batchMutex);
+      _batch.emplace_back(file->id, std::move(result));
+      if (_batch.size() >= _batchSize)
+        batch.swap(_batch);
+    }
+
+    persistBatch(batch);
+  }
+
+  void persistBatch(const std::vector<std::pair<model::FileId, TResult>>& batch_)
+  {
+    if (batch_.empty())
+      return;
+
+    const auto startTime = std::chrono::steady_clock::now();
+    bool committed = false;
+
+    try
+    {
+      // The lock is held until the transaction is committed, so the batches
+      // are written to the database one after the other.
+      std::lock_guard<std::mutex> lock(_persistMutex);
+      util::OdbTransaction {_ctx.db} ([&, this]
+      {
+        for (const auto& result : batch_)
+          persist(result.first, result.second);
+      });
+      committed = true;
+    }
+    catch (const std::exception& ex)
+    {
+      LOG(error) << '[' << _name << "] Failed to persist " << batch_.size()
+        << " file(s): " << ex.what();
+      _failed = true;
+    }
+    catch (...)
+    {
+      LOG(error) << '[' << _name << "] Failed to persist " << batch_.size()
+        << " file(s) with unknown exception!";
+      _failed = true;
+    }
+
+    if (committed)
+    {
+      // The files of a committed batch are not parsed again, e.g. by a later
+      // parse() of the same plugin.
+      std::lock_guard<std::mutex> lock(_parsedFilesMutex);
+      for (const auto& result : batch_)
+        _parsedFiles.insert(result.first);
+    }
+
+    _persistTime += std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - startTime).count();
+    ++_batchCount;
+  }
+
+  static const std::size_t inClauseChunkSize = 500;
+
+  const std::size_t _batchSize;
+
+  bool _parsedFilesLoaded = false;
+  std::unordered_set<model::FileId> _parsedFiles;
+  std::mutex _parsedFilesMutex;
+
+  std::vector<std::pair<model::FileId, TResult>> _batch;
+  std::mutex _batchMutex;
+  std::mutex _persistMutex;
+
+  std::atomic<std::size_t> _parsedCount{0};
+  std::atomic<std::size_t> _skippedCount{0};
+  std::atomic<std::size_t> _batchCount{0};
+  std::atomic<std::int64_t> _parseTime{0};
+  std::atomic<std::int64_t> _persistTime{0};
+  std::atomic<bool> _failed{false};
+};
+
+} // parser
+} // cc
+
+#endif // CC_PARSER_FILEPARSER_H
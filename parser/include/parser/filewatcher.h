@@ -0,0 +1,91 @@
+#ifndef CC_PARSER_FILEWATCHER_H
+#define CC_PARSER_FILEWATCHER_H
+
+#include <chrono>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cc
+{
+namespace parser
+{
+
+/**
+ * Watches the input paths of the parser for changes with inotify. Directories
+ * are watched recursively, including the directories created later. For a
+ * file input (e.g. a compilation database) its directory is watched, and only
+ * the changes of the file itself are reported.
+ */
+class FileWatcher
+{
+public:
+  /**
+   * @param paths_ Directories or files. Paths which don't exist are skipped.
+   */
+  FileWatcher(const std::vector<std::string>& paths_);
+  ~FileWatcher();
+
+  FileWatcher(const FileWatcher&) = delete;
+  FileWatcher& operator=(const FileWatcher&) = delete;
+
+  /**
+   * Returns false if inotify couldn't be initialized or nothing is watched.
+   */
+  bool isValid() const;
+
+  /**
+   * Blocks until a watched file changes, then collects the further changes
+   * until no change comes for delay_, so a burst of writes (e.g. a checkout or
+   * an editor saving several files) is reported at once.
+   * @param delay_ The quiet time which ends the collection.
+   * @param overflow_ Set to true if the changed files are not known: the
+   * kernel dropped events or a directory was removed or moved away.
+   * @param timeout_ The longest wait for the first change. Negative means no
+   * limit.
+   * @return The created, modified, moved and deleted files. It is empty if
+   * the wait was interrupted by a signal or timed out.
+   */
+  std::set<std::string> waitForChanges(
+    std::chrono::milliseconds delay_,
+    bool& overflow_,
+    std::chrono::milliseconds timeout_ = std::chrono::milliseconds(-1));
+
+private:
+  /**
+   * Watches the given directory. If recursive_ is true then its subdirectories
+   * are watched too, and the files found in them are added to files_, if it
+   * is not null.
+   */
+  void addDirectory(
+    const std::string& path_,
+    bool recursive_,
+    std::set<std::string>* files_ = nullptr);
+
+  /**
+   * Reads the pending events of the inotify descriptor.
+   * @return False if the read failed.
+   */
+  bool readEvents(std::set<std::string>& changes_, bool& overflow_);
+
+  struct Directory
+  {
+    std::string path;
+    bool recursive;
+  };
+
+  int _fd;
+  std::unordered_map<int, Directory> _directories;
+
+  /**
+   * The watched file inputs. The other files of their directories are not
+   * reported unless the directory is watched recursively too.
+   */
+  std::set<std::string> _files;
+};
+
+} // parser
+} // cc
+
+#endif // CC_PARSER_FILEWATCHER_H
@@ -2,6 +2,8 @@
 #define CC_PARSER_PARSERCONTEXT_H
 
 #include <memory>
+#include <set>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -16,6 +18,7 @@ namespace parser
 {
 
 class SourceManager;
+class FileCatalog;
 
 /**
  * Defines file status categories for incremental parsing.
@@ -32,11 +35,19 @@ enum class IncrementalStatus
 
 struct ParserContext 
 {  
+  /**
+   * The changed files of the project are detected by comparing the content
+   * hashes of the files in the database to the files on disk.
+   * @param changedPaths_ If given, only these files are checked, e.g. the
+   * ones reported by a file watcher, and the regular files among them which
+   * are not in the database yet are detected as added.
+   */
   ParserContext(
     std::shared_ptr<odb::database> db_,
     SourceManager& srcMgr_,
     std::string& compassRoot_,
-    po::variables_map& options_);
+    po::variables_map& options_,
+    const std::set<std::string>* changedPaths_ = nullptr);
 
   std::shared_ptr<odb::database> db;
   SourceManager& srcMgr;
@@ -44,6 +55,25 @@ struct ParserContext
   po::variables_map& options;
   std::unordered_map<std::string, IncrementalStatus> fileStatus;
   std::vector<std::string> moduleDirectories;
+
+  /**
+   * The files under the input paths, collected once for all plugins.
+   */
+  std::shared_ptr<const FileCatalog> fileCatalog;
+
+  /**
+   * The part of the project parsed by this run when it is split with the
+   * --shard option. A single shard contains the whole project.
+   */
+  std::size_t shardIndex = 0;
+  std::size_t shardCount = 1;
+
+  /**
+   * Tells whether the unit of work identified by the given key, e.g. the path
+   * of a source file, belongs to the shard of this run. The shards of a key
+   * are the same in every run.
+   */
+  bool inShard(const std::string& key_) const;
 };
 
 } // parser
@@ -14,12 +14,15 @@
 #include <model/filecontent.h>
 
 #include <util/odbtransaction.h>
+#include <util/sharedidmap.h>
 
 namespace cc
 {
 namespace parser
 {
 
+class FileCatalog;
+
 class SourceManager
 {
 public:
@@ -65,6 +68,12 @@ public:
   template<typename Filter = AllFilesFilter>
   std::vector<model::FilePtr> getFiles(const Filter& beta_ = Filter());
 
+  /**
+   * This function returns true if the cache contains the given path_, i.e.
+   * the file is in the database or it has been created by getFile() already.
+   */
+  bool isCached(const std::string& path_);
+
   /**
    * This function updates the file given as parameter. Note that the file
    * content is read-only, so it can't be changed.
@@ -78,6 +87,21 @@ public:
    */
   bool isPlainText(const std::string& path_) const;
 
+  /**
+   * Sets the catalog of the input files. Once the catalog is collected, the
+   * type and timestamp of the files in it are taken from there instead of
+   * being queried from the file system again. nullptr releases the catalog.
+   */
+  void setFileCatalog(std::shared_ptr<const FileCatalog> catalog_);
+
+  /**
+   * Shares the ids of the persisted files and file contents with the other
+   * processes which parse into the same database, so every file is persisted
+   * by only one of them. The ids persisted so far are added to the table.
+   * @param sharedIds_ The id table or nullptr to stop sharing.
+   */
+  void setSharedIds(std::shared_ptr<util::SharedIdMap> sharedIds_);
+
   // TODO: Maybe this function shouldn't exist.
   void persistFiles();
 
@@ -121,13 +145,24 @@ private:
    */
   model::FilePtr getCreateParent(const std::string& path_);
 
+  /**
+   * These functions mark a file or a file content as persisted. The caller
+   * must hold _createFileMutex.
+   * @return False if it has already been persisted by this or (if the ids are
+   * shared) by another process.
+   */
+  bool markPersistedFile(const model::FileId& id_);
+  bool markPersistedContent(const std::string& hash_);
+
   std::shared_ptr<odb::database> _db;
   util::OdbTransaction _transaction;
   std::map<std::string, model::FilePtr> _files;
   std::unordered_set<model::FileId> _persistedFiles;
   std::unordered_set<std::string> _persistedContents;
+  std::shared_ptr<util::SharedIdMap> _sharedIds;
   std::mutex _createFileMutex;
   ::magic_t _magicCookie;
+  std::shared_ptr<const FileCatalog> _fileCatalog;
 };
 
 template<typename Filter>
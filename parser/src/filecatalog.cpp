@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+
+#include <boost/filesystem.hpp>
+
+#include <util/logutil.h>
+
+#include <parser/filecatalog.h>
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+
+/**
+ * Directories of version control systems. Their content is not part of the
+ * project, so it is neither parsed nor classified.
+ */
+const char* const vcsDirectories[] = {".git", ".hg", ".svn"};
+
+bool isVcsDirectory(const std::string& path_)
+{
+  std::size_t pos = path_.rfind('/');
+  const char* name = path_.c_str() + (pos == std::string::npos ? 0 : pos + 1);
+
+  for (const char* dir : vcsDirectories)
+    if (std::strcmp(name, dir) == 0)
+      return true;
+
+  return false;
+}
+
+} // namespace
+
+namespace cc
+{
+namespace parser
+{
+
+FileCatalog::FileCatalog()
+  : _threadCount(1), _collected(false), _magicCookie(nullptr)
+{
+}
+
+FileCatalog::FileCatalog(
+  std::vector<std::string> paths_,
+  std::size_t threadCount_)
+  : _paths(std::move(paths_)),
+    _threadCount(threadCount_),
+    _collected(false),
+    _magicCookie(nullptr)
+{
+}
+
+FileCatalog::~FileCatalog()
+{
+  if (_magicCookie)
+    ::magic_close(_magicCookie);
+}
+
+const std::vector<FileCatalog::Entry>& FileCatalog::entries() const
+{
+  std::call_once(_collectFlag, [this]{ collect(); });
+  return _entries;
+}
+
+const FileCatalog::Entry* FileCatalog::find(const std::string& path_) const
+{
+  const std::vector<Entry>& all = entries();
+
+  auto it = std::lower_bound(all.begin(), all.end(), path_,
+    [](const Entry& entry_, const std::string& value_)
+    {
+      return entry_.path < value_;
+    });
+
+  return it != all.end() && it->path == path_ ? &*it : nullptr;
+}
+
+bool FileCatalog::isCollected() const
+{
+  return _collected.load(std::memory_order_acquire);
+}
+
+const std::string& FileCatalog::mimeType(const Entry& entry_) const
+{
+  static const std::string unknown;
+
+  const std::vector<Entry>& all = entries();
+  const Entry* entry = &entry_;
+
+  // A copy of an entry is looked up, its MIME type is stored in the original.
+  std::less<const Entry*> less;
+  if (less(entry, all.data()) || !less(entry, all.data() + all.size()))
+  {
+    entry = find(entry_.path);
+    if (!entry)
+      return unknown;
+  }
+
+  std::call_once(_mimeFlags[entry - all.data()], [this, entry]{
+    std::call_once(_magicFlag, [this]{
+      _magicCookie = ::magic_open(MAGIC_MIME_TYPE | MAGIC_SYMLINK);
+
+      if (!_magicCookie)
+        LOG(warning) << "Failed to create a libmagic cookie!";
+      else if (::magic_load(_magicCookie, nullptr) != 0)
+      {
+        LOG(warning)
+          << "magic_load failed! libmagic error: "
+          << ::magic_error(_magicCookie);
+
+        ::magic_close(_magicCookie);
+        _magicCookie = nullptr;
+      }
+    });
+
+    if (!_magicCookie)
+      return;
+
+    std::lock_guard<std::mutex> lock(_magicMutex);
+
+    const char* mime = ::magic_file(_magicCookie, entry->path.c_str());
+    if (mime)
+      entry->mime = mime;
+    else
+      LOG(warning)
+        << "Failed to get mime type for file '" << entry->path
+        << "'. libmagic error: " << ::magic_error(_magicCookie);
+  });
+
+  return entry->mime;
+}
+
+bool FileCatalog::isPlainText(const Entry& entry_) const
+{
+  return entry_.type == util::DirEntryType::RegularFile
+    && isPlainTextMime(mimeType(entry_).c_str());
+}
+
+bool FileCatalog::isPlainTextMime(const char* mime_)
+{
+  return std::strncmp(mime_, "text/", 5) == 0;
+}
+
+void FileCatalog::collect() const
+{
+  if (_paths.empty())
+  {
+    _collected.store(true, std::memory_order_release);
+    return;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  std::mutex entriesLock;
+
+  // The walker stats the entries relative to their directory, so the full
+  // path is not looked up again here.
+  util::DirEntryStatCallback record =
+    [&](
+      const std::string& path_,
+      util::DirEntryType type_,
+      const util::DirEntryStat& stat_)
+    {
+      Entry entry;
+      entry.path = path_;
+      entry.type = type_;
+      entry.size = type_ == util::DirEntryType::RegularFile ? stat_.size : 0;
+      entry.mtime = stat_.mtime;
+
+      {
+        std::lock_guard<std::mutex> lock(entriesLock);
+        _entries.push_back(std::move(entry));
+      }
+
+      return type_ != util::DirEntryType::Directory || !isVcsDirectory(path_);
+    };
+
+  for (const std::string& path : _paths)
+  {
+    boost::system::error_code ec;
+    fs::path canonicalPath = fs::canonical(path, ec);
+
+    if (ec)
+    {
+      LOG(warning) << "Input path not found: " << path;
+      continue;
+    }
+
+    util::iterateDirectoryParallel(
+      canonicalPath.string(), {record}, _threadCount);
+  }
+
+  //--- Sort and remove entities found under several inputs ---//
+
+  std::sort(_entries.begin(), _entries.end(),
+    [](const Entry& lhs_, const Entry& rhs_) { return lhs_.path < rhs_.path; });
+
+  _entries.erase(
+    std::unique(_entries.begin(), _entries.end(),
+      [](const Entry& lhs_, const Entry& rhs_)
+      {
+        return lhs_.path == rhs_.path;
+      }),
+    _entries.end());
+
+  _entries.shrink_to_fit();
+  _mimeFlags.reset(new std::once_flag[_entries.size()]);
+
+  std::size_t numFiles = std::count_if(_entries.begin(), _entries.end(),
+    [](const Entry& entry_)
+    {
+      return entry_.type == util::DirEntryType::RegularFile;
+    });
+
+  LOG(info)
+    << "File catalog: collected " << numFiles << " files and "
+    << _entries.size() - numFiles << " other entities in "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(
+         std::chrono::steady_clock::now() - start).count() << " ms.";
+
+  _collected.store(true, std::memory_order_release);
+}
+
+} // parser
+} // cc
@@ -0,0 +1,220 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+
+#include <util/logutil.h>
+
+#include <parser/filewatcher.h>
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+
+/**
+ * The events which tell that the content of a file may have changed. Files
+ * are reported when they are closed after writing, not on every write.
+ */
+const std::uint32_t watchMask =
+  IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+  IN_ONLYDIR;
+
+} // namespace
+
+namespace cc
+{
+namespace parser
+{
+
+FileWatcher::FileWatcher(const std::vector<std::string>& paths_)
+  : _fd(::inotify_init1(IN_CLOEXEC))
+{
+  if (_fd < 0)
+  {
+    LOG(error) << "Failed to initialize inotify: " << std::strerror(errno);
+    return;
+  }
+
+  for (const std::string& input : paths_)
+  {
+    boost::system::error_code ec;
+    fs::path path = fs::canonical(input, ec);
+
+    if (ec)
+    {
+      LOG(warning) << "Input path doesn't exist, it is not watched: " << input;
+      continue;
+    }
+
+    if (fs::is_directory(path, ec))
+      addDirectory(path.string(), true);
+    else
+    {
+      _files.insert(path.string());
+      addDirectory(path.parent_path().string(), false);
+    }
+  }
+}
+
+FileWatcher::~FileWatcher()
+{
+  if (_fd >= 0)
+    ::close(_fd);
+}
+
+bool FileWatcher::isValid() const
+{
+  return _fd >= 0 && !_directories.empty();
+}
+
+void FileWatcher::addDirectory(
+  const std::string& path_,
+  bool recursive_,
+  std::set<std::string>* files_)
+{
+  int wd = ::inotify_add_watch(_fd, path_.c_str(), watchMask);
+  if (wd < 0)
+  {
+    // The limit of watches is in /proc/sys/fs/inotify/max_user_watches.
+    LOG(warning) << "Failed to watch " << path_ << ": "
+      << std::strerror(errno);
+    return;
+  }
+
+  // A directory may be watched both as the parent of a file input and as a
+  // part of a directory input.
+  Directory& directory = _directories[wd];
+  directory.path = path_;
+  directory.recursive = directory.recursive || recursive_;
+
+  if (!recursive_)
+    return;
+
+  boost::system::error_code ec;
+  for (fs::directory_iterator it(path_, ec), end; !ec && it != end;
+    it.increment(ec))
+  {
+    fs::file_status status = it->symlink_status(ec);
+    if (ec)
+      continue;
+
+    if (fs::is_directory(status))
+      addDirectory(it->path().string(), true, files_);
+    else if (files_ && fs::is_regular_file(status))
+      files_->insert(it->path().string());
+  }
+}
+
+std::set<std::string> FileWatcher::waitForChanges(
+  std::chrono::milliseconds delay_,
+  bool& overflow_,
+  std::chrono::milliseconds timeout_)
+{
+  std::set<std::string> changes;
+  overflow_ = false;
+
+  pollfd pfd;
+  pfd.fd = _fd;
+  pfd.events = POLLIN;
+
+  // Wait for the first change, then until the changes stop coming.
+  int timeout = timeout_.count() < 0 ? -1 : static_cast<int>(timeout_.count());
+
+  while (true)
+  {
+    int ready = ::poll(&pfd, 1, timeout);
+
+    if (ready < 0)
+    {
+      if (errno != EINTR)
+        LOG(error) << "Failed to wait for file changes: "
+          << std::strerror(errno);
+      return {};
+    }
+
+    if (ready == 0)
+      return changes;
+
+    if (!readEvents(changes, overflow_))
+      return {};
+
+    if (!changes.empty() || overflow_)
+      timeout = static_cast<int>(delay_.count());
+  }
+}
+
+bool FileWatcher::readEvents(std::set<std::string>& changes_, bool& overflow_)
+{
+  alignas(inotify_event) char buffer[64 * 1024];
+
+  ssize_t length = ::read(_fd, buffer, sizeof(buffer));
+  if (length < 0)
+  {
+    if (errno == EINTR || errno == EAGAIN)
+      return true;
+
+    LOG(error) << "Failed to read file changes: " << std::strerror(errno);
+    return false;
+  }
+
+  for (const char* ptr = buffer; ptr < buffer + length;)
+  {
+    const inotify_event* event = reinterpret_cast<const inotify_event*>(ptr);
+    ptr += sizeof(inotify_event) + event->len;
+
+    if (event->mask & IN_Q_OVERFLOW)
+    {
+      LOG(warning) << "Too many file changes at once, every file is checked.";
+      overflow_ = true;
+      continue;
+    }
+
+    auto it = _directories.find(event->wd);
+    if (it == _directories.end())
+      continue;
+
+    if (event->mask & IN_IGNORED)
+    {
+      _directories.erase(it);
+      continue;
+    }
+
+    if (!event->len)
+      continue;
+
+    const Directory& directory = it->second;
+    std::string path = directory.path + '/' + event->name;
+
+    if (!directory.recursive && !_files.count(path))
+      continue;
+
+    if (event->mask & IN_ISDIR)
+    {
+      if (event->mask & (IN_CREATE | IN_MOVED_TO))
+      {
+        // The files could be created in the new directory before it was
+        // watched, so they are reported here.
+        addDirectory(path, true, &changes_);
+      }
+      else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+      {
+        // The files of the directory are not known here.
+        overflow_ = true;
+      }
+      continue;
+    }
+
+    changes_.insert(path);
+  }
+
+  return true;
+}
+
+} // parser
+} // cc
@@ -1,9 +1,19 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <condition_variable>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 #include <vector>
 #include <iostream>
 #include <fstream>
 
+#include <sys/resource.h>
+
 #include <boost/log/expressions.hpp>
 #include <boost/log/expressions/attr.hpp>
 #include <boost/log/attributes.hpp>
@@ -18,6 +28,8 @@
 #include <util/logutil.h>
 #include <util/odbtransaction.h>
 
+#include <parser/filecatalog.h>
+#include <parser/filewatcher.h>
 #include <parser/parsercontext.h>
 #include <parser/pluginhandler.h>
 #include <parser/sourcemanager.h>
@@ -86,10 +98,36 @@ po::options_description commandLineArguments()
     ("incremental-threshold", po::value<int>()->default_value(10),
       "This is a threshold percentage. If the total ratio of changed files "
       "is greater than this value, full parse is forced instead of incremental parsing.")
+    ("index-build-memory", po::value<int>()->default_value(2048),
+      "The memory in MiB which the database may use for sorting while it "
+      "builds the indexes after the first parse. It is shared by the indexes "
+      "built at the same time. Only used with PostgreSQL.")
     ("modules,m", po::value<std::string>(),
       "For metrics calculations, you can specify the project's (sub)module structure."
       "Provide the path of a text file for this setting."
-      "The file should contain directory paths, each on a separate line, which will be considered modules.");
+      "The file should contain directory paths, each on a separate line, which will be considered modules.")
+    ("shard", po::value<std::string>(),
+      "Parses a part of the project given as i/N, where 0 <= i < N. The "
+      "parsing of a large project can be split this way between N runs, e.g. "
+      "on separate machines, each having its own database and workspace. Only "
+      "the plugins which support it parse in the shards, the others parse "
+      "when the shards are merged with --merge. The shards have to be SQLite "
+      "databases.")
+    ("merge", po::value<std::vector<std::string>>(),
+      "Connection strings of shard databases parsed with --shard. The shards "
+      "are loaded into the new database of the project, then the plugins "
+      "which don't support sharding parse the project. Only SQLite databases "
+      "can be merged: --merge sqlite:database=shard0.sqlite --merge ...")
+    ("watch",
+      "After parsing, the parser keeps running and updates the project "
+      "incrementally whenever files under the input paths or the compilation "
+      "databases change. Stop it with Ctrl+C.")
+    ("watch-delay", po::value<int>()->default_value(500),
+      "With --watch, an update starts when no file has changed for this many "
+      "milliseconds, so a burst of changes is parsed at once.")
+    ("worker", po::value<std::string>(),
+      "Used internally: runs the given plugin as a worker process of a parser "
+      "which has been started with the same options.");
 
   return desc;
 }
@@ -217,6 +255,584 @@ void incrementalCleanup(cc::parser::ParserContext& ctx_)
   }
 }
 
+/**
+ * Orders the plugins for the cleanup of an incremental parse. A plugin may
+ * read the data of the plugins it depends on to find out what to clean up,
+ * so it is cleaned up before them.
+ * @param pluginNames_ The plugins to clean up.
+ * @return The plugins in the order of their cleanup.
+ */
+std::vector<std::string> cleanupOrder(
+  cc::parser::PluginHandler& pHandler_,
+  const std::vector<std::string>& pluginNames_)
+{
+  std::map<std::string, std::vector<std::string>> dependencies;
+  for (const std::string& pluginName : pluginNames_)
+    dependencies[pluginName]
+      = pHandler_.getParser(pluginName)->getDependencies();
+
+  std::vector<std::string> order;
+  std::vector<std::string> pending = pluginNames_;
+
+  while (!pending.empty())
+  {
+    // The next plugin is one on which no other pending plugin depends. If
+    // the dependencies are circular then runParsers() reports it, the
+    // cleanup just takes the first one.
+    auto next = std::find_if(pending.begin(), pending.end(),
+      [&](const std::string& pluginName_)
+      {
+        return std::none_of(pending.begin(), pending.end(),
+          [&](const std::string& other_)
+          {
+            const std::vector<std::string>& deps = dependencies[other_];
+            return std::find(deps.begin(), deps.end(), pluginName_)
+              != deps.end();
+          });
+      });
+
+    if (next == pending.end())
+      next = pending.begin();
+
+    order.push_back(*next);
+    pending.erase(next);
+  }
+
+  return order;
+}
+
+/**
+ * Runs the database cleanup of a plugin. An exception thrown by the plugin is
+ * logged and reported as a failed cleanup.
+ * @return False if the cleanup failed.
+ */
+bool cleanupPlugin(
+  cc::parser::PluginHandler& pHandler_,
+  const std::string& pluginName_)
+{
+  try
+  {
+    if (pHandler_.getParser(pluginName_)->cleanupDatabase())
+      return true;
+  }
+  catch (const std::exception& ex_)
+  {
+    LOG(error) << "[" << pluginName_ << "] cleanup threw an exception: "
+               << ex_.what();
+  }
+  catch (...)
+  {
+    LOG(error) << "[" << pluginName_ << "] cleanup failed with unknown "
+                  "exception!";
+  }
+
+  LOG(error) << "[" << pluginName_ << "] cleanup failed!";
+  return false;
+}
+
+/**
+ * Drops the file catalog once the plugins have parsed, so its entries don't
+ * stay in memory for the rest of the run.
+ * @param ctx_ Parser context.
+ */
+void releaseFileCatalog(cc::parser::ParserContext& ctx_)
+{
+  ctx_.srcMgr.setFileCatalog(nullptr);
+  ctx_.fileCatalog = std::make_shared<const cc::parser::FileCatalog>();
+}
+
+/**
+ * Returns the CPU time used by all threads of the process so far.
+ */
+double processCpuSeconds()
+{
+  struct rusage usage;
+  if (::getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0.0;
+
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+    + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * This function parses the value of the --shard option.
+ * @return False if the value is not in i/N format where 0 <= i < N.
+ */
+bool parseShard(
+  const std::string& shard_,
+  std::size_t& shardIndex_,
+  std::size_t& shardCount_)
+{
+  std::size_t pos = shard_.find('/');
+  if (pos == std::string::npos)
+    return false;
+
+  try
+  {
+    std::size_t end;
+    shardIndex_ = std::stoul(shard_.substr(0, pos), &end);
+    if (end != pos)
+      return false;
+
+    shardCount_ = std::stoul(shard_.substr(pos + 1), &end);
+    if (end != shard_.size() - pos - 1)
+      return false;
+  }
+  catch (const std::logic_error&)
+  {
+    return false;
+  }
+
+  return shardIndex_ < shardCount_;
+}
+
+/**
+ * Runs a plugin as a worker process of another parser process. The parent has
+ * prepared the workspace and the database already, so the worker only
+ * connects to the database and hands over the control to the plugin.
+ * @return The exit code of the process.
+ */
+int runWorker(
+  cc::parser::PluginHandler& pHandler_,
+  po::variables_map& vm_,
+  std::string& compassRoot_)
+{
+  const std::string& pluginName = vm_["worker"].as<std::string>();
+
+  std::vector<std::string> loaded = pHandler_.getLoadedPluginNames();
+  if (std::find(loaded.begin(), loaded.end(), pluginName) == loaded.end())
+  {
+    LOG(error) << "Plugin " << pluginName << " is not available.";
+    return 1;
+  }
+
+  std::shared_ptr<odb::database> db = cc::util::connectDatabase(
+    vm_["database"].as<std::string>(), false);
+
+  if (!db)
+  {
+    LOG(error) << "Worker process couldn't connect to the database.";
+    return 1;
+  }
+
+  cc::parser::SourceManager srcMgr(db);
+  cc::parser::ParserContext ctx(db, srcMgr, compassRoot_, vm_);
+  pHandler_.createPlugins(ctx);
+
+  return pHandler_.getParser(pluginName)->runWorker();
+}
+
+/**
+ * Runs the parse() of the given plugins. A plugin is started as soon as the
+ * plugins it depends on have finished, so independent plugins are parsing
+ * concurrently, each on its own thread. The --jobs threads are shared
+ * between the plugins running at the same time: a plugin gets an even share
+ * of the threads not used by the running plugins when it starts. If there
+ * are no such threads, it takes half of the share of the plugin with the
+ * most threads. The threads of a finished plugin which no starting plugin
+ * needs are handed over to the running plugins.
+ * @param pluginNames_ The plugins to run.
+ * @param finished_ The plugins which have already finished. The plugins run
+ * by this call are added to it.
+ * @param failed_ The plugins whose parse() failed are added to it.
+ * @param jobs_ The number of threads which may be used at the same time.
+ * @return False if the dependencies of the plugins can't be satisfied.
+ */
+bool runParsers(
+  cc::parser::PluginHandler& pHandler_,
+  const std::vector<std::string>& pluginNames_,
+  std::set<std::string>& finished_,
+  std::set<std::string>& failed_,
+  int jobs_)
+{
+  //--- Collect the dependencies between the given plugins ---//
+
+  std::vector<std::string> loaded = pHandler_.getLoadedPluginNames();
+  std::map<std::string, std::vector<std::string>> dependencies;
+
+  for (const std::string& pluginName : pluginNames_)
+    for (const std::string& dependency
+      : pHandler_.getParser(pluginName)->getDependencies())
+    {
+      if (finished_.count(dependency) ||
+          std::find(loaded.begin(), loaded.end(), dependency) == loaded.end())
+        continue;
+
+      if (std::find(pluginNames_.begin(), pluginNames_.end(), dependency)
+          == pluginNames_.end())
+      {
+        LOG(error) << "[" << pluginName << "] depends on " << dependency
+          << " which parses after the database indexes are created!";
+        return false;
+      }
+
+      dependencies[pluginName].push_back(dependency);
+    }
+
+  //--- Run the plugins whose dependencies have finished ---//
+
+  std::vector<std::string> pending = pluginNames_;
+  std::map<std::string, std::thread> running;
+  std::map<std::string, int> shares;
+  int available = jobs_;
+
+  std::mutex finishedMutex;
+  std::condition_variable finishedCond;
+  std::vector<std::string> justFinished;
+
+  auto runParser = [&](const std::string& pluginName_, int share_)
+  {
+    auto plugin = pHandler_.getParser(pluginName_);
+
+    LOG(info) << "[" << pluginName_ << "] parse started with " << share_
+              << " thread(s)!";
+
+    auto wallStart = std::chrono::steady_clock::now();
+    double cpuStart = processCpuSeconds();
+
+    bool success = false;
+    try
+    {
+      success = plugin->parse();
+    }
+    catch (const std::exception& ex_)
+    {
+      LOG(error) << "[" << pluginName_ << "] parse threw an exception: "
+                 << ex_.what();
+    }
+    catch (...)
+    {
+      LOG(error) << "[" << pluginName_ << "] parse failed with unknown "
+                    "exception!";
+    }
+
+    double wall = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - wallStart).count();
+    double cpu = processCpuSeconds() - cpuStart;
+
+    // The CPU time is measured for the whole process, so it includes the
+    // plugins running concurrently with this one.
+    LOG(info)
+      << "[" << pluginName_ << "] parse " << (success ? "finished" : "failed")
+      << " in " << wall << " s wall time. Process CPU time meanwhile: " << cpu
+      << " s, " << (wall > 0 ? static_cast<int>(100 * cpu / (wall * jobs_)) : 0)
+      << "% of the --jobs threads.";
+
+    std::lock_guard<std::mutex> lock(finishedMutex);
+    if (!success)
+      failed_.insert(pluginName_);
+    justFinished.push_back(pluginName_);
+    finishedCond.notify_one();
+  };
+
+  while (!pending.empty() || !running.empty())
+  {
+    std::vector<std::string> ready;
+    for (const std::string& pluginName : pending)
+    {
+      const std::vector<std::string>& deps = dependencies[pluginName];
+      if (std::all_of(deps.begin(), deps.end(),
+            [&](const std::string& dep_) { return finished_.count(dep_); }))
+        ready.push_back(pluginName);
+    }
+
+    if (ready.empty() && running.empty())
+    {
+      LOG(error) << "Circular dependency between the parser plugins:";
+      for (const std::string& pluginName : pending)
+        LOG(error) << " - " << pluginName;
+      return false;
+    }
+
+    for (std::size_t i = 0; i < ready.size(); ++i)
+    {
+      if (available == 0)
+      {
+        auto largest = std::max_element(running.begin(), running.end(),
+          [&](const auto& lhs_, const auto& rhs_)
+          {
+            return shares[lhs_.first] < shares[rhs_.first];
+          });
+
+        if (largest == running.end() || shares[largest->first] < 2)
+          break;
+
+        int taken = shares[largest->first] / 2;
+        shares[largest->first] -= taken;
+        available += taken;
+        pHandler_.getParser(largest->first)->setJobs(shares[largest->first]);
+      }
+
+      int share = std::max(1, available / static_cast<int>(ready.size() - i));
+      available -= share;
+      shares[ready[i]] = share;
+      pHandler_.getParser(ready[i])->setJobs(share);
+
+      pending.erase(std::find(pending.begin(), pending.end(), ready[i]));
+      running.emplace(ready[i], std::thread(runParser, ready[i], share));
+    }
+
+    // E.g. the C++ parser gets the threads of the plugins which finished
+    // before it.
+    int remaining = static_cast<int>(running.size());
+    for (auto& plugin : running)
+    {
+      if (available == 0)
+        break;
+
+      int extra = available / remaining--;
+      if (extra == 0)
+        continue;
+
+      available -= extra;
+      shares[plugin.first] += extra;
+      pHandler_.getParser(plugin.first)->setJobs(shares[plugin.first]);
+
+      LOG(debug) << "[" << plugin.first << "] continues with "
+                 << shares[plugin.first] << " thread(s).";
+    }
+
+    std::unique_lock<std::mutex> lock(finishedMutex);
+    finishedCond.wait(lock, [&]{ return !justFinished.empty(); });
+
+    for (const std::string& pluginName : justFinished)
+    {
+      running[pluginName].join();
+      running.erase(pluginName);
+      available += shares[pluginName];
+      finished_.insert(pluginName);
+    }
+
+    justFinished.clear();
+  }
+
+  return true;
+}
+
+namespace
+{
+
+/**
+ * Keeps the database in bulk load mode while it exists, so the database is
+ * switched back to durable mode on every exit path of the parser.
+ */
+class BulkLoadScope
+{
+public:
+  BulkLoadScope(
+    std::shared_ptr<odb::database> db_,
+    std::string sqlDir_,
+    std::size_t threadCount_)
+    : _db(std::move(db_)),
+      _sqlDir(std::move(sqlDir_)),
+      _threadCount(threadCount_),
+      _active(true)
+  {
+    cc::util::beginBulkLoad(_db, _sqlDir);
+  }
+
+  ~BulkLoadScope()
+  {
+    try
+    {
+      end();
+    }
+    catch (const odb::exception& ex)
+    {
+      LOG(error) << "Failed to switch the database to durable mode: "
+                 << ex.what();
+    }
+  }
+
+  void end()
+  {
+    if (!_active)
+      return;
+
+    _active = false;
+    cc::util::endBulkLoad(_db, _sqlDir, _threadCount);
+  }
+
+private:
+  std::shared_ptr<odb::database> _db;
+  std::string _sqlDir;
+  std::size_t _threadCount;
+  bool _active;
+};
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+void requestStop(int)
+{
+  stopRequested = 1;
+}
+
+} // namespace
+
+/**
+ * Keeps the parser running after the parse and updates the project whenever
+ * files under the input paths change. The changes are collected with inotify
+ * and the incremental parsing workflow runs for the changed files only: only
+ * these are walked and hashed. The plugin libraries, the database connection
+ * and the file cache of the source manager are kept between the updates. The
+ * plugins are created again for each update, because their state belongs to
+ * a single parse.
+ * @return The exit code of the process.
+ */
+int watchProject(
+  cc::parser::PluginHandler& pHandler_,
+  cc::parser::SourceManager& srcMgr_,
+  std::shared_ptr<odb::database> db_,
+  po::variables_map& vm_,
+  std::string& compassRoot_)
+{
+  const std::vector<std::string> inputs = vm_.count("input")
+    ? vm_["input"].as<std::vector<std::string>>()
+    : std::vector<std::string>();
+
+  cc::parser::FileWatcher watcher(inputs);
+  if (!watcher.isValid())
+  {
+    LOG(error) << "None of the input paths can be watched.";
+    return 1;
+  }
+
+  std::signal(SIGINT, requestStop);
+  std::signal(SIGTERM, requestStop);
+
+  // The updates are incremental even if the first parse was forced.
+  vm_.erase("force");
+
+  const std::chrono::milliseconds delay(vm_["watch-delay"].as<int>());
+  const int jobs = std::max(vm_["jobs"].as<int>(), 1);
+  const std::vector<std::string> pluginNames
+    = pHandler_.getLoadedPluginNames();
+
+  // The plugins refer to the context, so it is replaced only after the
+  // plugins which were created with it.
+  std::unique_ptr<cc::parser::ParserContext> ctx;
+
+  // The changes of an update whose cleanup failed. They are processed again
+  // together with the next changes, or after retryDelay if nothing changes.
+  std::set<std::string> retryChanges;
+  bool retryOverflow = false;
+  const std::chrono::milliseconds retryDelay = std::max(
+    delay * 10, std::chrono::milliseconds(std::chrono::seconds(10)));
+
+  LOG(info) << "Watching the input paths for changes. Press Ctrl+C to stop.";
+
+  while (!stopRequested)
+  {
+    bool retryPending = !retryChanges.empty() || retryOverflow;
+
+    bool overflow;
+    std::set<std::string> changes = watcher.waitForChanges(
+      delay,
+      overflow,
+      retryPending ? retryDelay : std::chrono::milliseconds(-1));
+
+    if (stopRequested)
+      break;
+
+    if (changes.empty() && !overflow && !retryPending)
+      continue;
+
+    changes.insert(retryChanges.begin(), retryChanges.end());
+    overflow |= retryOverflow;
+    retryChanges.clear();
+    retryOverflow = false;
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    // If the changed files are not known then every file is checked.
+    auto fileCatalog = std::make_shared<const cc::parser::FileCatalog>(
+      overflow
+        ? inputs
+        : std::vector<std::string>(changes.begin(), changes.end()),
+      jobs);
+    srcMgr_.setFileCatalog(fileCatalog);
+
+    auto nextCtx = std::make_unique<cc::parser::ParserContext>(
+      db_, srcMgr_, compassRoot_, vm_, overflow ? nullptr : &changes);
+    nextCtx->fileCatalog = fileCatalog;
+    pHandler_.createPlugins(*nextCtx);
+    ctx = std::move(nextCtx);
+
+    for (const std::string& pluginName : pluginNames)
+      pHandler_.getParser(pluginName)->markModifiedFiles();
+
+    if (ctx->fileStatus.empty())
+    {
+      LOG(debug) << "No changed file to parse.";
+      releaseFileCatalog(*ctx);
+      continue;
+    }
+
+    incrementalList(*ctx);
+
+    bool success = true;
+    for (const std::string& pluginName : cleanupOrder(pHandler_, pluginNames))
+    {
+      if (!cleanupPlugin(pHandler_, pluginName))
+      {
+        success = false;
+        break;
+      }
+    }
+
+    // The file entries are only removed by incrementalCleanup(), so the
+    // same changes are detected again when the change set is checked again.
+    if (!success)
+    {
+      releaseFileCatalog(*ctx);
+      retryChanges = std::move(changes);
+      retryOverflow = overflow;
+
+      LOG(warning)
+        << "Failed to update " << ctx->fileStatus.size()
+        << " changed file(s), retrying in "
+        << std::chrono::duration<double>(retryDelay).count()
+        << " s or with the next change.";
+      continue;
+    }
+
+    incrementalCleanup(*ctx);
+
+    // The database indexes exist already, but the plugins which require
+    // them still parse after the others.
+    std::vector<std::string> beforeIndexingPlugins;
+    std::vector<std::string> afterIndexingPlugins;
+
+    for (const std::string& pluginName : pluginNames)
+    {
+      if (!pHandler_.getParser(pluginName)->isDatabaseIndexRequired())
+        beforeIndexingPlugins.push_back(pluginName);
+      else
+        afterIndexingPlugins.push_back(pluginName);
+    }
+
+    std::set<std::string> finishedPlugins;
+    std::set<std::string> failedPlugins;
+    success =
+      runParsers(pHandler_, beforeIndexingPlugins, finishedPlugins,
+        failedPlugins, jobs) &&
+      runParsers(pHandler_, afterIndexingPlugins, finishedPlugins,
+        failedPlugins, jobs) &&
+      failedPlugins.empty();
+
+    releaseFileCatalog(*ctx);
+
+    LOG(info) << (success ? "Updated " : "Failed to update ")
+      << ctx->fileStatus.size() << " changed file(s) in "
+      << std::chrono::duration<double>(
+           std::chrono::steady_clock::now() - startTime).count()
+      << " s.";
+  }
+
+  LOG(info) << "Stopped watching the input paths.";
+  return 0;
+}
+
 int main(int argc, char* argv[])
 {
   std::string compassRoot = cc::util::binaryPathToInstallDir(argv[0]);
@@ -236,12 +852,14 @@ int main(int argc, char* argv[])
   po::store(po::command_line_parser(argc, argv)
     .options(desc).allow_unregistered().run(), vm);
 
+  // Worker processes append to the log file created by their parent.
   if (vm.count("logtarget"))
   {
     vm.at("logtarget").value() = cc::util::getLoggingBase( vm["logtarget"].as<std::string>()
                                                           , vm["name"].as<std::string>()
                                                           );
-    if (!cc::util::initFileLogger(vm["logtarget"].as<std::string>() + "parser.log"))
+    if (!cc::util::initFileLogger(vm["logtarget"].as<std::string>() + "parser.log",
+                                  vm.count("worker")))
     {
       vm.at("logtarget").value() = std::string();
     }
@@ -253,6 +871,12 @@ int main(int argc, char* argv[])
   if (vm.count("skip"))
     skipParserList = vm["skip"].as<std::vector<std::string>>();
 
+  // A worker process runs a single plugin.
+  if (vm.count("worker"))
+    for (const std::string& pluginName : pHandler.getPluginNames())
+      if (pluginName != vm["worker"].as<std::string>())
+        skipParserList.push_back(pluginName);
+
   //--- Load parsers ---//
 
   pHandler.loadPlugins(skipParserList);
@@ -302,6 +926,44 @@ int main(int argc, char* argv[])
     return 1;
   }
   
+  if (vm.count("worker"))
+    return runWorker(pHandler, vm, compassRoot);
+
+  std::size_t shardIndex = 0;
+  std::size_t shardCount = 1;
+
+  if (vm.count("shard") && !parseShard(
+    vm["shard"].as<std::string>(), shardIndex, shardCount))
+  {
+    LOG(error) << "The shard has to be given as i/N, where 0 <= i < N.";
+    return 1;
+  }
+
+  if (vm.count("shard") && vm.count("merge"))
+  {
+    LOG(error) << "A shard can't be merged with other shards.";
+    return 1;
+  }
+
+  // The shards are loaded by attaching their database files, so both the
+  // shards and the merged database have to be SQLite databases. This is
+  // checked before a shard is parsed in vain.
+  if (vm.count("shard") || vm.count("merge"))
+  {
+    std::vector<std::string> connStrs{vm["database"].as<std::string>()};
+    if (vm.count("merge"))
+      for (const std::string& shard : vm["merge"].as<std::vector<std::string>>())
+        connStrs.push_back(shard);
+
+    for (const std::string& connStr : connStrs)
+      if (connStr.compare(0, 7, "sqlite:") != 0)
+      {
+        LOG(error) << "--shard and --merge can only be used with SQLite "
+          "databases, not with '" << connStr << "'.";
+        return 1;
+      }
+  }
+
   //--- Check database and project directory existence ---//
   
   bool isNewDb = cc::util::connectDatabase(
@@ -329,6 +991,20 @@ int main(int argc, char* argv[])
     return 1;
   }
 
+  if (vm.count("watch") &&
+      (vm.count("shard") || vm.count("merge") || vm.count("dry-run")))
+  {
+    LOG(error) << "--watch can't be used with --shard, --merge or --dry-run.";
+    return 1;
+  }
+
+  if (!isNewDb && !vm.count("force") && vm.count("merge"))
+  {
+    LOG(error) << "Shards can only be merged into a new database. Use -f for "
+      "reparsing!";
+    return 1;
+  }
+
   //--- Prepare workspace and project directory ---//
   
   std::string projDir = prepareProjectDir(vm);
@@ -356,6 +1032,22 @@ int main(int argc, char* argv[])
   if (vm.count("force") || isNewDb)
     cc::util::createTables(db, SQL_DIR);
 
+  //--- Merge shards ---//
+
+  // The shards are loaded before the source manager reads the files from the
+  // database.
+  int jobs = std::max(vm["jobs"].as<int>(), 1);
+  std::unique_ptr<BulkLoadScope> bulkLoadScope;
+
+  if (vm.count("merge"))
+  {
+    bulkLoadScope.reset(new BulkLoadScope(db, SQL_DIR, jobs));
+
+    if (!cc::util::mergeDatabases(
+      db, SQL_DIR, vm["merge"].as<std::vector<std::string>>()))
+      return 1;
+  }
+
   //--- Start parsers ---//
 
   /*
@@ -369,11 +1061,37 @@ int main(int argc, char* argv[])
    * In case of an initial or forced parsing, only step 5 is executed.
    */
 
+  //--- Catalog the input paths once for all plugins ---//
+
+  // The catalog walks the inputs only when a plugin first reads it.
+  auto fileCatalog = std::make_shared<const cc::parser::FileCatalog>(
+    vm.count("input")
+      ? vm["input"].as<std::vector<std::string>>()
+      : std::vector<std::string>(),
+    vm["jobs"].as<int>());
+
   cc::parser::SourceManager srcMgr(db);
+  srcMgr.setFileCatalog(fileCatalog);
   cc::parser::ParserContext ctx(db, srcMgr, compassRoot, vm);
+  ctx.fileCatalog = fileCatalog;
+  ctx.shardIndex = shardIndex;
+  ctx.shardCount = shardCount;
   pHandler.createPlugins(ctx);
 
-  std::vector<std::string> pluginNames = pHandler.getLoadedPluginNames();
+  // The plugins which support sharding parse in the shards, the others parse
+  // the project when the shards are merged.
+  std::vector<std::string> pluginNames;
+  for (const std::string& pluginName : pHandler.getLoadedPluginNames())
+  {
+    bool shardable = pHandler.getParser(pluginName)->isShardable();
+
+    if ((vm.count("shard") && !shardable) || (vm.count("merge") && shardable))
+      LOG(info) << "[" << pluginName << "] skipped, it "
+                << (shardable ? "has parsed in the shards." : "doesn't "
+                    "support sharding, it parses when the shards are merged.");
+    else
+      pluginNames.push_back(pluginName);
+  }
   for (const std::string& pluginName : pluginNames)
   {
     LOG(info) << "[" << pluginName << "] started to mark modified files!";
@@ -402,45 +1120,59 @@ int main(int argc, char* argv[])
 
   if (!vm.count("force"))
   {
-    for (const std::string& pluginName : pluginNames)
+    for (const std::string& pluginName : cleanupOrder(pHandler, pluginNames))
     {
       LOG(info) << "[" << pluginName << "] cleanup started!";
-      if (!pHandler.getParser(pluginName)->cleanupDatabase())
-      {
-        LOG(error) << "[" << pluginName << "] cleanup failed!";
+      if (!cleanupPlugin(pHandler, pluginName))
         return 2;
-      }
     }
 
     incrementalCleanup(ctx);
   }
 
+  std::vector<std::string> beforeIndexingPlugins;
   std::vector<std::string> afterIndexingPlugins;
 
-  // TODO: Handle errors returned by parse().
   for (const std::string& pluginName : pluginNames)
   {
-    auto plugin = pHandler.getParser(pluginName);
-    if (!plugin->isDatabaseIndexRequired())
-    {
-      LOG(info) << "[" << pluginName << "] parse started!";
-      plugin->parse();
-    }
-    else {
+    if (!pHandler.getParser(pluginName)->isDatabaseIndexRequired())
+      beforeIndexingPlugins.push_back(pluginName);
+    else
       afterIndexingPlugins.push_back(pluginName);
-    }
   }
 
+  // A plugin which fails to parse doesn't stop the others, the failure is
+  // reported by the exit code.
+  std::set<std::string> finishedPlugins;
+  std::set<std::string> failedPlugins;
+
+  // A failed initial parse has to be restarted from scratch anyway, so the
+  // tables don't need to be crash-safe until the indexes are built.
+  bool bulkLoad = vm.count("force") || isNewDb;
+  if (bulkLoad && !bulkLoadScope)
+    bulkLoadScope.reset(new BulkLoadScope(db, SQL_DIR, jobs));
+
+  if (!runParsers(
+    pHandler, beforeIndexingPlugins, finishedPlugins, failedPlugins, jobs))
+    return 2;
+
   //--- Add indexes to the database ---//
 
-  if (vm.count("force") || isNewDb)
-    cc::util::createIndexes(db, SQL_DIR);
+  if (bulkLoadScope)
+    bulkLoadScope->end();
 
-  for (const std::string& pluginName : afterIndexingPlugins)
-  {
-    LOG(info) << "[" << pluginName << "] parse started!";
-    pHandler.getParser(pluginName)->parse();
-  }
+  // A shard is only read by the merge, which builds the indexes of the
+  // merged database.
+  if (bulkLoad && !vm.count("shard"))
+    cc::util::createIndexes(db, SQL_DIR, jobs,
+      std::max(vm["index-build-memory"].as<int>(), 64));
+
+  if (!runParsers(
+    pHandler, afterIndexingPlugins, finishedPlugins, failedPlugins, jobs))
+    return 2;
+
+  releaseFileCatalog(ctx);
+  fileCatalog.reset();
 
   //--- Create project config file ---//
 
@@ -475,6 +1207,16 @@ int main(int argc, char* argv[])
 
   boost::property_tree::write_json(projDir + "/project_info.json", pt);
 
+  if (!failedPlugins.empty())
+  {
+    for (const std::string& pluginName : failedPlugins)
+      LOG(error) << "[" << pluginName << "] parse failed!";
+    return 3;
+  }
+
+  if (vm.count("watch"))
+    return watchProject(pHandler, srcMgr, db, vm, compassRoot);
+
   // TODO: Print statistics.
 
   return 0;
@@ -9,6 +9,7 @@
 #include <util/hash.h>
 #include <util/odbtransaction.h>
 
+#include <parser/filecatalog.h>
 #include <parser/parsercontext.h>
 #include <parser/sourcemanager.h>
 
@@ -24,60 +25,81 @@ ParserContext::ParserContext(
   std::shared_ptr<odb::database> db_,
   SourceManager& srcMgr_,
   std::string& compassRoot_,
-  po::variables_map& options_) :
+  po::variables_map& options_,
+  const std::set<std::string>* changedPaths_) :
     db(db_),
     srcMgr(srcMgr_),
     compassRoot(compassRoot_),
-    options(options_)
+    options(options_),
+    fileCatalog(std::make_shared<FileCatalog>())
 {
   std::unordered_map<std::string, std::string> fileHashes;
 
-  (util::OdbTransaction(this->db))([&]
-   {
-     // Fetch directory and binary type files from SourceManager
-     auto func = [](model::FilePtr item)
+  // Worker processes get the files to parse from their parent, which has
+  // detected the changes already.
+  if (!options.count("worker"))
+    (util::OdbTransaction(this->db))([&]
      {
-       return item->type != model::File::DIRECTORY_TYPE &&
-              item->type != model::File::BINARY_TYPE;
-     };
-     std::vector<model::FilePtr> files = this->srcMgr.getFiles(func);
-
-     for (model::FilePtr file : files)
-     {
-       if (boost::filesystem::exists(file->path))
+       // Fetch directory and binary type files from SourceManager
+       auto func = [&](model::FilePtr item)
        {
-         if (!fileStatus.count(file->path))
-         {
-           model::FileContentPtr content = file->content.load();
-           if (!content)
-             continue;
-
-           fileHashes[file->path] = content->hash;
+         return (!changedPaths_ || changedPaths_->count(item->path)) &&
+                item->type != model::File::DIRECTORY_TYPE &&
+                item->type != model::File::BINARY_TYPE;
+       };
+       std::vector<model::FilePtr> files = this->srcMgr.getFiles(func);
+
+       // The files which are not in the database yet.
+       std::set<std::string> addedPaths;
+       if (changedPaths_)
+       {
+         for (const std::string& path : *changedPaths_)
+           if (!this->srcMgr.isCached(path) && fs::is_regular_file(path))
+             addedPaths.insert(path);
+       }
 
-           std::ifstream fileStream(file->path);
-           std::string fileContent(
-             std::istreambuf_iterator<char>{fileStream},
-             std::istreambuf_iterator<char>{});
-           fileStream.close();
+       for (const std::string& path : addedPaths)
+       {
+         fileStatus.emplace(path, cc::parser::IncrementalStatus::ADDED);
+         LOG(debug) << "File added: " << path;
+       }
 
-           if (content->hash != util::sha1Hash(fileContent))
+       for (model::FilePtr file : files)
+       {
+         if (boost::filesystem::exists(file->path))
+         {
+           if (!fileStatus.count(file->path))
            {
-             this->fileStatus.emplace(
-               file->path, cc::parser::IncrementalStatus::MODIFIED);
-             LOG(debug) << "File modified: " << file->path;
+             model::FileContentPtr content = file->content.load();
+             if (!content)
+               continue;
+
+             fileHashes[file->path] = content->hash;
+
+             std::ifstream fileStream(file->path);
+             std::string fileContent(
+               std::istreambuf_iterator<char>{fileStream},
+               std::istreambuf_iterator<char>{});
+             fileStream.close();
+
+             if (content->hash != util::sha1Hash(fileContent))
+             {
+               this->fileStatus.emplace(
+                 file->path, cc::parser::IncrementalStatus::MODIFIED);
+               LOG(debug) << "File modified: " << file->path;
+             }
            }
          }
+         else
+         {
+           fileStatus.emplace(
+             file->path, cc::parser::IncrementalStatus::DELETED);
+           LOG(debug) << "File deleted: " << file->path;
+         }
        }
-       else
-       {
-         fileStatus.emplace(
-           file->path, cc::parser::IncrementalStatus::DELETED);
-         LOG(debug) << "File deleted: " << file->path;
-       }
-     }
 
-     // TODO: detect ADDED files
-   });
+       // TODO: detect ADDED files when every file is checked
+     });
 
   // Fill moduleDirectories vector
   if (options.count("modules")) {
@@ -104,6 +126,12 @@ ParserContext::ParserContext(
     }
   }
 }
+
+bool ParserContext::inShard(const std::string& key_) const
+{
+  return shardCount <= 1 || util::fnvHash(key_) % shardCount == shardIndex;
+}
+
 }
 }
 
@@ -7,8 +7,21 @@
 #include <util/logutil.h>
 #include <util/dbutil.h>
 
+#include <parser/filecatalog.h>
 #include <parser/sourcemanager.h>
 
+namespace
+{
+
+/**
+ * The ids of different kinds of objects are separated in the shared id table
+ * by these masks.
+ */
+const std::uint64_t sharedFileIdMask = 0x6a09e667f3bcc908ULL;
+const std::uint64_t sharedContentIdMask = 0xbb67ae8584caa73bULL;
+
+} // namespace
+
 namespace cc
 {
 namespace parser
@@ -23,7 +36,7 @@ SourceManager::SourceManager(std::shared_ptr<odb::database> db_)
 
   //--- Initialize magic for plain text testing ---//
 
-  if ((_magicCookie = ::magic_open(MAGIC_SYMLINK)))
+  if ((_magicCookie = ::magic_open(MAGIC_MIME_TYPE | MAGIC_SYMLINK)))
   {
     if (::magic_load(_magicCookie, 0) != 0)
     {
@@ -124,9 +137,22 @@ model::FilePtr SourceManager::getCreateFileEntry(
   boost::system::error_code ec;
   boost::filesystem::path path(path_);
 
-  std::time_t timestamp = boost::filesystem::last_write_time(path, ec);
-  if (ec)
-    timestamp = 0;
+  // The catalog is only used if it's already collected, it's not worth
+  // walking the inputs for a single file.
+  const FileCatalog::Entry* entry
+    = _fileCatalog && _fileCatalog->isCollected()
+    ? _fileCatalog->find(path_)
+    : nullptr;
+
+  std::time_t timestamp;
+  if (entry)
+    timestamp = entry->mtime;
+  else
+  {
+    timestamp = boost::filesystem::last_write_time(path, ec);
+    if (ec)
+      timestamp = 0;
+  }
 
   model::FilePtr file(new model::File());
   file->id = util::fnvHash(path_);
@@ -135,14 +161,22 @@ model::FilePtr SourceManager::getCreateFileEntry(
   file->parent = getCreateParent(path_);
   file->filename = path.filename().native();
 
-  if (boost::filesystem::is_directory(path, ec))
+  bool isDirectory = entry
+    ? entry->type == util::DirEntryType::Directory
+    : boost::filesystem::is_directory(path, ec);
+
+  if (isDirectory)
     file->type = model::File::DIRECTORY_TYPE;
   else
     file->type = model::File::UNKNOWN_TYPE;
 
   if (file->type != model::File::DIRECTORY_TYPE && withContent_)
   {
-    if (!boost::filesystem::is_regular_file(path, ec))
+    bool isRegularFile = entry
+      ? entry->type == util::DirEntryType::RegularFile
+      : boost::filesystem::is_regular_file(path, ec);
+
+    if (!isRegularFile)
     {
       LOG(debug)
         << "'" << path_ << "' is not a regular file! Skip saving content.";
@@ -189,6 +223,12 @@ model::FilePtr SourceManager::getFile(const std::string& path_)
   return file;
 }
 
+bool SourceManager::isCached(const std::string& path_)
+{
+  std::lock_guard<std::mutex> guard(_createFileMutex);
+  return _files.count(path_);
+}
+
 model::FilePtr SourceManager::getCreateParent(const std::string& path_)
 {
   boost::filesystem::path parentPath
@@ -202,6 +242,16 @@ model::FilePtr SourceManager::getCreateParent(const std::string& path_)
 
 bool SourceManager::isPlainText(const std::string& path_) const
 {
+  // The catalog keeps the MIME type of its files, so they are classified only
+  // once during the parse.
+  const FileCatalog::Entry* entry
+    = _fileCatalog && _fileCatalog->isCollected()
+    ? _fileCatalog->find(path_)
+    : nullptr;
+
+  if (entry)
+    return _fileCatalog->isPlainText(*entry);
+
   static std::mutex _magicFileMutex;
   std::lock_guard<std::mutex> guard(_magicFileMutex);
 
@@ -213,16 +263,20 @@ bool SourceManager::isPlainText(const std::string& path_) const
     return false;
   }
 
-  if (std::strstr(magic, "text"))
-    return true;
+  return FileCatalog::isPlainTextMime(magic);
+}
 
-  return false;
+void SourceManager::setFileCatalog(
+  std::shared_ptr<const FileCatalog> catalog_)
+{
+  _fileCatalog = std::move(catalog_);
 }
 
 void SourceManager::updateFile(const model::File& file_)
 {
   _createFileMutex.lock();
-  bool find = _persistedFiles.find(file_.id) != _persistedFiles.end();
+  bool find = _persistedFiles.find(file_.id) != _persistedFiles.end()
+    || (_sharedIds && _sharedIds->contains(sharedFileIdMask ^ file_.id));
   _createFileMutex.unlock();
 
   if (find)
@@ -260,28 +314,66 @@ void SourceManager::removeFile(const model::File& file_)
   }
 }
 
+void SourceManager::setSharedIds(
+  std::shared_ptr<util::SharedIdMap> sharedIds_)
+{
+  std::lock_guard<std::mutex> guard(_createFileMutex);
+
+  _sharedIds = std::move(sharedIds_);
+
+  if (!_sharedIds)
+    return;
+
+  for (const model::FileId& id : _persistedFiles)
+    _sharedIds->insert(sharedFileIdMask ^ id);
+
+  for (const std::string& hash : _persistedContents)
+    _sharedIds->insert(sharedContentIdMask ^ util::fnvHash(hash));
+}
+
+bool SourceManager::markPersistedFile(const model::FileId& id_)
+{
+  if (!_persistedFiles.insert(id_).second)
+    return false;
+
+  return !_sharedIds || _sharedIds->insert(sharedFileIdMask ^ id_);
+}
+
+bool SourceManager::markPersistedContent(const std::string& hash_)
+{
+  if (!_persistedContents.insert(hash_).second)
+    return false;
+
+  return !_sharedIds
+    || _sharedIds->insert(sharedContentIdMask ^ util::fnvHash(hash_));
+}
+
 void SourceManager::persistFiles()
 {
   std::lock_guard<std::mutex> guard(_createFileMutex);
 
+  // The shared ids claimed here are committed once the transaction succeeds.
+  std::vector<std::uint64_t> claimedIds;
+
   _transaction([&]() {
     for (const auto& p : _files)
     {
-      if (_persistedFiles.find(p.second->id) == _persistedFiles.end())
-        _persistedFiles.insert(p.second->id);
-      else
+      if (!markPersistedFile(p.second->id))
         continue;
 
+      claimedIds.push_back(sharedFileIdMask ^ p.second->id);
+
       try
       {
         // Directories don't have content.
         if (p.second->content &&
-            _persistedContents.find(p.second->content.object_id()) ==
-            _persistedContents.end())
+            markPersistedContent(p.second->content.object_id()))
         {
+          claimedIds.push_back(sharedContentIdMask
+            ^ util::fnvHash(p.second->content.object_id()));
+
           p.second->content.load();
           _db->persist(*p.second->content);
-          _persistedContents.insert(p.second->content.object_id());
         }
 
         _db->persist(*p.second);
@@ -299,6 +391,10 @@ void SourceManager::persistFiles()
       }
     }
   });
+
+  if (_sharedIds)
+    for (std::uint64_t id : claimedIds)
+      _sharedIds->commit(id);
 }
 
 } // parser
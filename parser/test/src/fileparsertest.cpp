@@ -0,0 +1,297 @@
+#define GTEST_HAS_TR1_TUPLE 1
+#define GTEST_USE_OWN_TR1_TUPLE 0
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include <gtest/gtest.h>
+
+#include <util/dbutil.h>
+#include <util/hash.h>
+
+#include <parser/filecatalog.h>
+#include <parser/fileparser.h>
+#include <parser/parsercontext.h>
+#include <parser/sourcemanager.h>
+
+using namespace cc;
+
+namespace fs = boost::filesystem;
+namespace po = boost::program_options;
+
+const char* dbConnectionString;
+const char* sqlDir;
+
+namespace
+{
+
+/**
+ * The results of TestParser. It is kept between the parser instances, like
+ * the tables of a real plugin between parses.
+ */
+struct ResultStore
+{
+  std::mutex mutex;
+  std::map<model::FileId, std::uint64_t> sizes;
+  std::set<model::FileId> cleaned;
+};
+
+/**
+ * Stores the size of every file. The batches consist of a single file, so a
+ * result is in the store if and only if its transaction is committed.
+ */
+class TestParser : public parser::FileParser<std::uint64_t>
+{
+public:
+  TestParser(parser::ParserContext& ctx_, ResultStore& store_)
+    : parser::FileParser<std::uint64_t>(ctx_, "testparser", 1),
+      _store(store_)
+  {
+  }
+
+  bool parse() override
+  {
+    {
+      std::lock_guard<std::mutex> lock(_parsedMutex);
+      _parsed.clear();
+    }
+
+    return parser::FileParser<std::uint64_t>::parse();
+  }
+
+  /**
+   * The next persist() of this file throws.
+   */
+  void failOn(model::FileId file_)
+  {
+    _failing = file_;
+  }
+
+  /**
+   * The files parsed by the last parse().
+   */
+  std::set<model::FileId> parsedFiles()
+  {
+    std::lock_guard<std::mutex> lock(_parsedMutex);
+    return _parsed;
+  }
+
+protected:
+  bool parseFile(const model::FilePtr& file_, std::uint64_t& result_) override
+  {
+    {
+      std::lock_guard<std::mutex> lock(_parsedMutex);
+      _parsed.insert(file_->id);
+    }
+
+    result_ = fs::file_size(file_->path);
+    return true;
+  }
+
+  void persist(model::FileId file_, const std::uint64_t& result_) override
+  {
+    if (file_ == _failing)
+    {
+      _failing = 0;
+      throw std::runtime_error("persist failure");
+    }
+
+    std::lock_guard<std::mutex> lock(_store.mutex);
+    _store.sizes[file_] = result_;
+  }
+
+  std::unordered_set<model::FileId> getParsedFiles() override
+  {
+    std::lock_guard<std::mutex> lock(_store.mutex);
+
+    std::unordered_set<model::FileId> files;
+    for (const auto& result : _store.sizes)
+      files.insert(result.first);
+    return files;
+  }
+
+  void cleanupFile(model::FileId file_) override
+  {
+    std::lock_guard<std::mutex> lock(_store.mutex);
+    _store.sizes.erase(file_);
+    _store.cleaned.insert(file_);
+  }
+
+private:
+  ResultStore& _store;
+  std::atomic<model::FileId> _failing{0};
+
+  std::mutex _parsedMutex;
+  std::set<model::FileId> _parsed;
+};
+
+} // namespace
+
+class FileParserTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    _db = util::connectDatabase(dbConnectionString, true);
+    ASSERT_TRUE(_db);
+
+    util::removeTables(_db, sqlDir);
+    util::createTables(_db, sqlDir);
+
+    _root = fs::canonical(fs::temp_directory_path()).string() + '/'
+      + fs::unique_path("cc-fileparsertest-%%%%-%%%%").string();
+    fs::create_directories(_root);
+
+    for (const char* name : {"a.txt", "b.txt", "c.txt"})
+      writeFile(name, name);
+
+    _options.insert(std::make_pair("jobs", po::variable_value(4, false)));
+
+    _srcMgr.reset(new parser::SourceManager(_db));
+  }
+
+  void TearDown() override
+  {
+    _srcMgr.reset();
+
+    boost::system::error_code ec;
+    fs::remove_all(_root, ec);
+  }
+
+  void writeFile(const std::string& name_, const std::string& content_)
+  {
+    std::ofstream(_root + '/' + name_) << content_;
+  }
+
+  model::FileId fileId(const std::string& name_) const
+  {
+    return util::fnvHash(_root + '/' + name_);
+  }
+
+  /**
+   * Creates the context of a parse, which detects the changed files.
+   */
+  std::unique_ptr<parser::ParserContext> createContext()
+  {
+    std::unique_ptr<parser::ParserContext> ctx(new parser::ParserContext(
+      _db, *_srcMgr, _compassRoot, _options));
+    ctx->fileCatalog = std::make_shared<parser::FileCatalog>(
+      std::vector<std::string>{_root}, 2);
+    return ctx;
+  }
+
+  std::shared_ptr<odb::database> _db;
+  std::unique_ptr<parser::SourceManager> _srcMgr;
+  std::string _compassRoot;
+  po::variables_map _options;
+  std::string _root;
+  ResultStore _store;
+};
+
+TEST_F(FileParserTest, ParsePersistCleanup)
+{
+  std::set<model::FileId> allFiles{
+    fileId("a.txt"), fileId("b.txt"), fileId("c.txt")};
+
+  //--- First parse ---//
+
+  {
+    std::unique_ptr<parser::ParserContext> ctx = createContext();
+    TestParser parser(*ctx, _store);
+
+    EXPECT_TRUE(parser.cleanupDatabase());
+    EXPECT_TRUE(parser.parse());
+    EXPECT_EQ(parser.parsedFiles(), allFiles);
+
+    _srcMgr->persistFiles();
+  }
+
+  EXPECT_EQ(_store.sizes.size(), 3u);
+  EXPECT_EQ(_store.sizes[fileId("b.txt")], 5u);
+
+  //--- Nothing changed ---//
+
+  {
+    std::unique_ptr<parser::ParserContext> ctx = createContext();
+    TestParser parser(*ctx, _store);
+
+    EXPECT_TRUE(ctx->fileStatus.empty());
+    EXPECT_TRUE(parser.cleanupDatabase());
+    EXPECT_TRUE(parser.parse());
+    EXPECT_TRUE(parser.parsedFiles().empty());
+  }
+
+  EXPECT_TRUE(_store.cleaned.empty());
+
+  //--- A file is modified ---//
+
+  writeFile("b.txt", "modified b.txt");
+
+  {
+    std::unique_ptr<parser::ParserContext> ctx = createContext();
+    TestParser parser(*ctx, _store);
+
+    ASSERT_EQ(ctx->fileStatus.count(_root + "/b.txt"), 1u);
+
+    EXPECT_TRUE(parser.cleanupDatabase());
+    EXPECT_EQ(_store.cleaned, std::set<model::FileId>{fileId("b.txt")});
+    EXPECT_EQ(_store.sizes.count(fileId("b.txt")), 0u);
+
+    EXPECT_TRUE(parser.parse());
+    EXPECT_EQ(parser.parsedFiles(), std::set<model::FileId>{fileId("b.txt")});
+  }
+
+  EXPECT_EQ(_store.sizes.size(), 3u);
+  EXPECT_EQ(_store.sizes[fileId("b.txt")], 14u);
+}
+
+TEST_F(FileParserTest, FailedBatchIsParsedAgain)
+{
+  std::unique_ptr<parser::ParserContext> ctx = createContext();
+  TestParser parser(*ctx, _store);
+  parser.failOn(fileId("b.txt"));
+
+  EXPECT_TRUE(parser.cleanupDatabase());
+  EXPECT_FALSE(parser.parse());
+
+  // The other batches are committed.
+  EXPECT_EQ(_store.sizes.size(), 2u);
+  EXPECT_EQ(_store.sizes.count(fileId("b.txt")), 0u);
+
+  // The committed files are not parsed again, only the one whose batch
+  // failed.
+  EXPECT_TRUE(parser.parse());
+  EXPECT_EQ(parser.parsedFiles(), std::set<model::FileId>{fileId("b.txt")});
+  EXPECT_EQ(_store.sizes.size(), 3u);
+
+  TestParser next(*ctx, _store);
+  EXPECT_TRUE(next.parse());
+  EXPECT_TRUE(next.parsedFiles().empty());
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3 || std::strcmp(argv[1], "") == 0)
+  {
+    GTEST_LOG_(FATAL) << "No test database connection given.";
+    return 1;
+  }
+
+  dbConnectionString = argv[1];
+  sqlDir = argv[2];
+
+  GTEST_LOG_(INFO) << "Using database for tests: " << dbConnectionString;
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
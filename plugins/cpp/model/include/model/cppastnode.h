@@ -177,39 +177,30 @@ inline std::uint64_t createIdentifier(const CppAstNode& astNode_)
   using AstTypeInt
     = std::underlying_type<model::CppAstNode::AstType>::type;
 
-  std::string res;
+  // The identifier is the hash of a string which is built of the fields of
+  // the node. This function is invoked many times, so the hash is computed
+  // piece by piece, without building the string.
 
-  // For string concatenation we use append() function because this is faster
-  // than concatenating strings with operator+(). operator+=() would be more
-  // readable but unfortunately that is right associative. This function is
-  // invoked many times, so it is important to create identifier as fast as
-  // possible.
+  util::FnvHasher hasher;
 
-  res
-    .append(astNode_.astValue).append(":")
-    .append(std::to_string(astNode_.entityHash)).append(":")
-    .append(std::to_string(
-      static_cast<SymbolTypeInt>(astNode_.symbolType))).append(":")
-    .append(std::to_string(
-      static_cast<AstTypeInt>(astNode_.astType))).append(":")
-    .append(std::to_string(astNode_.visibleInSourceCode)).append(":");
+  hasher
+    .add(astNode_.astValue).add(':')
+    .addNumber(astNode_.entityHash).add(':')
+    .addNumber(static_cast<SymbolTypeInt>(astNode_.symbolType)).add(':')
+    .addNumber(static_cast<AstTypeInt>(astNode_.astType)).add(':')
+    .addNumber(static_cast<int>(astNode_.visibleInSourceCode)).add(':');
 
   if (astNode_.location.file)
-    res
-      .append(std::to_string(
-        astNode_.location.file->id)).append(":")
-      .append(std::to_string(
-        astNode_.location.range.start.line)).append(":")
-      .append(std::to_string(
-        astNode_.location.range.start.column)).append(":")
-      .append(std::to_string(
-        astNode_.location.range.end.line)).append(":")
-      .append(std::to_string(
-        astNode_.location.range.end.column)).append(":");
+    hasher
+      .addNumber(astNode_.location.file->id).add(':')
+      .addNumber(astNode_.location.range.start.line).add(':')
+      .addNumber(astNode_.location.range.start.column).add(':')
+      .addNumber(astNode_.location.range.end.line).add(':')
+      .addNumber(astNode_.location.range.end.column).add(':');
   else
-    res.append("null");
+    hasher.add("null", 4);
 
-  return util::fnvHash(res);
+  return hasher.value();
 }
 
 #pragma db view object(CppAstNode)
@@ -80,10 +80,11 @@ inline std::string CppEdge::toString() const
 
 inline std::uint64_t createIdentifier(const CppEdge& edge_)
 {
-  return util::fnvHash(
-    std::to_string(edge_.from->id) +
-    std::to_string(edge_.to->id) +
-    typeToString(edge_.type));
+  return util::FnvHasher()
+    .addNumber(edge_.from->id)
+    .addNumber(edge_.to->id)
+    .add(typeToString(edge_.type))
+    .value();
 }
 
 typedef std::uint64_t CppEdgeAttributeId;
@@ -119,8 +120,11 @@ inline std::string CppEdgeAttribute::toString() const
 
 inline std::uint64_t createIdentifier(const CppEdgeAttribute& attr_)
 {
-  return util::fnvHash(
-    std::to_string(attr_.edge->id) + attr_.key + attr_.value);
+  return util::FnvHasher()
+    .addNumber(attr_.edge->id)
+    .add(attr_.key)
+    .add(attr_.value)
+    .value();
 }
 
 } // model
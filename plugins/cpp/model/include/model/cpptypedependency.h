@@ -120,6 +120,30 @@ struct CppTypeDependency_Afferent_Count
   std::size_t count;
 };
 
+#pragma db view \
+  object(CppTypeDependency) \
+  query((?) + "GROUP BY" + CppTypeDependency::entityHash)
+struct CppTypeDependency_Efferent_GroupCount
+{
+  #pragma db column(CppTypeDependency::entityHash)
+  std::uint64_t entityHash;
+
+  #pragma db column("count(distinct" + CppTypeDependency::dependencyHash + ")")
+  std::size_t count;
+};
+
+#pragma db view \
+  object(CppTypeDependency) \
+  query((?) + "GROUP BY" + CppTypeDependency::dependencyHash)
+struct CppTypeDependency_Afferent_GroupCount
+{
+  #pragma db column(CppTypeDependency::dependencyHash)
+  std::uint64_t dependencyHash;
+
+  #pragma db column("count(distinct" + CppTypeDependency::entityHash + ")")
+  std::size_t count;
+};
+
 } // model
 } // cc
 
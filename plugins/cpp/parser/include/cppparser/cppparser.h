@@ -2,6 +2,7 @@
 #define CC_PARSER_CXXPARSER_H
 
 #include <map>
+#include <memory>
 #include <set>
 #include <unordered_set>
 #include <vector>
@@ -18,7 +19,11 @@ namespace cc
 {
 namespace parser
 {
-  
+
+class FileSystemCache;
+class ParseWorkerPool;
+class PreambleStore;
+
 class CppParser : public AbstractParser
 {
 public:
@@ -32,12 +37,26 @@ public:
    * relations. Then the nodes of the graph are sorted topologically.
    * In each iteration the leaf nodes of the graph are cleaned up (paralelly),
    * which guarantees that no file is cleaned up before its dependants.
+   * The files of a level are cleaned up in batches, each batch issuing a
+   * fixed number of set-based DELETE statements regardless of its size.
    *
    * @return Returns true if the cleanup succeeded, false otherwise.
    */
   virtual bool cleanupDatabase() override;
   virtual bool parse() override;
 
+  /**
+   * Parses the compile commands which the parser process sends, see the
+   * cpp-worker-processes option.
+   */
+  virtual int runWorker() override;
+
+  /**
+   * The compile commands are distributed between the shards by the path of
+   * their source files.
+   */
+  virtual bool isShardable() const override;
+
 private:
   /**
    * A single build command's cc::util::JobQueueThreadPool job.
@@ -54,6 +73,11 @@ private:
      */
     std::size_t index;
 
+    /**
+     * Path of the precompiled preamble to parse the command with, or empty.
+     */
+    std::string preamble;
+
     ParseJob(const clang::tooling::CompileCommand& command, std::size_t index)
       : command(command), index(index)
     {}
@@ -64,20 +88,27 @@ private:
   struct CleanupJob
   {
     /**
-     * The path of the file to be cleaned up.
+     * The paths of the files to be cleaned up together.
      */
-    std::string path;
+    std::vector<std::string> paths;
 
     /**
      * The # of the cleanup job.
      */
     std::size_t index;
 
-    CleanupJob(const std::string& path, std::size_t index)
-      : path(path), index(index)
+    CleanupJob(std::vector<std::string> paths, std::size_t index)
+      : paths(std::move(paths)), index(index)
     {}
   };
 
+  /**
+   * The maximum number of files cleaned up by a single cleanup job. The file
+   * IDs of a batch are bound as an IN list, so it must stay below the
+   * parameter limit of the database backends.
+   */
+  static constexpr std::size_t cleanupBatchSize = 128;
+
 
   /**
    * This function gets the input-output pairs from the compile command.
@@ -104,15 +135,97 @@ private:
   bool isSourceFile(const std::string& file_) const;
   bool isNonSourceFlag(const std::string& arg_) const;
   bool parseByJson(const std::string& jsonFile_, std::size_t threadNum_);
-  int parseWorker(const clang::tooling::CompileCommand& command_);
+
+  /**
+   * Reads the commands of the C/C++ source files from a compilation
+   * database.
+   */
+  bool loadCompileCommands(
+    const std::string& jsonFile_,
+    std::vector<clang::tooling::CompileCommand>& compileCommands_) const;
+
+  /**
+   * Parses the command of a job and logs the result.
+   * @return The error code of the clang tool.
+   */
+  int parseJob(const ParseJob& job_, std::size_t numCompileCommands_);
+
+  int parseWorker(
+    const clang::tooling::CompileCommand& command_,
+    const std::string& preamble_ = std::string());
+
+  static std::string getSourcePath(
+    const clang::tooling::CompileCommand& command_);
+
+  /**
+   * Returns the compiler flags of the command without the compiler, the
+   * source file, the output and the dependency file options.
+   */
+  std::vector<std::string> getPreambleFlags(
+    const clang::tooling::CompileCommand& command_) const;
+
+  /**
+   * Groups the jobs by their flags and the #include directives at the
+   * beginning of their source files, and sets a precompiled preamble for the
+   * members of the large enough groups. The preambles are taken from the
+   * store or built on threadNum_ threads.
+   */
+  void assignPreambles(std::vector<ParseJob>& jobs_, std::size_t threadNum_);
+
+  /**
+   * Builds the precompiled header of an include prefix into the preamble
+   * store.
+   * @return True if the preamble has been built and fits into the store.
+   */
+  bool buildPreamble(
+    const clang::tooling::CompileCommand& command_,
+    const std::string& key_,
+    const std::string& prefix_);
+
+  /**
+   * Returns the command line of a worker process: the one of this process
+   * extended by the --worker option.
+   */
+  std::vector<std::string> getWorkerCommandLine() const;
 
   void initBuildActions();
   void markByInclusion(const model::FilePtr& file_);
   std::vector<std::vector<std::string>> createCleanupOrder();
-  bool cleanupWorker(const std::string& path_);
+  /**
+   * Removes everything the C++ parser stored about the given files.
+   * @param deletedRows_ Incremented by the number of deleted rows.
+   * @return True if the transaction succeeded.
+   */
+  bool cleanupWorker(
+    const std::vector<std::string>& paths_,
+    std::size_t& deletedRows_);
 
   std::unordered_set<std::uint64_t> _parsedCommandHashes;
 
+  /**
+   * File statuses and contents shared by the translation units, or nullptr if
+   * caching is turned off.
+   */
+  std::shared_ptr<FileSystemCache> _fsCache;
+
+  /**
+   * Precompiled preambles of the common include prefixes, or nullptr if they
+   * are turned off.
+   */
+  std::unique_ptr<PreambleStore> _preambleStore;
+  std::size_t _preambleMinGroup;
+
+  /**
+   * The worker processes of the current parse, or nullptr if the translation
+   * units are parsed on threads.
+   */
+  std::unique_ptr<ParseWorkerPool> _workerPool;
+
+  /**
+   * The working directory in which the parser has been started.
+   */
+  std::string _workDir;
+
 };
 
 } // parser
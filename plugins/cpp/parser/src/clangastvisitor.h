@@ -39,15 +39,19 @@
 
 #include <parser/parsercontext.h>
 #include <parser/sourcemanager.h>
+#include <util/arena.h>
 #include <util/hash.h>
+#include <util/logutil.h>
 #include <util/odbtransaction.h>
 #include <util/scopedvalue.h>
 
 #include <cppparser/filelocutil.h>
 
 #include "entitycache.h"
+#include "indexedheaders.h"
 #include "symbolhelper.h"
 #include "nestedscope.h"
+#include "ppcontextcallback.h"
 
 namespace cc
 {
@@ -70,6 +74,12 @@ namespace parser
  * parameters and local variables of the function find their parent at the top
  * of the stack. If stack is used then they are pushed and popped in the
  * corresponding Traverse... function.
+ *
+ * If the fingerprints of the included files and a set of indexed headers are
+ * given, then the declarations of the headers which have already been indexed
+ * under the same preprocessor context in another translation unit are not
+ * traversed again. Templates are traversed anyway, since their instantiations
+ * depend on the translation unit.
  */
 class ClangASTVisitor : public clang::RecursiveASTVisitor<ClangASTVisitor>
 {
@@ -80,8 +90,11 @@ public:
     ParserContext& ctx_,
     clang::ASTContext& astContext_,
     EntityCache& entityCache_,
-    std::unordered_map<const void*, model::CppAstNodeId>& clangToAstNodeId_)
-    : _isImplicit(false),
+    std::unordered_map<const void*, model::CppAstNodeId>& clangToAstNodeId_,
+    const HeaderFingerprints* headerFingerprints_ = nullptr,
+    IndexedHeaders* indexedHeaders_ = nullptr)
+    : _arena(std::make_shared<util::Arena>()),
+      _isImplicit(false),
       _ctx(ctx_),
       _clangSrcMgr(astContext_.getSourceManager()),
       _fileLocUtil(astContext_.getSourceManager()),
@@ -89,7 +102,11 @@ public:
       _mngCtx(astContext_.createMangleContext()),
       _cppSourceType("CPP"),
       _entityCache(entityCache_),
-      _clangToAstNodeId(clangToAstNodeId_)
+      _clangToAstNodeId(clangToAstNodeId_),
+      _headerFingerprints(headerFingerprints_),
+      _indexedHeaders(indexedHeaders_),
+      _skipDisabled(false),
+      _numSkippedDecls(0)
   {
   }
 
@@ -133,6 +150,18 @@ public:
       util::persistAll(_relations, _ctx.db);
       util::persistAll(_typeDependencies, _ctx.db);
     });
+
+    for (const model::CppAstNodePtr& node : _astNodes)
+      _entityCache.commit(*node);
+
+    if (_indexedHeaders)
+      registerIndexedHeaders();
+
+    util::Arena::Statistics stats = _arena->statistics();
+    LOG(debug)
+      << "Model objects of the translation unit: " << stats.allocations
+      << " allocations, " << (stats.bytes >> 10) << " KiB in " << stats.blocks
+      << " heap blocks.";
   }
 
 
@@ -158,7 +187,7 @@ public:
       ClangASTVisitor* visitor_
     ) :
       _visitor(visitor_),
-      _type(std::make_shared<model::CppRecord>())
+      _type(_visitor->makeShared<model::CppRecord>())
     {
       _visitor->_typeStack.push(_type);
     }
@@ -186,7 +215,7 @@ public:
       ClangASTVisitor* visitor_
     ) :
       _visitor(visitor_),
-      _enum(std::make_shared<model::CppEnum>())
+      _enum(_visitor->makeShared<model::CppEnum>())
     {
       _visitor->_enumStack.push(_enum);
     }
@@ -212,7 +241,7 @@ public:
   public:
     FunctionScope(ClangASTVisitor* visitor_) :
       _visitor(visitor_),
-      _curFun(std::make_shared<model::CppFunction>())
+      _curFun(_visitor->makeShared<model::CppFunction>())
     {
       _visitor->_functionStack.push(_curFun);
     }
@@ -274,6 +303,19 @@ public:
     if (d_ == nullptr)
       return Base::TraverseDecl(d_);
 
+    bool keepChildren = _skipDisabled;
+    if (_indexedHeaders && !_skipDisabled)
+    {
+      if (hasInstantiations(d_))
+        keepChildren = true;
+      else if (isInIndexedHeader(d_))
+      {
+        ++_numSkippedDecls;
+        return true;
+      }
+    }
+    util::ScopedValue<bool> sd(_skipDisabled, keepChildren);
+
     // We use implicitness to determine if actual symbol location information
     // should be stored for AST nodes in our database. This differs somewhat
     // from Clang's concept of implicitness.
@@ -524,7 +566,7 @@ public:
 
     const clang::TypedefNameDecl* td = type->getDecl();
 
-    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+    model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
     astNode->location = getFileLoc(tl_.getBeginLoc(), tl_.getEndLoc());
     astNode->astType = model::CppAstNode::AstType::TypeLocation;
@@ -544,7 +586,7 @@ public:
 
     const clang::EnumDecl* ed = type->getDecl();
 
-    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+    model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
     astNode->location = getFileLoc(tl_.getBeginLoc(), tl_.getEndLoc());
     astNode->astType = model::CppAstNode::AstType::TypeLocation;
@@ -564,7 +606,7 @@ public:
 
     const clang::RecordDecl* rd = type->getDecl();
 
-    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+    model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
     astNode->location = getFileLoc(tl_.getBeginLoc(), tl_.getEndLoc());
     astNode->astType = model::CppAstNode::AstType::TypeLocation;
@@ -588,7 +630,7 @@ public:
 
     if (typeHash != 0 && typeHash != astNode->entityHash)
     {
-      model::CppTypeDependencyPtr td = std::make_shared<model::CppTypeDependency>();
+      model::CppTypeDependencyPtr td = makeShared<model::CppTypeDependency>();
       _typeDependencies.push_back(td);
 
       td->entityHash = typeHash;
@@ -609,7 +651,7 @@ public:
 
     //--- CppAstNode ---//
 
-    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+    model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
     astNode->astValue = getDeclPartAsString(_clangSrcMgr, rd_);
     astNode->location = getFileLoc(rd_->getBeginLoc(), rd_->getEndLoc());
@@ -681,7 +723,7 @@ public:
         if (baseDecl)
         {
           model::CppInheritancePtr inheritance
-            = std::make_shared<model::CppInheritance>();
+            = makeShared<model::CppInheritance>();
           _inheritances.push_back(inheritance);
 
           inheritance->derived = cppRecord->entityHash;
@@ -715,7 +757,7 @@ public:
           //--- Friend classes ---//
 
           model::CppFriendshipPtr friendship
-            = std::make_shared<model::CppFriendship>();
+            = makeShared<model::CppFriendship>();
           _friends.push_back(friendship);
 
           friendship->target = cppRecord->entityHash;
@@ -731,7 +773,7 @@ public:
           //--- Friend functions ---//
 
           model::CppFriendshipPtr friendship
-            = std::make_shared<model::CppFriendship>();
+            = makeShared<model::CppFriendship>();
           _friends.push_back(friendship);
 
           friendship->target = cppRecord->entityHash;
@@ -769,7 +811,7 @@ public:
   {
     //--- CppAstNode ---//
 
-    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+    model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
     astNode->astValue = getDeclPartAsString(_clangSrcMgr, ed_);
     astNode->location = getFileLoc(ed_->getBeginLoc(), ed_->getEndLoc());
@@ -807,7 +849,7 @@ public:
   {
     //--- CppAstNode ---//
 
-    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+    model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
     astNode->astValue = ec_->getNameAsString();
     astNode->location = getFileLoc(ec_->getBeginLoc(), ec_->getEndLoc());
@@ -825,7 +867,7 @@ public:
     //--- CppEnumConstant ---//
 
     model::CppEnumConstantPtr enumConstant
-      = std::make_shared<model::CppEnumConstant>();
+      = makeShared<model::CppEnumConstant>();
     _enumConstants.push_back(enumConstant);
 
     enumConstant->astNodeId = astNode->id;
@@ -843,7 +885,7 @@ public:
   {
     //--- CppAstNode ---//
 
-    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+    model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
     astNode->astValue = getSourceText(
       _clangSrcMgr,
@@ -864,7 +906,7 @@ public:
 
     //--- CppTypedef ---//
 
-    model::CppTypedefPtr cppTypedef = std::make_shared<model::CppTypedef>();
+    model::CppTypedefPtr cppTypedef = makeShared<model::CppTypedef>();
     _typedefs.push_back(cppTypedef);
 
     clang::QualType qualType = td_->getUnderlyingType();
@@ -895,18 +937,7 @@ public:
   {
     //--- CppAstNode ---//
 
-    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
-
-    astNode->astValue = getSignature(fn_);
-    astNode->location = getFileLoc(fn_->getBeginLoc(), fn_->getEndLoc());
-    astNode->entityHash = util::fnvHash(getUSR(fn_));
-    astNode->symbolType = model::CppAstNode::SymbolType::Function;
-    astNode->astType
-      = fn_->isThisDeclarationADefinition()
-      ? model::CppAstNode::AstType::Definition
-      : model::CppAstNode::AstType::Declaration;
-
-    astNode->id = model::createIdentifier(*astNode);
+    model::CppAstNodePtr astNode = createFunctionAstNode(fn_);
 
     if (insertToCache(fn_, astNode))
       _astNodes.push_back(astNode);
@@ -969,7 +1000,7 @@ public:
     if (md && !_typeStack.empty())
     {
       model::CppMemberTypePtr member
-        = std::make_shared<model::CppMemberType>();
+        = makeShared<model::CppMemberType>();
       _members.push_back(member);
 
       member->memberAstNode = astNode;
@@ -992,7 +1023,7 @@ public:
       if (!member || init->getSourceOrder() == -1)
         continue;
 
-      model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+      model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
       astNode->astValue = getSignature(cd_);
       astNode->location = getFileLoc(
@@ -1018,7 +1049,7 @@ public:
   {
     //--- CppAstNode ---//
 
-    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+    model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
     astNode->astValue = fd_->getType().getAsString();
     astNode->astValue.append(" ");
@@ -1041,7 +1072,7 @@ public:
 
     //--- CppMemberType ---//
 
-    model::CppMemberTypePtr member = std::make_shared<model::CppMemberType>();
+    model::CppMemberTypePtr member = makeShared<model::CppMemberType>();
     _members.push_back(member);
 
     clang::QualType qualType = fd_->getType();
@@ -1054,7 +1085,7 @@ public:
 
     //--- CppVariable ---//
 
-    model::CppVariablePtr variable = std::make_shared<model::CppVariable>();
+    model::CppVariablePtr variable = makeShared<model::CppVariable>();
     _variables.push_back(variable);
 
     variable->astNodeId = astNode->id;
@@ -1080,7 +1111,7 @@ public:
   {
     //--- CppAstNode ---//
 
-    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+    model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
     astNode->astValue = vd_->getType().getAsString();
     astNode->astValue.append(" ");
@@ -1119,7 +1150,7 @@ public:
 
     //--- CppVariable ---//
 
-    model::CppVariablePtr variable = std::make_shared<model::CppVariable>();
+    model::CppVariablePtr variable = makeShared<model::CppVariable>();
     _variables.push_back(variable);
 
     clang::QualType qualType = vd_->getType();
@@ -1142,7 +1173,7 @@ public:
     {
       variable->tags.insert(model::Tag::Static);
 
-      model::CppMemberTypePtr member = std::make_shared<model::CppMemberType>();
+      model::CppMemberTypePtr member = makeShared<model::CppMemberType>();
       _members.push_back(member);
 
       member->typeHash = _typeStack.top()->entityHash;
@@ -1205,7 +1236,7 @@ public:
   {
     //--- CppAstNode ---//
 
-    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+    model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
     astNode->astValue = getSourceText(
       _clangSrcMgr,
@@ -1227,7 +1258,7 @@ public:
 
     //--- CppNamespace ---//
 
-    model::CppNamespacePtr ns = std::make_shared<model::CppNamespace>();
+    model::CppNamespacePtr ns = makeShared<model::CppNamespace>();
     _namespaces.push_back(ns);
 
     ns->astNodeId = astNode->id;
@@ -1242,7 +1273,7 @@ public:
   {
     //--- CppAstNode ---//
 
-    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+    model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
     astNode->astValue = getSourceText(
       _clangSrcMgr,
@@ -1264,7 +1295,7 @@ public:
 
     //--- CppNamespaceAlias ---//
 
-    model::CppNamespaceAliasPtr nsa = std::make_shared<model::CppNamespaceAlias>();
+    model::CppNamespaceAliasPtr nsa = makeShared<model::CppNamespaceAlias>();
     _namespaceAliases.push_back(nsa);
 
     nsa->astNodeId = astNode->id;
@@ -1281,7 +1312,7 @@ public:
     //--- CppAstNode ---//
 
     for (const clang::UsingShadowDecl* nd : ud_->shadows()) {
-      model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+      model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
       astNode->astValue = getSourceText(
         _clangSrcMgr,
@@ -1307,7 +1338,7 @@ public:
   {
     //--- CppAstNode ---//
 
-    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+    model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
     const clang::NamespaceDecl* nd = udd_->getNominatedNamespace();
 
@@ -1331,7 +1362,7 @@ public:
 
   bool VisitCXXConstructExpr(clang::CXXConstructExpr* ce_)
   {
-    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+    model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
     const clang::CXXConstructorDecl* ctor = ce_->getConstructor();
 
@@ -1361,7 +1392,7 @@ public:
     if (!functionDecl)
       return true;
 
-    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+    model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
     astNode->astValue = getSignature(functionDecl);
     astNode->location = getFileLoc(ne_->getBeginLoc(), ne_->getEndLoc());
@@ -1395,7 +1426,7 @@ public:
     if (!functionDecl)
       return true;
 
-    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+    model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
     astNode->astValue = getSignature(functionDecl);
     astNode->location = getFileLoc(de_->getBeginLoc(), de_->getEndLoc());
@@ -1425,7 +1456,7 @@ public:
     const clang::FunctionDecl* funcCallee
       = llvm::dyn_cast<clang::FunctionDecl>(callee);
 
-    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+    model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
     std::string usr = getUSR(namedCallee);
 
@@ -1460,7 +1491,7 @@ public:
 
     if (const clang::VarDecl* vd = llvm::dyn_cast<clang::VarDecl>(decl))
     {
-      astNode = std::make_shared<model::CppAstNode>();
+      astNode = makeShared<model::CppAstNode>();
 
       if (!_contextStatementStack.empty())
       {
@@ -1490,7 +1521,7 @@ public:
     else if (const clang::EnumConstantDecl* ec
       = llvm::dyn_cast<clang::EnumConstantDecl>(decl))
     {
-      astNode = std::make_shared<model::CppAstNode>();
+      astNode = makeShared<model::CppAstNode>();
 
       if (!_contextStatementStack.empty())
       {
@@ -1526,7 +1557,7 @@ public:
     const clang::CXXMethodDecl* method
       = llvm::dyn_cast<clang::CXXMethodDecl>(vd);
 
-    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+    model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
     astNode->astValue = method ? getSignature(method) : vd->getNameAsString();
     astNode->location = getFileLoc(me_->getBeginLoc(), me_->getEndLoc());
@@ -1559,13 +1590,33 @@ public:
       auto left = _clangToAstNodeId.find(decl);
       auto right = _clangToAstNodeId.find(*it);
 
-      if (left == _clangToAstNodeId.end() || right == _clangToAstNodeId.end())
+      if (left == _clangToAstNodeId.end())
+        continue;
+
+      model::CppAstNodeId rightId;
+
+      if (right != _clangToAstNodeId.end())
+        rightId = right->second;
+      else if (_indexedHeaders && isInIndexedHeader(*it))
+        // The overridden method was skipped, but its AST node is the same as
+        // the one stored by the translation unit which indexed the header.
+        rightId = createFunctionAstNode(*it)->id;
+      else
         continue;
 
-      model::CppRelationPtr rel = std::make_shared<model::CppRelation>();
+      model::CppRelationPtr rel = makeShared<model::CppRelation>();
       rel->kind = model::CppRelation::Kind::Override;
       rel->lhs = _entityCache.at(left->second);
-      rel->rhs = _entityCache.at(right->second);
+
+      try
+      {
+        rel->rhs = _entityCache.at(rightId);
+      }
+      catch (const std::out_of_range&)
+      {
+        continue;
+      }
+
       _relations.push_back(rel);
     }
 
@@ -1573,6 +1624,130 @@ public:
   }
 
 private:
+  model::CppAstNodePtr createFunctionAstNode(const clang::FunctionDecl* fn_)
+  {
+    model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
+
+    astNode->astValue = getSignature(fn_);
+    astNode->location = getFileLoc(fn_->getBeginLoc(), fn_->getEndLoc());
+    astNode->entityHash = util::fnvHash(getUSR(fn_));
+    astNode->symbolType = model::CppAstNode::SymbolType::Function;
+    astNode->astType
+      = fn_->isThisDeclarationADefinition()
+      ? model::CppAstNode::AstType::Definition
+      : model::CppAstNode::AstType::Declaration;
+
+    astNode->id = model::createIdentifier(*astNode);
+
+    return astNode;
+  }
+
+  /**
+   * Returns true if the traversal of the declaration visits template
+   * instantiations, which depend on the translation unit.
+   */
+  static bool hasInstantiations(const clang::Decl* d_)
+  {
+    if (llvm::isa<clang::TemplateDecl>(d_) ||
+        llvm::isa<clang::ClassTemplatePartialSpecializationDecl>(d_))
+      return true;
+
+    if (const clang::ClassTemplateSpecializationDecl* sd
+      = llvm::dyn_cast<clang::ClassTemplateSpecializationDecl>(d_))
+      if (sd->getSpecializationKind() != clang::TSK_ExplicitSpecialization)
+        return true;
+
+    if (const clang::VarTemplateSpecializationDecl* sd
+      = llvm::dyn_cast<clang::VarTemplateSpecializationDecl>(d_))
+      if (sd->getSpecializationKind() != clang::TSK_ExplicitSpecialization)
+        return true;
+
+    if (const clang::FunctionDecl* fd
+      = llvm::dyn_cast<clang::FunctionDecl>(d_))
+      return fd->isTemplateInstantiation();
+
+    if (const clang::CXXRecordDecl* rd
+      = llvm::dyn_cast<clang::CXXRecordDecl>(d_))
+      for (const clang::Decl* member : rd->decls())
+        if (hasInstantiations(member))
+          return true;
+
+    return false;
+  }
+
+  /**
+   * Returns true if the declaration is located in a header inclusion which
+   * has already been indexed under the same preprocessor context. Namespaces
+   * and linkage specifications are never skipped, since they may contain
+   * templates.
+   */
+  bool isInIndexedHeader(const clang::Decl* d_)
+  {
+    if (llvm::isa<clang::TranslationUnitDecl>(d_) ||
+        llvm::isa<clang::NamespaceDecl>(d_) ||
+        llvm::isa<clang::LinkageSpecDecl>(d_) ||
+        llvm::isa<clang::ExportDecl>(d_))
+      return false;
+
+    clang::SourceLocation loc = d_->getLocation();
+    if (loc.isInvalid())
+      return false;
+
+    clang::FileID fid = _clangSrcMgr.getFileID(
+      _clangSrcMgr.getExpansionLoc(loc));
+
+    auto cached = _indexedFiles.find(fid);
+    if (cached != _indexedFiles.end())
+      return cached->second;
+
+    bool indexed = false;
+
+    auto fingerprint = _headerFingerprints->find(fid);
+    if (fid != _clangSrcMgr.getMainFileID() &&
+        fingerprint != _headerFingerprints->end())
+      if (const clang::FileEntry* entry = _clangSrcMgr.getFileEntryForID(fid))
+        indexed = _indexedHeaders->contains(
+          entry->getName().str(), fingerprint->second);
+
+    _indexedFiles[fid] = indexed;
+    return indexed;
+  }
+
+  /**
+   * Records the header inclusions of the translation unit as indexed, so the
+   * other translation units can skip them. Translation units with errors may
+   * have an incomplete AST, so their headers are not recorded.
+   */
+  void registerIndexedHeaders()
+  {
+    std::size_t numIndexedFiles = 0;
+    for (const auto& file : _indexedFiles)
+      if (file.second)
+        ++numIndexedFiles;
+
+    const clang::FileEntry* mainFile
+      = _clangSrcMgr.getFileEntryForID(_clangSrcMgr.getMainFileID());
+
+    LOG(info)
+      << (mainFile ? mainFile->getName().str() : std::string()) << ": skipped "
+      << _numSkippedDecls << " declarations in " << numIndexedFiles
+      << " already indexed header inclusions out of "
+      << _headerFingerprints->size() << " files.";
+
+    if (_astContext.getDiagnostics().hasErrorOccurred())
+      return;
+
+    for (const auto& file : *_headerFingerprints)
+    {
+      if (file.first == _clangSrcMgr.getMainFileID())
+        continue;
+
+      if (const clang::FileEntry* entry
+        = _clangSrcMgr.getFileEntryForID(file.first))
+        _indexedHeaders->insert(entry->getName().str(), file.second);
+    }
+  }
+
   void addDestructorUsage(
     clang::QualType type_,
     const model::FileLoc& location_,
@@ -1582,7 +1757,7 @@ private:
     {
       if (clang::CXXDestructorDecl* dd = rd->getDestructor())
       {
-        model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+        model::CppAstNodePtr astNode = makeShared<model::CppAstNode>();
 
         astNode->astValue = getSignature(dd);
         astNode->location = location_;
@@ -1597,6 +1772,17 @@ private:
     }
   }
 
+  /**
+   * Creates a model object in the memory of the translation unit. The objects
+   * are allocated from an arena, which is freed when the last of them is
+   * destroyed, so creating them doesn't call malloc() one by one.
+   */
+  template <typename T>
+  std::shared_ptr<T> makeShared()
+  {
+    return std::allocate_shared<T>(util::ArenaAllocator<T>(_arena));
+  }
+
   /**
    * This function inserts a model::CppAstNodeId to a cache in a thread-safe
    * way. The cache is static so the parsers in each thread can use the same.
@@ -1854,6 +2040,9 @@ private:
     return false;
   }
 
+  // The model objects of the translation unit are allocated here.
+  std::shared_ptr<util::Arena> _arena;
+
   std::vector<model::CppAstNodePtr>        _astNodes;
   std::vector<model::CppEnumConstantPtr>   _enumConstants;
   std::vector<model::CppEnumPtr>           _enums;
@@ -1888,6 +2077,13 @@ private:
   EntityCache& _entityCache;
   std::unordered_map<const void*, model::CppAstNodeId>& _clangToAstNodeId;
 
+  // Header deduplication. _indexedHeaders is nullptr if it is turned off.
+  const HeaderFingerprints* _headerFingerprints;
+  IndexedHeaders* _indexedHeaders;
+  llvm::DenseMap<clang::FileID, bool> _indexedFiles;
+  bool _skipDisabled;
+  std::size_t _numSkippedDecls;
+
   // clang::TypeLoc for type names is like clang::DeclRefExpr for objects: it
   // represents their occurrences in the source code. Type names may occur in
   // source code in several contexts: at variable declaration, function return
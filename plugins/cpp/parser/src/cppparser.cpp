@@ -1,19 +1,29 @@
 #include <algorithm>
-#include <numeric>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
+#include <unistd.h>
+
 #include <boost/algorithm/string/join.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/graph/graph_traits.hpp>
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/topological_sort.hpp>
 
+#include <clang/Basic/Version.h>
 #include <clang/Frontend/CompilerInstance.h>
 #include <clang/Frontend/FrontendAction.h>
+#include <clang/Frontend/FrontendActions.h>
+#include <clang/Frontend/Utils.h>
+#include <clang/Lex/HeaderSearch.h>
+#include <clang/Lex/PPCallbacks.h>
 
 #include <model/buildaction.h>
 #include <model/buildaction-odb.hxx>
@@ -25,6 +35,7 @@
 #include <util/hash.h>
 #include <util/logutil.h>
 #include <util/odbtransaction.h>
+#include <util/sharedidmap.h>
 #include <util/threadpool.h>
 
 #include <cppparser/cppparser.h>
@@ -36,6 +47,11 @@
 #include "ppmacrocallback.h"
 #include "doccommentcollector.h"
 #include "diagnosticmessagehandler.h"
+#include "filesystemcache.h"
+#include "indexedheaders.h"
+#include "parseworker.h"
+#include "ppcontextcallback.h"
+#include "preamblestore.h"
 
 namespace cc
 {
@@ -50,6 +66,7 @@ public:
   static void cleanUp()
   {
     MyFrontendAction::_entityCache.clear();
+    MyFrontendAction::_indexedHeaders.clear();
   }
 
   static void init(ParserContext& ctx_)
@@ -60,6 +77,11 @@ public:
     });
   }
 
+  static void share(std::shared_ptr<util::SharedIdMap> sharedIds_)
+  {
+    MyFrontendAction::_entityCache.share(std::move(sharedIds_));
+  }
+
   VisitorActionFactory(ParserContext& ctx_) : _ctx(ctx_)
   {
   }
@@ -76,8 +98,14 @@ private:
     MyConsumer(
       ParserContext& ctx_,
       clang::ASTContext& context_,
-      EntityCache& entityCache_)
-        : _entityCache(entityCache_), _ctx(ctx_), _context(context_)
+      EntityCache& entityCache_,
+      const HeaderFingerprints* headerFingerprints_,
+      IndexedHeaders* indexedHeaders_)
+        : _entityCache(entityCache_),
+          _headerFingerprints(headerFingerprints_),
+          _indexedHeaders(indexedHeaders_),
+          _ctx(ctx_),
+          _context(context_)
     {
     }
 
@@ -85,7 +113,8 @@ private:
     {
       {
         ClangASTVisitor clangAstVisitor(
-          _ctx, _context, _entityCache, _clangToAstNodeId);
+          _ctx, _context, _entityCache, _clangToAstNodeId,
+          _headerFingerprints, _indexedHeaders);
         clangAstVisitor.TraverseDecl(context_.getTranslationUnitDecl());
       }
 
@@ -108,6 +137,8 @@ private:
   private:
     EntityCache& _entityCache;
     std::unordered_map<const void*, model::CppAstNodeId> _clangToAstNodeId;
+    const HeaderFingerprints* _headerFingerprints;
+    IndexedHeaders* _indexedHeaders;
 
     ParserContext& _ctx;
     clang::ASTContext& _context;
@@ -133,18 +164,29 @@ private:
       pp.addPPCallbacks(std::make_unique<PPMacroCallback>(
         _ctx, compiler_.getASTContext(), _entityCache, pp));
 
+      if (_ctx.options.count("cpp-skip-indexed-headers"))
+        pp.addPPCallbacks(
+          std::make_unique<PPContextCallback>(pp, _headerFingerprints));
+
       return true;
     }
 
     virtual std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(
       clang::CompilerInstance& compiler_, llvm::StringRef) override
     {
+      bool skipIndexedHeaders = _ctx.options.count("cpp-skip-indexed-headers");
+
       return std::unique_ptr<clang::ASTConsumer>(
-        new MyConsumer(_ctx, compiler_.getASTContext(), _entityCache));
+        new MyConsumer(_ctx, compiler_.getASTContext(), _entityCache,
+          skipIndexedHeaders ? &_headerFingerprints : nullptr,
+          skipIndexedHeaders ? &_indexedHeaders : nullptr));
     }
 
   private:
     static EntityCache _entityCache;
+    static IndexedHeaders _indexedHeaders;
+
+    HeaderFingerprints _headerFingerprints;
 
     ParserContext& _ctx;
   };
@@ -153,6 +195,125 @@ private:
 };
 
 EntityCache VisitorActionFactory::MyFrontendAction::_entityCache;
+IndexedHeaders VisitorActionFactory::MyFrontendAction::_indexedHeaders;
+
+/**
+ * Builds a precompiled header and collects the files it is built from.
+ */
+class PreambleActionFactory : public clang::tooling::FrontendActionFactory
+{
+public:
+  /**
+   * @param inputs_ The files which the precompiled header is built from.
+   * @param unguarded_ Set to the first header of the prefix which has neither
+   * an include guard nor a #pragma once.
+   */
+  PreambleActionFactory(
+    std::vector<std::string>& inputs_,
+    std::string& unguarded_)
+    : _inputs(inputs_), _unguarded(unguarded_)
+  {
+  }
+
+  std::unique_ptr<clang::FrontendAction> create() override
+  {
+    return std::make_unique<PreambleAction>(_inputs, _unguarded);
+  }
+
+private:
+  class InputCollector : public clang::DependencyCollector
+  {
+  public:
+    bool needSystemDependencies() override { return true; }
+  };
+
+  /**
+   * Collects the headers included directly by the prefix. The translation
+   * unit still contains these #include lines when it is parsed with the
+   * precompiled header, so they are entered a second time.
+   */
+  class PrefixIncludeCollector : public clang::PPCallbacks
+  {
+  public:
+    PrefixIncludeCollector(
+      const clang::SourceManager& srcMgr_,
+      std::vector<const clang::FileEntry*>& headers_)
+      : _srcMgr(srcMgr_), _headers(headers_)
+    {
+    }
+
+    void InclusionDirective(
+      clang::SourceLocation hashLoc_,
+      const clang::Token&,
+      clang::StringRef,
+      bool,
+      clang::CharSourceRange,
+      clang::Optional<clang::FileEntryRef> file_,
+      clang::StringRef,
+      clang::StringRef,
+      const clang::Module*,
+      clang::SrcMgr::CharacteristicKind) override
+    {
+      if (file_ && _srcMgr.isInMainFile(hashLoc_))
+        _headers.push_back(&file_->getFileEntry());
+    }
+
+  private:
+    const clang::SourceManager& _srcMgr;
+    std::vector<const clang::FileEntry*>& _headers;
+  };
+
+  class PreambleAction : public clang::GeneratePCHAction
+  {
+  public:
+    PreambleAction(std::vector<std::string>& inputs_, std::string& unguarded_)
+      : _inputs(inputs_),
+        _unguarded(unguarded_),
+        _collector(std::make_shared<InputCollector>())
+    {
+    }
+
+    bool BeginSourceFileAction(clang::CompilerInstance& compiler_) override
+    {
+      clang::Preprocessor& pp = compiler_.getPreprocessor();
+
+      _collector->attachToPreprocessor(pp);
+      pp.addPPCallbacks(std::make_unique<PrefixIncludeCollector>(
+        compiler_.getSourceManager(), _headers));
+
+      return clang::GeneratePCHAction::BeginSourceFileAction(compiler_);
+    }
+
+    void EndSourceFileAction() override
+    {
+      // A header is known to be guarded only after it has been preprocessed
+      // to its end.
+      clang::HeaderSearch& headerSearch
+        = getCompilerInstance().getPreprocessor().getHeaderSearchInfo();
+
+      for (const clang::FileEntry* header : _headers)
+        if (!headerSearch.isFileMultipleIncludeGuarded(header))
+        {
+          _unguarded = header->getName().str();
+          break;
+        }
+
+      clang::GeneratePCHAction::EndSourceFileAction();
+
+      llvm::ArrayRef<std::string> deps = _collector->getDependencies();
+      _inputs.assign(deps.begin(), deps.end());
+    }
+
+  private:
+    std::vector<std::string>& _inputs;
+    std::string& _unguarded;
+    std::shared_ptr<InputCollector> _collector;
+    std::vector<const clang::FileEntry*> _headers;
+  };
+
+  std::vector<std::string>& _inputs;
+  std::string& _unguarded;
+};
 
 bool CppParser::isSourceFile(const std::string& file_) const
 {
@@ -288,7 +449,257 @@ void CppParser::addCompileCommand(
   });
 }
 
-int CppParser::parseWorker(const clang::tooling::CompileCommand& command_)
+std::string CppParser::getSourcePath(
+  const clang::tooling::CompileCommand& command_)
+{
+  fs::path sourceFullPath(command_.Filename);
+  if (!sourceFullPath.is_absolute())
+    sourceFullPath = fs::path(command_.Directory) / command_.Filename;
+
+  return sourceFullPath.string();
+}
+
+std::vector<std::string> CppParser::getPreambleFlags(
+  const clang::tooling::CompileCommand& command_) const
+{
+  std::string sourcePath = getSourcePath(command_);
+  std::vector<std::string> flags;
+
+  for (auto it = command_.CommandLine.begin() + 1; // Skip compiler name
+       it != command_.CommandLine.end();
+       ++it)
+  {
+    const std::string& arg = *it;
+
+    if (arg == command_.Filename || arg == sourcePath ||
+        arg == "-c" || arg == "-M" || arg == "-MM" || arg == "-MD" ||
+        arg == "-MMD" || arg == "-MP")
+      continue;
+
+    // Skip the output and the dependency file options with their values.
+    if (arg == "-o" || arg == "-MF" || arg == "-MT" || arg == "-MQ")
+    {
+      if (it + 1 != command_.CommandLine.end())
+        ++it;
+      continue;
+    }
+
+    if (arg.compare(0, 2, "-o") == 0)
+      continue;
+
+    flags.push_back(arg);
+  }
+
+  return flags;
+}
+
+bool CppParser::buildPreamble(
+  const clang::tooling::CompileCommand& command_,
+  const std::string& key_,
+  const std::string& prefix_)
+{
+  std::string headerPath = _preambleStore->headerPath(key_);
+  std::string pchPath = _preambleStore->pchPath(key_);
+
+  {
+    std::ofstream header(headerPath);
+    header << prefix_;
+  }
+
+  //--- Assemble compiler command line ---//
+
+  std::string language = fs::path(command_.Filename).extension() == ".c"
+    ? "c-header"
+    : "c++-header";
+
+  std::vector<std::string> flags = getPreambleFlags(command_);
+  flags.insert(flags.end(), {"-x", language, "-o", pchPath});
+
+  std::vector<const char*> commandLine;
+  commandLine.reserve(flags.size() + 1);
+  commandLine.push_back("--");
+  std::transform(
+    flags.begin(),
+    flags.end(),
+    std::back_inserter(commandLine),
+    [](const std::string& s){ return s.c_str(); });
+
+  int argc = commandLine.size();
+
+  std::string compilationDbLoadError;
+  std::unique_ptr<clang::tooling::FixedCompilationDatabase> compilationDb(
+    clang::tooling::FixedCompilationDatabase::loadFromCommandLine(
+      argc,
+      commandLine.data(),
+      compilationDbLoadError));
+
+  if (!compilationDb)
+  {
+    _preambleStore->discard(key_);
+    return false;
+  }
+
+  //--- Start the tool ---//
+
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fileSystem = _fsCache
+    ? new CachingFileSystem(_fsCache)
+    : llvm::vfs::getRealFileSystem();
+
+  clang::tooling::ClangTool tool(
+    *compilationDb,
+    headerPath,
+    std::make_shared<clang::PCHContainerOperations>(),
+    fileSystem);
+
+  // The default adjusters would turn this into a syntax-only run without an
+  // output file.
+  tool.clearArgumentsAdjusters();
+  tool.appendArgumentsAdjuster(
+    clang::tooling::getClangStripDependencyFileAdjuster());
+
+  clang::IgnoringDiagConsumer diagConsumer;
+  tool.setDiagnosticConsumer(&diagConsumer);
+
+  std::vector<std::string> inputs;
+  std::string unguarded;
+  PreambleActionFactory factory(inputs, unguarded);
+
+  if (tool.run(&factory) != 0)
+  {
+    LOG(debug)
+      << "Failed to build the preamble of " << command_.Filename << '.';
+    _preambleStore->discard(key_);
+    return false;
+  }
+
+  // The translation units are parsed with their #include lines, so the
+  // headers of the prefix are entered again after the precompiled header. A
+  // header without a guard, like an X-macro .def file, would be expanded
+  // twice.
+  if (!unguarded.empty())
+  {
+    LOG(debug)
+      << "No preamble is used for " << command_.Filename << ": "
+      << unguarded << " has no include guard.";
+    _preambleStore->discard(key_);
+    return false;
+  }
+
+  return _preambleStore->commit(key_, inputs);
+}
+
+void CppParser::assignPreambles(
+  std::vector<ParseJob>& jobs_,
+  std::size_t threadNum_)
+{
+  struct Group
+  {
+    const clang::tooling::CompileCommand* command;
+    std::string prefix;
+    std::vector<ParseJob*> jobs;
+  };
+
+  //--- Read the include prefixes of the sources ---//
+
+  // The key and the include prefix of each job. Reading the beginning of
+  // every source file is I/O bound, so it is done on the threads.
+  std::vector<std::pair<std::string, std::string>> prefixes(jobs_.size());
+
+  std::unique_ptr<util::JobQueueThreadPool<std::size_t>> prefixPool =
+    util::make_thread_pool<std::size_t>(
+      threadNum_, [&, this](std::size_t index_)
+      {
+        const clang::tooling::CompileCommand& command = jobs_[index_].command;
+
+        std::string prefix
+          = PreambleStore::includePrefix(getSourcePath(command));
+        if (prefix.empty())
+          return;
+
+        // Relative paths in the flags are resolved from the working
+        // directory, and the preamble can only be loaded by the same
+        // compiler.
+        std::vector<std::string> keyFlags = getPreambleFlags(command);
+        keyFlags.push_back(command.Directory);
+        keyFlags.push_back(fs::path(command.Filename).extension().string());
+        keyFlags.push_back(clang::getClangFullVersion());
+
+        prefixes[index_].first = PreambleStore::key(keyFlags, prefix);
+        prefixes[index_].second = std::move(prefix);
+      });
+
+  for (std::size_t i = 0; i < jobs_.size(); ++i)
+    prefixPool->enqueue(i);
+
+  prefixPool->wait();
+
+  //--- Group the commands by flags and include prefix ---//
+
+  std::map<std::string, Group> groups;
+
+  for (std::size_t i = 0; i < jobs_.size(); ++i)
+  {
+    if (prefixes[i].second.empty())
+      continue;
+
+    Group& group = groups[prefixes[i].first];
+    if (group.jobs.empty())
+    {
+      group.command = &jobs_[i].command.get();
+      group.prefix = std::move(prefixes[i].second);
+    }
+    group.jobs.push_back(&jobs_[i]);
+  }
+
+  // The largest groups gain the most, so they are the first to get a place in
+  // the store.
+  std::vector<std::pair<std::string, Group*>> candidates;
+  for (auto& group : groups)
+    if (group.second.jobs.size() >= _preambleMinGroup)
+      candidates.emplace_back(group.first, &group.second);
+
+  std::stable_sort(candidates.begin(), candidates.end(),
+    [](const auto& lhs_, const auto& rhs_)
+    {
+      return lhs_.second->jobs.size() > rhs_.second->jobs.size();
+    });
+
+  LOG(info) << "[cppparser] Preparing preambles for " << candidates.size()
+            << " groups of translation units.";
+
+  //--- Build or reuse the preambles ---//
+
+  std::unique_ptr<util::JobQueueThreadPool<std::pair<std::string, Group*>>>
+    pool = util::make_thread_pool<std::pair<std::string, Group*>>(
+      threadNum_, [this](std::pair<std::string, Group*>& candidate_)
+      {
+        const std::string& key = candidate_.first;
+        Group& group = *candidate_.second;
+
+        std::string pchPath = _preambleStore->acquire(key);
+        if (pchPath.empty())
+        {
+          if (!buildPreamble(*group.command, key, group.prefix))
+            return;
+          pchPath = _preambleStore->pchPath(key);
+        }
+
+        // The first translation unit of the group is parsed from source, so
+        // the inclusions and macro expansions in the prefix are stored once
+        // even if the database was emptied since the preamble was built.
+        for (std::size_t i = 1; i < group.jobs.size(); ++i)
+          group.jobs[i]->preamble = pchPath;
+      });
+
+  for (auto& candidate : candidates)
+    pool->enqueue(candidate);
+
+  pool->wait();
+}
+
+int CppParser::parseWorker(
+  const clang::tooling::CompileCommand& command_,
+  const std::string& preamble_)
 {
   //--- Assemble compiler command line ---//
 
@@ -324,19 +735,58 @@ int CppParser::parseWorker(const clang::tooling::CompileCommand& command_)
 
   //--- Start the tool ---//
 
-  fs::path sourceFullPath(command_.Filename);
-  if (!sourceFullPath.is_absolute())
-    sourceFullPath = fs::path(command_.Directory) / command_.Filename;
+  // A failed preamble is only detected while the translation unit is
+  // parsed, so the result of that parse is kept unless the preamble itself
+  // couldn't be loaded.
+  bool preambleFailed = false;
 
-  VisitorActionFactory factory(_ctx);
-  clang::tooling::ClangTool tool(*compilationDb, sourceFullPath.string());
+  auto runTool = [&, this](const std::string& pchPath_)
+  {
+    VisitorActionFactory factory(_ctx);
+
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fileSystem = _fsCache
+      ? new CachingFileSystem(_fsCache)
+      : llvm::vfs::getRealFileSystem();
+
+    clang::tooling::ClangTool tool(
+      *compilationDb,
+      getSourcePath(command_),
+      std::make_shared<clang::PCHContainerOperations>(),
+      fileSystem);
+
+    if (!pchPath_.empty())
+      tool.appendArgumentsAdjuster(clang::tooling::getInsertArgumentAdjuster(
+        {"-include-pch", pchPath_, "-fpch-validate-input-files-content"},
+        clang::tooling::ArgumentInsertPosition::END));
+
+    llvm::IntrusiveRefCntPtr<clang::DiagnosticOptions> diagOpts
+      = new clang::DiagnosticOptions();
+    DiagnosticMessageHandler diagMsgHandler(
+      diagOpts.get(), _ctx.srcMgr, _ctx.db);
+    tool.setDiagnosticConsumer(&diagMsgHandler);
+
+    int error = tool.run(&factory);
+
+    // Clang stops before parsing the source if the precompiled header can't
+    // be loaded, so nothing else has been persisted.
+    if (error && !pchPath_.empty() && diagMsgHandler.hasPchError())
+    {
+      preambleFailed = true;
+      diagMsgHandler.discard();
+    }
 
-  llvm::IntrusiveRefCntPtr<clang::DiagnosticOptions> diagOpts
-    = new clang::DiagnosticOptions();
-  DiagnosticMessageHandler diagMsgHandler(diagOpts.get(), _ctx.srcMgr, _ctx.db);
-  tool.setDiagnosticConsumer(&diagMsgHandler);
+    return error;
+  };
 
-  int error = tool.run(&factory);
+  int error = runTool(preamble_);
+
+  if (preambleFailed)
+  {
+    LOG(debug)
+      << "Parsing " << command_.Filename
+      << " with a preamble has been failed, parsing it from source.";
+    error = runTool(std::string());
+  }
 
   //--- Save build command ---//
 
@@ -345,8 +795,131 @@ int CppParser::parseWorker(const clang::tooling::CompileCommand& command_)
   return error;
 }
 
+int CppParser::parseJob(
+  const ParseJob& job_,
+  std::size_t numCompileCommands_)
+{
+  const clang::tooling::CompileCommand& command = job_.command;
+
+  LOG(info)
+    << '(' << job_.index << '/' << numCompileCommands_ << ')'
+    << " Parsing " << command.Filename;
+
+  int error = parseWorker(command, job_.preamble);
+
+  if (error)
+    LOG(warning)
+      << '(' << job_.index << '/' << numCompileCommands_ << ')'
+      << " Parsing " << command.Filename << " has been failed.";
+  else
+    LOG(debug)
+      << '(' << job_.index << '/' << numCompileCommands_ << ')'
+      << " Parsing " << command.Filename << " finished successfully.";
+
+  return error;
+}
+
+int CppParser::runWorker()
+{
+  std::shared_ptr<util::SharedIdMap> sharedIds
+    = util::SharedIdMap::open(ParseWorkerProcess::sharedIdsFd);
+
+  if (!sharedIds)
+  {
+    LOG(error) << "Parse worker didn't get the shared id table.";
+    return 1;
+  }
+
+  // The parent has loaded the ids of the database into the table. The ids
+  // claimed by this process stay uncommitted until they are persisted, so
+  // the parent can release them if this process dies.
+  sharedIds->setOwner(::getpid());
+  _ctx.srcMgr.setSharedIds(sharedIds);
+  VisitorActionFactory::share(sharedIds);
+  RelationCollector::share(sharedIds);
+
+  std::string request;
+
+  while (ParseWorkerProcess::readRequest(request))
+  {
+    // The # of the request, the # of the command in the compilation
+    // database, the number of commands, the preamble, then the command
+    // itself: directory, file, output and the arguments.
+    std::vector<std::string> fields = ParseWorkerProcess::splitFields(request);
+
+    if (fields.size() < 7)
+    {
+      LOG(error) << "Invalid parse request: " << request;
+      return 1;
+    }
+
+    clang::tooling::CompileCommand command(
+      fields[4],
+      fields[5],
+      std::vector<std::string>(fields.begin() + 7, fields.end()),
+      fields[6]);
+
+    ParseJob job(command, std::stoul(fields[1]));
+    job.preamble = fields[3];
+
+    int error = parseJob(job, std::stoul(fields[2]));
+
+    // The claims of a translation unit whose objects couldn't be persisted
+    // are given to the other workers.
+    sharedIds->releasePending();
+
+    if (!ParseWorkerProcess::writeResult(
+      fields[0] + '\t' + std::to_string(error)))
+      break;
+  }
+
+  return 0;
+}
+
+std::vector<std::string> CppParser::getWorkerCommandLine() const
+{
+  // The workers get the same options as this process, so they see the same
+  // compilation databases, plugin options and database.
+  std::ifstream cmdline("/proc/self/cmdline");
+  std::vector<std::string> args;
+  std::string arg;
+
+  while (std::getline(cmdline, arg, '\0'))
+    args.push_back(arg);
+
+  boost::system::error_code ec;
+  fs::path executable = fs::read_symlink("/proc/self/exe", ec);
+  if (ec || args.empty())
+    return {};
+
+  args[0] = executable.string();
+  args.push_back("--worker");
+  args.push_back("cppparser");
+
+  return args;
+}
+
 CppParser::CppParser(ParserContext& ctx_) : AbstractParser(ctx_)
 {
+  int cacheSize = _ctx.options["cpp-fs-cache-size"].as<int>();
+  if (cacheSize > 0)
+    _fsCache = std::make_shared<FileSystemCache>(
+      static_cast<std::uint64_t>(cacheSize) << 20);
+
+  // The preambles of the worker processes are built by their parent.
+  int preambleCacheSize = _ctx.options["cpp-preamble-cache-size"].as<int>();
+  if (preambleCacheSize > 0 && !_ctx.options.count("worker"))
+    _preambleStore.reset(new PreambleStore(
+      _ctx.options["workspace"].as<std::string>() + '/'
+        + _ctx.options["name"].as<std::string>() + "/preambles",
+      static_cast<std::uint64_t>(preambleCacheSize) << 20));
+
+  _preambleMinGroup = std::max(
+    _ctx.options["cpp-preamble-min-group"].as<int>(), 2);
+
+  // Tools which use the real file system change the working directory of the
+  // process, so the one of the command line is saved for the workers.
+  _workDir = fs::current_path().string();
 }
 
 std::vector<std::vector<std::string>> CppParser::createCleanupOrder()
@@ -537,31 +1110,80 @@ bool CppParser::cleanupDatabase()
   std::vector<std::vector<std::string>> topologicallyOrderedFiles =
     createCleanupOrder();
 
-  // Calculate the complete number of cleanup jobs.
+  // Split the levels into batches. Added files have nothing in the database
+  // to be cleaned up, so they are left out.
 
-  int threadNum = _ctx.options["jobs"].as<int>();
-  int numCleanupJobs = std::accumulate(
-    topologicallyOrderedFiles.begin(),
-    topologicallyOrderedFiles.end(),
-    0,
-    [](int sum, const auto& level)
+  std::vector<std::vector<std::vector<std::string>>> levelBatches;
+  std::size_t numCleanupFiles = 0;
+  std::size_t numCleanupJobs = 0;
+  std::size_t maxLevelJobs = 0;
+
+  for (const auto& level : topologicallyOrderedFiles)
+  {
+    levelBatches.emplace_back();
+    std::vector<std::vector<std::string>>& batches = levelBatches.back();
+
+    for (const std::string& path : level)
     {
-      return sum + level.size();
+      if (_ctx.fileStatus.at(path) == IncrementalStatus::ADDED)
+        continue;
+
+      if (batches.empty() || batches.back().size() == cleanupBatchSize)
+      {
+        batches.emplace_back();
+        ++numCleanupJobs;
+      }
+
+      batches.back().push_back(path);
+      ++numCleanupFiles;
     }
-  );
-  bool allJobsSucceded = true;
 
-  // Define the cleanup action for a single file.
+    maxLevelJobs = std::max(maxLevelJobs, batches.size());
+  }
 
-  auto cleanupCommand = [this, &numCleanupJobs, &allJobsSucceded](CleanupJob& job_)
-  {
+  int threadNum = _ctx.options["jobs"].as<int>();
+  std::atomic<bool> allJobsSucceded(true);
+  std::atomic<std::size_t> levelDeletedRows(0);
 
+  // The levels share a single thread pool. A level has to be finished before
+  // the next one starts, so the jobs of the current level are counted down.
+  std::mutex levelMutex;
+  std::condition_variable levelFinished;
+  std::size_t levelPendingJobs = 0;
+
+  // Define the cleanup action for a batch of files.
+
+  auto cleanupCommand = [&, this](CleanupJob& job_)
+  {
     LOG(info)
       << "[cppparser] "
       << '(' << job_.index << '/' << numCleanupJobs << ')'
-      << " Database cleanup: " << job_.path;
+      << " Database cleanup: " << job_.paths.size() << " file(s)";
 
-    bool success = this->cleanupWorker(job_.path);
+    for (const std::string& path : job_.paths)
+      LOG(debug) << "[cppparser] Database cleanup: " << path;
+
+    std::size_t deletedRows = 0;
+    bool success = false;
+
+    // The level waits for every job to count down, so an exception must not
+    // skip it.
+    try
+    {
+      success = this->cleanupWorker(job_.paths, deletedRows);
+    }
+    catch (const std::exception& ex_)
+    {
+      LOG(error) << "[cppparser] Database cleanup threw an exception: "
+                 << ex_.what();
+    }
+    catch (...)
+    {
+      LOG(error) << "[cppparser] Database cleanup failed with unknown "
+                    "exception!";
+    }
+
+    levelDeletedRows += deletedRows;
 
     if (!success)
     {
@@ -569,43 +1191,79 @@ bool CppParser::cleanupDatabase()
       LOG(error)
         << "[cppparser] "
         << '(' << job_.index << '/' << numCleanupJobs << ')'
-        << " Database cleanup for " << job_.path << " has been failed.";
+        << " Database cleanup has been failed.";
     }
     else
       LOG(debug)
         << "[cppparser] "
         << '(' << job_.index << '/' << numCleanupJobs << ')'
-        << " Database cleanup for " << job_.path << " has succeeded.";
+        << " Database cleanup has succeeded.";
+
+    std::lock_guard<std::mutex> guard(levelMutex);
+    if (--levelPendingJobs == 0)
+      levelFinished.notify_all();
   };
 
   // Process all the layers of the graph.
-  // The elements of a single layer can be cleaned up parallely.
+  // The batches of a single layer can be cleaned up parallely.
+
+  LOG(info) << "[cppparser] Cleaning up " << numCleanupFiles << " file(s) in "
+    << numCleanupJobs << " batch(es).";
+
+  if (!numCleanupJobs)
+    return true;
+
+  std::unique_ptr<util::JobQueueThreadPool<CleanupJob>> pool =
+    util::make_thread_pool<CleanupJob>(
+      std::min<std::size_t>(threadNum, maxLevelJobs), cleanupCommand);
 
   int levelIndex = 0;
   std::size_t jobIndex = 0;
-  for (const auto& level : topologicallyOrderedFiles)
+  for (auto& batches : levelBatches)
   {
-    std::unique_ptr<util::JobQueueThreadPool<CleanupJob>> pool =
-      util::make_thread_pool<CleanupJob>(threadNum, cleanupCommand);
+    ++levelIndex;
+
+    if (batches.empty())
+      continue;
+
+    auto start = std::chrono::steady_clock::now();
+    levelDeletedRows = 0;
 
-    LOG(debug) << "[cppparser] Started cleanup level: " << ++levelIndex;
-    for (const std::string& filePath : level)
     {
-      CleanupJob job(filePath, ++jobIndex);
-      pool->enqueue(job);
+      std::lock_guard<std::mutex> guard(levelMutex);
+      levelPendingJobs = batches.size();
     }
 
-    pool->wait();
-    LOG(debug)
-      << "[cppparser] Finished cleanup level: " << levelIndex
-      << " (" << jobIndex << " jobs)";
+    LOG(debug) << "[cppparser] Started cleanup level: " << levelIndex;
+    for (std::vector<std::string>& batch : batches)
+      pool->enqueue(CleanupJob(std::move(batch), ++jobIndex));
+
+    {
+      std::unique_lock<std::mutex> lock(levelMutex);
+      levelFinished.wait(lock, [&]{ return levelPendingJobs == 0; });
+    }
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+
+    LOG(info)
+      << "[cppparser] Finished cleanup level " << levelIndex << ": "
+      << batches.size() << " batch(es), " << levelDeletedRows
+      << " row(s) deleted in " << duration.count() << " ms.";
   }
 
+  pool->wait();
+
   return allJobsSucceded;
 }
 
-bool CppParser::cleanupWorker(const std::string& path_)
+bool CppParser::cleanupWorker(
+  const std::vector<std::string>& paths_,
+  std::size_t& deletedRows_)
 {
+  typedef odb::query<model::CppAstNode> AstQuery;
+  typedef odb::query<model::BuildSource> SourceQuery;
+
   const unsigned short maxTries = 3;
   for (unsigned short tryCount = 1; ; ++tryCount)
   {
@@ -613,66 +1271,64 @@ bool CppParser::cleanupWorker(const std::string& path_)
     {
       util::OdbTransaction{_ctx.db}([&]
       {
-        switch (_ctx.fileStatus[path_])
-        {
-          case IncrementalStatus::MODIFIED:
-          case IncrementalStatus::DELETED:
-          case IncrementalStatus::ACTION_CHANGED:
-          {
-            // Fetch file from SourceManager by path
-            model::FilePtr delFile = _ctx.srcMgr.getFile(path_);
+        std::vector<model::FileId> fileIds;
+        fileIds.reserve(paths_.size());
+        for (const std::string& path : paths_)
+          fileIds.push_back(_ctx.srcMgr.getFile(path)->id);
 
-            // Query CppAstNode
-            auto defCppAstNodes = _ctx.db->query<model::CppAstNode>(
-              odb::query<model::CppAstNode>::location.file == delFile->id);
+        // Every statement below deletes the rows belonging to the whole batch
+        // at once. The AST nodes of the files are selected by subqueries, so
+        // none of them has to be loaded into memory.
 
-            for (const model::CppAstNode& astNode : defCppAstNodes)
-            {
-              // Delete CppEntity
-              _ctx.db->erase_query<model::CppEntity>(odb::query<model::CppEntity>::astNodeId == astNode.id);
+        const AstQuery nodesInFiles =
+          AstQuery::location.file.in_range(fileIds.begin(), fileIds.end());
 
-              if (astNode.astType == model::CppAstNode::AstType::Definition)
-              {
-                // Delete CppInheritance
-                _ctx.db->erase_query<model::CppInheritance>(
-                  odb::query<model::CppInheritance>::derived == astNode.entityHash);
+        const AstQuery definitionHashes = "(SELECT" + AstQuery::entityHash
+          + "FROM \"CppAstNode\" WHERE" + (nodesInFiles
+            && AstQuery::astType == model::CppAstNode::AstType::Definition)
+          + ")";
 
-                // Delete CppFriendship
-                _ctx.db->erase_query<model::CppFriendship>(
-                  odb::query<model::CppFriendship>::target == astNode.entityHash);
-              }
-            }
+        const AstQuery nodeIds = "(SELECT" + AstQuery::id
+          + "FROM \"CppAstNode\" WHERE" + nodesInFiles + ")";
 
-            // Delete BuildAction
-            auto delSources = _ctx.db->query<model::BuildSource>(
-              odb::query<model::BuildSource>::file == delFile->id);
-            for (const model::BuildSource& source : delSources)
-            {
-              _ctx.db->erase<model::BuildAction>(source.action->id);
-            }
+        const SourceQuery actionIds = "(SELECT" + SourceQuery::action
+          + "FROM \"BuildSource\" WHERE"
+          + SourceQuery::file.in_range(fileIds.begin(), fileIds.end()) + ")";
 
-            // Delete CppEdge (connected to File)
-            _ctx.db->erase_query<model::CppEdge>(odb::query<model::CppEdge>::from == delFile->id);
+        // Delete CppInheritance and CppFriendship
+        deletedRows_ += _ctx.db->erase_query<model::CppInheritance>(
+          odb::query<model::CppInheritance>::derived + "IN" + definitionHashes);
 
-            break;
-          }
+        deletedRows_ += _ctx.db->erase_query<model::CppFriendship>(
+          odb::query<model::CppFriendship>::target + "IN" + definitionHashes);
 
-          case IncrementalStatus::ADDED:
-            // Empty deliberately
-            break;
-        }
+        // Delete CppEntity
+        deletedRows_ += _ctx.db->erase_query<model::CppEntity>(
+          odb::query<model::CppEntity>::astNodeId + "IN" + nodeIds);
+
+        // Delete BuildAction
+        deletedRows_ += _ctx.db->erase_query<model::BuildAction>(
+          odb::query<model::BuildAction>::id + "IN" + actionIds);
+
+        // Delete CppEdge (connected to File)
+        deletedRows_ += _ctx.db->erase_query<model::CppEdge>(
+          odb::query<model::CppEdge>::from.in_range(
+            fileIds.begin(), fileIds.end()));
       });
     }
     catch (odb::deadlock& ex)
     {
+      deletedRows_ = 0;
+
       if (tryCount < maxTries)
-        LOG(warning) << "[cppparser] Transaction deadlock occurred, "
-          << "retrying (" << (tryCount + 1) << '/' << maxTries << "): " << path_;
-      else
       {
-        LOG(error) << "[cppparser] Transaction deadlock occurred, aborting: " << path_;
-        return false;
+        LOG(warning) << "[cppparser] Transaction deadlock occurred, "
+          << "retrying (" << (tryCount + 1) << '/' << maxTries << ").";
+        continue;
       }
+
+      LOG(error) << "[cppparser] Transaction deadlock occurred, aborting.";
+      return false;
     }
     catch (odb::database_exception&)
     {
@@ -687,6 +1343,47 @@ bool CppParser::cleanupWorker(const std::string& path_)
 bool CppParser::parse()
 {
   initBuildActions();
+
+  int workers = _ctx.options["cpp-worker-processes"].as<int>();
+  std::vector<std::string> workerCommandLine;
+  std::shared_ptr<util::SharedIdMap> sharedIds;
+
+  if (workers > 0)
+    workerCommandLine = getWorkerCommandLine();
+
+  if (workers > 0 && _ctx.db->id() == odb::id_sqlite)
+    LOG(warning)
+      << "[cppparser] Worker processes need a database which can be written "
+         "by several processes, parsing on threads.";
+  else if (workers > 0 && workerCommandLine.empty())
+    LOG(warning)
+      << "[cppparser] The command line of the parser can't be determined, "
+         "parsing on threads.";
+  else if (workers > 0)
+    sharedIds = util::SharedIdMap::create(
+      static_cast<std::uint64_t>(
+        _ctx.options["cpp-worker-id-table-size"].as<int>()) << 20);
+
+  if (sharedIds)
+  {
+    // The objects already in the database and the ones persisted by any of
+    // the workers are registered in the shared table, so that every object
+    // is persisted by exactly one process.
+    _ctx.srcMgr.setSharedIds(sharedIds);
+    VisitorActionFactory::share(sharedIds);
+    RelationCollector::share(sharedIds);
+    RelationCollector::init(_ctx);
+
+    _workerPool.reset(new ParseWorkerPool(
+      workerCommandLine,
+      _workDir,
+      sharedIds,
+      workers,
+      std::max(_ctx.options["cpp-worker-max-tus"].as<int>(), 0),
+      static_cast<std::uint64_t>(std::max(
+        _ctx.options["cpp-worker-max-rss"].as<int>(), 0)) << 20));
+  }
+
   VisitorActionFactory::init(_ctx);
 
   bool success = true;
@@ -695,14 +1392,59 @@ bool CppParser::parse()
     : _ctx.options["input"].as<std::vector<std::string>>())
     if (fs::is_regular_file(input))
       success
-        = success && parseByJson(input, _ctx.options["jobs"].as<int>());
+        = success && parseByJson(input, _jobs);
+
+  if (_workerPool)
+  {
+    ParseWorkerPool::Statistics stats = _workerPool->statistics();
+    _workerPool.reset();
+
+    LOG(info)
+      << "[cppparser] Worker processes: " << stats.started << " started, "
+      << stats.crashed << " crashed, " << sharedIds->size()
+      << " shared ids.";
+
+    if (sharedIds->overflows())
+      LOG(warning)
+        << "[cppparser] " << sharedIds->overflows() << " id(s) didn't fit "
+           "into the shared id table, their objects may have been persisted "
+           "more than once. Increase --cpp-worker-id-table-size (now "
+        << _ctx.options["cpp-worker-id-table-size"].as<int>() << " MiB).";
+  }
 
   VisitorActionFactory::cleanUp();
+  RelationCollector::cleanUp();
   _parsedCommandHashes.clear();
 
+  if (_fsCache)
+  {
+    FileSystemCache::Statistics stats = _fsCache->statistics();
+    LOG(info)
+      << "[cppparser] File system cache: " << stats.statHits
+      << " stat hits, " << stats.negativeHits << " negative hits, "
+      << stats.statMisses << " stat misses, " << stats.contentHits
+      << " content hits, " << stats.contentMisses << " content misses, "
+      << (stats.bytesSaved >> 20) << " MiB read from memory, "
+      << stats.evictions << " content evictions, " << stats.statusEvictions
+      << " status evictions.";
+  }
+
+  if (_preambleStore)
+  {
+    PreambleStore::Statistics stats = _preambleStore->statistics();
+    LOG(info)
+      << "[cppparser] Preambles: " << stats.built << " built, "
+      << stats.reused << " reused, " << stats.evicted << " evicted.";
+  }
+
   return success;
 }
 
+bool CppParser::isShardable() const
+{
+  return true;
+}
+
 void CppParser::initBuildActions()
 {
   util::OdbTransaction {_ctx.db} ([&] {
@@ -733,65 +1475,25 @@ bool CppParser::parseByJson(
   const std::string& jsonFile_,
   std::size_t threadNum_)
 {
-  std::string errorMsg;
-
-  std::unique_ptr<clang::tooling::JSONCompilationDatabase> compDb
-    = clang::tooling::JSONCompilationDatabase::loadFromFile(
-        jsonFile_, errorMsg,
-        clang::tooling::JSONCommandLineSyntax::Gnu);
-
-  if (!errorMsg.empty())
-  {
-    LOG(error) << errorMsg;
-    return false;
-  }
-
   //--- Read the compilation commands compile database ---//
 
-  std::vector<clang::tooling::CompileCommand> compileCommands =
-    compDb->getAllCompileCommands();
-
-  compileCommands.erase(
-    std::remove_if(compileCommands.begin(), compileCommands.end(),
-      [&](const clang::tooling::CompileCommand& c)
-      {
-        return !isSourceFile(c.Filename);
-      }),
-    compileCommands.end());
+  std::vector<clang::tooling::CompileCommand> compileCommands;
+  if (!loadCompileCommands(jsonFile_, compileCommands))
+    return false;
 
   std::size_t numCompileCommands = compileCommands.size();
 
-  //--- Create a thread pool for the current commands ---//
-  std::unique_ptr<
-    util::JobQueueThreadPool<ParseJob>> pool =
-    util::make_thread_pool<ParseJob>(
-      threadNum_, [this, &numCompileCommands](ParseJob& job_)
-      {
-        const clang::tooling::CompileCommand& command = job_.command;
-
-        LOG(info)
-          << '(' << job_.index << '/' << numCompileCommands << ')'
-          << " Parsing " << command.Filename;
-
-        int error = this->parseWorker(command);
-
-        if (error)
-          LOG(warning)
-            << '(' << job_.index << '/' << numCompileCommands << ')'
-            << " Parsing " << command.Filename << " has been failed.";
-        else          
-          LOG(debug)
-            << '(' << job_.index << '/' << numCompileCommands << ')'
-            << " Parsing " << command.Filename << " finished successfully.";
-      });
-
-  //--- Push all commands into the thread pool's queue ---//
+  //--- Collect the commands to be parsed ---//
+  std::vector<ParseJob> jobs;
   std::size_t index = 0;
 
   for (const auto& command : compileCommands)
   {
     ParseJob job(command, ++index);
 
+    if (!_ctx.inShard(getSourcePath(command)))
+      continue;
+
     auto hash = util::fnvHash(
       boost::algorithm::join(command.CommandLine, " "));
 
@@ -808,17 +1510,102 @@ bool CppParser::parseByJson(
 
     _parsedCommandHashes.insert(hash);
 
-    //--- Push the job ---//
+    jobs.push_back(job);
+  }
 
-    pool->enqueue(job);
+  if (_preambleStore)
+    assignPreambles(jobs, threadNum_);
+
+  //--- Send the commands to the worker processes ---//
+
+  if (_workerPool)
+  {
+    // The commands are sent in the requests, so the workers don't have to
+    // load the compilation database whenever they are restarted.
+    std::vector<std::string> requests;
+    for (const ParseJob& job : jobs)
+    {
+      const clang::tooling::CompileCommand& command = job.command;
+
+      std::vector<std::string> fields {
+        std::to_string(job.index),
+        std::to_string(numCompileCommands),
+        job.preamble,
+        command.Directory,
+        command.Filename,
+        command.Output};
+      fields.insert(
+        fields.end(), command.CommandLine.begin(), command.CommandLine.end());
+
+      requests.push_back(ParseWorkerProcess::joinFields(fields));
+    }
+
+    return _workerPool->run(requests, [&](std::size_t request_, int error_)
+      {
+        if (error_ == ParseWorkerPool::crashed)
+          LOG(error)
+            << '(' << jobs[request_].index << '/' << numCompileCommands
+            << ") Parsing " << jobs[request_].command.get().Filename
+            << " has crashed the worker process.";
+      });
   }
 
+  //--- Create a thread pool for the current commands ---//
+
+  // The pool has a thread for each of the --jobs threads, but only as many
+  // of them parse at the same time as the current share of this plugin, which
+  // grows when the plugins parsing concurrently finish.
+  std::unique_ptr<
+    util::JobQueueThreadPool<ParseJob>> pool =
+    util::make_thread_pool<ParseJob>(
+      std::max<std::size_t>(threadNum_, maxJobs()),
+      [this, &numCompileCommands](ParseJob& job_)
+      {
+        JobSlot slot(*this);
+        this->parseJob(job_, numCompileCommands);
+      });
+
+  //--- Push all commands into the thread pool's queue ---//
+
+  for (ParseJob& job : jobs)
+    pool->enqueue(job);
+
   // Block execution until every job is finished.
   pool->wait();
 
   return true;
 }
 
+bool CppParser::loadCompileCommands(
+  const std::string& jsonFile_,
+  std::vector<clang::tooling::CompileCommand>& compileCommands_) const
+{
+  std::string errorMsg;
+
+  std::unique_ptr<clang::tooling::JSONCompilationDatabase> compDb
+    = clang::tooling::JSONCompilationDatabase::loadFromFile(
+        jsonFile_, errorMsg,
+        clang::tooling::JSONCommandLineSyntax::Gnu);
+
+  if (!errorMsg.empty())
+  {
+    LOG(error) << errorMsg;
+    return false;
+  }
+
+  compileCommands_ = compDb->getAllCompileCommands();
+
+  compileCommands_.erase(
+    std::remove_if(compileCommands_.begin(), compileCommands_.end(),
+      [&](const clang::tooling::CompileCommand& c)
+      {
+        return !isSourceFile(c.Filename);
+      }),
+    compileCommands_.end());
+
+  return true;
+}
+
 CppParser::~CppParser()
 {
 }
@@ -833,7 +1620,45 @@ extern "C"
     description.add_options()
       ("skip-doccomment",
        "If this flag is given the parser will skip parsing the documentation "
-       "comments.");
+       "comments.")
+      ("cpp-fs-cache-size", po::value<int>()->default_value(1024),
+       "Memory limit in MiB for the header contents cached between the "
+       "translation units. The status of the files (including the failed "
+       "lookups along the include paths) is cached too, in at most an eighth "
+       "of this amount of memory in addition. 0 turns the cache off.")
+      ("cpp-skip-indexed-headers",
+       "If this flag is given, the declarations of a header are only visited "
+       "in the first translation unit which includes it under a given "
+       "preprocessor context (language, target and the definitions of the "
+       "macros the header refers to). The other translation units skip them, "
+       "except for templates. Usages in the main files are still recorded. "
+       "Skipped declaration statistics are logged for each translation "
+       "unit.")
+      ("cpp-preamble-cache-size", po::value<int>()->default_value(0),
+       "Disk limit in MiB for the precompiled preambles stored in the "
+       "workspace. Translation units with the same flags which start with "
+       "the same #include directives share a precompiled header built from "
+       "these directives. 0 turns the preambles off.")
+      ("cpp-preamble-min-group", po::value<int>()->default_value(4),
+       "The minimum number of translation units which have to share an "
+       "include prefix for building a preamble.")
+      ("cpp-worker-processes", po::value<int>()->default_value(0),
+       "Number of worker processes parsing the translation units instead of "
+       "the threads of the parser. A crash of a worker only fails the "
+       "translation unit it was parsing, and the memory of the workers is "
+       "given back by restarting them. Not available with SQLite. 0 parses "
+       "on threads.")
+      ("cpp-worker-max-tus", po::value<int>()->default_value(500),
+       "A worker process is restarted after parsing this many translation "
+       "units. 0 means no limit.")
+      ("cpp-worker-max-rss", po::value<int>()->default_value(4096),
+       "A worker process is restarted when its private resident memory "
+       "exceeds this limit in MiB after a translation unit. 0 means no "
+       "limit.")
+      ("cpp-worker-id-table-size", po::value<int>()->default_value(1024),
+       "Size in MiB of the shared memory table through which the worker "
+       "processes decide which of them persists an entity. The memory is "
+       "only used as the table fills up.");
     return description;
   }
 
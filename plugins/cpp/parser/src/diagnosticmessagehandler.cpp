@@ -1,3 +1,4 @@
+#include <clang/Basic/DiagnosticFrontend.h>
 #include <llvm/ADT/SmallString.h>
 #include <cppparser/filelocutil.h>
 #include "diagnosticmessagehandler.h"
@@ -11,7 +12,8 @@ DiagnosticMessageHandler::DiagnosticMessageHandler(
   clang::DiagnosticOptions* diags,
   SourceManager& srcMgr_,
   std::shared_ptr<odb::database> db_)
-    : TextDiagnosticPrinter(llvm::errs(), diags), _srcMgr(srcMgr_), _db(db_)
+    : TextDiagnosticPrinter(llvm::errs(), diags), _srcMgr(srcMgr_), _db(db_),
+      _pchError(false)
 {
 }
 
@@ -21,6 +23,15 @@ void DiagnosticMessageHandler::HandleDiagnostic(
 {
   clang::TextDiagnosticPrinter::HandleDiagnostic(diagLevel_, info_);
 
+  // The errors of reading a precompiled header, e.g. a stale or malformed
+  // one, are serialization errors.
+  unsigned id = info_.getID();
+  if (diagLevel_ >= clang::DiagnosticsEngine::Error &&
+      ((id >= clang::diag::DIAG_START_SERIALIZATION &&
+        id < clang::diag::DIAG_START_LEX) ||
+       id == clang::diag::err_fe_unable_to_load_pch))
+    _pchError = true;
+
   model::BuildLog buildLog;
 
   //--- Message type ---//
@@ -64,6 +75,16 @@ void DiagnosticMessageHandler::HandleDiagnostic(
   _messages.push_back(buildLog);
 }
 
+bool DiagnosticMessageHandler::hasPchError() const
+{
+  return _pchError;
+}
+
+void DiagnosticMessageHandler::discard()
+{
+  _messages.clear();
+}
+
 DiagnosticMessageHandler::~DiagnosticMessageHandler()
 {
   util::OdbTransaction{_db}([this](){
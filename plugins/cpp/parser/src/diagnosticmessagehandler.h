@@ -25,10 +25,21 @@ public:
     clang::DiagnosticsEngine::Level diagLevel_,
     const clang::Diagnostic& info_) override;
 
+  /**
+   * Returns true if a precompiled header couldn't be loaded.
+   */
+  bool hasPchError() const;
+
+  /**
+   * Drops the messages collected so far, so they are not persisted.
+   */
+  void discard();
+
 private:
   SourceManager& _srcMgr;
   std::vector<model::BuildLog> _messages;
   std::shared_ptr<odb::database> _db;
+  bool _pchError;
 };
 
 }
@@ -1,5 +1,17 @@
 #include "entitycache.h"
 
+#include <stdexcept>
+
+namespace
+{
+
+/**
+ * Separates the AST node ids from the other ids in the shared id table.
+ */
+const std::uint64_t sharedAstNodeIdMask = 0x3c6ef372fe94f82bULL;
+
+} // namespace
+
 namespace cc
 {
 namespace parser
@@ -7,13 +19,31 @@ namespace parser
 
 bool EntityCache::insert(const model::CppAstNode& node_)
 {
+  if (_sharedIds)
+    return _sharedIds->insert(
+      sharedAstNodeIdMask ^ node_.id, node_.entityHash);
+
   std::lock_guard<std::mutex> guard(_cacheMutex);
   return _entityCache.insert(
     std::make_pair(node_.id, node_.entityHash)).second;
 }
 
+void EntityCache::commit(const model::CppAstNode& node_)
+{
+  if (_sharedIds)
+    _sharedIds->commit(sharedAstNodeIdMask ^ node_.id);
+}
+
 std::uint64_t EntityCache::at(const model::CppAstNodeId& id_) const
 {
+  if (_sharedIds)
+  {
+    std::uint64_t entityHash;
+    if (!_sharedIds->find(sharedAstNodeIdMask ^ id_, entityHash))
+      throw std::out_of_range("EntityCache::at");
+    return entityHash;
+  }
+
   std::lock_guard<std::mutex> guard(_cacheMutex);
   return _entityCache.at(id_);
 }
@@ -21,6 +51,18 @@ std::uint64_t EntityCache::at(const model::CppAstNodeId& id_) const
 void EntityCache::clear()
 {
   _entityCache.clear();
+  _sharedIds.reset();
+}
+
+void EntityCache::share(std::shared_ptr<util::SharedIdMap> sharedIds_)
+{
+  std::lock_guard<std::mutex> guard(_cacheMutex);
+
+  for (const auto& entity : _entityCache)
+    sharedIds_->insert(sharedAstNodeIdMask ^ entity.first, entity.second);
+
+  _entityCache.clear();
+  _sharedIds = std::move(sharedIds_);
 }
 
 }
@@ -1,11 +1,14 @@
 #ifndef CC_PARSER_ENTITYCACHE_H
 #define CC_PARSER_ENTITYCACHE_H
 
+#include <memory>
 #include <unordered_map>
 #include <mutex>
 
 #include <model/cppastnode.h>
 
+#include <util/sharedidmap.h>
+
 namespace cc
 {
 namespace parser
@@ -25,6 +28,12 @@ public:
    */
   bool insert(const model::CppAstNode& node_);
 
+  /**
+   * Tells the other parser processes that the AST node inserted by this
+   * process has been persisted, see util::SharedIdMap::commit().
+   */
+  void commit(const model::CppAstNode& node_);
+
   /**
    * Returns a reference to the mapped value of the element with key equivalent
    * to id_. If no such element exists, an exception of type
@@ -33,12 +42,19 @@ public:
   std::uint64_t at(const model::CppAstNodeId& id_) const;
 
   /**
-   * Removes all elements from the cache.
+   * Removes all elements from the cache and stops sharing it.
    */
   void clear();
 
+  /**
+   * Moves the cache into a table shared with the other parser processes, so
+   * an AST node is persisted only by one of them.
+   */
+  void share(std::shared_ptr<util::SharedIdMap> sharedIds_);
+
 private:
   std::unordered_map<model::CppAstNodeId, std::uint64_t> _entityCache;
+  std::shared_ptr<util::SharedIdMap> _sharedIds;
   mutable std::mutex _cacheMutex;
 };
 
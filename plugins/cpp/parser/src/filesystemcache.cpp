@@ -0,0 +1,325 @@
+#include <llvm/Support/Path.h>
+
+#include "filesystemcache.h"
+
+namespace
+{
+
+/**
+ * Memory buffer which shares the content of a cached buffer. The content
+ * stays alive while clang uses it, even if the cache evicts it meanwhile.
+ */
+class SharedMemoryBuffer : public llvm::MemoryBuffer
+{
+public:
+  SharedMemoryBuffer(
+    std::shared_ptr<const llvm::MemoryBuffer> content_,
+    std::string name_)
+    : _content(std::move(content_)), _name(std::move(name_))
+  {
+    init(_content->getBufferStart(), _content->getBufferEnd(), true);
+  }
+
+  llvm::StringRef getBufferIdentifier() const override
+  {
+    return _name;
+  }
+
+  BufferKind getBufferKind() const override
+  {
+    return MemoryBuffer_Malloc;
+  }
+
+private:
+  std::shared_ptr<const llvm::MemoryBuffer> _content;
+  std::string _name;
+};
+
+class CachedFile : public llvm::vfs::File
+{
+public:
+  CachedFile(
+    llvm::vfs::Status status_,
+    std::shared_ptr<const llvm::MemoryBuffer> content_)
+    : _status(std::move(status_)), _content(std::move(content_))
+  {
+  }
+
+  llvm::ErrorOr<llvm::vfs::Status> status() override
+  {
+    return _status;
+  }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> getBuffer(
+    const llvm::Twine& name_,
+    int64_t,
+    bool,
+    bool) override
+  {
+    return std::unique_ptr<llvm::MemoryBuffer>(
+      new SharedMemoryBuffer(_content, name_.str()));
+  }
+
+  std::error_code close() override
+  {
+    return std::error_code();
+  }
+
+private:
+  llvm::vfs::Status _status;
+  std::shared_ptr<const llvm::MemoryBuffer> _content;
+};
+
+} // namespace
+
+namespace cc
+{
+namespace parser
+{
+
+FileSystemCache::FileSystemCache(std::uint64_t maxBytes_)
+  : _maxBytes(maxBytes_),
+    _maxStatusBytes(maxBytes_ / 8),
+    _statusBytesCached(0),
+    _statusEvictions(0),
+    _statHits(0),
+    _statMisses(0),
+    _negativeHits(0),
+    _contentHits(0),
+    _contentMisses(0),
+    _bytesSaved(0),
+    _bytesCached(0),
+    _evictions(0)
+{
+}
+
+bool FileSystemCache::getStatus(
+  const std::string& path_,
+  llvm::ErrorOr<llvm::vfs::Status>& status_)
+{
+  {
+    std::lock_guard<std::mutex> guard(_statusMutex);
+
+    auto it = _statuses.find(path_);
+    if (it != _statuses.end())
+    {
+      _statusLru.splice(_statusLru.begin(), _statusLru, it->second.lruPos);
+      status_ = it->second.status;
+      if (status_)
+        ++_statHits;
+      else
+        ++_negativeHits;
+      return true;
+    }
+  }
+
+  ++_statMisses;
+  return false;
+}
+
+void FileSystemCache::putStatus(
+  const std::string& path_,
+  const llvm::ErrorOr<llvm::vfs::Status>& status_)
+{
+  std::lock_guard<std::mutex> guard(_statusMutex);
+
+  if (_statuses.count(path_))
+    return;
+
+  _statusLru.push_front(path_);
+  _statuses.emplace(path_, CachedStatus{status_, _statusLru.begin()});
+  _statusBytesCached += statusSize(path_);
+
+  while (_statusBytesCached > _maxStatusBytes && _statuses.size() > 1)
+  {
+    _statusBytesCached -= statusSize(_statusLru.back());
+    _statuses.erase(_statusLru.back());
+    _statusLru.pop_back();
+    ++_statusEvictions;
+  }
+}
+
+std::uint64_t FileSystemCache::statusSize(const std::string& path_)
+{
+  // The constant covers the nodes of the map and the list, and the fields of
+  // the status.
+  return 3 * path_.size() + sizeof(CachedStatus) + 128;
+}
+
+std::shared_ptr<const llvm::MemoryBuffer> FileSystemCache::getContent(
+  const std::string& path_)
+{
+  {
+    std::lock_guard<std::mutex> guard(_contentMutex);
+
+    auto it = _contents.find(path_);
+    if (it != _contents.end())
+    {
+      _lru.splice(_lru.begin(), _lru, it->second.lruPos);
+      ++_contentHits;
+      _bytesSaved += it->second.buffer->getBufferSize();
+      return it->second.buffer;
+    }
+  }
+
+  ++_contentMisses;
+  return nullptr;
+}
+
+bool FileSystemCache::putContent(
+  const std::string& path_,
+  std::shared_ptr<const llvm::MemoryBuffer> content_)
+{
+  std::uint64_t size = content_->getBufferSize();
+  if (size > _maxBytes / 16)
+    return false;
+
+  std::lock_guard<std::mutex> guard(_contentMutex);
+
+  if (_contents.count(path_))
+    return true;
+
+  _lru.push_front(path_);
+  _contents.emplace(path_, Content{std::move(content_), _lru.begin()});
+  _bytesCached += size;
+
+  while (_bytesCached > _maxBytes)
+  {
+    auto it = _contents.find(_lru.back());
+    _bytesCached -= it->second.buffer->getBufferSize();
+    _contents.erase(it);
+    _lru.pop_back();
+    ++_evictions;
+  }
+
+  return true;
+}
+
+FileSystemCache::Statistics FileSystemCache::statistics() const
+{
+  Statistics stats;
+  stats.statHits = _statHits;
+  stats.statMisses = _statMisses;
+  stats.negativeHits = _negativeHits;
+  stats.contentHits = _contentHits;
+  stats.contentMisses = _contentMisses;
+  stats.bytesSaved = _bytesSaved;
+
+  {
+    std::lock_guard<std::mutex> guard(_contentMutex);
+    stats.bytesCached = _bytesCached;
+    stats.evictions = _evictions;
+  }
+
+  std::lock_guard<std::mutex> guard(_statusMutex);
+  stats.statusBytesCached = _statusBytesCached;
+  stats.statusEvictions = _statusEvictions;
+
+  return stats;
+}
+
+CachingFileSystem::CachingFileSystem(std::shared_ptr<FileSystemCache> cache_)
+  : _cache(std::move(cache_)),
+    _base(llvm::vfs::createPhysicalFileSystem().release())
+{
+}
+
+std::string CachingFileSystem::cacheKey(const llvm::Twine& path_) const
+{
+  llvm::SmallString<256> path;
+  path_.toVector(path);
+
+  makeAbsolute(path);
+  llvm::sys::path::remove_dots(path);
+
+  return path.str().str();
+}
+
+llvm::ErrorOr<llvm::vfs::Status> CachingFileSystem::status(
+  const llvm::Twine& path_)
+{
+  std::string key = cacheKey(path_);
+
+  llvm::ErrorOr<llvm::vfs::Status> status(
+    std::make_error_code(std::errc::no_such_file_or_directory));
+  if (!_cache->getStatus(key, status))
+  {
+    status = _base->status(key);
+    _cache->putStatus(key, status);
+  }
+
+  // The status of a file carries the name by which it was looked up.
+  if (status)
+    return llvm::vfs::Status::copyWithNewName(*status, path_);
+
+  return status;
+}
+
+llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+CachingFileSystem::openFileForRead(const llvm::Twine& path_)
+{
+  llvm::ErrorOr<llvm::vfs::Status> status = this->status(path_);
+  if (!status)
+    return status.getError();
+
+  if (status->getType() != llvm::sys::fs::file_type::regular_file)
+    return _base->openFileForRead(path_);
+
+  std::string key = cacheKey(path_);
+
+  std::shared_ptr<const llvm::MemoryBuffer> content = _cache->getContent(key);
+  if (!content)
+  {
+    llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> file
+      = _base->openFileForRead(key);
+    if (!file)
+      return file.getError();
+
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer
+      = (*file)->getBuffer(key, status->getSize());
+    if (!buffer)
+      return buffer.getError();
+
+    content = std::move(*buffer);
+    _cache->putContent(key, content);
+  }
+
+  return std::unique_ptr<llvm::vfs::File>(
+    new CachedFile(std::move(*status), std::move(content)));
+}
+
+llvm::vfs::directory_iterator CachingFileSystem::dir_begin(
+  const llvm::Twine& dir_,
+  std::error_code& ec_)
+{
+  return _base->dir_begin(dir_, ec_);
+}
+
+std::error_code CachingFileSystem::setCurrentWorkingDirectory(
+  const llvm::Twine& path_)
+{
+  return _base->setCurrentWorkingDirectory(path_);
+}
+
+llvm::ErrorOr<std::string>
+CachingFileSystem::getCurrentWorkingDirectory() const
+{
+  return _base->getCurrentWorkingDirectory();
+}
+
+std::error_code CachingFileSystem::getRealPath(
+  const llvm::Twine& path_,
+  llvm::SmallVectorImpl<char>& output_) const
+{
+  return _base->getRealPath(path_, output_);
+}
+
+std::error_code CachingFileSystem::isLocal(
+  const llvm::Twine& path_,
+  bool& result_)
+{
+  return _base->isLocal(path_, result_);
+}
+
+} // parser
+} // cc
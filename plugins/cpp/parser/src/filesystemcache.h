@@ -0,0 +1,197 @@
+#ifndef CC_PARSER_FILESYSTEMCACHE_H
+#define CC_PARSER_FILESYSTEMCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/VirtualFileSystem.h>
+
+namespace cc
+{
+namespace parser
+{
+
+/**
+ * Thread safe cache of file statuses and file contents shared by the
+ * translation units parsed in the same process. The source files are not
+ * expected to change during parsing, so the entries are never invalidated.
+ *
+ * Failed lookups are cached too, so the search for an #include along the
+ * include paths doesn't hit the disk again for the directories which don't
+ * contain the header. The file contents and the statuses have separate
+ * memory limits, and are evicted in least recently used order above them.
+ */
+class FileSystemCache
+{
+public:
+  struct Statistics
+  {
+    std::uint64_t statHits = 0;
+    std::uint64_t statMisses = 0;
+
+    /**
+     * Cache hits on files which don't exist.
+     */
+    std::uint64_t negativeHits = 0;
+
+    std::uint64_t contentHits = 0;
+    std::uint64_t contentMisses = 0;
+
+    /**
+     * The number of bytes served from the cache instead of the disk.
+     */
+    std::uint64_t bytesSaved = 0;
+
+    /**
+     * The total size of the file contents currently in the cache.
+     */
+    std::uint64_t bytesCached = 0;
+
+    std::uint64_t evictions = 0;
+
+    /**
+     * The estimated size of the statuses currently in the cache.
+     */
+    std::uint64_t statusBytesCached = 0;
+
+    std::uint64_t statusEvictions = 0;
+  };
+
+  /**
+   * @param maxBytes_ The maximum total size of the cached file contents. The
+   * statuses may take up an eighth of this in addition.
+   */
+  FileSystemCache(std::uint64_t maxBytes_);
+
+  /**
+   * Looks up the status of an absolute path.
+   * @return False if the path is not in the cache.
+   */
+  bool getStatus(
+    const std::string& path_,
+    llvm::ErrorOr<llvm::vfs::Status>& status_);
+
+  void putStatus(
+    const std::string& path_,
+    const llvm::ErrorOr<llvm::vfs::Status>& status_);
+
+  /**
+   * Looks up the content of an absolute path.
+   * @return The content or nullptr if it is not in the cache.
+   */
+  std::shared_ptr<const llvm::MemoryBuffer> getContent(
+    const std::string& path_);
+
+  /**
+   * Stores the content of a file. Files larger than a fraction of the memory
+   * limit are not stored, so a single huge file can't flush the cache.
+   * @return False if the content was not stored.
+   */
+  bool putContent(
+    const std::string& path_,
+    std::shared_ptr<const llvm::MemoryBuffer> content_);
+
+  Statistics statistics() const;
+
+private:
+  struct Content
+  {
+    std::shared_ptr<const llvm::MemoryBuffer> buffer;
+    std::list<std::string>::iterator lruPos;
+  };
+
+  struct CachedStatus
+  {
+    llvm::ErrorOr<llvm::vfs::Status> status;
+    std::list<std::string>::iterator lruPos;
+  };
+
+  /**
+   * Returns the estimated memory footprint of a status entry: the path is
+   * stored as the key, in the LRU list and as the name of the status.
+   */
+  static std::uint64_t statusSize(const std::string& path_);
+
+  const std::uint64_t _maxBytes;
+  const std::uint64_t _maxStatusBytes;
+
+  mutable std::mutex _statusMutex;
+  std::unordered_map<std::string, CachedStatus> _statuses;
+
+  /**
+   * Paths of the cached statuses, the most recently used first.
+   */
+  std::list<std::string> _statusLru;
+  std::uint64_t _statusBytesCached;
+  std::uint64_t _statusEvictions;
+
+  mutable std::mutex _contentMutex;
+  std::unordered_map<std::string, Content> _contents;
+
+  /**
+   * Paths of the cached contents, the most recently used first.
+   */
+  std::list<std::string> _lru;
+
+  std::atomic<std::uint64_t> _statHits;
+  std::atomic<std::uint64_t> _statMisses;
+  std::atomic<std::uint64_t> _negativeHits;
+  std::atomic<std::uint64_t> _contentHits;
+  std::atomic<std::uint64_t> _contentMisses;
+  std::atomic<std::uint64_t> _bytesSaved;
+  std::uint64_t _bytesCached;
+  std::uint64_t _evictions;
+};
+
+/**
+ * File system of a single ClangTool run which serves the file statuses and
+ * the contents from a shared FileSystemCache and falls back to the real file
+ * system. Every instance has its own working directory, so the tools running
+ * on different threads don't change the working directory of each other (or
+ * of the process).
+ */
+class CachingFileSystem : public llvm::vfs::FileSystem
+{
+public:
+  CachingFileSystem(std::shared_ptr<FileSystemCache> cache_);
+
+  llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine& path_) override;
+
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> openFileForRead(
+    const llvm::Twine& path_) override;
+
+  llvm::vfs::directory_iterator dir_begin(
+    const llvm::Twine& dir_,
+    std::error_code& ec_) override;
+
+  std::error_code setCurrentWorkingDirectory(
+    const llvm::Twine& path_) override;
+
+  llvm::ErrorOr<std::string> getCurrentWorkingDirectory() const override;
+
+  std::error_code getRealPath(
+    const llvm::Twine& path_,
+    llvm::SmallVectorImpl<char>& output_) const override;
+
+  std::error_code isLocal(const llvm::Twine& path_, bool& result_) override;
+
+private:
+  /**
+   * Returns the absolute form of the path which is used as the cache key.
+   */
+  std::string cacheKey(const llvm::Twine& path_) const;
+
+  std::shared_ptr<FileSystemCache> _cache;
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> _base;
+};
+
+} // parser
+} // cc
+
+#endif // CC_PARSER_FILESYSTEMCACHE_H
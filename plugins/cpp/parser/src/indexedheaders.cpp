@@ -0,0 +1,48 @@
+#include <boost/functional/hash.hpp>
+
+#include <util/hash.h>
+
+#include "indexedheaders.h"
+
+namespace cc
+{
+namespace parser
+{
+
+bool IndexedHeaders::contains(
+  const std::string& path_,
+  std::size_t fingerprint_) const
+{
+  std::size_t k = key(path_, fingerprint_);
+
+  std::lock_guard<std::mutex> guard(_headersMutex);
+  return _headers.count(k);
+}
+
+void IndexedHeaders::insert(
+  const std::string& path_,
+  std::size_t fingerprint_)
+{
+  std::size_t k = key(path_, fingerprint_);
+
+  std::lock_guard<std::mutex> guard(_headersMutex);
+  _headers.insert(k);
+}
+
+void IndexedHeaders::clear()
+{
+  std::lock_guard<std::mutex> guard(_headersMutex);
+  _headers.clear();
+}
+
+std::size_t IndexedHeaders::key(
+  const std::string& path_,
+  std::size_t fingerprint_)
+{
+  std::size_t k = util::fnvHash(path_);
+  boost::hash_combine(k, fingerprint_);
+  return k;
+}
+
+}
+}
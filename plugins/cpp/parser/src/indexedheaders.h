@@ -0,0 +1,49 @@
+#ifndef CC_PARSER_INDEXEDHEADERS_H
+#define CC_PARSER_INDEXEDHEADERS_H
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+namespace cc
+{
+namespace parser
+{
+
+/**
+ * Thread safe set of the header files whose declarations have been fully
+ * indexed. A header is identified by its path together with the fingerprint
+ * of the preprocessor context in which it was parsed (see PPContextCallback),
+ * since the same header may produce different declarations under different
+ * macro definitions.
+ */
+class IndexedHeaders
+{
+public:
+  /**
+   * Returns true if the header has been indexed under the given context.
+   */
+  bool contains(const std::string& path_, std::size_t fingerprint_) const;
+
+  /**
+   * Records that the header has been indexed under the given context.
+   */
+  void insert(const std::string& path_, std::size_t fingerprint_);
+
+  /**
+   * Removes all elements from the set.
+   */
+  void clear();
+
+private:
+  static std::size_t key(const std::string& path_, std::size_t fingerprint_);
+
+  std::unordered_set<std::size_t> _headers;
+  mutable std::mutex _headersMutex;
+};
+
+} // parser
+} // cc
+
+#endif // CC_PARSER_INDEXEDHEADERS_H
@@ -0,0 +1,480 @@
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <util/logutil.h>
+
+#include "parseworker.h"
+
+namespace
+{
+
+/**
+ * Splits the complete lines off the beginning of a buffer.
+ */
+void takeLines(std::string& buffer_, std::vector<std::string>& lines_)
+{
+  std::size_t begin = 0;
+  std::size_t end;
+
+  while ((end = buffer_.find('\n', begin)) != std::string::npos)
+  {
+    lines_.push_back(buffer_.substr(begin, end - begin));
+    begin = end + 1;
+  }
+
+  buffer_.erase(0, begin);
+}
+
+bool writeAll(int fd_, const std::string& data_)
+{
+  std::size_t written = 0;
+
+  while (written < data_.size())
+  {
+    ssize_t n = ::write(fd_, data_.data() + written, data_.size() - written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    written += n;
+  }
+
+  return true;
+}
+
+} // namespace
+
+namespace cc
+{
+namespace parser
+{
+
+constexpr int ParseWorkerProcess::requestFd;
+constexpr int ParseWorkerProcess::resultFd;
+constexpr int ParseWorkerProcess::sharedIdsFd;
+constexpr int ParseWorkerPool::crashed;
+
+ParseWorkerProcess::ParseWorkerProcess(
+  const std::vector<std::string>& args_,
+  const std::string& workDir_,
+  int sharedIdsFd_)
+{
+  // Everything the child needs is prepared before fork(): the parent has
+  // other threads, so the child may only make async-signal-safe calls.
+  std::vector<char*> argv;
+  for (const std::string& arg : args_)
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  argv.push_back(nullptr);
+
+  long maxFd = ::sysconf(_SC_OPEN_MAX);
+
+  openPipe(_resultPipeFd[0], _resultPipeFd[1]);
+
+  if (startProcess() == 0)
+  {
+    // This is the child process. Move the pipes and the shared id table to
+    // their fixed descriptors and close everything else inherited from the
+    // parent, e.g. the pipes of the other workers.
+    int fds[] = {_pipeFd[0], _resultPipeFd[1], sharedIdsFd_};
+    for (int& fd : fds)
+      fd = ::fcntl(fd, F_DUPFD, sharedIdsFd + 1);
+
+    ::dup2(fds[0], requestFd);
+    ::dup2(fds[1], resultFd);
+    ::dup2(fds[2], sharedIdsFd);
+
+#ifdef SYS_close_range
+    if (::syscall(SYS_close_range, sharedIdsFd + 1, ~0U, 0) != 0)
+#endif
+      for (long fd = sharedIdsFd + 1; fd < maxFd; ++fd)
+        ::close(fd);
+
+    if (::chdir(workDir_.c_str()) == 0)
+      ::execv(argv[0], argv.data());
+
+    ::_exit(127);
+  }
+
+  // The ends of the child are closed, so it gets an EOF when the parent
+  // closes its end, and vice versa.
+  ::close(_pipeFd[0]);
+  _pipeFd[0] = 0;
+  ::close(_resultPipeFd[1]);
+  _resultPipeFd[1] = 0;
+
+  ::fcntl(_pipeFd[1], F_SETFD, FD_CLOEXEC);
+  ::fcntl(_resultPipeFd[0], F_SETFD, FD_CLOEXEC);
+}
+
+ParseWorkerProcess::~ParseWorkerProcess()
+{
+  closePipe(_pipeFd[0], _pipeFd[1]);
+
+  try
+  {
+    refreshExitStatus(true);
+  }
+  catch (const Failure&)
+  {
+  }
+
+  closePipe(_resultPipeFd[0], _resultPipeFd[1]);
+}
+
+bool ParseWorkerProcess::send(const std::string& request_)
+{
+  return writeAll(_pipeFd[1], request_ + '\n');
+}
+
+bool ParseWorkerProcess::receive(std::vector<std::string>& results_)
+{
+  char buffer[4096];
+  ssize_t n = ::read(_resultPipeFd[0], buffer, sizeof(buffer));
+
+  if (n < 0 && errno == EINTR)
+    return true;
+  if (n <= 0)
+    return false;
+
+  _buffer.append(buffer, n);
+  takeLines(_buffer, results_);
+
+  return true;
+}
+
+int ParseWorkerProcess::resultPipe() const
+{
+  return _resultPipeFd[0];
+}
+
+int ParseWorkerProcess::pid() const
+{
+  return _childPid;
+}
+
+std::uint64_t ParseWorkerProcess::privateResidentBytes() const
+{
+  // The shared id table and the mapped files are not counted: these are not
+  // given back by a restart.
+  std::ifstream status("/proc/" + std::to_string(_childPid) + "/status");
+  std::string line;
+
+  while (std::getline(status, line))
+    if (line.compare(0, 8, "RssAnon:") == 0)
+      return std::stoull(line.substr(8)) << 10;
+
+  return 0;
+}
+
+std::string ParseWorkerProcess::exitReason()
+{
+  try
+  {
+    refreshExitStatus(true);
+  }
+  catch (const Failure&)
+  {
+    return "unknown reason";
+  }
+
+  if (WIFSIGNALED(_childExitStatus))
+    return "killed by signal " + std::to_string(WTERMSIG(_childExitStatus))
+      + " (" + ::strsignal(WTERMSIG(_childExitStatus)) + ')';
+
+  if (WIFEXITED(_childExitStatus))
+    return "exited with code "
+      + std::to_string(WEXITSTATUS(_childExitStatus));
+
+  return "unknown reason";
+}
+
+bool ParseWorkerProcess::readRequest(std::string& request_)
+{
+  static std::string buffer;
+
+  while (true)
+  {
+    std::size_t end = buffer.find('\n');
+    if (end != std::string::npos)
+    {
+      request_ = buffer.substr(0, end);
+      buffer.erase(0, end + 1);
+      return true;
+    }
+
+    char chunk[4096];
+    ssize_t n = ::read(requestFd, chunk, sizeof(chunk));
+
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+
+    buffer.append(chunk, n);
+  }
+}
+
+bool ParseWorkerProcess::writeResult(const std::string& result_)
+{
+  return writeAll(resultFd, result_ + '\n');
+}
+
+std::string ParseWorkerProcess::joinFields(
+  const std::vector<std::string>& fields_)
+{
+  std::string line;
+
+  for (const std::string& field : fields_)
+  {
+    if (&field != &fields_.front())
+      line += '\t';
+
+    for (char c : field)
+      switch (c)
+      {
+        case '\\': line += "\\\\"; break;
+        case '\t': line += "\\t"; break;
+        case '\n': line += "\\n"; break;
+        default: line += c;
+      }
+  }
+
+  return line;
+}
+
+std::vector<std::string> ParseWorkerProcess::splitFields(
+  const std::string& line_)
+{
+  std::vector<std::string> fields(1);
+
+  for (std::size_t i = 0; i < line_.size(); ++i)
+  {
+    char c = line_[i];
+
+    if (c == '\t')
+      fields.emplace_back();
+    else if (c == '\\' && i + 1 < line_.size())
+    {
+      c = line_[++i];
+      fields.back() += c == 't' ? '\t' : c == 'n' ? '\n' : c;
+    }
+    else
+      fields.back() += c;
+  }
+
+  return fields;
+}
+
+ParseWorkerPool::ParseWorkerPool(
+  std::vector<std::string> args_,
+  std::string workDir_,
+  std::shared_ptr<util::SharedIdMap> sharedIds_,
+  std::size_t size_,
+  std::size_t maxJobs_,
+  std::uint64_t maxResidentBytes_)
+  : _args(std::move(args_)),
+    _workDir(std::move(workDir_)),
+    _sharedIds(std::move(sharedIds_)),
+    _maxJobs(maxJobs_),
+    _maxResidentBytes(maxResidentBytes_),
+    _workers(size_)
+{
+  // A request sent to a crashed worker must fail with EPIPE instead of
+  // killing the parser.
+  struct sigaction ignore;
+  std::memset(&ignore, 0, sizeof(ignore));
+  ignore.sa_handler = SIG_IGN;
+  ::sigemptyset(&ignore.sa_mask);
+  ::sigaction(SIGPIPE, &ignore, &_oldSigPipeAction);
+}
+
+ParseWorkerPool::~ParseWorkerPool()
+{
+  // The pipes of the workers are closed first.
+  _workers.clear();
+  ::sigaction(SIGPIPE, &_oldSigPipeAction, nullptr);
+}
+
+bool ParseWorkerPool::start(Worker& worker_)
+{
+  try
+  {
+    worker_.process.reset(
+      new ParseWorkerProcess(_args, _workDir, _sharedIdsFd));
+    worker_.jobs = 0;
+    ++_statistics.started;
+    return true;
+  }
+  catch (const util::PipedProcess::Failure& ex)
+  {
+    LOG(error) << "Failed to start a parse worker: " << ex.what();
+    return false;
+  }
+}
+
+void ParseWorkerPool::recycle(Worker& worker_)
+{
+  if (_maxJobs && worker_.jobs >= _maxJobs)
+  {
+    LOG(debug)
+      << "Restarting a parse worker after " << worker_.jobs
+      << " translation units.";
+    worker_.process.reset();
+    return;
+  }
+
+  std::uint64_t residentBytes = worker_.process->privateResidentBytes();
+  if (_maxResidentBytes && residentBytes > _maxResidentBytes)
+  {
+    LOG(debug)
+      << "Restarting a parse worker using " << (residentBytes >> 20)
+      << " MiB memory after " << worker_.jobs << " translation units.";
+    worker_.process.reset();
+  }
+}
+
+void ParseWorkerPool::bury(Worker& worker_)
+{
+  LOG(warning)
+    << "Parse worker has " << worker_.process->exitReason() << '.';
+
+  // The exit status has been collected, so the pid can't be reused by
+  // another worker before its claims are released.
+  std::uint64_t released = _sharedIds->release(worker_.process->pid());
+  if (released)
+    LOG(debug)
+      << "Released " << released << " ids claimed by the crashed worker.";
+
+  worker_.process.reset();
+  ++_statistics.crashed;
+}
+
+bool ParseWorkerPool::run(
+  const std::vector<std::string>& requests_,
+  const std::function<void(std::size_t, int)>& done_)
+{
+  std::size_t next = 0;
+
+  // If a worker can't be started then the others would most likely fail too,
+  // and every remaining request would be reported as crashed at once.
+  bool startFailed = false;
+
+  auto dispatch = [&, this](Worker& worker_)
+  {
+    while (next < requests_.size() && !startFailed)
+    {
+      if (!worker_.process && !start(worker_))
+      {
+        startFailed = true;
+        return;
+      }
+
+      std::size_t index = next++;
+
+      if (worker_.process->send(
+        std::to_string(index) + '\t' + requests_[index]))
+      {
+        worker_.current = index;
+        return;
+      }
+
+      bury(worker_);
+      done_(index, crashed);
+    }
+  };
+
+  for (Worker& worker : _workers)
+    dispatch(worker);
+
+  while (true)
+  {
+    std::vector<pollfd> fds;
+    std::vector<Worker*> busy;
+
+    for (Worker& worker : _workers)
+      if (worker.current != std::string::npos)
+      {
+        fds.push_back({worker.process->resultPipe(), POLLIN, 0});
+        busy.push_back(&worker);
+      }
+
+    if (fds.empty())
+      break;
+
+    if (::poll(fds.data(), fds.size(), -1) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      LOG(error) << "Waiting for the parse workers failed: "
+                 << std::strerror(errno);
+      return false;
+    }
+
+    for (std::size_t i = 0; i < fds.size(); ++i)
+    {
+      if (!fds[i].revents)
+        continue;
+
+      Worker& worker = *busy[i];
+
+      std::vector<std::string> results;
+      bool alive = worker.process->receive(results);
+
+      for (const std::string& result : results)
+      {
+        std::size_t index;
+        int error;
+        std::istringstream(result) >> index >> error;
+
+        done_(index, error);
+        worker.current = std::string::npos;
+        ++worker.jobs;
+      }
+
+      if (!alive)
+      {
+        if (worker.current != std::string::npos)
+        {
+          bury(worker);
+          done_(worker.current, crashed);
+          worker.current = std::string::npos;
+        }
+        else
+          worker.process.reset();
+      }
+      else if (worker.current == std::string::npos)
+        recycle(worker);
+
+      if (worker.current == std::string::npos)
+        dispatch(worker);
+    }
+  }
+
+  if (startFailed)
+  {
+    LOG(error)
+      << "No more parse workers can be started, "
+      << requests_.size() - next << " translation unit(s) are not parsed.";
+    return false;
+  }
+
+  return true;
+}
+
+ParseWorkerPool::Statistics ParseWorkerPool::statistics() const
+{
+  return _statistics;
+}
+
+} // parser
+} // cc
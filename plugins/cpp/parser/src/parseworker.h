@@ -0,0 +1,220 @@
+#ifndef CC_PARSER_PARSEWORKER_H
+#define CC_PARSER_PARSEWORKER_H
+
+#include <csignal>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <util/pipedprocess.h>
+#include <util/sharedidmap.h>
+
+namespace cc
+{
+namespace parser
+{
+
+/**
+ * A copy of the parser started with the --worker option, which parses the
+ * compile commands it gets on a pipe and reports the result of each on
+ * another pipe. Both the requests and the results are single lines.
+ */
+class ParseWorkerProcess : public util::PipedProcess
+{
+public:
+  /**
+   * The file descriptors of the worker process: it reads the requests from
+   * requestFd, writes the results to resultFd and gets the shared id table
+   * on sharedIdsFd.
+   */
+  static constexpr int requestFd = 3;
+  static constexpr int resultFd = 4;
+  static constexpr int sharedIdsFd = 5;
+
+  /**
+   * Starts a worker process.
+   * @param args_ The command line of the worker. The first one is the path of
+   * the executable.
+   * @param workDir_ The working directory of the worker.
+   * @param sharedIdsFd_ The file descriptor of the shared id table.
+   */
+  ParseWorkerProcess(
+    const std::vector<std::string>& args_,
+    const std::string& workDir_,
+    int sharedIdsFd_);
+
+  /**
+   * Closes the request pipe, so the worker exits after its current request,
+   * and waits for it.
+   */
+  ~ParseWorkerProcess();
+
+  /**
+   * Sends a request to the worker.
+   * @return False if the worker has died.
+   */
+  bool send(const std::string& request_);
+
+  /**
+   * Reads the results which the worker has written so far.
+   * @return False if the worker has closed its end, i.e. it has died.
+   */
+  bool receive(std::vector<std::string>& results_);
+
+  /**
+   * The file descriptor on which the results arrive.
+   */
+  int resultPipe() const;
+
+  /**
+   * The process id of the worker.
+   */
+  int pid() const;
+
+  /**
+   * The resident memory of the worker which is not shared with other
+   * processes, or 0 if it can't be determined.
+   */
+  std::uint64_t privateResidentBytes() const;
+
+  /**
+   * Describes how the worker has exited, e.g. "killed by signal 11". It is
+   * only valid after receive() has returned false.
+   */
+  std::string exitReason();
+
+  /**
+   * Reads the next request in the worker process.
+   * @return False if the parent has closed the pipe.
+   */
+  static bool readRequest(std::string& request_);
+
+  /**
+   * Writes a result in the worker process.
+   */
+  static bool writeResult(const std::string& result_);
+
+  /**
+   * Joins the fields of a request or a result with tabs. The tabs, newlines
+   * and backslashes in the fields are escaped.
+   */
+  static std::string joinFields(const std::vector<std::string>& fields_);
+
+  /**
+   * Splits a line created by joinFields() to its fields.
+   */
+  static std::vector<std::string> splitFields(const std::string& line_);
+
+private:
+  int _resultPipeFd[2];
+  std::string _buffer;
+};
+
+/**
+ * Parses compile commands in worker processes. A worker is restarted after a
+ * given number of translation units or when its memory usage exceeds a limit,
+ * so the memory leaked or fragmented by clang is given back. If a worker
+ * crashes then only its current translation unit fails.
+ */
+class ParseWorkerPool
+{
+public:
+  struct Statistics
+  {
+    std::uint64_t started = 0;
+    std::uint64_t crashed = 0;
+  };
+
+  /**
+   * The result of a translation unit which crashed its worker.
+   */
+  static constexpr int crashed = -1;
+
+  /**
+   * @param sharedIds_ The shared id table of the workers. The uncommitted
+   * claims of a crashed worker are released in it.
+   * @param size_ The number of worker processes.
+   * @param maxJobs_ A worker is restarted after this many translation units.
+   * @param maxResidentBytes_ A worker is restarted when its private resident
+   * memory exceeds this after a translation unit.
+   */
+  ParseWorkerPool(
+    std::vector<std::string> args_,
+    std::string workDir_,
+    std::shared_ptr<util::SharedIdMap> sharedIds_,
+    std::size_t size_,
+    std::size_t maxJobs_,
+    std::uint64_t maxResidentBytes_);
+
+  /**
+   * Stops the workers and restores the SIGPIPE handler.
+   */
+  ~ParseWorkerPool();
+
+  /**
+   * Sends the requests to the workers and blocks until all of them are done.
+   * If a worker can't be started then no more requests are sent, only the
+   * ones already sent are waited for.
+   * @param done_ Called with the # of the request and the error code of its
+   * translation unit, or crashed. It is not called for the requests which
+   * haven't been sent.
+   * @return False if some requests haven't been sent.
+   */
+  bool run(
+    const std::vector<std::string>& requests_,
+    const std::function<void(std::size_t, int)>& done_);
+
+  Statistics statistics() const;
+
+private:
+  struct Worker
+  {
+    std::unique_ptr<ParseWorkerProcess> process;
+
+    /**
+     * The number of translation units parsed by the process.
+     */
+    std::size_t jobs = 0;
+
+    /**
+     * The # of the request being parsed or npos if the worker is idle.
+     */
+    std::size_t current = std::string::npos;
+  };
+
+  /**
+   * Starts the process of a worker.
+   * @return False if the process can't be started.
+   */
+  bool start(Worker& worker_);
+
+  /**
+   * Stops the worker if it has parsed enough translation units or uses too
+   * much memory.
+   */
+  void recycle(Worker& worker_);
+
+  /**
+   * Stops a worker which has died and releases the ids it has claimed but
+   * not persisted.
+   */
+  void bury(Worker& worker_);
+
+  const std::vector<std::string> _args;
+  const std::string _workDir;
+  const std::shared_ptr<util::SharedIdMap> _sharedIds;
+  const std::size_t _maxJobs;
+  const std::uint64_t _maxResidentBytes;
+
+  std::vector<Worker> _workers;
+  Statistics _statistics;
+
+  struct sigaction _oldSigPipeAction;
+};
+
+} // parser
+} // cc
+
+#endif // CC_PARSER_PARSEWORKER_H
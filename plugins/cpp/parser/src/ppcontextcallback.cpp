@@ -0,0 +1,124 @@
+#include <boost/functional/hash.hpp>
+
+#include <clang/Basic/TargetInfo.h>
+#include <clang/Lex/MacroInfo.h>
+
+#include <util/hash.h>
+
+#include "ppcontextcallback.h"
+
+namespace cc
+{
+namespace parser
+{
+
+PPContextCallback::PPContextCallback(
+  clang::Preprocessor& pp_,
+  HeaderFingerprints& fingerprints_) :
+    _pp(pp_),
+    _clangSrcMgr(pp_.getSourceManager()),
+    _fingerprints(fingerprints_),
+    _seed(util::fnvHash(pp_.getTargetInfo().getTriple().str()))
+{
+  // The language mode changes the parsing even if no macro refers to it.
+  const clang::LangOptions& langOpts = pp_.getLangOpts();
+  boost::hash_combine(_seed, static_cast<int>(langOpts.LangStd));
+  boost::hash_combine(_seed, static_cast<bool>(langOpts.CPlusPlus));
+  boost::hash_combine(_seed, static_cast<bool>(langOpts.ObjC));
+}
+
+void PPContextCallback::FileChanged(
+  clang::SourceLocation loc_,
+  FileChangeReason reason_,
+  clang::SrcMgr::CharacteristicKind,
+  clang::FileID)
+{
+  if (reason_ != EnterFile)
+    return;
+
+  clang::FileID fid = _clangSrcMgr.getFileID(loc_);
+  if (fid.isValid())
+    _fingerprints.try_emplace(fid, _seed);
+}
+
+void PPContextCallback::MacroExpands(
+  const clang::Token& macroNameTok_,
+  const clang::MacroDefinition& md_,
+  clang::SourceRange range_,
+  const clang::MacroArgs*)
+{
+  addMacroReference(range_.getBegin(), macroNameTok_, md_);
+}
+
+void PPContextCallback::Defined(
+  const clang::Token& macroNameTok_,
+  const clang::MacroDefinition& md_,
+  clang::SourceRange range_)
+{
+  addMacroReference(range_.getBegin(), macroNameTok_, md_);
+}
+
+void PPContextCallback::Ifdef(
+  clang::SourceLocation loc_,
+  const clang::Token& macroNameTok_,
+  const clang::MacroDefinition& md_)
+{
+  addMacroReference(loc_, macroNameTok_, md_);
+}
+
+void PPContextCallback::Ifndef(
+  clang::SourceLocation loc_,
+  const clang::Token& macroNameTok_,
+  const clang::MacroDefinition& md_)
+{
+  addMacroReference(loc_, macroNameTok_, md_);
+}
+
+void PPContextCallback::addMacroReference(
+  clang::SourceLocation loc_,
+  const clang::Token& macroNameTok_,
+  const clang::MacroDefinition& md_)
+{
+  if (loc_.isInvalid())
+    return;
+
+  // Nested expansions are accounted to the file of the outermost one.
+  clang::FileID fid
+    = _clangSrcMgr.getFileID(_clangSrcMgr.getExpansionLoc(loc_));
+
+  auto it = _fingerprints.find(fid);
+  if (it == _fingerprints.end())
+    return;
+
+  const clang::IdentifierInfo* ii = macroNameTok_.getIdentifierInfo();
+
+  boost::hash_combine(it->second, ii ? util::fnvHash(ii->getName().str()) : 0);
+  boost::hash_combine(it->second, macroHash(md_.getMacroInfo()));
+}
+
+std::size_t PPContextCallback::macroHash(const clang::MacroInfo* mi_)
+{
+  // An undefined macro.
+  if (!mi_)
+    return 0;
+
+  auto it = _macroHashes.find(mi_);
+  if (it != _macroHashes.end())
+    return it->second;
+
+  std::size_t hash = 1;
+  boost::hash_combine(hash, mi_->isFunctionLike());
+  boost::hash_combine(hash, mi_->isVariadic());
+
+  for (const clang::IdentifierInfo* param : mi_->params())
+    boost::hash_combine(hash, util::fnvHash(param->getName().str()));
+
+  for (const clang::Token& token : mi_->tokens())
+    boost::hash_combine(hash, util::fnvHash(_pp.getSpelling(token)));
+
+  _macroHashes[mi_] = hash;
+  return hash;
+}
+
+}
+}
@@ -0,0 +1,90 @@
+#ifndef CC_PARSER_PPCONTEXTCALLBACK_H
+#define CC_PARSER_PPCONTEXTCALLBACK_H
+
+#include <cstddef>
+
+#include <clang/Basic/SourceManager.h>
+#include <clang/Lex/PPCallbacks.h>
+#include <clang/Lex/Preprocessor.h>
+#include <llvm/ADT/DenseMap.h>
+
+namespace cc
+{
+namespace parser
+{
+
+/**
+ * Fingerprints of the preprocessor context of the files entered in a
+ * translation unit. Every inclusion of a header gets its own clang::FileID.
+ */
+typedef llvm::DenseMap<clang::FileID, std::size_t> HeaderFingerprints;
+
+/**
+ * This callback computes a fingerprint for every file inclusion of the
+ * translation unit. The fingerprint covers the language mode, the target and
+ * the definition of every macro which is expanded or tested by #ifdef,
+ * #ifndef or defined() in the included file, in the order of the references.
+ * Given the same file content, two inclusions with the same fingerprint are
+ * preprocessed to the same tokens.
+ */
+class PPContextCallback : public clang::PPCallbacks
+{
+public:
+  PPContextCallback(
+    clang::Preprocessor& pp_,
+    HeaderFingerprints& fingerprints_);
+
+  virtual void FileChanged(
+    clang::SourceLocation loc_,
+    FileChangeReason reason_,
+    clang::SrcMgr::CharacteristicKind fileType_,
+    clang::FileID prevFid_) override;
+
+  virtual void MacroExpands(
+    const clang::Token& macroNameTok_,
+    const clang::MacroDefinition& md_,
+    clang::SourceRange range_,
+    const clang::MacroArgs* args_) override;
+
+  virtual void Defined(
+    const clang::Token& macroNameTok_,
+    const clang::MacroDefinition& md_,
+    clang::SourceRange range_) override;
+
+  virtual void Ifdef(
+    clang::SourceLocation loc_,
+    const clang::Token& macroNameTok_,
+    const clang::MacroDefinition& md_) override;
+
+  virtual void Ifndef(
+    clang::SourceLocation loc_,
+    const clang::Token& macroNameTok_,
+    const clang::MacroDefinition& md_) override;
+
+private:
+  /**
+   * Adds the macro referenced at the given location to the fingerprint of
+   * the file containing the location.
+   */
+  void addMacroReference(
+    clang::SourceLocation loc_,
+    const clang::Token& macroNameTok_,
+    const clang::MacroDefinition& md_);
+
+  /**
+   * Returns the hash of the name, the parameters and the replacement tokens
+   * of a macro definition.
+   */
+  std::size_t macroHash(const clang::MacroInfo* mi_);
+
+  clang::Preprocessor& _pp;
+  const clang::SourceManager& _clangSrcMgr;
+  HeaderFingerprints& _fingerprints;
+  std::size_t _seed;
+  llvm::DenseMap<const clang::MacroInfo*, std::size_t> _macroHashes;
+};
+
+} // parser
+} // cc
+
+#endif // CC_PARSER_PPCONTEXTCALLBACK_H
@@ -0,0 +1,339 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/filesystem.hpp>
+
+#include <util/hash.h>
+#include <util/logutil.h>
+
+#include "preamblestore.h"
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+
+/**
+ * Parses an #include directive.
+ * @param line_ A trimmed line of the source file.
+ * @param quoted_ Set to true for "..." includes, false for <...> ones.
+ * @param name_ The included name between the delimiters.
+ * @return False if the line is not an #include directive with a file name.
+ */
+bool parseInclude(const std::string& line_, bool& quoted_, std::string& name_)
+{
+  if (line_.empty() || line_[0] != '#')
+    return false;
+
+  std::size_t pos = line_.find_first_not_of(" \t", 1);
+  if (pos == std::string::npos || line_.compare(pos, 7, "include") != 0)
+    return false;
+
+  pos = line_.find_first_not_of(" \t", pos + 7);
+  if (pos == std::string::npos || (line_[pos] != '"' && line_[pos] != '<'))
+    return false;
+
+  quoted_ = line_[pos] == '"';
+  std::size_t end = line_.find(quoted_ ? '"' : '>', pos + 1);
+  if (end == std::string::npos)
+    return false;
+
+  // Only a comment may follow the file name.
+  std::string rest = boost::algorithm::trim_copy(line_.substr(end + 1));
+  if (!rest.empty() && rest.compare(0, 2, "//") != 0)
+    return false;
+
+  name_ = line_.substr(pos + 1, end - pos - 1);
+  return !name_.empty();
+}
+
+} // namespace
+
+namespace cc
+{
+namespace parser
+{
+
+PreambleStore::PreambleStore(const std::string& dir_, std::uint64_t maxBytes_)
+  : _dir(dir_), _maxBytes(maxBytes_), _totalBytes(0)
+{
+  boost::system::error_code ec;
+  fs::create_directories(_dir, ec);
+  if (ec)
+  {
+    LOG(warning) << "Failed to create preamble directory " << _dir << ": "
+                 << ec.message();
+    return;
+  }
+
+  for (fs::directory_iterator it(_dir, ec), end; !ec && it != end; ++it)
+  {
+    if (it->path().extension() != ".pch")
+      continue;
+
+    std::uint64_t size = fs::file_size(it->path(), ec);
+    if (ec)
+      continue;
+
+    _sizes[it->path().stem().string()] = size;
+    _totalBytes += size;
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  evict();
+}
+
+std::string PreambleStore::includePrefix(const std::string& sourcePath_)
+{
+  std::ifstream file(sourcePath_);
+  fs::path dir = fs::path(sourcePath_).parent_path();
+
+  std::string prefix;
+  std::string line;
+  bool inComment = false;
+
+  while (std::getline(file, line))
+  {
+    boost::algorithm::trim(line);
+
+    //--- Skip comments ---//
+
+    if (inComment || line.compare(0, 2, "/*") == 0)
+    {
+      std::size_t end = line.find("*/", inComment ? 0 : 2);
+      inComment = end == std::string::npos;
+      if (inComment)
+        continue;
+
+      line = boost::algorithm::trim_copy(line.substr(end + 2));
+    }
+
+    if (line.empty() || line.compare(0, 2, "//") == 0)
+      continue;
+
+    //--- Collect includes ---//
+
+    bool quoted;
+    std::string name;
+    if (!parseInclude(line, quoted, name))
+      break;
+
+    boost::system::error_code ec;
+    fs::path local = fs::canonical(dir / name, ec);
+
+    if (quoted && !ec && fs::is_regular_file(local))
+      prefix += "#include \"" + local.string() + "\"\n";
+    else if (quoted)
+      prefix += "#include \"" + name + "\"\n";
+    else
+      prefix += "#include <" + name + ">\n";
+  }
+
+  return prefix;
+}
+
+std::string PreambleStore::key(
+  const std::vector<std::string>& flags_,
+  const std::string& prefix_)
+{
+  std::string data;
+  for (const std::string& flag : flags_)
+  {
+    data += flag;
+    data += '\0';
+  }
+  data += prefix_;
+
+  std::ostringstream ss;
+  ss << std::hex << std::setw(16) << std::setfill('0') << util::fnvHash(data);
+  return ss.str();
+}
+
+std::string PreambleStore::acquire(const std::string& key_)
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_sizes.count(key_))
+      return std::string();
+    if (_pinned.count(key_))
+      return pchPath(key_);
+  }
+
+  bool upToDate = isUpToDate(key_);
+
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  if (!_sizes.count(key_))
+    return std::string();
+
+  if (!upToDate)
+  {
+    remove(key_);
+    return std::string();
+  }
+
+  // The manifest's modification time tells when the preamble was used last.
+  boost::system::error_code ec;
+  fs::last_write_time(manifestPath(key_), std::time(nullptr), ec);
+
+  _pinned.insert(key_);
+  ++_statistics.reused;
+
+  return pchPath(key_);
+}
+
+std::string PreambleStore::headerPath(const std::string& key_) const
+{
+  return _dir + '/' + key_ + ".h";
+}
+
+std::string PreambleStore::pchPath(const std::string& key_) const
+{
+  return _dir + '/' + key_ + ".pch";
+}
+
+std::string PreambleStore::manifestPath(const std::string& key_) const
+{
+  return _dir + '/' + key_ + ".deps";
+}
+
+bool PreambleStore::commit(
+  const std::string& key_,
+  const std::vector<std::string>& inputs_)
+{
+  {
+    std::ofstream manifest(manifestPath(key_));
+    for (const std::string& input : inputs_)
+    {
+      boost::system::error_code ec;
+      fs::path path = fs::absolute(input);
+      if (!fs::is_regular_file(path, ec) || path.string() == headerPath(key_))
+        continue;
+
+      manifest << contentHash(path.string()) << ' ' << path.string() << '\n';
+    }
+  }
+
+  boost::system::error_code ec;
+  std::uint64_t size = fs::file_size(pchPath(key_), ec);
+
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  if (ec)
+  {
+    remove(key_);
+    return false;
+  }
+
+  _totalBytes += size - _sizes[key_];
+  _sizes[key_] = size;
+  _pinned.insert(key_);
+  ++_statistics.built;
+
+  evict();
+
+  if (_totalBytes > _maxBytes)
+  {
+    LOG(debug) << "Preamble " << key_ << " doesn't fit into the store.";
+    remove(key_);
+    return false;
+  }
+
+  return true;
+}
+
+void PreambleStore::discard(const std::string& key_)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  remove(key_);
+}
+
+PreambleStore::Statistics PreambleStore::statistics() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _statistics;
+}
+
+std::uint64_t PreambleStore::contentHash(const std::string& path_)
+{
+  std::ifstream file(path_, std::ios::binary);
+  if (!file)
+    return 0;
+
+  std::string content(
+    (std::istreambuf_iterator<char>(file)),
+    (std::istreambuf_iterator<char>()));
+
+  return util::fnvHash(content);
+}
+
+bool PreambleStore::isUpToDate(const std::string& key_) const
+{
+  std::ifstream manifest(manifestPath(key_));
+  if (!manifest)
+    return false;
+
+  std::uint64_t hash;
+  std::string path;
+
+  while (manifest >> hash && std::getline(manifest >> std::ws, path))
+    if (contentHash(path) != hash)
+    {
+      LOG(debug) << "Preamble " << key_ << " is outdated: " << path
+                 << " has changed.";
+      return false;
+    }
+
+  return manifest.eof();
+}
+
+void PreambleStore::remove(const std::string& key_)
+{
+  boost::system::error_code ec;
+  fs::remove(pchPath(key_), ec);
+  fs::remove(manifestPath(key_), ec);
+  fs::remove(headerPath(key_), ec);
+
+  auto it = _sizes.find(key_);
+  if (it != _sizes.end())
+  {
+    _totalBytes -= it->second;
+    _sizes.erase(it);
+  }
+
+  _pinned.erase(key_);
+}
+
+void PreambleStore::evict()
+{
+  if (_totalBytes <= _maxBytes)
+    return;
+
+  std::vector<std::pair<std::time_t, std::string>> candidates;
+  for (const auto& preamble : _sizes)
+    if (!_pinned.count(preamble.first))
+    {
+      boost::system::error_code ec;
+      std::time_t lastUse = fs::last_write_time(
+        manifestPath(preamble.first), ec);
+      candidates.emplace_back(ec ? 0 : lastUse, preamble.first);
+    }
+
+  std::sort(candidates.begin(), candidates.end());
+
+  for (const auto& candidate : candidates)
+  {
+    if (_totalBytes <= _maxBytes)
+      break;
+
+    remove(candidate.second);
+    ++_statistics.evicted;
+  }
+}
+
+} // parser
+} // cc
@@ -0,0 +1,135 @@
+#ifndef CC_PARSER_PREAMBLESTORE_H
+#define CC_PARSER_PREAMBLESTORE_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace cc
+{
+namespace parser
+{
+
+/**
+ * Disk store of the precompiled headers built from the common #include
+ * prefix of translation units. Every preamble is identified by a key which
+ * covers the compiler flags and the text of the prefix. Next to the
+ * precompiled header a manifest lists its input files with the hash of their
+ * content, so a preamble is rebuilt if any header it contains has changed.
+ *
+ * The total size of the precompiled headers is kept under a limit by removing
+ * the least recently used ones. The preambles used by the current run are
+ * never removed. The store is thread safe.
+ */
+class PreambleStore
+{
+public:
+  struct Statistics
+  {
+    std::uint64_t reused = 0;
+    std::uint64_t built = 0;
+    std::uint64_t evicted = 0;
+  };
+
+  /**
+   * @param dir_ The directory of the store. It is created if it doesn't exist.
+   * @param maxBytes_ The maximum total size of the precompiled headers.
+   */
+  PreambleStore(const std::string& dir_, std::uint64_t maxBytes_);
+
+  /**
+   * Returns the leading #include directives of a source file, or an empty
+   * string if it doesn't start with an #include. Only blank lines and
+   * comments may be mixed with the directives. The quoted includes which are
+   * found next to the source file are rewritten to absolute paths, so the
+   * prefix can be compiled from another directory.
+   */
+  static std::string includePrefix(const std::string& sourcePath_);
+
+  /**
+   * Computes the key of a preamble from the compiler flags (without the
+   * source and output files) and the include prefix.
+   */
+  static std::string key(
+    const std::vector<std::string>& flags_,
+    const std::string& prefix_);
+
+  /**
+   * Returns the path of an up to date precompiled header for the key, or an
+   * empty string if it has to be built.
+   */
+  std::string acquire(const std::string& key_);
+
+  /**
+   * Path of the header file from which the preamble is built.
+   */
+  std::string headerPath(const std::string& key_) const;
+
+  /**
+   * Path of the precompiled header.
+   */
+  std::string pchPath(const std::string& key_) const;
+
+  /**
+   * Registers a precompiled header which has been built to pchPath(). Older
+   * preambles are evicted if the size limit is exceeded.
+   * @param inputs_ The files which the precompiled header was built from.
+   * @return False if the preamble doesn't fit into the store, in which case
+   * it is removed.
+   */
+  bool commit(const std::string& key_, const std::vector<std::string>& inputs_);
+
+  /**
+   * Removes the files of a preamble which failed to build.
+   */
+  void discard(const std::string& key_);
+
+  Statistics statistics() const;
+
+private:
+  /**
+   * Returns the hash of a file's content or 0 if it can't be read.
+   */
+  static std::uint64_t contentHash(const std::string& path_);
+
+  std::string manifestPath(const std::string& key_) const;
+
+  /**
+   * Checks the content hashes in the manifest of the preamble.
+   */
+  bool isUpToDate(const std::string& key_) const;
+
+  void remove(const std::string& key_);
+
+  /**
+   * Removes unused preambles, the least recently used first, until the size
+   * limit is kept. The caller must hold _mutex.
+   */
+  void evict();
+
+  const std::string _dir;
+  const std::uint64_t _maxBytes;
+
+  mutable std::mutex _mutex;
+
+  /**
+   * The size of the precompiled headers in the store.
+   */
+  std::map<std::string, std::uint64_t> _sizes;
+
+  /**
+   * The preambles acquired or built by this run.
+   */
+  std::set<std::string> _pinned;
+
+  std::uint64_t _totalBytes;
+  Statistics _statistics;
+};
+
+} // parser
+} // cc
+
+#endif // CC_PARSER_PREAMBLESTORE_H
@@ -7,6 +7,17 @@
 #include "symbolhelper.h"
 #include "relationcollector.h"
 
+namespace
+{
+
+/**
+ * Separates the edge ids from the other ids in the shared id table.
+ */
+const std::uint64_t sharedEdgeIdMask = 0xa54ff53a5f1d36f1ULL;
+const std::uint64_t sharedEdgeAttributeIdMask = 0x510e527fade682d1ULL;
+
+} // namespace
+
 namespace cc
 {
 namespace parser
@@ -15,6 +26,8 @@ namespace parser
 std::unordered_set<model::CppEdgeId> RelationCollector::_edgeCache;
 std::unordered_set<model::CppEdgeAttributeId> RelationCollector::_edgeAttrCache;
 std::mutex RelationCollector::_edgeCacheMutex;
+bool RelationCollector::_cacheLoaded = false;
+std::shared_ptr<util::SharedIdMap> RelationCollector::_sharedIds;
 
 RelationCollector::RelationCollector(
   ParserContext& ctx_,
@@ -25,20 +38,63 @@ RelationCollector::RelationCollector(
   // Fill edge cache on first object initialization
   // Note that the caches are static members.
   std::lock_guard<std::mutex> cacheLock(_edgeCacheMutex);
-  if (_edgeCache.empty())
+  if (!_cacheLoaded)
+    loadCache(_ctx);
+}
+
+void RelationCollector::init(ParserContext& ctx_)
+{
+  std::lock_guard<std::mutex> cacheLock(_edgeCacheMutex);
+  loadCache(ctx_);
+}
+
+void RelationCollector::loadCache(ParserContext& ctx_)
+{
+  util::OdbTransaction{ctx_.db}([&ctx_]
   {
-    util::OdbTransaction{_ctx.db}([this]
+    for (const model::CppEdge &edge : ctx_.db->query<model::CppEdge>())
     {
-      for (const model::CppEdge &edge : _ctx.db->query<model::CppEdge>())
-      {
-        _edgeCache.insert(edge.id);
-      }
-      for (const model::CppEdgeAttribute &edgeAttr : _ctx.db->query<model::CppEdgeAttribute>())
-      {
-        _edgeAttrCache.insert(edgeAttr.id);
-      }
-    }); // end of transaction
-  }
+      insertEdge(edge.id);
+    }
+    for (const model::CppEdgeAttribute &edgeAttr : ctx_.db->query<model::CppEdgeAttribute>())
+    {
+      insertEdgeAttribute(edgeAttr.id);
+    }
+  }); // end of transaction
+
+  _cacheLoaded = true;
+}
+
+void RelationCollector::share(std::shared_ptr<util::SharedIdMap> sharedIds_)
+{
+  std::lock_guard<std::mutex> cacheLock(_edgeCacheMutex);
+
+  for (const model::CppEdgeId& id : _edgeCache)
+    sharedIds_->insert(sharedEdgeIdMask ^ id);
+  for (const model::CppEdgeAttributeId& id : _edgeAttrCache)
+    sharedIds_->insert(sharedEdgeAttributeIdMask ^ id);
+
+  _edgeCache.clear();
+  _edgeAttrCache.clear();
+  _sharedIds = std::move(sharedIds_);
+  _cacheLoaded = true;
+}
+
+bool RelationCollector::insertEdge(const model::CppEdgeId& id_)
+{
+  if (_sharedIds)
+    return _sharedIds->insert(sharedEdgeIdMask ^ id_);
+
+  return _edgeCache.insert(id_).second;
+}
+
+bool RelationCollector::insertEdgeAttribute(
+  const model::CppEdgeAttributeId& id_)
+{
+  if (_sharedIds)
+    return _sharedIds->insert(sharedEdgeAttributeIdMask ^ id_);
+
+  return _edgeAttrCache.insert(id_).second;
 }
 
 RelationCollector::~RelationCollector()
@@ -49,6 +105,14 @@ RelationCollector::~RelationCollector()
     util::persistAll(_newEdges, _ctx.db);
     util::persistAll(_newEdgeAttributes, _ctx.db);
   });
+
+  if (_sharedIds)
+  {
+    for (const model::CppEdgePtr& edge : _newEdges)
+      _sharedIds->commit(sharedEdgeIdMask ^ edge->id);
+    for (const model::CppEdgeAttributePtr& attr : _newEdgeAttributes)
+      _sharedIds->commit(sharedEdgeAttributeIdMask ^ attr->id);
+  }
 }
 
 bool RelationCollector::VisitFunctionDecl(clang::FunctionDecl* fd_)
@@ -159,6 +223,8 @@ void RelationCollector::cleanUp()
 {
   _edgeCache.clear();
   _edgeAttrCache.clear();
+  _sharedIds.reset();
+  _cacheLoaded = false;
 }
 
 void RelationCollector::addEdge(
@@ -182,7 +248,7 @@ void RelationCollector::addEdge(
   edge->type = type_;
   edge->id   = createIdentifier(*edge);
 
-  if (_edgeCache.insert(edge->id).second)
+  if (insertEdge(edge->id))
   {
     _newEdges.push_back(edge);
 
@@ -193,7 +259,7 @@ void RelationCollector::addEdge(
       attr_->edge = edge;
       attr_->id = model::createIdentifier(*attr_);
 
-      if (_edgeAttrCache.insert(attr_->id).second)
+      if (insertEdgeAttribute(attr_->id))
         _newEdgeAttributes.push_back(attr_);
     }
   }
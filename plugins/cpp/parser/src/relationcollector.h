@@ -13,6 +13,7 @@
 #include <parser/parsercontext.h>
 
 #include <util/logutil.h>
+#include <util/sharedidmap.h>
 
 #include <cppparser/filelocutil.h>
 
@@ -36,9 +37,34 @@ public:
 
   bool VisitCallExpr(clang::CallExpr* ce_);
 
+  /**
+   * Loads the ids of the edges which are already in the database. Otherwise
+   * this is done by the first collector.
+   */
+  static void init(ParserContext& ctx_);
+
+  /**
+   * Moves the edge caches into a table shared with the other parser
+   * processes, so an edge is persisted only by one of them. The table is
+   * expected to contain the edges of the database already.
+   */
+  static void share(std::shared_ptr<util::SharedIdMap> sharedIds_);
+
   static void cleanUp();
 
 private:
+  /**
+   * Fills the caches from the database. The caller must hold _edgeCacheMutex.
+   */
+  static void loadCache(ParserContext& ctx_);
+
+  /**
+   * These functions return true if the edge (attribute) hasn't been persisted
+   * before by this or (if the caches are shared) by another process.
+   */
+  static bool insertEdge(const model::CppEdgeId& id_);
+  static bool insertEdgeAttribute(const model::CppEdgeAttributeId& id_);
+
   void addEdge(
     const model::FileId& from_,
     const model::FileId& to_,
@@ -50,6 +76,8 @@ private:
   static std::unordered_set<model::CppEdgeId> _edgeCache;
   static std::unordered_set<model::CppEdgeAttributeId> _edgeAttrCache;
   static std::mutex _edgeCacheMutex;
+  static bool _cacheLoaded;
+  static std::shared_ptr<util::SharedIdMap> _sharedIds;
 
   std::vector<model::CppEdgePtr> _newEdges;
   std::vector<model::CppEdgeAttributePtr> _newEdgeAttributes;
@@ -0,0 +1,7 @@
+#include "shared.h"
+
+int first(const shared::Point& p_, const shared::Base& b_)
+{
+  shared::Counter c = shared::clamp(p_.sum());
+  return shared::twice(c) + b_.value();
+}
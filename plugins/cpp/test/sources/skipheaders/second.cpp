@@ -0,0 +1,9 @@
+#include "shared.h"
+
+int second(const shared::Derived& d_, shared::Color color_)
+{
+  if (color_ == shared::Color::Red)
+    return shared::twice(d_.value());
+
+  return shared::clamp(static_cast<int>(color_));
+}
@@ -0,0 +1,52 @@
+#ifndef CC_TEST_SHARED_H
+#define CC_TEST_SHARED_H
+
+#define SHARED_LIMIT 10
+
+namespace shared
+{
+
+enum class Color
+{
+  Red,
+  Green,
+  Blue
+};
+
+typedef int Counter;
+
+struct Point
+{
+  int x;
+  int y;
+
+  int sum() const { return x + y; }
+};
+
+class Base
+{
+public:
+  virtual ~Base() {}
+  virtual int value() const { return 0; }
+};
+
+class Derived : public Base
+{
+public:
+  int value() const override { return SHARED_LIMIT; }
+};
+
+inline Counter clamp(Counter c_)
+{
+  return c_ > SHARED_LIMIT ? SHARED_LIMIT : c_;
+}
+
+template <typename T>
+T twice(const T& t_)
+{
+  return t_ + t_;
+}
+
+} // shared
+
+#endif // CC_TEST_SHARED_H
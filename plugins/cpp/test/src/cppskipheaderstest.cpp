@@ -0,0 +1,119 @@
+#define GTEST_HAS_TR1_TUPLE 1
+#define GTEST_USE_OWN_TR1_TUPLE 0
+
+#include <set>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <model/cppastnode.h>
+#include <model/cppastnode-odb.hxx>
+#include <model/cppedge.h>
+#include <model/cppedge-odb.hxx>
+#include <model/file.h>
+#include <model/file-odb.hxx>
+
+#include <util/dbutil.h>
+#include <util/odbtransaction.h>
+
+/**
+ * The same project is parsed into both databases, into the second one with
+ * --cpp-skip-indexed-headers.
+ */
+const char* dbConnectionString;
+const char* skipDbConnectionString;
+
+using namespace cc;
+
+namespace
+{
+
+std::set<std::string> astNodes(const std::shared_ptr<odb::database>& db_)
+{
+  std::set<std::string> nodes;
+
+  util::OdbTransaction {db_} ([&] {
+    for (const model::CppAstNode& node : db_->query<model::CppAstNode>())
+      nodes.insert(node.toString());
+  });
+
+  return nodes;
+}
+
+std::set<std::string> edges(const std::shared_ptr<odb::database>& db_)
+{
+  std::set<std::string> edges;
+
+  util::OdbTransaction {db_} ([&] {
+    for (const model::CppEdge& edge : db_->query<model::CppEdge>())
+      edges.insert(edge.toString());
+  });
+
+  return edges;
+}
+
+} // namespace
+
+class CppSkipHeadersTest : public ::testing::Test
+{
+public:
+  CppSkipHeadersTest() :
+    _db(util::connectDatabase(dbConnectionString)),
+    _skipDb(util::connectDatabase(skipDbConnectionString))
+  {
+  }
+
+protected:
+  std::shared_ptr<odb::database> _db;
+  std::shared_ptr<odb::database> _skipDb;
+};
+
+TEST_F(CppSkipHeadersTest, SharedHeaderIsParsed)
+{
+  util::OdbTransaction {_skipDb} ([&, this] {
+    model::File header = _skipDb->query_value<model::File>(
+      odb::query<model::File>::filename == "shared.h");
+
+    EXPECT_FALSE(_skipDb->query<model::CppAstNode>(
+      odb::query<model::CppAstNode>::location.file == header.id).empty());
+  });
+}
+
+TEST_F(CppSkipHeadersTest, AstNodesAreIdentical)
+{
+  std::set<std::string> nodes = astNodes(_db);
+
+  EXPECT_FALSE(nodes.empty());
+  EXPECT_EQ(nodes, astNodes(_skipDb));
+}
+
+TEST_F(CppSkipHeadersTest, EdgesAreIdentical)
+{
+  std::set<std::string> nodeEdges = edges(_db);
+
+  EXPECT_FALSE(nodeEdges.empty());
+  EXPECT_EQ(nodeEdges, edges(_skipDb));
+}
+
+int main(int argc, char** argv)
+{
+  dbConnectionString = argv[3];
+  skipDbConnectionString = argv[4];
+  if (strcmp(dbConnectionString, "") == 0)
+  {
+    GTEST_LOG_(FATAL) << "No test database connection given.";
+    return 1;
+  }
+
+  GTEST_LOG_(INFO) << "Testing skipped C++ headers started...";
+  GTEST_LOG_(INFO) << "Executing build command: " << argv[1];
+  system(argv[1]);
+
+  GTEST_LOG_(INFO) << "Executing parser command: " << argv[2];
+  system(argv[2]);
+
+  GTEST_LOG_(INFO) << "Using databases for tests: " << dbConnectionString
+                   << ", " << skipDbConnectionString;
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
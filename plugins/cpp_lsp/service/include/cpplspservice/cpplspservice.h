@@ -31,125 +31,125 @@ public:
   // Standard LSP methods
 
   void getDefinition(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getDeclaration(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getImplementation(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getReferences(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   // Extended LSP methods
 
   void getDiagramTypes(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getDiagram(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getModuleDiagram(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getSignature(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getParameters(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getLocalVariables(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getOverridden(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getOverrider(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getRead(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getWrite(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getMethods(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getFriends(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getEnumConstants(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getExpansion(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getUndefinition(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getThisCalls(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getCallsOfThis(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getCallee(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getCaller(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getVirtualCall(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getFunctionPointerCall(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getAlias(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getImplements(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getDataMember(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
   void getUnderlyingType(
-    pt::ptree& responseTree_,
+    Response& response_,
     const pt::ptree& params_) override final;
 
 private:
-  void fillResponseTree(pt::ptree& responseTree_,
+  void fillResponse(Response& response_,
     const pt::ptree& params_,
     language::CppServiceHandler::ReferenceType refType_,
     bool canBeSingle_ = true);
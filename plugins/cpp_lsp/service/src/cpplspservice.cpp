@@ -3,6 +3,7 @@
 #include <iterator>
 #include <stack>
 #include <string>
+#include <unordered_map>
 
 #include <boost/property_tree/json_parser.hpp>
 
@@ -27,7 +28,7 @@ CppLspServiceHandler::CppLspServiceHandler(
 {
 }
 
-void CppLspServiceHandler::fillResponseTree(pt::ptree& responseTree_,
+void CppLspServiceHandler::fillResponse(Response& response_,
   const pt::ptree& params_,
   language::CppServiceHandler::ReferenceType refType_,
   bool canBeSingle_)
@@ -39,16 +40,11 @@ void CppLspServiceHandler::fillResponseTree(pt::ptree& responseTree_,
 
   if (canBeSingle_ && locations.size() == 1)
   {
-    responseTree_.put_child("result", locations[0].createNode());
+    response_.setResult(locations[0]);
   }
-  else if (locations.size() > 1)
+  else if (locations.size() > 1 || !canBeSingle_)
   {
-    pt::ptree resultNode;
-    for (const Location &location : locations)
-    {
-      resultNode.push_back(std::make_pair("", location.createNode()));
-    }
-    responseTree_.put_child("result", resultNode);
+    response_.setResult(locations);
   }
 }
 
@@ -76,31 +72,36 @@ std::vector<Location> CppLspServiceHandler::responseLocations(
   std::vector<language::AstNodeInfo> nodeInfos;
   _cppService.getReferences(nodeInfos, astNodeInfo.id, refType_, {});
 
-  std::vector<Location> locations(nodeInfos.size());
-  std::transform(
-    nodeInfos.begin(), nodeInfos.end(),
-    locations.begin(),
-    [&, this](const language::AstNodeInfo& nodeInfo)
+  // Files are loaded once per request, since the locations of a long
+  // reference list usually point into just a few files.
+  std::unordered_map<std::string, std::string> paths;
+  std::vector<Location> locations;
+  locations.reserve(nodeInfos.size());
+
+  _transaction([&, this](){
+    for (const language::AstNodeInfo& nodeInfo : nodeInfos)
     {
-      std::string path = _transaction([&, this](){
-        return _db->load<model::File>(std::stoull(nodeInfo.range.file))->path;
-      });
+      auto it = paths.find(nodeInfo.range.file);
+      if (it == paths.end())
+        it = paths.emplace(nodeInfo.range.file, _db->load<model::File>(
+          std::stoull(nodeInfo.range.file))->path).first;
 
       Location location;
-      location.uri = path;
+      location.uri = it->second;
       location.range.start.line = nodeInfo.range.range.startpos.line;
       location.range.start.character = nodeInfo.range.range.startpos.column;
       location.range.end.line = nodeInfo.range.range.endpos.line;
       location.range.end.character = nodeInfo.range.range.endpos.column;
 
-      return location;
-    });
+      locations.push_back(std::move(location));
+    }
+  });
 
   return locations;
 }
 
 void CppLspServiceHandler::getSignature(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
   TextDocumentPositionParams positionParams;
@@ -122,263 +123,263 @@ void CppLspServiceHandler::getSignature(
 
     _cppService.getAstNodeInfoByPosition(astNodeInfo, cppPosition);
 
-    responseTree_.put("result", astNodeInfo.astNodeValue);
+    response_.setResult(astNodeInfo.astNodeValue);
   }
 }
 
 void CppLspServiceHandler::getDefinition(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::DEFINITION);
 }
 
 void CppLspServiceHandler::getDeclaration(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::DECLARATION);
 }
 
 void CppLspServiceHandler::getImplementation(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::INHERIT_BY);
 }
 
 void CppLspServiceHandler::getReferences(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::USAGE,
     false); // the result must always be a vector
 }
 
 void CppLspServiceHandler::getParameters(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::PARAMETER);
 }
 
 void CppLspServiceHandler::getLocalVariables(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::LOCAL_VAR);
 }
 
 void CppLspServiceHandler::getOverridden(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::OVERRIDE);
 }
 
 void CppLspServiceHandler::getOverrider(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::OVERRIDDEN_BY);
 }
 
 void CppLspServiceHandler::getRead(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::READ);
 }
 
 void CppLspServiceHandler::getWrite(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::WRITE);
 }
 
 void CppLspServiceHandler::getMethods(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::METHOD);
 }
 
 void CppLspServiceHandler::getFriends(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::FRIEND);
 }
 
 void CppLspServiceHandler::getEnumConstants(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::ENUM_CONSTANTS);
 }
 
 void CppLspServiceHandler::getExpansion(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::EXPANSION);
 }
 
 void CppLspServiceHandler::getUndefinition(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::UNDEFINITION);
 }
 
 void CppLspServiceHandler::getThisCalls(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::THIS_CALLS);
 }
 
 void CppLspServiceHandler::getCallsOfThis(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::CALLS_OF_THIS);
 }
 
 void CppLspServiceHandler::getCallee(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::CALLEE);
 }
 
 void CppLspServiceHandler::getCaller(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::CALLER);
 }
 
 void CppLspServiceHandler::getVirtualCall(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::VIRTUAL_CALL);
 }
 
 void CppLspServiceHandler::getFunctionPointerCall(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::FUNC_PTR_CALL);
 }
 
 void CppLspServiceHandler::getAlias(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::ALIAS);
 }
 
 void CppLspServiceHandler::getImplements(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::INHERIT_FROM);
 }
 
 void CppLspServiceHandler::getDataMember(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::DATA_MEMBER);
 }
 
 void CppLspServiceHandler::getUnderlyingType(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  fillResponseTree(
-    responseTree_,
+  fillResponse(
+    response_,
     params_,
     language::CppServiceHandler::UNDERLYING_TYPE);
 }
 
 void CppLspServiceHandler::getDiagramTypes(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
   DiagramTypeParams diagramTypeParams;
@@ -394,12 +395,7 @@ void CppLspServiceHandler::getDiagramTypes(
     diagramTypesResult = nodeDiagramTypes(diagramTypeParams);
   }
 
-  pt::ptree resultNode;
-  for (const std::string& diagramType : diagramTypesResult)
-  {
-    resultNode.push_back(std::make_pair("", pt::ptree(diagramType)));
-  }
-  responseTree_.put_child("result", resultNode);
+  response_.setResult(diagramTypesResult);
 }
 
 std::vector<std::string> CppLspServiceHandler::fileDiagramTypes(
@@ -461,7 +457,7 @@ std::vector<std::string> CppLspServiceHandler::nodeDiagramTypes(
 }
 
 void CppLspServiceHandler::getDiagram(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
   DiagramParams diagramParams;
@@ -477,14 +473,14 @@ void CppLspServiceHandler::getDiagram(
     diagramResult = nodeDiagram(diagramParams);
   }
 
-  responseTree_.put("result", diagramResult);
+  response_.setResult(diagramResult);
 }
 
 void CppLspServiceHandler::getModuleDiagram(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree& params_)
 {
-  getDiagram(responseTree_, params_);
+  getDiagram(response_, params_);
 }
 
 Diagram CppLspServiceHandler::fileDiagram(
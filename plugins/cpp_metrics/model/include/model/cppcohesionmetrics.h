@@ -41,6 +41,9 @@ struct CohesionCppRecord_Count
   query(CppMemberType::kind == cc::model::CppMemberType::Kind::Field && (?))
 struct CohesionCppFieldView
 {
+  #pragma db column(CppMemberType::typeHash)
+  std::size_t typeHash;
+
   #pragma db column(CppAstNode::entityHash)
   std::size_t entityHash;
 };
@@ -54,6 +57,12 @@ struct CohesionCppMethodView
 {
   typedef cc::model::Position::PosType PosType;
 
+  #pragma db column(CppMemberType::typeHash)
+  std::size_t typeHash;
+
+  #pragma db column(CppAstNode::entityHash)
+  std::size_t entityHash;
+
   #pragma db column(CppAstNode::location.range.start.line)
   PosType startLine;
   #pragma db column(CppAstNode::location.range.start.column)
@@ -92,6 +101,20 @@ struct CohesionCppAstNodeView
   std::string filePath;
 };
 
+#pragma db view \
+  object(CppAstNode) \
+  query(CppAstNode::symbolType == cc::model::CppAstNode::SymbolType::Function \
+    && CppAstNode::astType == cc::model::CppAstNode::AstType::Definition \
+    && (?))
+struct CppFunctionDefinitionView
+{
+  #pragma db column(CppAstNode::entityHash)
+  std::uint64_t entityHash;
+
+  #pragma db column(CppAstNode::id)
+  CppAstNodeId astNodeId;
+};
+
 } //model
 } //cc
 
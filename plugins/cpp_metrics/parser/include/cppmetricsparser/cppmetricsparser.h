@@ -1,6 +1,16 @@
 #ifndef CC_PARSER_CPPMETRICSPARSER_H
 #define CC_PARSER_CPPMETRICSPARSER_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
 #include <parser/abstractparser.h>
 #include <parser/parsercontext.h>
 
@@ -52,6 +62,17 @@ private:
   std::size_t _size;
 };
 
+/// The worker function type of CppMetricsParser::parallelCalcMetric: it
+/// computes the metrics of a partition of tasks into the result vector.
+/// (Wrapped in a class so that it does not take part in template argument
+/// deduction.)
+template<typename TTask, typename TMetric>
+struct MetricsWorker
+{
+  typedef std::function<void(
+    const MetricsTasks<TTask>&,
+    std::vector<TMetric>&)> type;
+};
 
 class CppMetricsParser : public AbstractParser
 {
@@ -67,6 +88,11 @@ public:
     return true;
   }
 
+  virtual std::vector<std::string> getDependencies() const override
+  {
+    return {"cppparser"};
+  }
+
 private:
   // Calculate the count of parameters for every function.
   void functionParameters();
@@ -91,12 +117,17 @@ private:
   void relationalCohesionModuleLevel();
   // Returns module path query based on parser configuration.
   odb::query<model::File> getModulePathsQuery();
+  // Returns module path queries restricted to the affected modules.
+  std::vector<odb::query<model::File>> getModulePathsQueries();
   // Returns cohesion record query based on parser configuration.
   odb::query<model::CohesionCppRecordView> getCohesionRecordQuery();
+  // Returns cohesion record queries restricted to the affected types.
+  std::vector<odb::query<model::CohesionCppRecordView>> getCohesionRecordQueries();
 
-  // Returns metric function query based on parser configuration.
+  // Returns metric function queries based on parser configuration,
+  // restricted to the functions of the changed files.
   template<typename TQueryParam>
-  odb::query<TQueryParam> getFunctionQuery() const
+  std::vector<odb::query<TQueryParam>> getFunctionQueries() const
   {
     odb::query<TQueryParam> query = getFilterPathsQuery<TQueryParam>();
 
@@ -104,9 +135,48 @@ private:
       query = query && odb::query<TQueryParam>::CppFunction::inLambdaObject == false;
     }
 
-    return query;
+    return getIncrementalQueries(
+      query, odb::query<TQueryParam>::File::id, _changedFileIds);
   }
 
+  /// @brief Restricts a query to the records whose column_ is among ids_
+  /// when the metrics are recomputed incrementally.
+  /// @return The query itself on a full recomputation, otherwise one query
+  /// per chunk of ids_, or none if ids_ is empty.
+  template<typename TQueryParam, typename TColumn, typename TId>
+  std::vector<odb::query<TQueryParam>> getIncrementalQueries(
+    const odb::query<TQueryParam>& query_,
+    const TColumn& column_,
+    const std::vector<TId>& ids_) const
+  {
+    if (!_incremental)
+      return {query_};
+
+    std::vector<odb::query<TQueryParam>> queries;
+    forEachChunk(ids_.begin(), ids_.end(), [&](auto begin_, auto end_)
+    {
+      queries.push_back(query_ && column_.in_range(begin_, end_));
+    });
+    return queries;
+  }
+
+  /// @brief Collects the files, types and modules whose metrics have to be
+  /// recomputed because of the changed files of an incremental parse, and
+  /// removes their stale metrics.
+  void collectAffectedEntities();
+
+  /// @brief Collects the types defined in the given files or whose methods
+  /// are defined there, and the types and paths on both ends of their type
+  /// dependencies. Must be called inside a transaction.
+  /// @param affectedTypes_ The types of the files and the types they depend
+  /// on or which depend on them are added to this set.
+  /// @param affectedPaths_ The files defining the types on either end of
+  /// these dependencies are added to this set.
+  void collectDependentTypes(
+    const std::vector<model::FileId>& fileIds_,
+    std::unordered_set<std::uint64_t>& affectedTypes_,
+    std::unordered_set<std::string>& affectedPaths_);
+
   /// @brief Constructs an ODB query that you can use to filter only
   /// the database records of the given parameter type whose path
   /// is rooted under any of this parser's input paths.
@@ -122,38 +192,60 @@ private:
   }
 
   /// @brief Calculates a metric by querying all objects of the
-  /// specified parameter type and passing them one-by-one to the
-  /// specified worker function on parallel threads.
-  /// This call blocks the caller thread until all workers are finished.
+  /// specified parameter type and passing them in partitions to the
+  /// specified worker function on the threads of the shared pool.
+  /// The worker is expected to prefetch everything it needs for its whole
+  /// partition with a few set-based queries, and to return the computed
+  /// metrics, which are then persisted in a single transaction per partition.
+  /// This call blocks the caller thread until the partitions of this metric
+  /// are finished. The partitions of other metrics may be calculated on the
+  /// pool meanwhile.
+  /// @throw std::runtime_error if the calculation of a partition failed.
   /// @tparam TQueryParam The type of parameters to query.
+  /// @tparam TMetric The type of the metric records produced by the workers.
   /// @param name_ The name of the metric (for progress logging).
   /// @param partitions_ The number of jobs to partition the query into.
-  /// @param query_ A filter query for retrieving only
+  /// @param queries_ Filter queries for retrieving only
   /// the eligible parameters for which a worker should be spawned.
   /// @param worker_ The logic of the worker thread.
-  template<typename TQueryParam>
+  template<typename TQueryParam, typename TMetric = model::CppAstNodeMetrics>
   void parallelCalcMetric(
     const char* name_,
     std::size_t partitions_,
-    const odb::query<TQueryParam>& query_,
-    const std::function<void(const MetricsTasks<TQueryParam>&)>& worker_)
+    const std::vector<odb::query<TQueryParam>>& queries_,
+    const typename MetricsWorker<TQueryParam, TMetric>::type& worker_)
   {
     typedef MetricsTasks<TQueryParam> TMetricsTasks;
     typedef typename TMetricsTasks::TTaskIter TTaskIter;
     typedef std::pair<std::size_t, TMetricsTasks> TJobParam;
 
-    // Define the thread pool and job wrapper function.
-    LOG(info) << name_ << " : Collecting jobs from database...";
-    std::unique_ptr<util::JobQueueThreadPool<TJobParam>> pool =
-      util::make_thread_pool<TJobParam>(_threadCount,
-        [&](const TJobParam& job)
+    const auto startTime = std::chrono::steady_clock::now();
+    std::atomic<std::size_t> rowCount(0);
+
+    // The job wrapper function, which runs on the shared pool.
+    auto calcPartition = [&](const TJobParam& job)
+    {
+      LOG(debug) << '(' << job.first << '/' << partitions_
+        << ") " << name_;
+
+      std::vector<TMetric> results;
+      worker_(job.second, results);
+
+      util::OdbTransaction {_ctx.db} ([&, this]
       {
-        LOG(debug) << '(' << job.first << '/' << partitions_
-          << ") " << name_;
-        worker_(job.second);
+        for (TMetric& result : results)
+          _ctx.db->persist(result);
       });
+      rowCount += results.size();
+    };
+
+    std::size_t pending = 0;
+    std::mutex pendingMutex;
+    std::condition_variable pendingCond;
+    std::atomic<bool> failed(false);
 
     // Cache the results of the query that will be dispatched to workers.
+    LOG(info) << name_ << " : Collecting jobs from database...";
     std::vector<TQueryParam> tasks;
     util::OdbTransaction {_ctx.db} ([&, this]
     {
@@ -161,8 +253,9 @@ private:
       // on it does not work: odb::result<>::size() will always throw
       // odb::result_not_cached. As of writing, this is a limitation of SQLite.
       // So we fall back to the old-fashioned way: std::vector<> in memory.
-      for (const TQueryParam& param : _ctx.db->query<TQueryParam>(query_))
-        tasks.emplace_back(param);
+      for (const odb::query<TQueryParam>& query : queries_)
+        for (const TQueryParam& param : _ctx.db->query<TQueryParam>(query))
+          tasks.emplace_back(param);
     });
 
     // Ensure that all workers receive at least one task.
@@ -171,8 +264,9 @@ private:
       partitions_ = taskCount;
 
     // Dispatch jobs to workers in discrete packets.
-    LOG(info) << name_ << " : Dispatching jobs on "
-      << _threadCount << " thread(s)...";
+    LOG(info) << name_ << " : Dispatching " << partitions_ << " jobs...";
+    pending = partitions_;
+
     std::size_t prev = 0;
     TTaskIter it_prev = tasks.cbegin();
 
@@ -184,44 +278,163 @@ private:
       TTaskIter it_next = it_prev;
       std::advance(it_next, size);
 
-      pool->enqueue(TJobParam(i, TMetricsTasks(it_prev, it_next, size)));
+      TJobParam job(i, TMetricsTasks(it_prev, it_next, size));
+      _pool->enqueue([&, job]
+      {
+        // A failed partition must not keep the caller waiting, nor take the
+        // pool thread down.
+        try
+        {
+          calcPartition(job);
+        }
+        catch (const std::exception& ex)
+        {
+          LOG(error) << '(' << job.first << '/' << partitions_ << ") "
+            << name_ << " failed: " << ex.what();
+          failed = true;
+        }
+        catch (...)
+        {
+          LOG(error) << '(' << job.first << '/' << partitions_ << ") "
+            << name_ << " failed with an unknown exception.";
+          failed = true;
+        }
+
+        // The condition variable is notified under the lock, so it isn't
+        // destroyed by the returning caller in the meantime.
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        if (--pending == 0)
+          pendingCond.notify_all();
+      });
 
       prev = next;
       it_prev = it_next;
     }
 
-    // Await the termination of all workers.
-    pool->wait();
+    // Await the partitions of this metric.
+    {
+      std::unique_lock<std::mutex> lock(pendingMutex);
+      pendingCond.wait(lock, [&]{ return pending == 0; });
+    }
+
+    if (failed)
+      throw std::runtime_error(
+        std::string(name_) + " : Calculation of a partition failed.");
+
     LOG(info) << name_ << " : Calculation finished.";
+
+    std::lock_guard<std::mutex> lock(_metricStatsMutex);
+    _metricStats.push_back({
+      name_,
+      taskCount,
+      rowCount,
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - startTime)});
   }
 
   /// @brief Calculates a metric by querying all objects of the
-  /// specified parameter type and passing them one-by-one to the
+  /// specified parameter type and passing them in partitions to the
   /// specified worker function on parallel threads.
   /// This call blocks the caller thread until all workers are finished.
   /// @tparam TQueryParam The type of parameters to query.
+  /// @tparam TMetric The type of the metric records produced by the workers.
   /// @param name_ The name of the metric (for progress logging).
   /// @param partitions_ The number of jobs to partition the query into.
   /// @param worker_ The logic of the worker thread.
-  template<typename TQueryParam>
+  template<typename TQueryParam, typename TMetric = model::CppAstNodeMetrics>
   void parallelCalcMetric(
     const char* name_,
     std::size_t partitions_,
-    const std::function<void(const MetricsTasks<TQueryParam>&)>& worker_)
+    const typename MetricsWorker<TQueryParam, TMetric>::type& worker_)
   {
-    parallelCalcMetric<TQueryParam>(
+    parallelCalcMetric<TQueryParam, TMetric>(
       name_,
       partitions_,
-      odb::query<TQueryParam>(),
+      {odb::query<TQueryParam>()},
       worker_);
   }
 
+  /// @brief Calls func_ with consecutive subranges of [begin_, end_), each
+  /// small enough to be used in an IN (...) clause on every database backend
+  /// (SQLite limits the number of host parameters of a statement).
+  template<typename TIter, typename TFunc>
+  static void forEachChunk(TIter begin_, TIter end_, TFunc func_)
+  {
+    while (begin_ != end_)
+    {
+      TIter next = begin_;
+      for (std::size_t i = 0; i < inClauseChunkSize && next != end_; ++i)
+        ++next;
+
+      func_(begin_, next);
+      begin_ = next;
+    }
+  }
+
+  /// @brief Returns the AST node IDs among astNodeIds_ whose entity
+  /// has the given tag. Must be called inside a transaction.
+  std::unordered_set<model::CppAstNodeId> getTaggedEntities(
+    const std::vector<model::CppAstNodeId>& astNodeIds_,
+    model::Tag tag_);
+
+  /// @brief A metric calculation and the names of the other metric
+  /// calculations whose results it reads.
+  struct MetricPass
+  {
+    std::string name;
+    std::vector<std::string> dependencies;
+    std::function<void()> run;
+  };
+
+  /// @brief Runs the metric calculations as a dependency graph: a pass is
+  /// started as soon as its dependencies have finished, each on a thread of
+  /// its own which dispatches its partitions to the shared pool. This way
+  /// the threads of the pool aren't idle during the serial parts of a pass.
+  /// This call blocks the caller thread until all passes are finished.
+  /// A pass which throws fails, and the passes depending on it are skipped.
+  /// @return False if a pass failed or was skipped, or the dependencies of
+  /// the passes can't be satisfied.
+  bool runMetricPasses(const std::vector<MetricPass>& passes_);
+
+  /// @brief Logs the time and the number of computed rows of each metric
+  /// calculated so far.
+  /// @param wallTime_ The time of the whole metrics phase.
+  void logMetricStats(std::chrono::milliseconds wallTime_) const;
+
+  struct MetricStats
+  {
+    std::string name;
+    std::size_t tasks;
+    std::size_t rows;
+    std::chrono::milliseconds time;
+  };
 
   int _threadCount;
+  std::unique_ptr<util::JobQueueThreadPool<std::function<void()>>> _pool;
   std::vector<std::string> _inputPaths;
   std::unordered_set<model::FileId> _fileIdCache;
   std::unordered_map<model::CppAstNodeId, model::FileId> _astNodeIdCache;
 
+  // True if only the metrics affected by the changed files are recomputed.
+  bool _incremental = false;
+  // The files parsed again by the incremental parse.
+  std::vector<model::FileId> _changedFileIds;
+  // The types whose metrics change because of the changed files.
+  std::vector<std::uint64_t> _affectedTypeHashes;
+  // The modules containing changed files or affected types.
+  std::vector<model::FileId> _affectedModuleIds;
+  // The types and their files which were in a dependency with a type of the
+  // changed files before the C++ parser removed the dependencies of these
+  // files. E.g. the afferent coupling of a type changes when a changed file
+  // no longer depends on it, but no dependency is left to find it by.
+  std::unordered_set<std::uint64_t> _formerDependentTypes;
+  std::unordered_set<std::string> _formerDependentPaths;
+
+  std::vector<MetricStats> _metricStats;
+  mutable std::mutex _metricStatsMutex;
+
+  static const std::size_t inClauseChunkSize = 500;
+
   static const int functionParamsPartitionMultiplier = 5;
   static const int functionMcCabePartitionMultiplier = 5;
   static const int functionBumpyRoadPartitionMultiplier = 5;
@@ -22,7 +22,13 @@
 #include <util/filesystem.h>
 #include <util/logutil.h>
 
+#include <algorithm>
+#include <map>
 #include <memory>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace cc
 {
@@ -55,6 +61,41 @@ CppMetricsParser::CppMetricsParser(ParserContext& ctx_): AbstractParser(ctx_)
 
 bool CppMetricsParser::cleanupDatabase()
 {
+  if (!_fileIdCache.empty() || !_astNodeIdCache.empty())
+  {
+    // The type dependencies of the changed files are removed by the cleanup
+    // of the C++ parser, which runs after this one, so the types on their
+    // other end are looked up now.
+    try
+    {
+      std::vector<std::string> changedPaths;
+      for (const auto& item : _ctx.fileStatus)
+        if (item.second != IncrementalStatus::ADDED)
+          changedPaths.push_back(item.first);
+
+      util::OdbTransaction {_ctx.db} ([&, this] {
+        std::vector<model::FileId> changedFileIds;
+        forEachChunk(changedPaths.begin(), changedPaths.end(),
+          [&, this](auto begin_, auto end_)
+        {
+          for (const model::File& file : _ctx.db->query<model::File>(
+            odb::query<model::File>::path.in_range(begin_, end_)))
+          {
+            changedFileIds.push_back(file.id);
+          }
+        });
+
+        collectDependentTypes(
+          changedFileIds, _formerDependentTypes, _formerDependentPaths);
+      });
+    }
+    catch (odb::database_exception&)
+    {
+      LOG(fatal) << "Transaction failed in cxxmetrics parser!";
+      return false;
+    }
+  }
+
   if (!_fileIdCache.empty())
   {
     try
@@ -105,25 +146,45 @@ bool CppMetricsParser::cleanupDatabase()
   return true;
 }
 
+std::unordered_set<model::CppAstNodeId> CppMetricsParser::getTaggedEntities(
+  const std::vector<model::CppAstNodeId>& astNodeIds_,
+  model::Tag tag_)
+{
+  typedef odb::query<model::CppEntity> EntityQuery;
+
+  std::unordered_set<model::CppAstNodeId> tagged;
+  forEachChunk(astNodeIds_.begin(), astNodeIds_.end(),
+    [&, this](auto begin_, auto end_)
+  {
+    for (const model::CppEntity& entity : _ctx.db->query<model::CppEntity>(
+      EntityQuery::astNodeId.in_range(begin_, end_)))
+    {
+      if (entity.tags.find(tag_) != entity.tags.cend())
+        tagged.insert(entity.astNodeId);
+    }
+  });
+
+  return tagged;
+}
+
 void CppMetricsParser::functionParameters()
 {
   parallelCalcMetric<model::CppFunctionParamCountWithId>(
     "Function parameters",
     _threadCount * functionParamsPartitionMultiplier,// number of jobs; adjust for granularity
-    getFunctionQuery<model::CppFunctionParamCountWithId>(),
-    [&, this](const MetricsTasks<model::CppFunctionParamCountWithId>& tasks)
+    getFunctionQueries<model::CppFunctionParamCountWithId>(),
+    [&, this](
+      const MetricsTasks<model::CppFunctionParamCountWithId>& tasks,
+      std::vector<model::CppAstNodeMetrics>& results)
   {
-    util::OdbTransaction {_ctx.db} ([&, this]
+    for (const model::CppFunctionParamCountWithId& param : tasks)
     {
-      for (const model::CppFunctionParamCountWithId& param : tasks)
-      {
-        model::CppAstNodeMetrics funcParams;
-        funcParams.astNodeId = param.id;
-        funcParams.type = model::CppAstNodeMetrics::Type::PARAMETER_COUNT;
-        funcParams.value = param.count;
-        _ctx.db->persist(funcParams);
-      }
-    });
+      model::CppAstNodeMetrics funcParams;
+      funcParams.astNodeId = param.id;
+      funcParams.type = model::CppAstNodeMetrics::Type::PARAMETER_COUNT;
+      funcParams.value = param.count;
+      results.push_back(funcParams);
+    }
   });
 }
 
@@ -132,20 +193,19 @@ void CppMetricsParser::functionMcCabe()
   parallelCalcMetric<model::CppFunctionMcCabe>(
     "Function-level McCabe",
     _threadCount * functionMcCabePartitionMultiplier,// number of jobs; adjust for granularity
-    getFunctionQuery<model::CppFunctionMcCabe>(),
-    [&, this](const MetricsTasks<model::CppFunctionMcCabe>& tasks)
+    getFunctionQueries<model::CppFunctionMcCabe>(),
+    [&, this](
+      const MetricsTasks<model::CppFunctionMcCabe>& tasks,
+      std::vector<model::CppAstNodeMetrics>& results)
   {
-    util::OdbTransaction {_ctx.db} ([&, this]
+    for (const model::CppFunctionMcCabe& param : tasks)
     {
-      for (const model::CppFunctionMcCabe& param : tasks)
-      {
-        model::CppAstNodeMetrics funcMcCabe;
-        funcMcCabe.astNodeId = param.astNodeId;
-        funcMcCabe.type = model::CppAstNodeMetrics::Type::MCCABE_FUNCTION;
-        funcMcCabe.value = param.mccabe;
-        _ctx.db->persist(funcMcCabe);
-      }
-    });
+      model::CppAstNodeMetrics funcMcCabe;
+      funcMcCabe.astNodeId = param.astNodeId;
+      funcMcCabe.type = model::CppAstNodeMetrics::Type::MCCABE_FUNCTION;
+      funcMcCabe.value = param.mccabe;
+      results.push_back(funcMcCabe);
+    }
   });
 }
 
@@ -155,103 +215,136 @@ void CppMetricsParser::functionBumpyRoad()
   parallelCalcMetric<model::CppFunctionBumpyRoad>(
     "Bumpy road complexity",
     _threadCount * functionBumpyRoadPartitionMultiplier,// number of jobs; adjust for granularity
-    getFunctionQuery<model::CppFunctionBumpyRoad>(),
-    [&, this](const MetricsTasks<model::CppFunctionBumpyRoad>& tasks)
+    getFunctionQueries<model::CppFunctionBumpyRoad>(),
+    [&, this](
+      const MetricsTasks<model::CppFunctionBumpyRoad>& tasks,
+      std::vector<model::CppAstNodeMetrics>& results)
   {
-    util::OdbTransaction {_ctx.db} ([&, this]
+    for (const model::CppFunctionBumpyRoad& function : tasks)
     {
-      for (const model::CppFunctionBumpyRoad& function : tasks)
-      {
-        const double dB = function.bumpiness;
-        const double dC = function.statementCount;
-        const bool empty = function.statementCount == 0;
-
-        model::CppAstNodeMetrics metrics;
-        metrics.astNodeId = function.astNodeId;
-        metrics.type = model::CppAstNodeMetrics::Type::BUMPY_ROAD;
-        metrics.value = empty ? 1.0 : (dB / dC);
-        _ctx.db->persist(metrics);
-      }
-    });
+      const double dB = function.bumpiness;
+      const double dC = function.statementCount;
+      const bool empty = function.statementCount == 0;
+
+      model::CppAstNodeMetrics metrics;
+      metrics.astNodeId = function.astNodeId;
+      metrics.type = model::CppAstNodeMetrics::Type::BUMPY_ROAD;
+      metrics.value = empty ? 1.0 : (dB / dC);
+      results.push_back(metrics);
+    }
   });
 }
 
 void CppMetricsParser::typeMcCabe()
 {
-  using MemberT    = model::CppMemberType;
-  using AstNode    = model::CppAstNode;
-  using Entity     = model::CppEntity;
-  using AstNodeMet = model::CppAstNodeMetrics;
+  typedef odb::query<model::CohesionCppMethodView> MethodQuery;
+  typedef odb::query<model::CppFunctionDefinitionView> DefinitionQuery;
+  typedef odb::query<model::CppAstNodeMetrics> MetricsQuery;
 
   // Calculate type level McCabe metric for all types on parallel threads.
   parallelCalcMetric<model::CohesionCppRecordView>(
     "Type-level McCabe",
     _threadCount * typeMcCabePartitionMultiplier,// number of jobs; adjust for granularity
-    getCohesionRecordQuery(),
-    [&, this](const MetricsTasks<model::CohesionCppRecordView>& tasks)
+    getCohesionRecordQueries(),
+    [&, this](
+      const MetricsTasks<model::CohesionCppRecordView>& tasks,
+      std::vector<model::CppAstNodeMetrics>& results)
   {
     util::OdbTransaction {_ctx.db} ([&, this]
     {
+      std::vector<model::CppAstNodeId> typeAstNodeIds;
+      std::unordered_set<std::uint64_t> typeHashes;
+      for (const model::CohesionCppRecordView& type : tasks)
+      {
+        typeAstNodeIds.push_back(type.astNodeId);
+        typeHashes.insert(type.entityHash);
+      }
+
+      // Template instantiations are skipped.
+      const std::unordered_set<model::CppAstNodeId> instantiations =
+        getTaggedEntities(typeAstNodeIds, model::Tag::TemplateInstantiation);
+
+      // Entity hashes of the methods of every type.
+      std::unordered_multimap<std::uint64_t, std::uint64_t> methods;
+      std::unordered_set<std::uint64_t> methodHashes;
+      forEachChunk(typeHashes.begin(), typeHashes.end(),
+        [&, this](auto begin_, auto end_)
+      {
+        for (const model::CohesionCppMethodView& method
+          : _ctx.db->query<model::CohesionCppMethodView>(
+            MethodQuery::CppMemberType::typeHash.in_range(begin_, end_)))
+        {
+          methods.emplace(method.typeHash, method.entityHash);
+          methodHashes.insert(method.entityHash);
+        }
+      });
+
+      // Definition of the methods (different AST node if not defined in class
+      // body). Note: a project might have multiple functions with the same
+      // entityHash compiled to different binaries, so we take the first
+      // result, which introduces a small level of potential inaccuracy.
+      // This could be optimized in the future if linkage information about
+      // translation units got added to the database.
+      std::unordered_map<std::uint64_t, model::CppAstNodeId> definitions;
+      forEachChunk(methodHashes.begin(), methodHashes.end(),
+        [&, this](auto begin_, auto end_)
+      {
+        for (const model::CppFunctionDefinitionView& def
+          : _ctx.db->query<model::CppFunctionDefinitionView>(
+            DefinitionQuery::CppAstNode::entityHash.in_range(begin_, end_)))
+        {
+          definitions.emplace(def.entityHash, def.astNodeId);
+        }
+      });
+
+      std::vector<model::CppAstNodeId> definitionIds;
+      for (const auto& def : definitions)
+        definitionIds.push_back(def.second);
+
+      // Implicitly defined methods (constructors, operator=, etc.) are skipped.
+      const std::unordered_set<model::CppAstNodeId> implicits =
+        getTaggedEntities(definitionIds, model::Tag::Implicit);
+
+      // Metrics of the definitions.
+      std::unordered_map<model::CppAstNodeId, double> functionMcCabes;
+      forEachChunk(definitionIds.begin(), definitionIds.end(),
+        [&, this](auto begin_, auto end_)
+      {
+        for (const model::CppAstNodeMetrics& metric
+          : _ctx.db->query<model::CppAstNodeMetrics>(
+            MetricsQuery::astNodeId.in_range(begin_, end_) &&
+            MetricsQuery::type
+              == model::CppAstNodeMetrics::Type::MCCABE_FUNCTION))
+        {
+          functionMcCabes.emplace(metric.astNodeId, metric.value);
+        }
+      });
+
       for (const model::CohesionCppRecordView& type : tasks)
       {
-        // Skip if its a template instantiation
-        const auto typeEntity = _ctx.db->query_one<Entity>(
-          odb::query<Entity>::astNodeId == type.astNodeId);
-        if (typeEntity && typeEntity->tags.find(model::Tag::TemplateInstantiation)
-                          != typeEntity->tags.cend())
+        if (instantiations.count(type.astNodeId))
           continue;
 
         unsigned int value = 0;
 
-        // Process its methods
-        for (const auto& method : _ctx.db->query<MemberT>(
-          odb::query<MemberT>::typeHash == type.entityHash &&
-          odb::query<MemberT>::kind == MemberT::Kind::Method))
+        auto range = methods.equal_range(type.entityHash);
+        for (auto it = range.first; it != range.second; ++it)
         {
-          // Lookup AST node of method
-          method.memberAstNode.load();
-          const auto methodAstNode = _ctx.db->query_one<AstNode>(
-            odb::query<AstNode>::id == method.memberAstNode->id);
-          if (!methodAstNode)
+          auto def = definitions.find(it->second);
+          if (def == definitions.end() || implicits.count(def->second))
             continue;
 
-          // Lookup its definition (different AST node if not defined in class body)
-          auto methodDefs = _ctx.db->query<AstNode>(
-            odb::query<AstNode>::entityHash == methodAstNode->entityHash &&
-            odb::query<AstNode>::symbolType == AstNode::SymbolType::Function &&
-            odb::query<AstNode>::astType == AstNode::AstType::Definition);
-          if (methodDefs.empty())
-            continue;
-          const auto methodDef = *methodDefs.begin();
-          // Note: we cannot use query_one, because a project might have multiple
-          // functions with the same entityHash compiled to different binaries
-          // So we take the first result, which introduces a small level of
-          // potential inaccuracy
-          // This could be optimized in the future if linkage information about
-          // translation units got added to the database
-
-          // Skip implicitly defined methods (constructors, operator=, etc.)
-          const auto entity = _ctx.db->query_one<Entity>(
-            odb::query<Entity>::astNodeId == methodDef.id);
-          if (entity && entity->tags.find(model::Tag::Implicit) != entity->tags.cend())
-            continue;
-
-          // Lookup metrics of this definition
-          const auto funcMetrics = _ctx.db->query_one<AstNodeMet>(
-            odb::query<AstNodeMet>::astNodeId == methodDef.id &&
-            odb::query<AstNodeMet>::type == model::CppAstNodeMetrics::Type::MCCABE_FUNCTION);
-          if (funcMetrics)
-          {
-            // Increase class mccabe by the method's
-            value += funcMetrics->value;
-          }
+          // Increase class mccabe by the method's
+          auto mcCabe = functionMcCabes.find(def->second);
+          if (mcCabe != functionMcCabes.end())
+            value += mcCabe->second;
         }
 
         model::CppAstNodeMetrics typeMcMetric;
         typeMcMetric.astNodeId = type.astNodeId;
         typeMcMetric.type = model::CppAstNodeMetrics::Type::MCCABE_TYPE;
         typeMcMetric.value = value;
-        _ctx.db->persist(typeMcMetric);
+        results.push_back(typeMcMetric);
       }
     });
   });
@@ -272,14 +365,25 @@ odb::query<model::CohesionCppRecordView> CppMetricsParser::getCohesionRecordQuer
   return query;
 }
 
+std::vector<odb::query<model::CohesionCppRecordView>>
+CppMetricsParser::getCohesionRecordQueries()
+{
+  return getIncrementalQueries(
+    getCohesionRecordQuery(),
+    odb::query<model::CohesionCppRecordView>::CppRecord::entityHash,
+    _affectedTypeHashes);
+}
+
 void CppMetricsParser::lackOfCohesion()
 {
   // Calculate the cohesion metric for all types on parallel threads.
   parallelCalcMetric<model::CohesionCppRecordView>(
     "Lack of cohesion",
     _threadCount * lackOfCohesionPartitionMultiplier, // number of jobs; adjust for granularity
-    getCohesionRecordQuery(),
-    [&, this](const MetricsTasks<model::CohesionCppRecordView>& tasks)
+    getCohesionRecordQueries(),
+    [&, this](
+      const MetricsTasks<model::CohesionCppRecordView>& tasks,
+      std::vector<model::CppAstNodeMetrics>& results)
   {
     util::OdbTransaction {_ctx.db} ([&, this]
     {
@@ -293,134 +397,100 @@ void CppMetricsParser::lackOfCohesion()
       const auto& QMethodTypeHash = QMethod::CppMemberType::typeHash;
 
       typedef odb::query<model::CohesionCppAstNodeView>::query_columns QNode;
-      const auto& QNodeFilePath = QNode::File::path;
-      const auto& QNodeRange = QNode::CppAstNode::location.range;
+      const auto& QNodeEntityHash = QNode::CppAstNode::entityHash;
 
+      std::unordered_set<HashType> typeHashes;
       for (const model::CohesionCppRecordView& type : tasks)
+        typeHashes.insert(type.entityHash);
+
+      // Query the fields and the methods of all types of the partition.
+      std::unordered_map<HashType, std::unordered_set<HashType>> fieldHashes;
+      std::unordered_set<HashType> allFieldHashes;
+      std::unordered_multimap<HashType, model::CohesionCppMethodView> methods;
+      std::unordered_set<std::string> methodFiles;
+
+      forEachChunk(typeHashes.begin(), typeHashes.end(),
+        [&, this](auto begin_, auto end_)
       {
-        std::unordered_set<HashType> fieldHashes;
-        // Query all fields of the current type.
         for (const model::CohesionCppFieldView& field
           : _ctx.db->query<model::CohesionCppFieldView>(
-            QFieldTypeHash == type.entityHash
-          ))
+            QFieldTypeHash.in_range(begin_, end_)))
         {
-          // Record these fields for later use.
-          fieldHashes.insert(field.entityHash);
+          fieldHashes[field.typeHash].insert(field.entityHash);
+          allFieldHashes.insert(field.entityHash);
         }
-        std::size_t fieldCount = fieldHashes.size();
-
-#ifdef DATABASE_SQLITE
-        /* SQLite has a fixed-size recursive descent parser, and each logical operator (like OR) adds a
-         * level to the parser's stack. Constructing queries with many ORs can lead to a stack overflow.
-         */
-
-        // Counter variables.
-        std::size_t methodCount = 0;
-        std::size_t totalCohesion = 0;
 
         for (const model::CohesionCppMethodView& method
-          : _ctx.db->query<model::CohesionCppMethodView>(QMethodTypeHash == type.entityHash))
+          : _ctx.db->query<model::CohesionCppMethodView>(
+            QMethodTypeHash.in_range(begin_, end_)))
         {
           // Do not consider methods with no explicit bodies.
           const model::Position start(method.startLine, method.startColumn);
           const model::Position end(method.endLine, method.endColumn);
-
           if (!(start < end))
-          {
             continue;
-          }
-
-          std::unordered_set<HashType> usedFields;
-
-          // Query AST nodes that use a variable for reading or writing...
-          for (const model::CohesionCppAstNodeView& node
-            : _ctx.db->query<model::CohesionCppAstNodeView>(
-            // ... in the same file as the current method
-            (QNodeFilePath == method.filePath &&
-              // ... within the textual scope of the current method's body.
-              (QNodeRange.start.line > start.line
-                || (QNodeRange.start.line == start.line
-                  && QNodeRange.start.column >= start.column)) &&
-              (QNodeRange.end.line < end.line
-                || (QNodeRange.end.line == end.line
-                  && QNodeRange.end.column <= end.column)))
-          ))
-          {
-            // If this AST node is a reference to a field of the type...
-            if (fieldHashes.find(node.entityHash) != fieldHashes.end())
-            {
-              // ... then mark it as used by this method.
-              usedFields.insert(node.entityHash);
-            }
-          }
 
-          ++methodCount;
-          totalCohesion += usedFields.size();
+          methods.emplace(method.typeHash, method);
+          methodFiles.insert(method.filePath);
         }
-#else
-        /* With more advanced database engines like PostgreSQL or MySQL we can choose an optimized query strategy.
-         * These engines use much more robust parsing engine and can handle deeply nested expressions.
-         */
-
-        // Query all methods of the current type.
-        std::vector<model::CohesionCppMethodView> methods;
-        // Build a query for variable access that within ANY of the methods.
-        odb::query<model::CohesionCppAstNodeView> nodeQuery(false);
-        for (const model::CohesionCppMethodView& method
-          : _ctx.db->query<model::CohesionCppMethodView>(QMethodTypeHash == type.entityHash))
-        {
-          // Do not consider methods with no explicit bodies.
-          const model::Position start(method.startLine, method.startColumn);
-          const model::Position end(method.endLine, method.endColumn);
-          if (!(start < end))
-          {
-            continue;
-          }
+      });
 
-          methods.push_back(method);
-
-          // Query AST nodes that use a variable for reading or writing...
-          nodeQuery = nodeQuery ||
-            // ... in the same file as the current method
-            (QNodeFilePath == method.filePath &&
-              // ... within the textual scope of the current method's body.
-              (QNodeRange.start.line > start.line
-                || (QNodeRange.start.line == start.line
-                  && QNodeRange.start.column >= start.column)) &&
-              (QNodeRange.end.line < end.line
-                || (QNodeRange.end.line == end.line
-                  && QNodeRange.end.column <= end.column)));
-        }
+      // Query the AST nodes reading or writing the fields of these types,
+      // and group the ones in the files of the methods by file. Only the
+      // usages of these fields are loaded, not every Read and Write node of
+      // the files.
+      std::unordered_map<std::string,
+        std::vector<model::CohesionCppAstNodeView>> nodes;
 
-        // Query all nodes in a single operation.
-        std::vector<model::CohesionCppAstNodeView> nodes;
-        for (const model::CohesionCppAstNodeView& node: _ctx.db->query<model::CohesionCppAstNodeView>(nodeQuery))
+      forEachChunk(allFieldHashes.begin(), allFieldHashes.end(),
+        [&, this](auto begin_, auto end_)
+      {
+        for (const model::CohesionCppAstNodeView& node
+          : _ctx.db->query<model::CohesionCppAstNodeView>(
+            QNodeEntityHash.in_range(begin_, end_)))
         {
-          nodes.push_back(node);
+          if (methodFiles.find(node.filePath) != methodFiles.end())
+            nodes[node.filePath].push_back(node);
         }
+      });
+
+      static const std::unordered_set<HashType> noFields;
+      static const std::vector<model::CohesionCppAstNodeView> noNodes;
+
+      for (const model::CohesionCppRecordView& type : tasks)
+      {
+        auto typeFieldsIt = fieldHashes.find(type.entityHash);
+        const std::unordered_set<HashType>& typeFields
+          = typeFieldsIt == fieldHashes.end() ? noFields : typeFieldsIt->second;
+        std::size_t fieldCount = typeFields.size();
 
         // Counter variables.
-        std::size_t methodCount = methods.size();
+        std::size_t methodCount = 0;
         std::size_t totalCohesion = 0;
 
-        // For each node, find the method it belongs to and check for field usage.
-        for (const auto& method : methods) {
+        auto range = methods.equal_range(type.entityHash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+          const model::CohesionCppMethodView& method = it->second;
           model::Position start(method.startLine, method.startColumn);
           model::Position end(method.endLine, method.endColumn);
 
+          auto fileNodesIt = nodes.find(method.filePath);
+          const std::vector<model::CohesionCppAstNodeView>& fileNodes
+            = fileNodesIt == nodes.end() ? noNodes : fileNodesIt->second;
+
           std::unordered_set<HashType> usedFields;
 
-          for (const auto& node : nodes) {
+          for (const auto& node : fileNodes)
+          {
             // Filter AST nodes used in this method.
-            if (node.filePath == method.filePath &&
-                (node.startLine > start.line ||
+            if ((node.startLine > start.line ||
                   (node.startLine == start.line && node.startColumn >= start.column)) &&
                 (node.endLine < end.line ||
                   (node.endLine == end.line && node.endColumn <= end.column)))
             {
               // If this AST node is a reference to a field of the type...
-              if (fieldHashes.find(node.entityHash) != fieldHashes.end())
+              if (typeFields.find(node.entityHash) != typeFields.end())
               {
                 // ... then mark it as used by this method.
                 usedFields.insert(node.entityHash);
@@ -428,9 +498,9 @@ void CppMetricsParser::lackOfCohesion()
             }
           }
 
+          ++methodCount;
           totalCohesion += usedFields.size();
         }
-#endif
 
         // Calculate and record metrics.
         const double dF = fieldCount;
@@ -445,7 +515,7 @@ void CppMetricsParser::lackOfCohesion()
         lcm.type = model::CppAstNodeMetrics::Type::LACK_OF_COHESION;
         lcm.value = trivial ? 0.0 :
           (1.0 - dC / (dM * dF));
-        _ctx.db->persist(lcm);
+        results.push_back(lcm);
 
         // Henderson-Sellers variant (range: [0,2])
         model::CppAstNodeMetrics lcm_hs;
@@ -453,7 +523,7 @@ void CppMetricsParser::lackOfCohesion()
         lcm_hs.type = model::CppAstNodeMetrics::Type::LACK_OF_COHESION_HS;
         lcm_hs.value = trivial ? 0.0 : singular ? NAN :
           ((dM - dC / dF) / (dM - 1.0));
-        _ctx.db->persist(lcm_hs);
+        results.push_back(lcm_hs);
       }
     });
   });
@@ -464,24 +534,41 @@ void CppMetricsParser::efferentTypeLevel()
   parallelCalcMetric<model::CohesionCppRecordView>(
     "Efferent coupling of types",
     _threadCount * efferentCouplingTypesPartitionMultiplier,// number of jobs; adjust for granularity
-    getCohesionRecordQuery(),
-    [&, this](const MetricsTasks<model::CohesionCppRecordView>& tasks)
+    getCohesionRecordQueries(),
+    [&, this](
+      const MetricsTasks<model::CohesionCppRecordView>& tasks,
+      std::vector<model::CppAstNodeMetrics>& results)
     {
       util::OdbTransaction{_ctx.db}([&, this]
       {
-        typedef odb::query<model::CppTypeDependency_Efferent_Count> TypeDependencyQuery;
-        typedef model::CppTypeDependency_Efferent_Count TypeDependencyResult;
+        typedef odb::query<model::CppTypeDependency_Efferent_GroupCount> TypeDependencyQuery;
+        typedef model::CppTypeDependency_Efferent_GroupCount TypeDependencyResult;
+
+        std::unordered_set<std::uint64_t> typeHashes;
+        for (const model::CohesionCppRecordView& type : tasks)
+          typeHashes.insert(type.entityHash);
+
+        std::unordered_map<std::uint64_t, std::size_t> counts;
+        forEachChunk(typeHashes.begin(), typeHashes.end(),
+          [&, this](auto begin_, auto end_)
+        {
+          for (const TypeDependencyResult& result
+            : _ctx.db->query<TypeDependencyResult>(
+              TypeDependencyQuery::entityHash.in_range(begin_, end_)))
+          {
+            counts.emplace(result.entityHash, result.count);
+          }
+        });
 
         for (const model::CohesionCppRecordView& type : tasks)
         {
-          const TypeDependencyResult result = _ctx.db->query_value<model::CppTypeDependency_Efferent_Count>(
-            TypeDependencyQuery::entityHash == type.entityHash);
+          auto it = counts.find(type.entityHash);
 
           model::CppAstNodeMetrics metric;
           metric.astNodeId = type.astNodeId;
           metric.type = model::CppAstNodeMetrics::Type::EFFERENT_TYPE;
-          metric.value = result.count;
-          _ctx.db->persist(metric);
+          metric.value = it == counts.end() ? 0 : it->second;
+          results.push_back(metric);
         }
       });
   });
@@ -492,24 +579,41 @@ void CppMetricsParser::afferentTypeLevel()
   parallelCalcMetric<model::CohesionCppRecordView>(
     "Afferent coupling of types",
     _threadCount * afferentCouplingTypesPartitionMultiplier,// number of jobs; adjust for granularity
-    getCohesionRecordQuery(),
-    [&, this](const MetricsTasks<model::CohesionCppRecordView>& tasks)
+    getCohesionRecordQueries(),
+    [&, this](
+      const MetricsTasks<model::CohesionCppRecordView>& tasks,
+      std::vector<model::CppAstNodeMetrics>& results)
     {
       util::OdbTransaction{_ctx.db}([&, this]
       {
-        typedef odb::query<model::CppTypeDependency_Afferent_Count> TypeDependencyQuery;
-        typedef model::CppTypeDependency_Afferent_Count TypeDependencyResult;
+        typedef odb::query<model::CppTypeDependency_Afferent_GroupCount> TypeDependencyQuery;
+        typedef model::CppTypeDependency_Afferent_GroupCount TypeDependencyResult;
+
+        std::unordered_set<std::uint64_t> typeHashes;
+        for (const model::CohesionCppRecordView& type : tasks)
+          typeHashes.insert(type.entityHash);
+
+        std::unordered_map<std::uint64_t, std::size_t> counts;
+        forEachChunk(typeHashes.begin(), typeHashes.end(),
+          [&, this](auto begin_, auto end_)
+        {
+          for (const TypeDependencyResult& result
+            : _ctx.db->query<TypeDependencyResult>(
+              TypeDependencyQuery::dependencyHash.in_range(begin_, end_)))
+          {
+            counts.emplace(result.dependencyHash, result.count);
+          }
+        });
 
         for (const model::CohesionCppRecordView& type : tasks)
         {
-          const TypeDependencyResult result = _ctx.db->query_value<model::CppTypeDependency_Afferent_Count>(
-            TypeDependencyQuery::dependencyHash == type.entityHash);
+          auto it = counts.find(type.entityHash);
 
           model::CppAstNodeMetrics metric;
           metric.astNodeId = type.astNodeId;
           metric.type = model::CppAstNodeMetrics::Type::AFFERENT_TYPE;
-          metric.value = result.count;
-          _ctx.db->persist(metric);
+          metric.value = it == counts.end() ? 0 : it->second;
+          results.push_back(metric);
         }
       });
   });
@@ -526,13 +630,21 @@ odb::query<model::File> CppMetricsParser::getModulePathsQuery()
   }
 }
 
+std::vector<odb::query<model::File>> CppMetricsParser::getModulePathsQueries()
+{
+  return getIncrementalQueries(
+    getModulePathsQuery(), odb::query<model::File>::id, _affectedModuleIds);
+}
+
 void CppMetricsParser::efferentModuleLevel()
 {
-  parallelCalcMetric<model::File>(
+  parallelCalcMetric<model::File, model::CppFileMetrics>(
     "Efferent coupling at module level",
     _threadCount * efferentCouplingModulesPartitionMultiplier,// number of jobs; adjust for granularity
-    getModulePathsQuery(),
-    [&, this](const MetricsTasks<model::File>& tasks)
+    getModulePathsQueries(),
+    [&, this](
+      const MetricsTasks<model::File>& tasks,
+      std::vector<model::CppFileMetrics>& results)
     {
       util::OdbTransaction{_ctx.db}([&, this]
       {
@@ -549,7 +661,7 @@ void CppMetricsParser::efferentModuleLevel()
           metric.file = file.id;
           metric.type = model::CppFileMetrics::Type::EFFERENT_MODULE;
           metric.value = types.count;
-          _ctx.db->persist(metric);
+          results.push_back(metric);
         }
       });
   });
@@ -557,11 +669,13 @@ void CppMetricsParser::efferentModuleLevel()
 
 void CppMetricsParser::afferentModuleLevel()
 {
-  parallelCalcMetric<model::File>(
+  parallelCalcMetric<model::File, model::CppFileMetrics>(
     "Afferent coupling at module level",
     _threadCount * afferentCouplingModulesPartitionMultiplier,// number of jobs; adjust for granularity
-    getModulePathsQuery(),
-    [&, this](const MetricsTasks<model::File>& tasks)
+    getModulePathsQueries(),
+    [&, this](
+      const MetricsTasks<model::File>& tasks,
+      std::vector<model::CppFileMetrics>& results)
     {
       util::OdbTransaction{_ctx.db}([&, this]
       {
@@ -578,7 +692,7 @@ void CppMetricsParser::afferentModuleLevel()
           metric.file = file.id;
           metric.type = model::CppFileMetrics::Type::AFFERENT_MODULE;
           metric.value = types.count;
-          _ctx.db->persist(metric);
+          results.push_back(metric);
         }
       });
   });
@@ -589,11 +703,13 @@ void CppMetricsParser::relationalCohesionModuleLevel()
   // Compute relational cohesion defined by CppDepend:
   // https://www.cppdepend.com/documentation/code-metrics#RelationalCohesion
 
-  parallelCalcMetric<model::File>(
+  parallelCalcMetric<model::File, model::CppFileMetrics>(
     "Relational cohesion at module level",
     _threadCount * relationalCohesionPartitionMultiplier, // number of jobs; adjust for granularity
-    getModulePathsQuery(),
-    [&, this](const MetricsTasks<model::File>& tasks)
+    getModulePathsQueries(),
+    [&, this](
+      const MetricsTasks<model::File>& tasks,
+      std::vector<model::CppFileMetrics>& results)
     {
       util::OdbTransaction{_ctx.db}([&, this]
       {
@@ -625,35 +741,384 @@ void CppMetricsParser::relationalCohesionModuleLevel()
           metric.file = file.id;
           metric.type = model::CppFileMetrics::Type::RELATIONAL_COHESION_MODULE;
           metric.value = h;
-          _ctx.db->persist(metric);
+          results.push_back(metric);
         }
       });
   });
 }
 
+void CppMetricsParser::collectDependentTypes(
+  const std::vector<model::FileId>& fileIds_,
+  std::unordered_set<std::uint64_t>& affectedTypes_,
+  std::unordered_set<std::string>& affectedPaths_)
+{
+  typedef odb::query<model::CohesionCppRecordView> RecordQuery;
+  typedef odb::query<model::CppFunctionDefinitionView> DefinitionQuery;
+  typedef odb::query<model::CohesionCppMethodView> MethodQuery;
+  typedef odb::query<model::CppTypeDependencyPathView> DependencyQuery;
+
+  // The types defined in the files, and the ones whose methods are defined
+  // there.
+  std::unordered_set<std::uint64_t> types;
+  std::unordered_set<std::uint64_t> methodHashes;
+  forEachChunk(fileIds_.begin(), fileIds_.end(),
+    [&, this](auto begin_, auto end_)
+  {
+    for (const model::CohesionCppRecordView& type
+      : _ctx.db->query<model::CohesionCppRecordView>(
+        RecordQuery::File::id.in_range(begin_, end_)))
+    {
+      types.insert(type.entityHash);
+    }
+
+    for (const model::CppFunctionDefinitionView& def
+      : _ctx.db->query<model::CppFunctionDefinitionView>(
+        DefinitionQuery::CppAstNode::location.file.in_range(begin_, end_)))
+    {
+      methodHashes.insert(def.entityHash);
+    }
+  });
+
+  forEachChunk(methodHashes.begin(), methodHashes.end(),
+    [&, this](auto begin_, auto end_)
+  {
+    for (const model::CohesionCppMethodView& method
+      : _ctx.db->query<model::CohesionCppMethodView>(
+        MethodQuery::CppAstNode::entityHash.in_range(begin_, end_)))
+    {
+      types.insert(method.typeHash);
+    }
+  });
+
+  // The types on both ends of their dependencies, and the files of these.
+  auto addDependency = [&](const model::CppTypeDependencyPathView& dep_)
+  {
+    affectedTypes_.insert(dep_.entityHash);
+    affectedTypes_.insert(dep_.dependencyHash);
+    affectedPaths_.insert(dep_.entityPath);
+    affectedPaths_.insert(dep_.dependencyPath);
+  };
+
+  forEachChunk(types.begin(), types.end(),
+    [&, this](auto begin_, auto end_)
+  {
+    for (const model::CppTypeDependencyPathView& dep
+      : _ctx.db->query<model::CppTypeDependencyPathView>(
+        DependencyQuery::CppTypeDependency::entityHash.in_range(
+          begin_, end_)))
+    {
+      addDependency(dep);
+    }
+
+    for (const model::CppTypeDependencyPathView& dep
+      : _ctx.db->query<model::CppTypeDependencyPathView>(
+        DependencyQuery::CppTypeDependency::dependencyHash.in_range(
+          begin_, end_)))
+    {
+      addDependency(dep);
+    }
+  });
+
+  affectedTypes_.insert(types.begin(), types.end());
+}
+
+void CppMetricsParser::collectAffectedEntities()
+{
+  typedef odb::query<model::File> FileQuery;
+  typedef odb::query<model::CohesionCppRecordView> RecordQuery;
+  typedef odb::query<model::CppAstNodeMetrics> AstNodeMetricsQuery;
+  typedef odb::query<model::CppFileMetrics> FileMetricsQuery;
+
+  // Deleted files have no metrics to recompute, but their modules do.
+  std::vector<std::string> changedPaths;
+  std::unordered_set<std::string> affectedPaths;
+  for (const auto& item : _ctx.fileStatus)
+  {
+    affectedPaths.insert(item.first);
+    if (item.second != IncrementalStatus::DELETED)
+      changedPaths.push_back(item.first);
+  }
+
+  util::OdbTransaction {_ctx.db} ([&, this]
+  {
+    forEachChunk(changedPaths.begin(), changedPaths.end(),
+      [&, this](auto begin_, auto end_)
+    {
+      for (const model::File& file : _ctx.db->query<model::File>(
+        FileQuery::path.in_range(begin_, end_)))
+      {
+        _changedFileIds.push_back(file.id);
+      }
+    });
+
+    // The McCabe and cohesion metrics of the types defined in the changed
+    // files change, and the coupling metrics of the types on the other end
+    // of their dependencies, both the current and the former ones.
+    std::unordered_set<std::uint64_t> affectedTypes(
+      _formerDependentTypes.begin(), _formerDependentTypes.end());
+    affectedPaths.insert(
+      _formerDependentPaths.begin(), _formerDependentPaths.end());
+
+    collectDependentTypes(_changedFileIds, affectedTypes, affectedPaths);
+
+    _affectedTypeHashes.assign(affectedTypes.begin(), affectedTypes.end());
+
+    // The metrics of the changed files were removed by cleanupDatabase(), the
+    // ones of the affected types in unchanged files are removed here.
+    std::vector<model::CppAstNodeId> typeAstNodeIds;
+    forEachChunk(_affectedTypeHashes.begin(), _affectedTypeHashes.end(),
+      [&, this](auto begin_, auto end_)
+    {
+      for (const model::CohesionCppRecordView& type
+        : _ctx.db->query<model::CohesionCppRecordView>(
+          RecordQuery::CppRecord::entityHash.in_range(begin_, end_)))
+      {
+        typeAstNodeIds.push_back(type.astNodeId);
+      }
+    });
+
+    forEachChunk(typeAstNodeIds.begin(), typeAstNodeIds.end(),
+      [&, this](auto begin_, auto end_)
+    {
+      _ctx.db->erase_query<model::CppAstNodeMetrics>(
+        AstNodeMetricsQuery::astNodeId.in_range(begin_, end_));
+    });
+
+    // A module is affected if an affected path is under its directory.
+    std::unordered_map<std::string, model::FileId> modules;
+    for (const model::File& module
+      : _ctx.db->query<model::File>(getModulePathsQuery()))
+    {
+      modules.emplace(module.path, module.id);
+    }
+
+    std::unordered_set<model::FileId> affectedModules;
+    for (const std::string& path : affectedPaths)
+    {
+      std::size_t pos = path.size();
+      while (pos > 0 && (pos = path.rfind('/', pos - 1)) != std::string::npos)
+      {
+        auto it = modules.find(path.substr(0, pos));
+        if (it != modules.end())
+          affectedModules.insert(it->second);
+      }
+    }
+
+    _affectedModuleIds.assign(affectedModules.begin(), affectedModules.end());
+
+    forEachChunk(_affectedModuleIds.begin(), _affectedModuleIds.end(),
+      [&, this](auto begin_, auto end_)
+    {
+      _ctx.db->erase_query<model::CppFileMetrics>(
+        FileMetricsQuery::file.in_range(begin_, end_));
+    });
+  });
+
+  LOG(info) << "[cppmetricsparser] Recomputing the metrics of "
+    << _changedFileIds.size() << " changed file(s), "
+    << _affectedTypeHashes.size() << " type(s) and "
+    << _affectedModuleIds.size() << " module(s).";
+}
+
 bool CppMetricsParser::parse()
 {
-  LOG(info) << "[cppmetricsparser] Computing function parameter count metric.";
-  functionParameters();
-  LOG(info) << "[cppmetricsparser] Computing McCabe metric for functions.";
-  functionMcCabe();
-  LOG(info) << "[cppmetricsparser] Computing Bumpy Road metric for functions.";
-  functionBumpyRoad();
-  LOG(info) << "[cppmetricsparser] Computing McCabe metric for types.";
-  typeMcCabe();
-  LOG(info) << "[cppmetricsparser] Computing Lack of Cohesion metric for types.";
-  lackOfCohesion();
-  LOG(info) << "[cppmetricsparser] Computing efferent coupling metric for types.";
-  efferentTypeLevel();
-  LOG(info) << "[cppmetricsparser] Computing afferent coupling metric for types.";
-  afferentTypeLevel();
-  LOG(info) << "[cppmetricsparser] Computing efferent coupling metric at module level.";
-  efferentModuleLevel(); // This metric needs to be calculated after efferentTypeLevel
-  LOG(info) << "[cppmetricsparser] Computing afferent coupling metric at module level.";
-  afferentModuleLevel(); // This metric needs to be calculated after efferentTypeLevel (sic!)
-  LOG(info) << "[cppmetricsparser] Computing relational cohesion metric at module level.";
-  relationalCohesionModuleLevel(); // This metric needs to be calculated after efferentTypeLevel
-  return true;
+  _threadCount = _jobs;
+
+  try
+  {
+    if (_ctx.options.count("cppmetrics-full"))
+    {
+      util::OdbTransaction {_ctx.db} ([this]
+      {
+        _ctx.db->erase_query<model::CppAstNodeMetrics>();
+        _ctx.db->erase_query<model::CppFileMetrics>();
+      });
+    }
+    else if (!_ctx.options.count("force") &&
+      (!_fileIdCache.empty() || !_astNodeIdCache.empty()))
+    {
+      // The metrics which are left after cleanupDatabase() are kept, only the
+      // ones affected by the changed files are recomputed.
+      _incremental = true;
+
+      if (_ctx.fileStatus.empty())
+      {
+        LOG(info) << "[cppmetricsparser] No changed files, the metrics are "
+          "up to date.";
+        return true;
+      }
+
+      collectAffectedEntities();
+    }
+  }
+  catch (odb::database_exception&)
+  {
+    LOG(fatal) << "Transaction failed in cxxmetrics parser!";
+    return false;
+  }
+
+  // Only a few metrics read the results of others, e.g. the McCabe metric of
+  // types sums the McCabe metric of their methods.
+  std::vector<MetricPass> passes = {
+    {"function parameter count", {}, [this]{ functionParameters(); }},
+    {"function McCabe", {}, [this]{ functionMcCabe(); }},
+    {"function Bumpy Road", {}, [this]{ functionBumpyRoad(); }},
+    {"type McCabe", {"function McCabe"}, [this]{ typeMcCabe(); }},
+    {"type Lack of Cohesion", {}, [this]{ lackOfCohesion(); }},
+    {"type efferent coupling", {}, [this]{ efferentTypeLevel(); }},
+    {"type afferent coupling", {}, [this]{ afferentTypeLevel(); }},
+    {"module efferent coupling", {"type efferent coupling"},
+      [this]{ efferentModuleLevel(); }},
+    {"module afferent coupling", {"type efferent coupling"},
+      [this]{ afferentModuleLevel(); }},
+    {"module relational cohesion", {"type efferent coupling"},
+      [this]{ relationalCohesionModuleLevel(); }}
+  };
+
+  const auto startTime = std::chrono::steady_clock::now();
+
+  _pool = util::make_thread_pool<std::function<void()>>(
+    _threadCount, [](const std::function<void()>& job_) { job_(); });
+
+  bool success = runMetricPasses(passes);
+
+  _pool->wait();
+  _pool.reset();
+
+  logMetricStats(std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now() - startTime));
+  return success;
+}
+
+bool CppMetricsParser::runMetricPasses(const std::vector<MetricPass>& passes_)
+{
+  std::vector<const MetricPass*> pending;
+  for (const MetricPass& pass : passes_)
+    pending.push_back(&pass);
+
+  std::set<std::string> finished;
+  std::set<std::string> failed;
+  std::map<std::string, std::thread> running;
+
+  std::mutex finishedMutex;
+  std::condition_variable finishedCond;
+  std::vector<std::pair<std::string, bool>> justFinished;
+
+  // A single thread calculates the partitions on the thread of the pass, so
+  // the passes have to run one after the other.
+  const std::size_t maxRunning = _threadCount > 1 ? passes_.size() : 1;
+
+  while (!pending.empty() || !running.empty())
+  {
+    bool skipped = false;
+
+    for (auto it = pending.begin();
+      it != pending.end() && running.size() < maxRunning;)
+    {
+      const MetricPass* pass = *it;
+
+      // The results of a failed pass are incomplete, so the passes reading
+      // them are not run.
+      auto failedDep = std::find_if(
+        pass->dependencies.begin(), pass->dependencies.end(),
+        [&](const std::string& dep_) { return failed.count(dep_); });
+      if (failedDep != pass->dependencies.end())
+      {
+        LOG(error) << "[cppmetricsparser] Skipping " << pass->name
+          << " metric, as " << *failedDep << " metric failed.";
+        failed.insert(pass->name);
+        it = pending.erase(it);
+        skipped = true;
+        continue;
+      }
+
+      if (!std::all_of(pass->dependencies.begin(), pass->dependencies.end(),
+        [&](const std::string& dep_) { return finished.count(dep_); }))
+      {
+        ++it;
+        continue;
+      }
+
+      LOG(info) << "[cppmetricsparser] Computing " << pass->name << " metric.";
+
+      running.emplace(pass->name, std::thread([&, pass]
+      {
+        bool success = false;
+
+        try
+        {
+          pass->run();
+          success = true;
+        }
+        catch (const std::exception& ex)
+        {
+          LOG(error) << "[cppmetricsparser] Computing " << pass->name
+            << " metric failed: " << ex.what();
+        }
+        catch (...)
+        {
+          LOG(error) << "[cppmetricsparser] Computing " << pass->name
+            << " metric failed with an unknown exception.";
+        }
+
+        std::lock_guard<std::mutex> lock(finishedMutex);
+        justFinished.emplace_back(pass->name, success);
+        finishedCond.notify_one();
+      }));
+
+      it = pending.erase(it);
+    }
+
+    if (running.empty())
+    {
+      // The passes depending on the skipped ones are skipped in the next
+      // round.
+      if (pending.empty())
+        break;
+      if (skipped)
+        continue;
+
+      LOG(error) << "[cppmetricsparser] Unknown or circular dependencies "
+        "between the metrics:";
+      for (const MetricPass* pass : pending)
+        LOG(error) << " - " << pass->name;
+      return false;
+    }
+
+    std::unique_lock<std::mutex> lock(finishedMutex);
+    finishedCond.wait(lock, [&]{ return !justFinished.empty(); });
+
+    for (const auto& result : justFinished)
+    {
+      running[result.first].join();
+      running.erase(result.first);
+      (result.second ? finished : failed).insert(result.first);
+    }
+
+    justFinished.clear();
+  }
+
+  return failed.empty();
+}
+
+void CppMetricsParser::logMetricStats(std::chrono::milliseconds wallTime_) const
+{
+  std::lock_guard<std::mutex> lock(_metricStatsMutex);
+
+  std::chrono::milliseconds total(0);
+  for (const MetricStats& stats : _metricStats)
+  {
+    LOG(info) << "[cppmetricsparser] " << stats.name << ": "
+      << stats.tasks << " tasks, " << stats.rows << " rows in "
+      << stats.time.count() << " ms";
+    total += stats.time;
+  }
+
+  // The metrics are calculated concurrently, so the wall time is less than
+  // the sum of their times.
+  LOG(info) << "[cppmetricsparser] Total metric calculation time: "
+    << wallTime_.count() << " ms (" << total.count()
+    << " ms summed over the metrics)";
 }
 
 CppMetricsParser::~CppMetricsParser()
@@ -682,7 +1147,9 @@ extern "C"
     ("cppmetrics-ignore-lambdas",
       "Skip Efferent/Afferent Coupling, Lack of Cohesion C++ metrics calculations for lambdas.")
     ("cppmetrics-ignore-nested-classes",
-      "Skip Efferent/Afferent Coupling, Lack of Cohesion C++ metrics calculations for nested classes.");
+      "Skip Efferent/Afferent Coupling, Lack of Cohesion C++ metrics calculations for nested classes.")
+    ("cppmetrics-full",
+      "Recompute every C++ metric on incremental parsing, not only the ones affected by the changed files.");
 
     return description;
   }
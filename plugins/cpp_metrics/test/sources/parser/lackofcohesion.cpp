@@ -221,3 +221,20 @@ struct same_partial_coh_C
 	void method2() { field2 = 42 * field3 / field2; }
 	int method3() { return field1 = field3 + field2; }
 };
+
+////////////////
+
+struct foreign_fields_other
+{
+	int field1;
+	int field2;
+};
+
+struct foreign_fields_2_2
+{
+	int field1;
+	int field2;
+	
+	int method1(const foreign_fields_other& other) const { return other.field1 + field1; }
+	int method2(const foreign_fields_other& other) const { return other.field2; }
+};
@@ -251,6 +251,8 @@ std::vector<LackOfCohesionParam> paramLackOfCohesion = {
   {"same_partial_coh_A", C1_3, 0.5},
   {"same_partial_coh_B", C1_3, 0.5},
   {"same_partial_coh_C", C1_3, 0.5},
+  {"foreign_fields_other", 0, 0},
+  {"foreign_fields_2_2", 0.75, 1.5},
 };
 
 TEST_P(ParameterizedLackOfCohesionTest, LackOfCohesionTest) {
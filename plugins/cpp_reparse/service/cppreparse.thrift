@@ -33,6 +33,40 @@ struct ASTNodeDetail
   2: list<ASTNodeBasic> children /** Basic details about the children nodes. */
 }
 
+/**
+ * The state of an asynchronous reparse job.
+ */
+enum ReparseJobState
+{
+  Queued,    /** The build of the AST waits for a free worker. */
+  Running,   /** The AST is being built. */
+  Done,      /** The AST is built and cached, getAsHTML() returns quickly. */
+  Failed,    /** The AST could not be built, see the error of the job. */
+  Cancelled  /** The job was cancelled or the server is shutting down. */
+}
+
+struct ReparseJob
+{
+  1: string          jobId /** The ID returned by submitReparse(). */
+  2: common.FileId   fileId /** The file whose AST is built. */
+  3: ReparseJobState state /** The current state of the job. */
+  4: string          error /** The reason of the failure if the job failed. */
+  5: i64             buildMillis /** Wall time of the build in milliseconds, 0 until it finishes. */
+}
+
+struct ReparseStatistics
+{
+  1: i64    queueDepth /** Number of builds waiting for a worker. */
+  2: i64    runningBuilds /** Number of builds in progress. */
+  3: i64    completedBuilds /** Number of successful builds. */
+  4: i64    failedBuilds /** Number of failed builds. */
+  5: i64    cancelledBuilds /** Number of builds dropped before they started. */
+  6: i64    coalescedRequests /** Number of requests attached to an already queued or running build of the same file. */
+  7: double averageBuildMillis /** Average wall time of the finished builds. */
+  8: i64    maxBuildMillis /** Longest wall time of a finished build. */
+  9: i64    cacheHits /** Number of requests served from the AST cache without a build. */
+}
+
 service CppReparseService
 {
   /**
@@ -50,4 +84,31 @@ service CppReparseService
    * Returns the AST for the given AST Node('s subtree) as an HTML string.
    */
   string getAsHTMLForNode(1: common.AstNodeId nodeId);
+
+  /**
+   * Queues the build of the AST of the given file without waiting for it.
+   * Requests for a file whose build is already queued or running share that
+   * build.
+   * @return The ID of the job, which can be passed to waitReparse() and
+   * cancelReparse().
+   */
+  string submitReparse(1: common.FileId fileId);
+
+  /**
+   * Waits at most timeoutMillis milliseconds for the job to finish and returns
+   * its state. A timeout of 0 only polls the job.
+   */
+  ReparseJob waitReparse(1: string jobId, 2: i32 timeoutMillis);
+
+  /**
+   * Cancels the job. A queued build is dropped if no other job needs it, a
+   * build already running is finished and cached nevertheless.
+   * @return False if the job is unknown or has already finished.
+   */
+  bool cancelReparse(1: string jobId);
+
+  /**
+   * Returns the statistics of the reparse worker pool.
+   */
+  ReparseStatistics getReparseStatistics();
 }
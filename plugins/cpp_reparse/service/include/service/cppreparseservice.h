@@ -1,6 +1,7 @@
 #ifndef CC_SERVICE_CPPREPARSESERVICE_H
 #define CC_SERVICE_CPPREPARSESERVICE_H
 
+#include <cstdint>
 #include <string>
 #include <memory>
 
@@ -24,6 +25,7 @@ namespace reparse
 
 class ASTCache;
 class CppReparser;
+class ReparseScheduler;
 
 } // namespace reparse
 
@@ -50,13 +52,27 @@ public:
     std::string& return_,
     const core::AstNodeId& nodeId_) override;
 
+  virtual void submitReparse(
+    std::string& return_,
+    const core::FileId& fileId_) override;
+
+  virtual void waitReparse(
+    ReparseJob& return_,
+    const std::string& jobId_,
+    const std::int32_t timeoutMillis_) override;
+
+  virtual bool cancelReparse(const std::string& jobId_) override;
+
+  virtual void getReparseStatistics(ReparseStatistics& return_) override;
+
 private:
   std::shared_ptr<odb::database> _db;
   util::OdbTransaction _transaction;
   const boost::program_options::variables_map& _config;
 
   std::shared_ptr<reparse::ASTCache> _astCache;
-  std::unique_ptr<reparse::CppReparser> _reparser;
+  std::shared_ptr<reparse::CppReparser> _reparser;
+  std::unique_ptr<reparse::ReparseScheduler> _scheduler;
 };
 
 } // namespace language
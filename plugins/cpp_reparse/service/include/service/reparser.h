@@ -2,6 +2,7 @@
 #define CC_SERVICE_CPPREPARSESERVICE_REPARSER_H
 
 #include <memory>
+#include <vector>
 
 #include <boost/variant.hpp>
 
@@ -14,6 +15,7 @@
 namespace clang
 {
 class ASTUnit;
+class PCHContainerOperations;
 
 namespace tooling
 {
@@ -21,6 +23,17 @@ class FixedCompilationDatabase;
 } // namespace tooling
 } // namespace clang
 
+namespace llvm
+{
+namespace vfs
+{
+class FileSystem;
+} // namespace vfs
+
+template <typename T>
+class IntrusiveRefCntPtr;
+} // namespace llvm
+
 namespace cc
 {
 namespace service
@@ -38,7 +51,6 @@ public:
     std::shared_ptr<ASTCache> astCache_);
   CppReparser(const CppReparser&) = delete;
   CppReparser& operator=(const CppReparser&) = delete;
-  ~CppReparser() = default;
 
   /**
    * Obtain the compilation command that used the given file as source file.
@@ -52,7 +64,9 @@ public:
   getCompilationCommandForFile(const core::FileId& fileId_);
 
   /**
-   * Returns the ASTUnit instance for the given source file
+   * Returns the ASTUnit instance for the given source file. The AST is
+   * taken from the cache, loaded from the cache's swap directory, or built,
+   * in this order of preference.
    * @param fileId_ The file ID of the file to build the AST for.
    * @return An ASTUnit pointer, on which ASTConsumers can be executed. If an
    * error happened and the AST could not be obtained, a string explaining the
@@ -61,12 +75,40 @@ public:
   boost::variant<std::shared_ptr<clang::ASTUnit>, std::string>
   getASTForTranslationUnitFile(const core::FileId& fileId_);
 
+  /**
+   * Returns at most the given number of other translation units in the
+   * directory of the given file whose AST is not cached yet. These are worth
+   * building in the background, as they are likely to be requested next.
+   */
+  std::vector<core::FileId> getUncachedNeighbours(
+    const core::FileId& fileId_,
+    size_t maxCount_);
+
 private:
   std::shared_ptr<odb::database> _db;
   util::OdbTransaction _transaction;
   std::shared_ptr<ASTCache> _astCache;
+  std::shared_ptr<clang::PCHContainerOperations> _pchContainerOps;
 
   std::string getFilenameForId(const core::FileId& fileId_);
+
+  /**
+   * Returns the hash of the content of the file stored in the database, or
+   * an empty string if the file has no content.
+   */
+  std::string getContentHashForId(const core::FileId& fileId_);
+
+  /**
+   * Loads an AST which was serialized by the cache, or returns nullptr if
+   * that fails (e.g. the file is missing or was written by another Clang).
+   */
+  std::unique_ptr<clang::ASTUnit> loadSwappedAST(const std::string& path_);
+
+  /**
+   * Returns the file system the sources are read from: the contents stored
+   * in the database take precedence over the real file system.
+   */
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> createFileSystem();
 };
 
 } // namespace reparse
@@ -1,6 +1,12 @@
 #include <algorithm>
+#include <tuple>
+#include <vector>
 
+#include <boost/filesystem.hpp>
+
+#include <clang/Basic/SourceManager.h>
 #include <clang/Frontend/ASTUnit.h>
+#include <clang/Lex/Preprocessor.h>
 
 #include <util/logutil.h>
 
@@ -17,9 +23,50 @@ namespace reparse
 
 using namespace clang;
 
-ASTCache::ASTCache(size_t maxCacheSize_)
-  : _maxCacheSize(maxCacheSize_)
-{}
+ASTCache::ASTCache(
+  size_t maxCacheSize_,
+  size_t maxMemory_,
+  std::string swapDirectory_,
+  size_t maxSwapSize_)
+  : _maxCacheSize(maxCacheSize_),
+    _maxMemory(maxMemory_),
+    _memoryUsage(0),
+    _swapDirectory(std::move(swapDirectory_)),
+    _maxSwapSize(maxSwapSize_),
+    _swapUsage(0)
+{
+  if (_swapDirectory.empty())
+    return;
+
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(_swapDirectory, ec);
+  if (ec)
+  {
+    LOG(warning) << "Failed to create AST swap directory '" << _swapDirectory
+                 << "', pruned ASTs will be dropped: " << ec.message();
+    _swapDirectory.clear();
+    return;
+  }
+
+  // The AST files left behind by a previous run (e.g. which was killed) are
+  // not known by this cache, they would only take up space.
+  std::vector<std::string> stale;
+  for (boost::filesystem::directory_iterator it(_swapDirectory, ec), end;
+       !ec && it != end; it.increment(ec))
+    if (it->path().extension() == ".ast")
+      stale.push_back(it->path().string());
+
+  deleteFiles(stale);
+}
+
+ASTCache::~ASTCache()
+{
+  std::vector<std::string> toDelete;
+  for (const auto& entry : _swapped)
+    toDelete.push_back(entry.second.path);
+
+  deleteFiles(toDelete);
+}
 
 std::shared_ptr<clang::ASTUnit> ASTCache::getAST(const core::FileId& id_)
 {
@@ -31,46 +78,249 @@ std::shared_ptr<clang::ASTUnit> ASTCache::getAST(const core::FileId& id_)
   return it->second.getAST();
 }
 
-std::shared_ptr<ASTUnit> ASTCache::storeAST(
+std::string ASTCache::getSwappedASTPath(
   const core::FileId& id_,
-  std::unique_ptr<ASTUnit> AST_)
+  const std::string& contentHash_)
 {
-  if (_cache.size() >= _maxCacheSize)
-    pruneEntries();
+  std::vector<std::string> toDelete;
+  std::string path;
 
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    auto it = _swapped.find(id_);
+    if (it == _swapped.end())
+      return std::string();
+
+    if (it->second.contentHash == contentHash_)
+    {
+      it->second.lastUsed = std::chrono::steady_clock::now();
+      path = it->second.path;
+    }
+    else
+    {
+      LOG(debug) << "The content of file #" << id_ << " has changed, its "
+                 << "swapped out AST is dropped.";
+      dropSwapped(it, toDelete);
+    }
+  }
+
+  deleteFiles(toDelete);
+
+  return path;
+}
+
+bool ASTCache::contains(const core::FileId& id_)
+{
   std::lock_guard<std::mutex> lock(_lock);
-  auto it = _cache.find(id_);
-  if (it != _cache.end())
-    // If the key already exists in the map, it has to be overwritten.
-    // This cannot be done pre-C++17 without clearing the element first.
-    _cache.erase(it);
+  return _cache.count(id_) || _swapped.count(id_);
+}
+
+std::shared_ptr<ASTUnit> ASTCache::storeAST(
+  const core::FileId& id_,
+  std::unique_ptr<ASTUnit> AST_,
+  const std::string& contentHash_)
+{
+  std::shared_ptr<ASTUnit> result;
+  std::vector<std::string> toDelete;
+
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    auto it = _cache.find(id_);
+    if (it != _cache.end())
+    {
+      // If the key already exists in the map, it has to be overwritten.
+      // This cannot be done pre-C++17 without clearing the element first.
+      _memoryUsage -= it->second.memorySize();
+      _cache.erase(it);
+    }
+
+    // An AST file of the former content must not be loaded again.
+    auto swapIt = _swapped.find(id_);
+    if (swapIt != _swapped.end() &&
+        swapIt->second.contentHash != contentHash_)
+      dropSwapped(swapIt, toDelete);
+
+    auto inserted = _cache.emplace(
+      std::piecewise_construct,
+      std::forward_as_tuple(id_),
+      std::forward_as_tuple(std::move(AST_), contentHash_));
+    _memoryUsage += inserted.first->second.memorySize();
+    result = inserted.first->second.getAST();
+
+    LOG(debug) << "AST of file #" << id_ << " is cached, estimated size: "
+               << (inserted.first->second.memorySize() >> 20) << " MiB, "
+               << "cache: " << _cache.size() << " AST(s), "
+               << (_memoryUsage >> 20) << " MiB";
+  }
+
+  deleteFiles(toDelete);
+
+  pruneEntries();
 
-  auto result = _cache.emplace(id_, std::move(AST_));
-  return result.first->second.getAST();
+  return result;
 }
 
 void ASTCache::pruneEntries()
 {
-  std::lock_guard<std::mutex> lock(_lock);
+  struct ToSwap
+  {
+    core::FileId id;
+    std::shared_ptr<ASTUnit> AST;
+    std::string contentHash;
+  };
+
+  std::vector<ToSwap> toSwap;
+
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+
+    // The most recently stored entry is never pruned, so the cache can hold
+    // at least one AST even if that alone is over the memory limit.
+    while (_cache.size() > 1 &&
+      (_cache.size() > _maxCacheSize || _memoryUsage > _maxMemory))
+    {
+      // Remove the element who wasn't touched for the longest time.
+      auto elemToRemove = std::min_element(
+          _cache.begin(), _cache.end(),
+          [](const auto& lhs, const auto& rhs)
+          {
+            return lhs.second.lastHit() < rhs.second.lastHit();
+          });
+
+      _memoryUsage -= elemToRemove->second.memorySize();
+
+      // ASTs still in use by a request are not serialized concurrently with
+      // it, they are simply dropped from the cache. An AST which was loaded
+      // from the swap directory can't be serialized again: it is dropped,
+      // and its AST file is used if it wasn't deleted meanwhile.
+      if (!_swapDirectory.empty() &&
+          elemToRemove->second.serializable() &&
+          !_swapped.count(elemToRemove->first) &&
+          elemToRemove->second.referenceCount() == 0)
+        toSwap.push_back({
+          elemToRemove->first,
+          elemToRemove->second.releaseAST(),
+          elemToRemove->second.contentHash()});
 
-  while (_cache.size() >= _maxCacheSize)
+      _cache.erase(elemToRemove);
+    }
+  }
+
+  for (ToSwap& entry : toSwap)
+  {
+    std::string path = swapPath(entry.id);
+
+    // ASTUnit::Save() returns true on error.
+    if (entry.AST->Save(path))
+    {
+      LOG(warning) << "Failed to serialize the AST of file #" << entry.id
+                   << " to " << path;
+      deleteFiles({path});
+      continue;
+    }
+
+    boost::system::error_code ec;
+    size_t size = boost::filesystem::file_size(path, ec);
+    if (ec)
+      size = 0;
+
+    LOG(debug) << "AST of file #" << entry.id << " swapped out to " << path
+               << ", size: " << (size >> 20) << " MiB";
+
+    std::vector<std::string> toDelete;
+
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+
+      // The file may have been swapped out by another thread meanwhile.
+      auto it = _swapped.find(entry.id);
+      if (it != _swapped.end())
+      {
+        _swapUsage -= it->second.size;
+        _swapped.erase(it);
+      }
+
+      _swapped[entry.id] = {
+        path, entry.contentHash, size, std::chrono::steady_clock::now()};
+      _swapUsage += size;
+
+      pruneSwapped(toDelete);
+    }
+
+    deleteFiles(toDelete);
+  }
+}
+
+void ASTCache::pruneSwapped(std::vector<std::string>& toDelete_)
+{
+  while (!_swapped.empty() && _swapUsage > _maxSwapSize)
   {
-    // For now, remove the element who wasn't touched for the longest time.
     auto elemToRemove = std::min_element(
-        _cache.begin(), _cache.end(),
-        [](const auto& lhs, const auto& rhs)
-        {
-          return lhs.second.lastHit() < rhs.second.lastHit();
-        });
+      _swapped.begin(), _swapped.end(),
+      [](const auto& lhs, const auto& rhs)
+      {
+        return lhs.second.lastUsed < rhs.second.lastUsed;
+      });
+
+    LOG(debug) << "Swapped out AST of file #" << elemToRemove->first
+               << " is deleted, swap directory: "
+               << (_swapUsage >> 20) << " MiB";
+
+    dropSwapped(elemToRemove, toDelete_);
+  }
+}
+
+void ASTCache::dropSwapped(
+  std::map<core::FileId, SwapEntry>::iterator it_,
+  std::vector<std::string>& toDelete_)
+{
+  _swapUsage -= it_->second.size;
+  toDelete_.push_back(it_->second.path);
+  _swapped.erase(it_);
+}
 
-    _cache.erase(elemToRemove);
+void ASTCache::deleteFiles(const std::vector<std::string>& paths_)
+{
+  for (const std::string& path : paths_)
+  {
+    boost::system::error_code ec;
+    boost::filesystem::remove(path, ec);
+    if (ec)
+      LOG(warning) << "Failed to delete AST file " << path << ": "
+                   << ec.message();
   }
 }
 
-ASTCache::ASTCacheEntry::ASTCacheEntry(std::unique_ptr<clang::ASTUnit> AST_)
+std::string ASTCache::swapPath(const core::FileId& id_) const
+{
+  return (boost::filesystem::path(_swapDirectory) / (id_ + ".ast")).string();
+}
+
+size_t ASTCache::estimateMemory(const ASTUnit& AST_)
+{
+  const ASTContext& context = AST_.getASTContext();
+  const SourceManager& sourceManager = AST_.getSourceManager();
+  SourceManager::MemoryBufferSizes buffers =
+    sourceManager.getMemoryBufferSizes();
+
+  return context.getASTAllocatedMemory()
+    + context.getSideTableAllocatedMemory()
+    + sourceManager.getContentCacheSize()
+    + sourceManager.getDataStructureSizes()
+    + buffers.malloc_bytes
+    + buffers.mmap_bytes
+    + AST_.getPreprocessor().getTotalMemory();
+}
+
+ASTCache::ASTCacheEntry::ASTCacheEntry(
+  std::unique_ptr<clang::ASTUnit> AST_,
+  std::string contentHash_)
   : _AST(std::move(AST_)),
     _hitCount(0),
-    _lastHit(std::chrono::steady_clock::now())
+    _lastHit(std::chrono::steady_clock::now()),
+    _memorySize(estimateMemory(*_AST)),
+    _contentHash(std::move(contentHash_)),
+    _serializable(_AST->hasSema())
 {}
 
 std::shared_ptr<ASTUnit> ASTCache::ASTCacheEntry::getAST()
@@ -80,6 +330,11 @@ std::shared_ptr<ASTUnit> ASTCache::ASTCacheEntry::getAST()
   return _AST;
 }
 
+std::shared_ptr<ASTUnit> ASTCache::ASTCacheEntry::releaseAST()
+{
+  return std::move(_AST);
+}
+
 size_t ASTCache::ASTCacheEntry::hitCount() const
 {
   return _hitCount;
@@ -90,6 +345,21 @@ std::chrono::steady_clock::time_point ASTCache::ASTCacheEntry::lastHit() const
   return _lastHit;
 }
 
+size_t ASTCache::ASTCacheEntry::memorySize() const
+{
+  return _memorySize;
+}
+
+const std::string& ASTCache::ASTCacheEntry::contentHash() const
+{
+  return _contentHash;
+}
+
+bool ASTCache::ASTCacheEntry::serializable() const
+{
+  return _serializable;
+}
+
 size_t ASTCache::ASTCacheEntry::referenceCount() const
 {
   auto useCount = static_cast<size_t>(_AST.use_count());
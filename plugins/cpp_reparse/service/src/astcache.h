@@ -5,6 +5,8 @@
 #include <map>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <vector>
 
 // Required for the Thrift objects, such as core::FileId.
 #include "cppreparse_types.h"
@@ -36,15 +38,31 @@ class ASTCache
 public:
 
   /**
-   * @param maxCacheSize_ The maximum size of the cache above which automatic
-   * pruning of old entries will take place. This is not an absolute limit, the
-   * cache is allowed to overfill in case no more entries could be pruned.
+   * @param maxCacheSize_ The maximum number of ASTs kept in memory.
+   * @param maxMemory_ The maximum estimated memory footprint of the ASTs kept
+   * in memory, in bytes.
+   * Above either limit, automatic pruning of the least recently used entries
+   * takes place. These are not absolute limits, the cache is allowed to
+   * overfill in case no more entries could be pruned.
+   * @param swapDirectory_ If not empty, pruned ASTs are serialized into this
+   * directory instead of being dropped, so they can be loaded again without
+   * parsing the source file.
+   * @param maxSwapSize_ The maximum size of the serialized ASTs on the disk,
+   * in bytes. Above this, the least recently used AST files are deleted.
    */
-  ASTCache(size_t maxCacheSize_);
+  ASTCache(
+    size_t maxCacheSize_,
+    size_t maxMemory_,
+    std::string swapDirectory_ = std::string(),
+    size_t maxSwapSize_ = 0);
 
   ASTCache(const ASTCache&) = delete;
   ASTCache& operator=(const ASTCache&) = delete;
-  ~ASTCache() = default;
+
+  /**
+   * Deletes the serialized ASTs from the swap directory.
+   */
+  ~ASTCache();
 
   /**
    * Retrieves the AST stored for the given file ID, or a nullptr if none is
@@ -52,21 +70,48 @@ public:
    */
   std::shared_ptr<clang::ASTUnit> getAST(const core::FileId& id_);
 
+  /**
+   * Returns the path of the AST file the AST of the given file was serialized
+   * to when it was pruned, or an empty string if there is no such file. An AST
+   * file which was serialized from another content of the file is deleted.
+   */
+  std::string getSwappedASTPath(
+    const core::FileId& id_,
+    const std::string& contentHash_);
+
+  /**
+   * Tells whether the AST of the given file is either in memory or swapped
+   * out to the disk.
+   */
+  bool contains(const core::FileId& id_);
+
   /**
    * Store the AST for the given file in the cache. The AST Cache takes
    * ownership over the ASTUnit. The method returns the shared pointer that
    * wraps the ASTUnit argument given.
+   * @param contentHash_ The hash of the content the AST was built from. It
+   * tells whether the AST is still valid when it is swapped in again.
    */
   std::shared_ptr<clang::ASTUnit> storeAST(
     const core::FileId& id_,
-    std::unique_ptr<clang::ASTUnit> AST_);
+    std::unique_ptr<clang::ASTUnit> AST_,
+    const std::string& contentHash_);
+
+  /**
+   * Returns the estimated memory footprint of the given AST in bytes. This
+   * covers the allocations of the AST context, the source manager and the
+   * preprocessor, which dominate the size of an ASTUnit.
+   */
+  static size_t estimateMemory(const clang::ASTUnit& AST_);
 
 private:
 
   class ASTCacheEntry
   {
   public:
-    ASTCacheEntry(std::unique_ptr<clang::ASTUnit> AST_);
+    ASTCacheEntry(
+      std::unique_ptr<clang::ASTUnit> AST_,
+      std::string contentHash_);
     ASTCacheEntry(const ASTCacheEntry&) = delete;
     ASTCacheEntry(ASTCacheEntry&&) = default;
     ~ASTCacheEntry() = default;
@@ -75,8 +120,21 @@ private:
 
     std::shared_ptr<clang::ASTUnit> getAST();
 
+    /**
+     * Releases the AST from the entry without counting it as a hit.
+     */
+    std::shared_ptr<clang::ASTUnit> releaseAST();
+
     size_t hitCount() const;
     std::chrono::steady_clock::time_point lastHit() const;
+    size_t memorySize() const;
+    const std::string& contentHash() const;
+
+    /**
+     * Tells whether the AST can be serialized into the swap directory. An AST
+     * loaded from an AST file has no Sema, which ASTUnit::Save() requires.
+     */
+    bool serializable() const;
 
     /**
      * Returns the number of EXTERNAL (not counting the reference made by the
@@ -98,17 +156,72 @@ private:
      * retrieved, this timestamp stores the time when it was stored.
      */
     std::chrono::steady_clock::time_point _lastHit;
+
+    /**
+     * The estimated memory footprint of the AST, computed once when stored.
+     */
+    size_t _memorySize;
+
+    std::string _contentHash;
+
+    bool _serializable;
   };
 
   /**
-   * Handles the clearing of the cache if there are more elements than
-   * _maxCacheSize stored.
+   * An AST serialized to the swap directory.
+   */
+  struct SwapEntry
+  {
+    std::string path;
+    std::string contentHash;
+    size_t size;
+
+    /**
+     * The last time the AST file was written or asked for.
+     */
+    std::chrono::steady_clock::time_point lastUsed;
+  };
+
+  /**
+   * Removes the least recently used entries while the cache is over one of
+   * its limits. The entries are removed from the map under the lock, and the
+   * (potentially slow) serialization of swapped out ASTs happens after the
+   * lock is released.
    */
   void pruneEntries();
 
+  /**
+   * Removes the least recently used AST files from the map while they are
+   * over the size limit of the swap directory. The files have to be deleted
+   * by the caller, after the lock is released.
+   */
+  void pruneSwapped(std::vector<std::string>& toDelete_);
+
+  /**
+   * Forgets the AST file of the given file, and collects it for deletion.
+   */
+  void dropSwapped(
+    std::map<core::FileId, SwapEntry>::iterator it_,
+    std::vector<std::string>& toDelete_);
+
+  static void deleteFiles(const std::vector<std::string>& paths_);
+
+  std::string swapPath(const core::FileId& id_) const;
+
   std::mutex _lock;
   std::map<core::FileId, ASTCacheEntry> _cache;
   size_t _maxCacheSize;
+  size_t _maxMemory;
+  size_t _memoryUsage;
+
+  std::string _swapDirectory;
+  size_t _maxSwapSize;
+  size_t _swapUsage;
+
+  /**
+   * Files whose AST was serialized to the swap directory.
+   */
+  std::map<core::FileId, SwapEntry> _swapped;
 };
 
 } // namespace reparse
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <chrono>
 
 #include <boost/optional.hpp>
@@ -16,6 +17,7 @@
 
 #include "astcache.h"
 #include "asthtml.h"
+#include "reparsescheduler.h"
 
 namespace
 {
@@ -56,12 +58,28 @@ CppReparseServiceHandler::CppReparseServiceHandler(
       maxCacheSize = jobs;
     }
 
-    _astCache = std::make_shared<ASTCache>(maxCacheSize);
-    _reparser = std::make_unique<CppReparser>(_db, _astCache);
+    size_t maxMemory = _config["ast-cache-memory-limit"].as<size_t>() << 20;
+    std::string swapDirectory = _config.count("ast-cache-swap-dir")
+      ? _config["ast-cache-swap-dir"].as<std::string>()
+      : std::string();
+
+    size_t maxSwapSize = _config["ast-cache-swap-limit"].as<size_t>() << 20;
+
+    _astCache = std::make_shared<ASTCache>(
+      maxCacheSize, maxMemory, swapDirectory, maxSwapSize);
+    _reparser = std::make_shared<CppReparser>(_db, _astCache);
+    _scheduler = std::make_unique<ReparseScheduler>(
+      _reparser, _astCache, _config["reparse-threads"].as<size_t>(),
+      _config["ast-prewarm-neighbours"].as<size_t>());
   }
 }
 
-CppReparseServiceHandler::~CppReparseServiceHandler() = default;
+CppReparseServiceHandler::~CppReparseServiceHandler()
+{
+  // The workers of the scheduler use the reparser, so they must be stopped
+  // first.
+  _scheduler.reset();
+}
 
 bool CppReparseServiceHandler::isEnabled()
 {
@@ -78,7 +96,7 @@ void CppReparseServiceHandler::getAsHTML(
     return;
   }
 
-  auto result = _reparser->getASTForTranslationUnitFile(fileId_);
+  auto result = _scheduler->getAST(fileId_);
   if (std::string* err = boost::get<std::string>(&result))
   {
     return_ = "The AST could not be obtained. " + *err + " - The server log "
@@ -118,7 +136,7 @@ void CppReparseServiceHandler::getAsHTMLForNode(
   }
 
   core::FileId fileId_ = std::to_string(astNode->location.file.object_id());
-  auto result = _reparser->getASTForTranslationUnitFile(fileId_);
+  auto result = _scheduler->getAST(fileId_);
   if (std::string* err = boost::get<std::string>(&result))
   {
     return_ = "The AST could not be obtained. " + *err + " - The server log "
@@ -145,6 +163,87 @@ void CppReparseServiceHandler::getAsHTMLForNode(
   return_ = htmlFactory.str();
 }
 
+void CppReparseServiceHandler::submitReparse(
+  std::string& return_,
+  const core::FileId& fileId_)
+{
+  if (!isEnabled())
+    return;
+
+  return_ = _scheduler->submit(fileId_);
+}
+
+void CppReparseServiceHandler::waitReparse(
+  ReparseJob& return_,
+  const std::string& jobId_,
+  const std::int32_t timeoutMillis_)
+{
+  return_.jobId = jobId_;
+
+  if (!isEnabled())
+  {
+    return_.state = ReparseJobState::Failed;
+    return_.error = "Reparse capabilities has been disabled at server start.";
+    return;
+  }
+
+  ReparseScheduler::JobStatus status = _scheduler->wait(
+    jobId_, std::chrono::milliseconds(std::max(timeoutMillis_, 0)));
+
+  return_.fileId = status.fileId;
+  return_.error = status.error;
+  return_.buildMillis = status.buildMillis;
+
+  switch (status.state)
+  {
+    case ReparseScheduler::State::Queued:
+      return_.state = ReparseJobState::Queued;
+      break;
+    case ReparseScheduler::State::Running:
+      return_.state = ReparseJobState::Running;
+      break;
+    case ReparseScheduler::State::Done:
+      return_.state = ReparseJobState::Done;
+      break;
+    case ReparseScheduler::State::Failed:
+      return_.state = ReparseJobState::Failed;
+      break;
+    case ReparseScheduler::State::Cancelled:
+      return_.state = ReparseJobState::Cancelled;
+      break;
+  }
+}
+
+bool CppReparseServiceHandler::cancelReparse(const std::string& jobId_)
+{
+  if (!isEnabled())
+    return false;
+
+  return _scheduler->cancel(jobId_);
+}
+
+void CppReparseServiceHandler::getReparseStatistics(
+  ReparseStatistics& return_)
+{
+  if (!isEnabled())
+    return;
+
+  ReparseScheduler::Statistics stats = _scheduler->statistics();
+  std::uint64_t finished = stats.completedBuilds + stats.failedBuilds;
+
+  return_.queueDepth = stats.queueDepth;
+  return_.runningBuilds = stats.runningBuilds;
+  return_.completedBuilds = stats.completedBuilds;
+  return_.failedBuilds = stats.failedBuilds;
+  return_.cancelledBuilds = stats.cancelledBuilds;
+  return_.coalescedRequests = stats.coalescedRequests;
+  return_.averageBuildMillis = finished
+    ? static_cast<double>(stats.totalBuildMillis) / finished
+    : 0.0;
+  return_.maxBuildMillis = stats.maxBuildMillis;
+  return_.cacheHits = stats.cacheHits;
+}
+
 } // namespace language
 } // namespace service
 } // namespace cc
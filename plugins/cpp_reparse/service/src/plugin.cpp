@@ -23,6 +23,36 @@ extern "C"
        "The maximum number of reparsed syntax trees that should be cached in "
        "memory.");
 
+    description.add_options()
+      ("ast-cache-memory-limit", po::value<size_t>()->default_value(4096),
+       "The maximum estimated memory (in MiB) used by the reparsed syntax "
+       "trees cached in memory. The least recently used trees are pruned "
+       "above this limit.");
+
+    description.add_options()
+      ("ast-cache-swap-dir", po::value<std::string>(),
+       "If given, syntax trees pruned from the memory cache are serialized "
+       "into this directory instead of being dropped, and are loaded from "
+       "there when requested again. The files are deleted when the server "
+       "stops.");
+
+    description.add_options()
+      ("ast-cache-swap-limit", po::value<size_t>()->default_value(8192),
+       "The maximum size (in MiB) of the syntax trees serialized into the "
+       "swap directory. The least recently used ones are deleted above this "
+       "limit.");
+
+    description.add_options()
+      ("ast-prewarm-neighbours", po::value<size_t>()->default_value(2),
+       "The number of other translation units in the directory of a "
+       "requested file whose syntax tree is built in the background, when "
+       "no request is waiting for a build. 0 turns prewarming off.");
+
+    description.add_options()
+      ("reparse-threads", po::value<size_t>()->default_value(2),
+       "The number of syntax trees built at the same time. Reparse requests "
+       "above this are queued, requests for the same file share one build.");
+
     return description;
   }
 
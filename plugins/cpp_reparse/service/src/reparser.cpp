@@ -1,6 +1,10 @@
+#include <algorithm>
+
 #include <boost/algorithm/string.hpp>
 
 #include <clang/Frontend/ASTUnit.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Serialization/PCHContainerOperations.h>
 #include <clang/Tooling/CompilationDatabase.h>
 #include <clang/Tooling/Tooling.h>
 
@@ -41,8 +45,10 @@ CppReparser::CppReparser(
   std::shared_ptr<ASTCache> astCache_)
   : _db(db_),
     _transaction(db_),
-    _astCache(astCache_)
-{}
+    _astCache(astCache_),
+    _pchContainerOps(std::make_shared<PCHContainerOperations>())
+{
+}
 
 std::string CppReparser::getFilenameForId(const core::FileId& fileId_)
 {
@@ -59,6 +65,21 @@ std::string CppReparser::getFilenameForId(const core::FileId& fileId_)
   return fileName;
 }
 
+std::string CppReparser::getContentHashForId(const core::FileId& fileId_)
+{
+  std::string contentHash;
+
+  _transaction([&, this](){
+    model::FilePtr res = _db->query_one<model::File>(
+      FileQuery::id == std::stoull(fileId_));
+
+    if (res && res->content)
+      contentHash = res->content.object_id();
+  });
+
+  return contentHash;
+}
+
 boost::variant<
   std::unique_ptr<clang::tooling::FixedCompilationDatabase>, std::string>
 CppReparser::getCompilationCommandForFile(
@@ -149,44 +170,118 @@ CppReparser::getASTForTranslationUnitFile(
   const core::FileId& fileId_)
 {
   std::shared_ptr<ASTUnit> AST = _astCache->getAST(fileId_);
-  if (!AST)
+  if (AST)
+    return AST;
+
+  std::string contentHash = getContentHashForId(fileId_);
+
+  std::string swapPath = _astCache->getSwappedASTPath(fileId_, contentHash);
+  if (!swapPath.empty())
   {
-    LOG(debug) << "Fetching AST for " << fileId_ << " from database...";
+    LOG(debug) << "Loading AST for " << fileId_ << " from " << swapPath;
 
-    auto compilation = getCompilationCommandForFile(fileId_);
-    if (std::string* err = boost::get<std::string>(&compilation))
-    {
-      return "Failed to generate compilation command for file #" +
-        std::to_string(std::stoull(fileId_)) + ": " + *err;
-    }
+    std::unique_ptr<ASTUnit> loaded = loadSwappedAST(swapPath);
+    if (loaded)
+      return _astCache->storeAST(fileId_, std::move(loaded), contentHash);
 
-    // TODO: FIXME: Change this into the shortcutting overlay creation once the interface is upstreamed. (https://reviews.llvm.org/D45094)
-    IntrusiveRefCntPtr<DatabaseFileSystem> dbfs(
-      new DatabaseFileSystem(_db));
-    IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> overlayFs(
-      new llvm::vfs::OverlayFileSystem(llvm::vfs::getRealFileSystem()));
-    overlayFs->pushOverlay(dbfs);
+    LOG(warning) << "Failed to load serialized AST " << swapPath
+                 << ", the file will be parsed again.";
+  }
 
-    auto compileDb = std::move(
-      boost::get<std::unique_ptr<clang::tooling::FixedCompilationDatabase>>(
-        compilation));
+  LOG(debug) << "Fetching AST for " << fileId_ << " from database...";
 
-    ClangTool tool(
-      *compileDb, getFilenameForId(fileId_),
-      std::make_shared<clang::PCHContainerOperations>(), overlayFs);
+  auto compilation = getCompilationCommandForFile(fileId_);
+  if (std::string* err = boost::get<std::string>(&compilation))
+  {
+    return "Failed to generate compilation command for file #" +
+      std::to_string(std::stoull(fileId_)) + ": " + *err;
+  }
 
-    std::vector<std::unique_ptr<ASTUnit>> vect;
-    int error = tool.buildASTs(vect);
-    if (error)
-    {
-      return "Execution of parsing the AST failed with error code " +
-        std::to_string(error);
-    }
+  auto compileDb = std::move(
+    boost::get<std::unique_ptr<clang::tooling::FixedCompilationDatabase>>(
+      compilation));
 
-    AST = _astCache->storeAST(fileId_, std::move(vect.at(0)));
+  ClangTool tool(
+    *compileDb, getFilenameForId(fileId_), _pchContainerOps,
+    createFileSystem());
+
+  std::vector<std::unique_ptr<ASTUnit>> vect;
+  int error = tool.buildASTs(vect);
+  if (error)
+  {
+    return "Execution of parsing the AST failed with error code " +
+      std::to_string(error);
   }
 
-  return AST;
+  return _astCache->storeAST(fileId_, std::move(vect.at(0)), contentHash);
+}
+
+std::unique_ptr<ASTUnit> CppReparser::loadSwappedAST(const std::string& path_)
+{
+  IntrusiveRefCntPtr<DiagnosticsEngine> diags =
+    CompilerInstance::createDiagnostics(
+      new DiagnosticOptions(), new IgnoringDiagConsumer());
+
+  return ASTUnit::LoadFromASTFile(
+    path_,
+    _pchContainerOps->getRawReader(),
+    ASTUnit::LoadEverything,
+    diags,
+    FileSystemOptions(),
+    /* UseDebugInfo = */ false,
+    /* OnlyLocalDecls = */ false,
+    CaptureDiagsKind::None,
+    /* AllowASTWithCompilerErrors = */ true,
+    /* UserFilesAreVolatile = */ false,
+    createFileSystem());
+}
+
+IntrusiveRefCntPtr<llvm::vfs::FileSystem> CppReparser::createFileSystem()
+{
+  // TODO: FIXME: Change this into the shortcutting overlay creation once the interface is upstreamed. (https://reviews.llvm.org/D45094)
+  IntrusiveRefCntPtr<DatabaseFileSystem> dbfs(
+    new DatabaseFileSystem(_db));
+  IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> overlayFs(
+    new llvm::vfs::OverlayFileSystem(llvm::vfs::getRealFileSystem()));
+  overlayFs->pushOverlay(dbfs);
+
+  return overlayFs;
+}
+
+std::vector<core::FileId> CppReparser::getUncachedNeighbours(
+  const core::FileId& fileId_,
+  size_t maxCount_)
+{
+  std::vector<core::FileId> neighbours;
+
+  if (maxCount_ == 0)
+    return neighbours;
+
+  _transaction([&, this](){
+    model::FilePtr file = _db->query_one<model::File>(
+      FileQuery::id == std::stoull(fileId_));
+    if (!file || !file->parent)
+      return;
+
+    BuildSourceResult sources = _db->query<model::BuildSource>(
+      BuildSourceQuery::file->parent == file->parent.object_id());
+
+    for (const model::BuildSource& source : sources)
+    {
+      core::FileId id = std::to_string(source.file->id);
+      if (id == fileId_ ||
+          std::find(neighbours.begin(), neighbours.end(), id)
+            != neighbours.end() ||
+          _astCache->contains(id))
+        continue;
+
+      neighbours.push_back(id);
+      if (neighbours.size() == maxCount_)
+        break;
+    }
+  });
+
+  return neighbours;
 }
 
 } // namespace reparse
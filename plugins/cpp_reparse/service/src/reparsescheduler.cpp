@@ -0,0 +1,338 @@
+#include <algorithm>
+
+#include <clang/Frontend/ASTUnit.h>
+
+#include <util/logutil.h>
+
+#include <service/reparser.h>
+
+#include "astcache.h"
+#include "reparsescheduler.h"
+
+namespace cc
+{
+
+namespace service
+{
+
+namespace reparse
+{
+
+ReparseScheduler::ReparseScheduler(
+  std::shared_ptr<CppReparser> reparser_,
+  std::shared_ptr<ASTCache> astCache_,
+  std::size_t threadCount_,
+  std::size_t prewarmNeighbours_)
+  : _reparser(std::move(reparser_)),
+    _astCache(std::move(astCache_)),
+    _threadCount(std::max<std::size_t>(threadCount_, 1)),
+    _prewarmNeighbours(prewarmNeighbours_),
+    _nextJobId(0),
+    _shutdown(false)
+{
+  _pool = util::make_thread_pool<std::shared_ptr<Build>>(
+    _threadCount,
+    [this](std::shared_ptr<Build>& build_)
+    {
+      runBuild(build_);
+    },
+    true);
+}
+
+ReparseScheduler::~ReparseScheduler()
+{
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    _shutdown = true;
+  }
+
+  _pool->wait();
+}
+
+bool ReparseScheduler::isFinished(State state_)
+{
+  return state_ == State::Done || state_ == State::Failed ||
+    state_ == State::Cancelled;
+}
+
+std::shared_ptr<ReparseScheduler::Build> ReparseScheduler::getBuild(
+  const core::FileId& fileId_)
+{
+  auto it = _inFlight.find(fileId_);
+  if (it != _inFlight.end())
+  {
+    ++_statistics.coalescedRequests;
+
+    auto queued = std::find(
+      _prewarmQueue.begin(), _prewarmQueue.end(), it->second);
+    if (queued != _prewarmQueue.end())
+    {
+      _prewarmQueue.erase(queued);
+      ++_statistics.queueDepth;
+      _pool->enqueue(it->second);
+    }
+
+    return it->second;
+  }
+
+  auto build = std::make_shared<Build>();
+  build->fileId = fileId_;
+  _inFlight.emplace(fileId_, build);
+
+  ++_statistics.queueDepth;
+  _pool->enqueue(build);
+
+  return build;
+}
+
+std::string ReparseScheduler::submit(const core::FileId& fileId_)
+{
+  bool cached = _astCache->getAST(fileId_) != nullptr;
+
+  std::lock_guard<std::mutex> lock(_lock);
+
+  Job job;
+  job.fileId = fileId_;
+
+  if (cached)
+  {
+    // The job is finished at once, the AST is taken from the cache when the
+    // client asks for the result.
+    job.build = std::make_shared<Build>();
+    job.build->fileId = fileId_;
+    job.build->state = State::Done;
+    ++_statistics.cacheHits;
+  }
+  else
+    job.build = getBuild(fileId_);
+
+  ++job.build->interested;
+
+  std::string jobId = std::to_string(++_nextJobId);
+  _jobs.emplace(jobId, std::move(job));
+  _jobOrder.push_back(jobId);
+  forgetOldJobs();
+
+  LOG(debug) << "Reparse job #" << jobId << " submitted for file #" << fileId_
+             << ", queue depth: " << _statistics.queueDepth;
+
+  return jobId;
+}
+
+ReparseScheduler::JobStatus ReparseScheduler::wait(
+  const std::string& jobId_,
+  std::chrono::milliseconds timeout_)
+{
+  std::unique_lock<std::mutex> lock(_lock);
+
+  auto it = _jobs.find(jobId_);
+  if (it == _jobs.end())
+  {
+    JobStatus status;
+    status.jobId = jobId_;
+    status.state = State::Failed;
+    status.error = "Unknown reparse job.";
+    status.buildMillis = 0;
+    return status;
+  }
+
+  // The iterator is not reused after waiting, as old jobs may be forgotten
+  // while the lock is released.
+  std::shared_ptr<Build> build = it->second.build;
+  _finished.wait_for(lock, timeout_, [&]{ return isFinished(build->state); });
+
+  it = _jobs.find(jobId_);
+  if (it == _jobs.end())
+  {
+    Job job;
+    job.build = build;
+    job.fileId = build->fileId;
+    return jobStatus(jobId_, job);
+  }
+
+  return jobStatus(jobId_, it->second);
+}
+
+bool ReparseScheduler::cancel(const std::string& jobId_)
+{
+  std::lock_guard<std::mutex> lock(_lock);
+
+  auto it = _jobs.find(jobId_);
+  if (it == _jobs.end() || it->second.cancelled ||
+      isFinished(it->second.build->state))
+    return false;
+
+  it->second.cancelled = true;
+  --it->second.build->interested;
+
+  LOG(debug) << "Reparse job #" << jobId_ << " cancelled.";
+
+  return true;
+}
+
+ReparseScheduler::Statistics ReparseScheduler::statistics()
+{
+  std::lock_guard<std::mutex> lock(_lock);
+  return _statistics;
+}
+
+boost::variant<std::shared_ptr<clang::ASTUnit>, std::string>
+ReparseScheduler::getAST(const core::FileId& fileId_)
+{
+  if (std::shared_ptr<clang::ASTUnit> AST = _astCache->getAST(fileId_))
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    ++_statistics.cacheHits;
+    return AST;
+  }
+
+  std::unique_lock<std::mutex> lock(_lock);
+
+  std::shared_ptr<Build> build = getBuild(fileId_);
+  ++build->interested;
+  ++build->syncWaiters;
+
+  _finished.wait(lock, [&]{ return isFinished(build->state); });
+
+  std::shared_ptr<clang::ASTUnit> AST = build->AST;
+  if (--build->syncWaiters == 0)
+    build->AST.reset();
+  --build->interested;
+
+  if (build->state == State::Failed)
+    return build->error;
+  if (build->state == State::Cancelled)
+    return std::string("The reparse server is shutting down.");
+
+  return AST;
+}
+
+void ReparseScheduler::runBuild(std::shared_ptr<Build>& build_)
+{
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    --_statistics.queueDepth;
+
+    if (_shutdown || (build_->interested == 0 && !build_->prewarm))
+    {
+      build_->state = State::Cancelled;
+      _inFlight.erase(build_->fileId);
+      ++_statistics.cancelledBuilds;
+      _finished.notify_all();
+      startPrewarm();
+      return;
+    }
+
+    build_->state = State::Running;
+    ++_statistics.runningBuilds;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto result = _reparser->getASTForTranslationUnitFile(build_->fileId);
+  std::int64_t buildMillis =
+    std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start).count();
+
+  // The neighbours of prewarmed files are not prewarmed, so a request does
+  // not spread over the whole project.
+  std::vector<core::FileId> neighbours;
+  if (!build_->prewarm && boost::get<std::shared_ptr<clang::ASTUnit>>(&result))
+    neighbours = _reparser->getUncachedNeighbours(
+      build_->fileId, _prewarmNeighbours);
+
+  std::lock_guard<std::mutex> lock(_lock);
+
+  --_statistics.runningBuilds;
+  _statistics.totalBuildMillis += buildMillis;
+  _statistics.maxBuildMillis =
+    std::max(_statistics.maxBuildMillis, buildMillis);
+  build_->buildMillis = buildMillis;
+
+  if (std::string* err = boost::get<std::string>(&result))
+  {
+    build_->state = State::Failed;
+    build_->error = *err;
+    ++_statistics.failedBuilds;
+  }
+  else
+  {
+    build_->state = State::Done;
+    if (build_->syncWaiters > 0)
+      build_->AST = boost::get<std::shared_ptr<clang::ASTUnit>>(result);
+    ++_statistics.completedBuilds;
+  }
+
+  LOG(debug) << "Reparse of file #" << build_->fileId << " finished in "
+             << buildMillis << " ms, queue depth: "
+             << _statistics.queueDepth;
+
+  _inFlight.erase(build_->fileId);
+  _finished.notify_all();
+
+  queuePrewarm(neighbours);
+  startPrewarm();
+}
+
+void ReparseScheduler::queuePrewarm(const std::vector<core::FileId>& fileIds_)
+{
+  if (_shutdown)
+    return;
+
+  for (const core::FileId& fileId : fileIds_)
+  {
+    if (_inFlight.count(fileId))
+      continue;
+
+    auto build = std::make_shared<Build>();
+    build->fileId = fileId;
+    build->prewarm = true;
+    _inFlight.emplace(fileId, build);
+    _prewarmQueue.push_back(build);
+
+    LOG(debug) << "Prewarming AST for file #" << fileId << " is queued.";
+  }
+}
+
+void ReparseScheduler::startPrewarm()
+{
+  while (!_shutdown && !_prewarmQueue.empty() &&
+    _statistics.queueDepth + _statistics.runningBuilds < _threadCount)
+  {
+    ++_statistics.queueDepth;
+    _pool->enqueue(_prewarmQueue.front());
+    _prewarmQueue.pop_front();
+  }
+}
+
+ReparseScheduler::JobStatus ReparseScheduler::jobStatus(
+  const std::string& jobId_,
+  const Job& job_) const
+{
+  JobStatus status;
+  status.jobId = jobId_;
+  status.fileId = job_.fileId;
+  status.state = job_.cancelled ? State::Cancelled : job_.build->state;
+  status.error = job_.build->error;
+  status.buildMillis = job_.build->buildMillis;
+  return status;
+}
+
+void ReparseScheduler::forgetOldJobs()
+{
+  while (_jobOrder.size() > maxJobHistory)
+  {
+    auto it = _jobs.find(_jobOrder.front());
+    if (it != _jobs.end())
+    {
+      if (!it->second.cancelled && !isFinished(it->second.build->state))
+        --it->second.build->interested;
+      _jobs.erase(it);
+    }
+
+    _jobOrder.pop_front();
+  }
+}
+
+} // namespace reparse
+} // namespace service
+} // namespace cc
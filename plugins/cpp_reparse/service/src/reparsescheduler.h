@@ -0,0 +1,252 @@
+#ifndef CC_SERVICE_CPPREPARSESERVICE_REPARSESCHEDULER_H
+#define CC_SERVICE_CPPREPARSESERVICE_REPARSESCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/variant.hpp>
+
+#include <util/threadpool.h>
+
+// Required for the Thrift objects, such as core::FileId.
+#include "cppreparse_types.h"
+
+namespace clang
+{
+class ASTUnit;
+} // namespace clang
+
+namespace cc
+{
+
+namespace service
+{
+
+namespace reparse
+{
+
+class ASTCache;
+class CppReparser;
+
+/**
+ * Runs the AST builds of the reparse service on a dedicated, bounded pool of
+ * worker threads, so the webserver threads are not blocked by compilations.
+ *
+ * Requests are represented by jobs which can be polled, waited for and
+ * cancelled. Concurrent jobs for the same file are coalesced onto a single
+ * in-flight build, whose result ends up in the AST cache of the reparser.
+ * Requests whose AST is already in the cache don't go through the pool, so
+ * they don't wait behind the builds of other files.
+ *
+ * After a build, the neighbouring translation units of the file are prewarmed
+ * at a low priority: their builds are only started on idle worker threads.
+ */
+class ReparseScheduler
+{
+public:
+  enum class State
+  {
+    Queued,
+    Running,
+    Done,
+    Failed,
+    Cancelled
+  };
+
+  struct JobStatus
+  {
+    std::string jobId;
+    core::FileId fileId;
+    State state;
+
+    /**
+     * The reason of the failure if the job failed.
+     */
+    std::string error;
+
+    /**
+     * The wall time the build of the AST took, or 0 if it has not finished.
+     */
+    std::int64_t buildMillis;
+  };
+
+  struct Statistics
+  {
+    /**
+     * The number of builds waiting for a worker thread.
+     */
+    std::size_t queueDepth = 0;
+    std::size_t runningBuilds = 0;
+    std::uint64_t completedBuilds = 0;
+    std::uint64_t failedBuilds = 0;
+    std::uint64_t cancelledBuilds = 0;
+
+    /**
+     * The number of requests which were attached to an already queued or
+     * running build of the same file.
+     */
+    std::uint64_t coalescedRequests = 0;
+
+    /**
+     * The number of requests served from the AST cache without a build.
+     */
+    std::uint64_t cacheHits = 0;
+
+    std::int64_t totalBuildMillis = 0;
+    std::int64_t maxBuildMillis = 0;
+  };
+
+  /**
+   * @param astCache_ The cache in which the reparser stores the ASTs.
+   * @param threadCount_ The number of ASTs built at the same time.
+   * @param prewarmNeighbours_ The number of other translation units in the
+   * directory of a built file whose AST is built in the background. Zero
+   * turns prewarming off.
+   */
+  ReparseScheduler(
+    std::shared_ptr<CppReparser> reparser_,
+    std::shared_ptr<ASTCache> astCache_,
+    std::size_t threadCount_,
+    std::size_t prewarmNeighbours_ = 0);
+
+  ReparseScheduler(const ReparseScheduler&) = delete;
+  ReparseScheduler& operator=(const ReparseScheduler&) = delete;
+
+  /**
+   * Builds which have not been started yet are cancelled, the running ones
+   * are waited for.
+   */
+  ~ReparseScheduler();
+
+  /**
+   * Submits a job obtaining the AST of the given file.
+   * @return The ID of the job.
+   */
+  std::string submit(const core::FileId& fileId_);
+
+  /**
+   * Waits at most the given amount of time for the job to finish. A zero
+   * timeout only polls the state of the job.
+   */
+  JobStatus wait(
+    const std::string& jobId_,
+    std::chrono::milliseconds timeout_);
+
+  /**
+   * Cancels the job. The build of the file is dropped before it starts if no
+   * other job is interested in it, a running build can not be interrupted.
+   * @return False if the job is unknown or has already finished.
+   */
+  bool cancel(const std::string& jobId_);
+
+  Statistics statistics();
+
+  /**
+   * Obtains the AST of the file through the worker pool and waits for it.
+   * This is how the synchronous service methods share the builds of the
+   * asynchronous jobs.
+   */
+  boost::variant<std::shared_ptr<clang::ASTUnit>, std::string>
+  getAST(const core::FileId& fileId_);
+
+private:
+  /**
+   * An AST build in flight, shared by every job requesting the same file.
+   */
+  struct Build
+  {
+    core::FileId fileId;
+    State state = State::Queued;
+    std::string error;
+    std::int64_t buildMillis = 0;
+
+    /**
+     * Prewarm builds are run even if no job is interested in them.
+     */
+    bool prewarm = false;
+
+    /**
+     * The number of not cancelled jobs and synchronous callers waiting for
+     * this build. If it drops to zero before the build starts, the build is
+     * skipped.
+     */
+    std::size_t interested = 0;
+
+    /**
+     * The AST is only kept here while synchronous callers wait for it, the
+     * asynchronous jobs find it in the AST cache.
+     */
+    std::size_t syncWaiters = 0;
+    std::shared_ptr<clang::ASTUnit> AST;
+  };
+
+  struct Job
+  {
+    core::FileId fileId;
+    std::shared_ptr<Build> build;
+    bool cancelled = false;
+  };
+
+  /**
+   * The number of jobs remembered. Above this the oldest jobs are forgotten,
+   * so clients which never poll their jobs do not leak memory.
+   */
+  static constexpr std::size_t maxJobHistory = 1024;
+
+  static bool isFinished(State state_);
+
+  /**
+   * Returns the build of the file in flight, or queues a new one. A prewarm
+   * build which has not been handed to the pool yet is queued at once.
+   */
+  std::shared_ptr<Build> getBuild(const core::FileId& fileId_);
+  void runBuild(std::shared_ptr<Build>& build_);
+
+  /**
+   * Queues low priority builds for the files which are not in flight yet.
+   */
+  void queuePrewarm(const std::vector<core::FileId>& fileIds_);
+
+  /**
+   * Hands prewarm builds to the pool while there are idle worker threads and
+   * no other build is waiting.
+   */
+  void startPrewarm();
+  JobStatus jobStatus(const std::string& jobId_, const Job& job_) const;
+  void forgetOldJobs();
+
+  std::shared_ptr<CppReparser> _reparser;
+  std::shared_ptr<ASTCache> _astCache;
+  std::size_t _threadCount;
+  std::size_t _prewarmNeighbours;
+
+  std::mutex _lock;
+  std::condition_variable _finished;
+
+  std::map<core::FileId, std::shared_ptr<Build>> _inFlight;
+  std::map<std::string, Job> _jobs;
+  std::deque<std::string> _jobOrder;
+
+  /**
+   * Prewarm builds not handed to the pool yet.
+   */
+  std::deque<std::shared_ptr<Build>> _prewarmQueue;
+  std::uint64_t _nextJobId;
+  Statistics _statistics;
+  bool _shutdown;
+
+  std::unique_ptr<util::JobQueueThreadPool<std::shared_ptr<Build>>> _pool;
+};
+
+} // namespace reparse
+} // namespace service
+} // namespace cc
+
+#endif // CC_SERVICE_CPPREPARSESERVICE_REPARSESCHEDULER_H
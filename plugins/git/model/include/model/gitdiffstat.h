@@ -0,0 +1,167 @@
+#ifndef CC_MODEL_GITDIFFSTAT_H
+#define CC_MODEL_GITDIFFSTAT_H
+
+#include <cstdint>
+#include <string>
+
+#include <odb/core.hxx>
+
+#include <util/hash.h>
+
+namespace cc
+{
+namespace model
+{
+
+/**
+ * A commit whose diff statistics have been computed. Every commit reachable
+ * from the references gets one, including merge and empty commits which have
+ * no GitDiffStat rows, so a re-parse knows which commits are done.
+ */
+#pragma db object
+struct GitDiffCommit
+{
+  /**
+   * Hash of the repository ID and the commit ID.
+   */
+  #pragma db id
+  std::uint64_t id;
+
+  /**
+   * Repository ID, the same hash as the name of the bare copy under the
+   * workspace's version directory.
+   */
+  #pragma db not_null
+  std::uint64_t repo;
+
+  #pragma db not_null
+  std::string commit;
+
+  /**
+   * Commit time in seconds since the epoch (UTC).
+   */
+  #pragma db not_null
+  std::int64_t time;
+
+#pragma db index("GitDiffCommit_repo_idx") member(repo)
+};
+
+/**
+ * A path which has been changed by at least one commit of the repository.
+ * The path is stored once here instead of in every GitDiffStat row.
+ */
+#pragma db object
+struct GitDiffPath
+{
+  /**
+   * Hash of the repository ID and the path.
+   */
+  #pragma db id
+  std::uint64_t id;
+
+  #pragma db not_null
+  std::uint64_t repo;
+
+  /**
+   * Path of the file relative to the repository root.
+   */
+  #pragma db not_null
+  std::string path;
+
+#pragma db index("GitDiffPath_repo_path_idx") members(repo, path)
+};
+
+/**
+ * Number of lines added to and removed from a single file by a single commit,
+ * compared to its first parent. A row is four integers, the commit and the
+ * path are referenced by their IDs. The table is only ever read through the
+ * aggregating views below.
+ */
+#pragma db object no_id
+struct GitDiffStat
+{
+  #pragma db not_null
+  std::uint64_t commit;
+
+  #pragma db not_null
+  std::uint64_t path;
+
+  #pragma db not_null
+  unsigned added;
+
+  #pragma db not_null
+  unsigned removed;
+
+#pragma db index("GitDiffStat_path_idx") member(path)
+#pragma db index("GitDiffStat_commit_idx") member(commit)
+};
+
+inline std::uint64_t createIdentifier(const GitDiffCommit& commit_)
+{
+  return util::FnvHasher()
+    .addNumber(commit_.repo).add(':')
+    .add(commit_.commit)
+    .value();
+}
+
+inline std::uint64_t createIdentifier(const GitDiffPath& path_)
+{
+  return util::FnvHasher()
+    .addNumber(path_.repo).add(':')
+    .add(path_.path)
+    .value();
+}
+
+#pragma db view object(GitDiffCommit)
+struct GitDiffCommitIdView
+{
+  #pragma db column(GitDiffCommit::id)
+  std::uint64_t id;
+};
+
+#pragma db view object(GitDiffPath)
+struct GitDiffPathIdView
+{
+  #pragma db column(GitDiffPath::id)
+  std::uint64_t id;
+};
+
+#pragma db view \
+  object(GitDiffStat) \
+  object(GitDiffCommit : GitDiffStat::commit == GitDiffCommit::id)
+struct GitChurnView
+{
+  #pragma db column("sum(" + GitDiffStat::added + ")")
+  std::int64_t added;
+
+  #pragma db column("sum(" + GitDiffStat::removed + ")")
+  std::int64_t removed;
+
+  #pragma db column("count(distinct " + GitDiffStat::commit + ")")
+  std::size_t commits;
+};
+
+#pragma db view \
+  object(GitDiffStat) \
+  object(GitDiffCommit : GitDiffStat::commit == GitDiffCommit::id) \
+  object(GitDiffPath : GitDiffStat::path == GitDiffPath::id) \
+  query((?) + " GROUP BY " + GitDiffPath::path)
+struct GitPathChurnView
+{
+  #pragma db column(GitDiffPath::path)
+  std::string path;
+
+  #pragma db column("sum(" + GitDiffStat::added + ")")
+  std::int64_t added;
+
+  #pragma db column("sum(" + GitDiffStat::removed + ")")
+  std::int64_t removed;
+
+  #pragma db column("count(distinct " + GitDiffStat::commit + ")")
+  std::size_t commits;
+};
+
+} // model
+} // cc
+
+#endif // CC_MODEL_GITDIFFSTAT_H
@@ -1,10 +1,18 @@
 #ifndef CC_PARSER_GITPARSER_H
 #define CC_PARSER_GITPARSER_H
 
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
 #include <parser/abstractparser.h>
 #include <parser/parsercontext.h>
 
 #include <util/parserutil.h>
+#include <util/threadpool.h>
 
 namespace cc
 {
@@ -17,9 +25,72 @@ public:
   GitParser(ParserContext& ctx_);
   virtual ~GitParser();
   virtual bool parse() override;
+
 private:
+  /**
+   * A repository (or submodule) discovered under the input paths.
+   */
+  struct Repository
+  {
+    std::string id;
+    std::string name;
+    std::string path;
+  };
+
   static int getSubmodulePaths(git_submodule *sm, const char *smName, void *payload);
-  util::DirIterCallback getParserCallback();
+  util::DirEntryCallback getParserCallback();
+
+  /**
+   * Makes the bare copy of the repository in the version data directory up to
+   * date: an existing copy is fetched into, otherwise a new one is created.
+   * This function is called concurrently from the parser's thread pool.
+   * @return True if the copy is usable after the operation.
+   */
+  bool syncRepository(const Repository& repo_);
+  bool cloneRepository(const Repository& repo_, const std::string& clonePath_);
+  bool fetchRepository(const Repository& repo_, git_repository* clone_);
+
+  /**
+   * A batch of commits of a repository whose diff statistics are computed and
+   * persisted together by a worker thread.
+   */
+  struct DiffStatJob
+  {
+    Repository repo;
+    std::vector<git_oid> commits;
+  };
+
+  /**
+   * Collects the commits of the repository's bare copy which have no diff
+   * statistics in the database yet, and enqueues them in batches. The paths
+   * of the repository already in the database are loaded to _knownPaths.
+   */
+  void enqueueDiffStatJobs(
+    const Repository& repo_,
+    util::JobQueueThreadPool<DiffStatJob>& pool_);
+
+  /**
+   * Computes and persists the number of added and removed lines per file for
+   * every commit of the job. Merge commits have no statistics, the same way
+   * as in git log --numstat by default, but they are recorded as processed.
+   */
+  void persistDiffStats(const DiffStatJob& job_);
+
+  std::string _versionDataDir;
+
+  /**
+   * Repositories collected during the directory traversal, keyed by their ID,
+   * so a repository reachable through several paths is synchronized once.
+   */
+  std::map<std::string, Repository> _repositories;
+  std::mutex _repositoriesMutex;
+
+  /**
+   * IDs of the GitDiffPath rows which are persisted or are being persisted
+   * by a diff statistics job. A job removes its IDs if its transaction fails.
+   */
+  std::unordered_set<std::uint64_t> _knownPaths;
+  std::mutex _knownPathsMutex;
 };
 
 } // parser
@@ -1,3 +1,8 @@
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <unordered_set>
+
 #include <boost/filesystem.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/ini_parser.hpp>
@@ -7,6 +12,13 @@
 #include <util/parserutil.h>
 #include <util/hash.h>
 #include <util/logutil.h>
+#include <util/odbtransaction.h>
+#include <util/threadpool.h>
+
+#include <model/gitdiffstat.h>
+#include <model/gitdiffstat-odb.hxx>
+
+#include <parser/filecatalog.h>
 
 #include <gitparser/gitparser.h>
 
@@ -18,6 +30,9 @@ namespace parser
 GitParser::GitParser(ParserContext& ctx_) : AbstractParser(ctx_)
 {
   git_libgit2_init();
+
+  _versionDataDir = _ctx.options["workspace"].as<std::string>() + '/'
+    + _ctx.options["name"].as<std::string>() + "/version";
 }
 
 int GitParser::getSubmodulePaths(git_submodule *sm, const char *smName, void *payload)
@@ -73,19 +88,15 @@ int GitParser::getSubmodulePaths(git_submodule *sm, const char *smName, void *pa
   return 0;
 }
 
-util::DirIterCallback GitParser::getParserCallback()
+util::DirEntryCallback GitParser::getParserCallback()
 {
-  std::string wsDir = _ctx.options["workspace"].as<std::string>();
-  std::string projDir = wsDir + '/' + _ctx.options["name"].as<std::string>();
-  std::string versionDataDir = projDir + "/version";
-
-  return [&, versionDataDir](const std::string& path_)
+  return [this](const std::string& path_, util::DirEntryType type_)
   {
     boost::filesystem::path mainRepoPath(path_);
 
     //--- Check for .git folder ---//
 
-    if (!boost::filesystem::is_directory(mainRepoPath) ||
+    if (type_ != util::DirEntryType::Directory ||
         ".git" != mainRepoPath.filename())
       return true;
 
@@ -115,12 +126,15 @@ util::DirIterCallback GitParser::getParserCallback()
     //--- Iterate submodules recursively. ---//
 
     git_submodule_foreach(mainRepo, getSubmodulePaths, &repoPaths);
+    git_repository_free(mainRepo);
 
     repoPaths.erase("parent");
     repoPaths.emplace(mainRepoPath.filename().string(),
                       mainRepoPath.string());
 
-    //--- Iterate through the collected repositories. ---//
+    //--- Register the collected repositories. ---//
+
+    std::lock_guard<std::mutex> lock(_repositoriesMutex);
 
     for (auto rPath : repoPaths)
     {
@@ -128,67 +142,219 @@ util::DirIterCallback GitParser::getParserCallback()
 
       LOG(info) << "Git parser found a git repo at: " << path;
 
-      std::string repoId = std::to_string(util::fnvHash(path.string()));
-      std::string clonedRepoPath = versionDataDir + "/" + repoId;
+      Repository repo;
+      repo.id = std::to_string(util::fnvHash(path.string()));
+      repo.name = path.filename().string();
+      repo.path = path.string();
 
-      LOG(info) << "GitParser cloning into " << clonedRepoPath;
+      _repositories.emplace(repo.id, std::move(repo));
+    }
 
-      //--- Remove folder if exists ---//
+    return true;
+  };
+}
 
-      boost::filesystem::remove_all(clonedRepoPath);
+bool GitParser::syncRepository(const Repository& repo_)
+{
+  std::string clonedRepoPath = _versionDataDir + "/" + repo_.id;
+
+  //--- Reuse the existing bare copy if possible ---//
+
+  if (!_ctx.options.count("git-reclone") &&
+      boost::filesystem::is_directory(clonedRepoPath))
+  {
+    git_repository *clone;
+    if (!git_repository_open_bare(&clone, clonedRepoPath.c_str()))
+    {
+      LOG(info) << "GitParser fetching into " << clonedRepoPath;
 
-      //--- Clone the repo into a bare repo ---//
+      bool success = fetchRepository(repo_, clone);
+      git_repository_free(clone);
+
+      if (success)
+        return true;
+    }
+
+    LOG(warning) << "Existing copy at " << clonedRepoPath
+                 << " can't be updated, cloning again.";
+  }
 
-      git_clone_options opts;
-      git_clone_init_options(&opts, GIT_CLONE_OPTIONS_VERSION);
-      opts.bare = true;
+  //--- Remove folder if exists ---//
 
-      git_repository *out;
-      int error =
-          git_clone(&out, path.string().c_str(), clonedRepoPath.c_str(), &opts);
+  boost::filesystem::remove_all(clonedRepoPath);
 
-      if (error)
+  LOG(info) << "GitParser cloning into " << clonedRepoPath;
+
+  return cloneRepository(repo_, clonedRepoPath);
+}
+
+bool GitParser::cloneRepository(
+  const Repository& repo_,
+  const std::string& clonePath_)
+{
+  const std::string mode = _ctx.options["git-clone-mode"].as<std::string>();
+
+  git_repository *out;
+  int error;
+
+  if (mode == "alternates")
+  {
+    //--- Create an empty bare repo borrowing the source's objects ---//
+
+    git_repository *source;
+    error = git_repository_open(&source, repo_.path.c_str());
+
+    if (!error)
+    {
+      std::string sourceObjects
+        = std::string(git_repository_path(source)) + "objects";
+      git_repository_free(source);
+
+      error = git_repository_init(&out, clonePath_.c_str(), 1);
+
+      if (!error)
       {
-        const git_error *errDetails = giterr_last();
+        std::ofstream alternates(clonePath_ + "/objects/info/alternates");
+        alternates << sourceObjects << std::endl;
+      }
+    }
 
-        LOG(warning) << "Can't copy git repo from: " << path
-                     << " to: " << clonedRepoPath
-                     << "! Errcode: " << std::to_string(error)
-                     << "! Exception: " << errDetails->message;
+    if (!error)
+    {
+      git_remote *remote;
+      error = git_remote_create(&remote, out, "origin", repo_.path.c_str());
+
+      if (!error)
+      {
+        git_remote_free(remote);
 
-        return false;
+        bool success = fetchRepository(repo_, out);
+        git_repository_free(out);
+        return success;
       }
 
-      //--- Write repositories to repositories.txt. ---//
+      git_repository_free(out);
+    }
+  }
+  else
+  {
+    //--- Clone the repo into a bare repo ---//
+
+    git_clone_options opts;
+    git_clone_init_options(&opts, GIT_CLONE_OPTIONS_VERSION);
+    opts.bare = true;
+
+    if (mode == "hardlink")
+      opts.local = GIT_CLONE_LOCAL;
+    else if (mode == "copy")
+      opts.local = GIT_CLONE_LOCAL_NO_LINKS;
+
+    error = git_clone(&out, repo_.path.c_str(), clonePath_.c_str(), &opts);
+
+    if (!error)
+      git_repository_free(out);
+  }
+
+  if (error)
+  {
+    const git_error *errDetails = giterr_last();
+
+    LOG(warning) << "Can't copy git repo from: " << repo_.path
+                 << " to: " << clonePath_
+                 << "! Errcode: " << std::to_string(error)
+                 << "! Exception: "
+                 << (errDetails ? errDetails->message : "unknown");
+
+    return false;
+  }
+
+  return true;
+}
 
-      boost::property_tree::ptree pt;
-      std::string repoFile(versionDataDir + "/repositories.txt");
+bool GitParser::fetchRepository(
+  const Repository& repo_,
+  git_repository* clone_)
+{
+  git_remote *remote;
+  int error = git_remote_lookup(&remote, clone_, "origin");
 
-      if (boost::filesystem::is_regular_file(repoFile))
-        boost::property_tree::read_ini(repoFile, pt);
+  if (!error)
+  {
+    // Local branches are mirrored too, so the bare copy's HEAD branch follows
+    // the source repository just like after a fresh clone.
+    char* specs[] = {
+      const_cast<char*>("+refs/heads/*:refs/remotes/origin/*"),
+      const_cast<char*>("+refs/heads/*:refs/heads/*"),
+      const_cast<char*>("+refs/tags/*:refs/tags/*")};
+    git_strarray refspecs = {specs, 3};
+
+    git_fetch_options opts = GIT_FETCH_OPTIONS_INIT;
+    opts.prune = GIT_FETCH_PRUNE;
+
+    error = git_remote_fetch(remote, &refspecs, &opts, nullptr);
+    git_remote_free(remote);
+  }
 
-      pt.put(repoId + ".name", path.filename().string());
-      pt.put(repoId + ".path", path.string());
-      boost::property_tree::write_ini(repoFile, pt);
+  //--- Point HEAD to the source repository's current branch ---//
+
+  git_repository *source;
+  if (!error && !(error = git_repository_open(&source, repo_.path.c_str())))
+  {
+    git_reference *head;
+    if (!git_repository_head(&head, source))
+    {
+      if (git_reference_is_branch(head))
+        error = git_repository_set_head(clone_, git_reference_name(head));
+      git_reference_free(head);
     }
-    return true;
-  };
+    git_repository_free(source);
+  }
+
+  if (error)
+  {
+    const git_error *errDetails = giterr_last();
+
+    LOG(warning) << "Can't fetch git repo from: " << repo_.path
+                 << " into: " << git_repository_path(clone_)
+                 << "! Errcode: " << std::to_string(error)
+                 << "! Exception: "
+                 << (errDetails ? errDetails->message : "unknown");
+
+    return false;
+  }
+
+  return true;
 }
 
 bool GitParser::parse()
 {
-  for (const std::string& path :
-    _ctx.options["input"].as<std::vector<std::string>>())
+  auto cb = getParserCallback();
+
+  /*--- Look for repositories among the directories of the inputs. ---*/
+
+  // Directories on which the callback returned false, e.g. the ones which
+  // couldn't be opened as a repository. The entries under them are skipped,
+  // as the directory walk wouldn't have visited them either.
+  std::vector<std::string> pruned;
+
+  for (const FileCatalog::Entry& entry : _ctx.fileCatalog->entries())
   {
-    LOG(info) << "Git parse path: " << path;
+    if (entry.type != util::DirEntryType::Directory)
+      continue;
 
-    auto cb = getParserCallback();
+    if (std::any_of(pruned.begin(), pruned.end(),
+      [&entry](const std::string& dir_)
+      {
+        return entry.path.size() > dir_.size() &&
+          entry.path[dir_.size()] == '/' &&
+          entry.path.compare(0, dir_.size(), dir_) == 0;
+      }))
+      continue;
 
-    /*--- Call non-empty iter-callback for all files
-       in the current root directory. ---*/
     try
     {
-      util::iterateDirectoryRecursive(path, cb);
+      if (!cb(entry.path, entry.type))
+        pruned.push_back(entry.path);
     }
     catch (const std::exception& ex_)
     {
@@ -199,9 +365,268 @@ bool GitParser::parse()
       LOG(warning) << "Git parser failed with unknown exception!";
     }
   }
+
+  //--- Clone or update the repositories concurrently ---//
+
+  boost::filesystem::create_directories(_versionDataDir);
+
+  std::mutex syncedMutex;
+  std::vector<Repository> synced;
+
+  std::unique_ptr<util::JobQueueThreadPool<Repository>> pool =
+    util::make_thread_pool<Repository>(
+      _jobs,
+      [&, this](const Repository& repo_)
+      {
+        if (syncRepository(repo_))
+        {
+          std::lock_guard<std::mutex> lock(syncedMutex);
+          synced.push_back(repo_);
+        }
+      });
+
+  for (const auto& repo : _repositories)
+    pool->enqueue(repo.second);
+  pool->wait();
+
+  //--- Write repositories to repositories.txt. ---//
+
+  boost::property_tree::ptree pt;
+  std::string repoFile(_versionDataDir + "/repositories.txt");
+
+  if (boost::filesystem::is_regular_file(repoFile))
+    boost::property_tree::read_ini(repoFile, pt);
+
+  for (const Repository& repo : synced)
+  {
+    pt.put(repo.id + ".name", repo.name);
+    pt.put(repo.id + ".path", repo.path);
+  }
+
+  boost::property_tree::write_ini(repoFile, pt);
+
+  LOG(info) << "Git parser synchronized " << synced.size() << " of "
+            << _repositories.size() << " repositories.";
+
+  //--- Compute diff statistics of the new commits concurrently ---//
+
+  if (_ctx.options.count("git-skip-diffstat"))
+    return true;
+
+  std::unique_ptr<util::JobQueueThreadPool<DiffStatJob>> diffPool =
+    util::make_thread_pool<DiffStatJob>(
+      _jobs,
+      [this](const DiffStatJob& job_)
+      {
+        persistDiffStats(job_);
+      });
+
+  for (const Repository& repo : synced)
+    enqueueDiffStatJobs(repo, *diffPool);
+  diffPool->wait();
+
   return true;
 }
 
+void GitParser::enqueueDiffStatJobs(
+  const Repository& repo_,
+  util::JobQueueThreadPool<DiffStatJob>& pool_)
+{
+  // Commits are immutable, so the ones already in the database are final.
+  std::unordered_set<std::uint64_t> knownCommits;
+  model::GitDiffCommit commit;
+  commit.repo = std::stoull(repo_.id);
+
+  util::OdbTransaction {_ctx.db} ([&, this] {
+    for (const model::GitDiffCommitIdView& known
+      : _ctx.db->query<model::GitDiffCommitIdView>(
+          odb::query<model::GitDiffCommitIdView>::GitDiffCommit::repo
+            == commit.repo))
+      knownCommits.insert(known.id);
+
+    std::lock_guard<std::mutex> guard(_knownPathsMutex);
+    for (const model::GitDiffPathIdView& known
+      : _ctx.db->query<model::GitDiffPathIdView>(
+          odb::query<model::GitDiffPathIdView>::GitDiffPath::repo
+            == commit.repo))
+      _knownPaths.insert(known.id);
+  });
+
+  std::string clonedRepoPath = _versionDataDir + "/" + repo_.id;
+
+  git_repository *repo;
+  if (git_repository_open_bare(&repo, clonedRepoPath.c_str()))
+    return;
+
+  git_revwalk *walk;
+  git_revwalk_new(&walk, repo);
+  git_revwalk_push_glob(walk, "refs/*");
+
+  constexpr std::size_t batchSize = 256;
+
+  DiffStatJob job;
+  job.repo = repo_;
+  std::size_t numCommits = 0;
+
+  git_oid oid;
+  char hex[GIT_OID_HEXSZ + 1];
+  while (!git_revwalk_next(&oid, walk))
+  {
+    commit.commit = git_oid_tostr(hex, sizeof(hex), &oid);
+    if (knownCommits.count(model::createIdentifier(commit)))
+      continue;
+
+    job.commits.push_back(oid);
+    ++numCommits;
+
+    if (job.commits.size() == batchSize)
+    {
+      pool_.enqueue(job);
+      job.commits.clear();
+    }
+  }
+
+  if (!job.commits.empty())
+    pool_.enqueue(job);
+
+  git_revwalk_free(walk);
+  git_repository_free(repo);
+
+  LOG(info) << "Git parser computes diff statistics of " << numCommits
+            << " new commits in " << repo_.path;
+}
+
+void GitParser::persistDiffStats(const DiffStatJob& job_)
+{
+  // libgit2 objects must not be shared between threads, so every job opens
+  // the repository for itself.
+  std::string clonedRepoPath = _versionDataDir + "/" + job_.repo.id;
+
+  git_repository *repo;
+  if (git_repository_open_bare(&repo, clonedRepoPath.c_str()))
+    return;
+
+  git_diff_options opts;
+  git_diff_init_options(&opts, GIT_DIFF_OPTIONS_VERSION);
+  opts.context_lines = 0;
+
+  std::vector<model::GitDiffCommit> commits;
+  std::vector<model::GitDiffPath> paths;
+  std::vector<model::GitDiffStat> stats;
+
+  model::GitDiffCommit diffCommit;
+  model::GitDiffPath diffPath;
+  model::GitDiffStat stat;
+  diffCommit.repo = diffPath.repo = std::stoull(job_.repo.id);
+
+  char hex[GIT_OID_HEXSZ + 1];
+
+  for (const git_oid& oid : job_.commits)
+  {
+    git_commit *commit;
+    if (git_commit_lookup(&commit, repo, &oid))
+      continue;
+
+    // Merge and empty commits have no statistics, but they are recorded too,
+    // so that they are not processed again by the next parse.
+    diffCommit.commit = git_oid_tostr(hex, sizeof(hex), &oid);
+    diffCommit.time = git_commit_time(commit);
+    diffCommit.id = model::createIdentifier(diffCommit);
+    commits.push_back(diffCommit);
+
+    if (git_commit_parentcount(commit) > 1)
+    {
+      git_commit_free(commit);
+      continue;
+    }
+
+    git_tree *tree = nullptr;
+    git_tree *parentTree = nullptr;
+    git_commit_tree(&tree, commit);
+
+    if (git_commit_parentcount(commit) == 1)
+    {
+      git_commit *parent;
+      if (!git_commit_parent(&parent, commit, 0))
+      {
+        git_commit_tree(&parentTree, parent);
+        git_commit_free(parent);
+      }
+    }
+
+    stat.commit = diffCommit.id;
+
+    git_diff *diff;
+    if (!git_diff_tree_to_tree(&diff, repo, parentTree, tree, &opts))
+    {
+      std::size_t numDeltas = git_diff_num_deltas(diff);
+      for (std::size_t i = 0; i < numDeltas; ++i)
+      {
+        git_patch *patch;
+        if (git_patch_from_diff(&patch, diff, i) || !patch)
+          continue;
+
+        std::size_t added, removed;
+        git_patch_line_stats(nullptr, &added, &removed, patch);
+
+        const git_diff_delta *delta = git_patch_get_delta(patch);
+        diffPath.path = delta->status == GIT_DELTA_DELETED
+          ? delta->old_file.path
+          : delta->new_file.path;
+        diffPath.id = model::createIdentifier(diffPath);
+
+        {
+          // A path is persisted by the job which meets it first. The claim
+          // is released if that job fails to persist it.
+          std::lock_guard<std::mutex> guard(_knownPathsMutex);
+          if (_knownPaths.insert(diffPath.id).second)
+            paths.push_back(diffPath);
+        }
+
+        stat.path = diffPath.id;
+        stat.added = added;
+        stat.removed = removed;
+
+        stats.push_back(stat);
+        git_patch_free(patch);
+      }
+      git_diff_free(diff);
+    }
+
+    git_tree_free(parentTree);
+    git_tree_free(tree);
+    git_commit_free(commit);
+  }
+
+  git_repository_free(repo);
+
+  try
+  {
+    util::OdbTransaction {_ctx.db} ([&, this] {
+      for (model::GitDiffCommit& c : commits)
+        _ctx.db->persist(c);
+      for (model::GitDiffPath& p : paths)
+        _ctx.db->persist(p);
+      for (model::GitDiffStat& s : stats)
+        _ctx.db->persist(s);
+    });
+  }
+  catch (const std::exception& ex_)
+  {
+    // The paths claimed by this job are released, so the next job which
+    // meets them persists them instead.
+    {
+      std::lock_guard<std::mutex> guard(_knownPathsMutex);
+      for (const model::GitDiffPath& p : paths)
+        _knownPaths.erase(p.id);
+    }
+
+    LOG(error)
+      << "Failed to persist the diff statistics of repository "
+      << job_.repo.id << ": " << ex_.what();
+  }
+}
+
 GitParser::~GitParser()
 {
   git_libgit2_shutdown();
@@ -214,6 +639,20 @@ extern "C"
   boost::program_options::options_description getOptions()
   {
     boost::program_options::options_description description("Git Plugin");
+    description.add_options()
+      ("git-clone-mode",
+        po::value<std::string>()->default_value("auto"),
+        "How repositories are copied into the workspace on first parse: "
+        "'auto' (libgit2 default), 'hardlink' (hardlink object files), "
+        "'copy' (never hardlink) or 'alternates' (reference the source "
+        "repository's objects without copying them; the source must stay "
+        "in place).")
+      ("git-reclone",
+        "Delete and clone existing repository copies again instead of "
+        "fetching into them.")
+      ("git-skip-diffstat",
+        "Don't compute the per-commit, per-file line statistics which the "
+        "churn queries of the Git service are based on.");
     return description;
   }
 
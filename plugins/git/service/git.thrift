@@ -1,3 +1,5 @@
+include "project/common.thrift"
+
 namespace cpp cc.service.git
 
 enum GitObjectType
@@ -115,6 +117,14 @@ struct GitBlameHunk
                                       git_blame_options.oldest_commit). */
 }
 
+struct GitChurn
+{
+  1:string path,        /**< Path relative to the repository root. */
+  2:i64 linesAdded,     /**< Number of lines added in the time range. */
+  3:i64 linesRemoved,   /**< Number of lines removed in the time range. */
+  4:i32 commitCount     /**< Number of commits touching the path. */
+}
+
 service GitService
 {
   /**
@@ -211,6 +221,34 @@ service GitService
     3:string path_,
     4:string localModificationsFileId_),
 
+  /**
+   * Returns the number of lines added to and removed from a file by the
+   * commits in the [from_, to_] time range (UTC seconds). A 0 bound means
+   * the range is unbounded in that direction. Merge commits are not counted.
+   * @exception common.InvalidInput Exception is thrown if repoId_ is not a
+   * repository ID.
+   */
+  GitChurn getFileChurn(
+    1:string repoId_,
+    2:string path_,
+    3:i64 from_,
+    4:i64 to_)
+    throws (1:common.InvalidInput ex),
+
+  /**
+   * Returns the churn of every file under a directory of the repository in
+   * the [from_, to_] time range, ordered by decreasing number of changed
+   * lines. An empty path_ means the repository root.
+   * @exception common.InvalidInput Exception is thrown if repoId_ is not a
+   * repository ID.
+   */
+  list<GitChurn> getDirectoryChurn(
+    1:string repoId_,
+    2:string path_,
+    3:i64 from_,
+    4:i64 to_)
+    throws (1:common.InvalidInput ex),
+
    /**
    * Check whether there is at least one repository
    * in the workspace directory.
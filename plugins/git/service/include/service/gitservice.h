@@ -1,6 +1,7 @@
 #ifndef CC_SERVICE_GITSERVICE_H
 #define CC_SERVICE_GITSERVICE_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <memory>
@@ -13,6 +14,9 @@
 #include <util/odbtransaction.h>
 #include <webserver/servercontext.h>
 
+#include <model/gitdiffstat.h>
+#include <model/gitdiffstat-odb.hxx>
+
 #include <projectservice/projectservice.h>
 
 #include <GitService.h>
@@ -116,9 +120,30 @@ public:
     const GitDiffOptions& options_,
     const bool isCompact_ = false) override;
 
+  virtual void getFileChurn(
+    GitChurn& return_,
+    const std::string& repoId_,
+    const std::string& path_,
+    const int64_t from_,
+    const int64_t to_) override;
+
+  virtual void getDirectoryChurn(
+    std::vector<GitChurn>& return_,
+    const std::string& repoId_,
+    const std::string& path_,
+    const int64_t from_,
+    const int64_t to_) override;
+
   virtual bool isRepositoryAvailable() override;
 
 private:
+  /**
+   * Returns the numeric form of the repository id which the diff statistics
+   * are stored with.
+   * @throw core::InvalidInput if the id is not an unsigned 64-bit number.
+   */
+  std::uint64_t parseRepoId(const std::string& repoId_) const;
+
   /**
    * Returns the absolute path of the repository identified by repository id.
    */
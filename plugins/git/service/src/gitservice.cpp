@@ -1,3 +1,6 @@
+#include <charconv>
+#include <system_error>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/property_tree/ptree.hpp>
@@ -605,6 +608,110 @@ void GitServiceHandler::getCommitDiffAsString(
   git_strarray_free(&opts.pathspec);
 }
 
+void GitServiceHandler::getFileChurn(
+  GitChurn& return_,
+  const std::string& repoId_,
+  const std::string& path_,
+  const int64_t from_,
+  const int64_t to_)
+{
+  typedef odb::query<model::GitChurnView> ChurnQuery;
+
+  model::GitDiffPath diffPath;
+  diffPath.repo = parseRepoId(repoId_);
+  diffPath.path = path_;
+
+  return_.path = path_;
+
+  _transaction([&, this]{
+    ChurnQuery query =
+      ChurnQuery::GitDiffStat::path == model::createIdentifier(diffPath);
+
+    if (from_)
+      query = query && ChurnQuery::GitDiffCommit::time >= from_;
+    if (to_)
+      query = query && ChurnQuery::GitDiffCommit::time <= to_;
+
+    model::GitChurnView churn = _db->query_value<model::GitChurnView>(query);
+
+    return_.linesAdded = churn.added;
+    return_.linesRemoved = churn.removed;
+    return_.commitCount = churn.commits;
+  });
+}
+
+void GitServiceHandler::getDirectoryChurn(
+  std::vector<GitChurn>& return_,
+  const std::string& repoId_,
+  const std::string& path_,
+  const int64_t from_,
+  const int64_t to_)
+{
+  typedef odb::query<model::GitPathChurnView> ChurnQuery;
+
+  const std::uint64_t repo = parseRepoId(repoId_);
+
+  _transaction([&, this]{
+    ChurnQuery query = ChurnQuery::GitDiffPath::repo == repo;
+
+    if (!path_.empty())
+    {
+      // The wildcards of LIKE are valid characters in a path.
+      std::string prefix;
+      for (char c : path_)
+      {
+        if (c == '%' || c == '_' || c == '\\')
+          prefix += '\\';
+        prefix += c;
+      }
+
+      if (path_.back() != '/')
+        prefix += '/';
+
+      query = query && ChurnQuery::GitDiffPath::path.like(prefix + '%', "\\");
+    }
+
+    if (from_)
+      query = query && ChurnQuery::GitDiffCommit::time >= from_;
+    if (to_)
+      query = query && ChurnQuery::GitDiffCommit::time <= to_;
+
+    for (const model::GitPathChurnView& churn
+      : _db->query<model::GitPathChurnView>(query))
+    {
+      GitChurn gitChurn;
+      gitChurn.path = churn.path;
+      gitChurn.linesAdded = churn.added;
+      gitChurn.linesRemoved = churn.removed;
+      gitChurn.commitCount = churn.commits;
+      return_.push_back(std::move(gitChurn));
+    }
+  });
+
+  std::sort(return_.begin(), return_.end(),
+    [](const GitChurn& lhs_, const GitChurn& rhs_)
+    {
+      return lhs_.linesAdded + lhs_.linesRemoved
+        > rhs_.linesAdded + rhs_.linesRemoved;
+    });
+}
+
+std::uint64_t GitServiceHandler::parseRepoId(const std::string& repoId_) const
+{
+  std::uint64_t repo;
+  const char* end = repoId_.data() + repoId_.size();
+  std::from_chars_result result = std::from_chars(repoId_.data(), end, repo);
+
+  if (result.ec != std::errc() || result.ptr != end)
+  {
+    core::InvalidInput ex;
+    ex.__set_msg("Invalid repository ID: " + repoId_);
+    throw ex;
+  }
+
+  return repo;
+}
+
 git_oid GitServiceHandler::gitOidFromStr(const std::string& hexOid_)
 {
   git_oid oid;
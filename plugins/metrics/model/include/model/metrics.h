@@ -44,6 +44,74 @@ struct MetricsFileIdView
   FileId file;
 };
 
+#pragma db view \
+  object(Metrics) \
+  object(File : Metrics::file == File::id)
+struct MetricsPathView
+{
+  #pragma db column(File::path)
+  std::string path;
+
+  #pragma db column(Metrics::metric)
+  unsigned metric;
+};
+
+#pragma db view \
+  object(Metrics) \
+  object(File : Metrics::file == File::id)
+struct MetricsFileView
+{
+  #pragma db column(Metrics::file)
+  FileId file;
+
+  #pragma db column(File::type)
+  std::string fileType;
+
+  #pragma db column(Metrics::type)
+  Metrics::Type type;
+
+  #pragma db column(Metrics::metric)
+  unsigned metric;
+};
+
+/**
+ * Sum of a metric over all files of a given type under a directory,
+ * recursively. The table is recomputed at the end of each parse.
+ */
+#pragma db object
+struct MetricsDirectoryRollup
+{
+  #pragma db id auto
+  std::uint64_t id;
+
+  #pragma db not_null
+  FileId directory;
+
+  #pragma db not_null
+  std::string fileType;
+
+  #pragma db not_null
+  Metrics::Type type;
+
+  #pragma db not_null
+  std::uint64_t metric;
+
+#pragma db index member(directory)
+};
+
+#pragma db view \
+  object(MetricsDirectoryRollup) \
+  object(File : MetricsDirectoryRollup::directory == File::id) \
+  query((?) + " GROUP BY " + MetricsDirectoryRollup::directory)
+struct MetricsDirectoryRollupView
+{
+  #pragma db column(MetricsDirectoryRollup::directory)
+  FileId directory;
+
+  #pragma db column("sum(" + MetricsDirectoryRollup::metric + ")")
+  std::uint64_t metric;
+};
+
 } //model
 } //cc
 
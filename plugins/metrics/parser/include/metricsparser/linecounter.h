@@ -0,0 +1,45 @@
+#ifndef CC_PARSER_LINECOUNTER_H
+#define CC_PARSER_LINECOUNTER_H
+
+#include <string>
+
+namespace cc
+{
+namespace parser
+{
+
+/**
+ * Number of lines of a source file by kind.
+ */
+struct LineCounts
+{
+  /**
+   * Number of lines, including the last one even if it isn't terminated by a
+   * newline character.
+   */
+  unsigned originalLines = 0;
+
+  /**
+   * Number of lines with a non-whitespace character, comments included.
+   */
+  unsigned nonblankLines = 0;
+
+  /**
+   * Number of lines with a non-whitespace character outside of comments.
+   */
+  unsigned codeLines = 0;
+};
+
+/**
+ * Counts the lines of a source file in a single pass. The comment syntax is
+ * chosen by fileType_, which is the type of the file in the File table. The
+ * comment delimiters inside string and character literals are ignored.
+ */
+LineCounts countLines(
+  const std::string& content_,
+  const std::string& fileType_);
+
+} // namespace parser
+} // namespace cc
+
+#endif // CC_PARSER_LINECOUNTER_H
@@ -1,58 +1,48 @@
 #ifndef CC_PARSER_METRICS_PARSER_H
 #define CC_PARSER_METRICS_PARSER_H
 
-#include <atomic>
+#include <vector>
 
-#include <parser/abstractparser.h>
-#include <parser/parsercontext.h>
+#include <model/metrics.h>
+
+#include <metricsparser/linecounter.h>
 
-#include <util/parserutil.h>
+#include <parser/fileparser.h>
+#include <parser/parsercontext.h>
 
 namespace cc
 {
 namespace parser
 {
 
-class MetricsParser : public AbstractParser
+class MetricsParser : public FileParser<std::vector<model::Metrics>>
 {
 public:
   MetricsParser(ParserContext& ctx_);
-  virtual bool cleanupDatabase() override;
-  virtual bool parse() override;
 
-private:
-  util::DirIterCallback getParserCallback();
+protected:
+  virtual bool parseFile(
+    const model::FilePtr& file_,
+    std::vector<model::Metrics>& result_) override;
 
-  struct Loc
-  {
-    Loc() : originalLines(0), nonblankLines(0), codeLines(0) {}
+  virtual void persist(
+    model::FileId file_,
+    const std::vector<model::Metrics>& result_) override;
 
-    unsigned originalLines;
-    unsigned nonblankLines;
-    unsigned codeLines;
-  };
+  virtual std::unordered_set<model::FileId> getParsedFiles() override;
 
-  Loc getLocFromFile(model::FilePtr file_) const;
+  virtual void cleanupFile(model::FileId file_) override;
 
-  void setCommentTypes(
-    std::string& filetype_,
-    std::string& singleComment_,
-    std::string& multiCommentStart_,
-    std::string& multiCommentEnd_) const;
+  virtual bool finishParse() override;
 
-  void eraseBlankLines(std::string& file) const;
-
-  void eraseComments(
-    std::string& file_,
-    const std::string& singleComment_,
-    const std::string& multiCommentStart_,
-    const std::string& multiCommentEnd_) const;
-
-  void persistLoc(const Loc& loc_, model::FileId file_);
+private:
+  LineCounts getLocFromFile(model::FilePtr file_) const;
 
-  std::unordered_set<model::FileId> _fileIdCache;
-  std::unique_ptr<util::JobQueueThreadPool<std::string>> _pool;
-  std::atomic<int> _visitedFileCount;
+  /**
+   * Recomputes the per-directory sums of the metrics of all files, which the
+   * metrics service uses to answer queries on large directories.
+   */
+  void persistDirectoryRollup();
 };
 
 } // namespace parser
@@ -0,0 +1,205 @@
+#include <cstring>
+#include <unordered_map>
+
+#include <metricsparser/linecounter.h>
+
+namespace
+{
+
+/**
+ * Comment delimiters of a language. Empty strings mean the kind of comment
+ * doesn't exist in the language.
+ */
+struct CommentSyntax
+{
+  const char* single;
+  const char* multiStart;
+  const char* multiEnd;
+
+  /**
+   * True if multi-line comment delimiters are only recognized at the
+   * beginning of a line (e.g. Ruby's =begin and =end).
+   */
+  bool multiAtLineStart;
+};
+
+/**
+ * Comment syntax by file type. The file types of the C++ plugin should be
+ * kept in sync with this table.
+ */
+const std::unordered_map<std::string, CommentSyntax> commentSyntaxes = {
+  {"CPP",    {"//", "/*", "*/", false}},
+  {"Java",   {"//", "/*", "*/", false}},
+  {"Erlang", {"#", "", "", false}},
+  {"Bash",   {"#", "", "", false}},
+  {"Perl",   {"#", "", "", false}},
+  {"Python", {"#", R"(""")", R"(""")", false}},
+  {"Sql",    {"--", "/*", "*/", false}},
+  {"Ruby",   {"#", "=begin", "=end", true}}
+};
+
+const CommentSyntax noCommentSyntax = {"", "", "", false};
+
+const CommentSyntax& getCommentSyntax(const std::string& fileType_)
+{
+  auto it = commentSyntaxes.find(fileType_);
+  return it == commentSyntaxes.end() ? noCommentSyntax : it->second;
+}
+
+enum class LineKind
+{
+  Blank,
+  Comment,
+  Code
+};
+
+inline bool isSpace(char c_)
+{
+  return c_ == ' ' || c_ == '\t' || c_ == '\r' || c_ == '\v' || c_ == '\f';
+}
+
+inline bool startsWith(const char* pos_, const char* end_, const char* token_)
+{
+  for (; *token_; ++pos_, ++token_)
+    if (pos_ == end_ || *pos_ != *token_)
+      return false;
+  return true;
+}
+
+/**
+ * Classifies the [begin_, end_) line, which must not contain a newline
+ * character. A line is code if it has a non-whitespace character outside of
+ * comments, otherwise it is a comment line if it has any non-whitespace
+ * character at all. The inMultiComment_ state is carried between lines.
+ */
+LineKind classifyLine(
+  const char* begin_,
+  const char* end_,
+  const CommentSyntax& syntax_,
+  bool& inMultiComment_)
+{
+  const char* pos = begin_;
+  while (pos != end_ && isSpace(*pos))
+    ++pos;
+
+  if (pos == end_)
+    return LineKind::Blank;
+
+  const std::size_t multiStartLen = std::strlen(syntax_.multiStart);
+  const std::size_t multiEndLen = std::strlen(syntax_.multiEnd);
+
+  if (syntax_.multiAtLineStart)
+  {
+    if (inMultiComment_)
+    {
+      if (startsWith(begin_, end_, syntax_.multiEnd))
+        inMultiComment_ = false;
+      return LineKind::Comment;
+    }
+
+    if (multiStartLen && startsWith(begin_, end_, syntax_.multiStart))
+    {
+      inMultiComment_ = true;
+      return LineKind::Comment;
+    }
+  }
+
+  bool hasCode = false;
+
+  while (pos != end_)
+  {
+    if (inMultiComment_)
+    {
+      if (!syntax_.multiAtLineStart && startsWith(pos, end_, syntax_.multiEnd))
+      {
+        inMultiComment_ = false;
+        pos += multiEndLen;
+      }
+      else
+        ++pos;
+    }
+    else if (*syntax_.single && startsWith(pos, end_, syntax_.single))
+      break;
+    else if (!syntax_.multiAtLineStart && multiStartLen &&
+             startsWith(pos, end_, syntax_.multiStart))
+    {
+      inMultiComment_ = true;
+      pos += multiStartLen;
+    }
+    else if (*pos == '"' || *pos == '\'')
+    {
+      // Comment delimiters in a string or character literal are part of the
+      // code. Literals spanning lines are not recognized.
+      const char quote = *pos++;
+      while (pos != end_ && *pos != quote)
+        pos += *pos == '\\' && pos + 1 != end_ ? 2 : 1;
+      if (pos != end_)
+        ++pos;
+
+      hasCode = true;
+    }
+    else
+    {
+      hasCode = hasCode || !isSpace(*pos);
+      ++pos;
+    }
+  }
+
+  return hasCode ? LineKind::Code : LineKind::Comment;
+}
+
+} // namespace
+
+namespace cc
+{
+namespace parser
+{
+
+LineCounts countLines(
+  const std::string& content_,
+  const std::string& fileType_)
+{
+  LineCounts result;
+
+  if (content_.empty())
+    return result;
+
+  const CommentSyntax& syntax = getCommentSyntax(fileType_);
+  const char* const begin = content_.data();
+  const char* const end = begin + content_.size();
+
+  bool inMultiComment = false;
+  result.originalLines = 1;
+
+  for (const char* line = begin; line <= end; )
+  {
+    const char* eol = static_cast<const char*>(
+      std::memchr(line, '\n', end - line));
+    if (!eol)
+      eol = end;
+
+    switch (classifyLine(line, eol, syntax, inMultiComment))
+    {
+      case LineKind::Code:
+        ++result.codeLines;
+        ++result.nonblankLines;
+        break;
+      case LineKind::Comment:
+        ++result.nonblankLines;
+        break;
+      case LineKind::Blank:
+        break;
+    }
+
+    if (eol == end)
+      break;
+
+    ++result.originalLines;
+    line = eol + 1;
+  }
+
+  return result;
+}
+
+} // namespace parser
+} // namespace cc
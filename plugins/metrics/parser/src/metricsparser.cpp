@@ -7,8 +7,8 @@
 #include <util/logutil.h>
 #include <util/dbutil.h>
 #include <util/odbtransaction.h>
-#include <util/threadpool.h>
 
+#include <parser/filecatalog.h>
 #include <parser/sourcemanager.h>
 
 #include <model/metrics.h>
@@ -21,297 +21,121 @@ namespace cc
 namespace parser
 {
 
-MetricsParser::MetricsParser(ParserContext& ctx_): AbstractParser(ctx_)
+MetricsParser::MetricsParser(ParserContext& ctx_)
+  : FileParser<std::vector<model::Metrics>>(ctx_, "metricsparser")
 {
-  util::OdbTransaction {_ctx.db} ([&, this] {
-    for (const model::MetricsFileIdView& mf
-      : _ctx.db->query<model::MetricsFileIdView>())
-    {
-      _fileIdCache.insert(mf.file);
-    }
-  });
-
-  int threadNum = _ctx.options["jobs"].as<int>();
-  _pool = util::make_thread_pool<std::string>(
-    threadNum, [this](const std::string& path_)
-    {
-      model::FilePtr file = _ctx.srcMgr.getFile(path_);
-      if (file)
-      {
-        if (_fileIdCache.find(file->id) == _fileIdCache.end())
-        {
-          this->persistLoc(getLocFromFile(file), file->id);
-          ++this->_visitedFileCount;
-        }
-        else
-          LOG(debug) << "Metrics already counted for file: " << file->path;
-      }
-    });
 }
 
-bool MetricsParser::cleanupDatabase()
+std::unordered_set<model::FileId> MetricsParser::getParsedFiles()
 {
-  if (!_fileIdCache.empty())
+  std::unordered_set<model::FileId> files;
+  for (const model::MetricsFileIdView& mf
+    : _ctx.db->query<model::MetricsFileIdView>())
   {
-    try
-    {
-      util::OdbTransaction {_ctx.db} ([this] {
-        for (const model::File& file
-          : _ctx.db->query<model::File>(
-          odb::query<model::File>::id.in_range(_fileIdCache.begin(), _fileIdCache.end())))
-        {
-          auto it = _ctx.fileStatus.find(file.path);
-          if (it != _ctx.fileStatus.end() &&
-              (it->second == cc::parser::IncrementalStatus::DELETED ||
-               it->second == cc::parser::IncrementalStatus::MODIFIED ||
-               it->second == cc::parser::IncrementalStatus::ACTION_CHANGED))
-          {
-            LOG(info) << "[metricsparser] Database cleanup: " << file.path;
-
-            _ctx.db->erase_query<model::Metrics>(odb::query<model::Metrics>::file == file.id);
-            _fileIdCache.erase(file.id);
-          }
-        }
-      });
-    }
-    catch (odb::database_exception&)
-    {
-      LOG(fatal) << "Transaction failed in metrics parser!";
-      return false;
-    }
+    files.insert(mf.file);
   }
-  return true;
+  return files;
 }
 
-bool MetricsParser::parse()
+void MetricsParser::cleanupFile(model::FileId file_)
 {
-  this->_visitedFileCount = 0;
+  _ctx.db->erase_query<model::Metrics>(odb::query<model::Metrics>::file == file_);
+}
 
-  for(std::string path : _ctx.options["input"].as<std::vector<std::string>>())
-  {
-    LOG(info) << "Metrics parse path: " << path;
+bool MetricsParser::parseFile(
+  const model::FilePtr& file_,
+  std::vector<model::Metrics>& result_)
+{
+  LineCounts loc = getLocFromFile(file_);
 
-    util::OdbTransaction trans(_ctx.db);
-    trans([&, this]() {
-      auto cb = getParserCallback();
+  model::Metrics metrics;
+  metrics.file = file_->id;
 
-      /*--- Call non-empty iter-callback for all files
-         in the current root directory. ---*/
-      try
-      {
-        util::iterateDirectoryRecursive(path, cb);
-      }
-      catch (std::exception& ex_)
-      {
-        LOG(warning)
-          << "Metrics parser threw an exception: " << ex_.what();
-      }
-      catch (...)
-      {
-        LOG(warning)
-          << "Metrics parser failed with unknown exception!";
-      }
+  if (loc.codeLines != 0)
+  {
+    metrics.type   = model::Metrics::CODE_LOC;
+    metrics.metric = loc.codeLines;
+    result_.push_back(metrics);
+  }
 
-    });
+  if (loc.nonblankLines != 0)
+  {
+    metrics.type   = model::Metrics::NONBLANK_LOC;
+    metrics.metric = loc.nonblankLines;
+    result_.push_back(metrics);
   }
 
-  _pool->wait();
-  LOG(info) << "Processed files: " << this->_visitedFileCount;
+  if (loc.originalLines != 0)
+  {
+    metrics.type   = model::Metrics::ORIGINAL_LOC;
+    metrics.metric = loc.originalLines;
+    result_.push_back(metrics);
+  }
 
-  return true;
+  return !result_.empty();
 }
 
-util::DirIterCallback MetricsParser::getParserCallback()
+bool MetricsParser::finishParse()
 {
-  return [this](const std::string& currPath_)
-  {
-    boost::filesystem::path path(currPath_);
-
-    if (boost::filesystem::is_regular_file(path))
-      _pool->enqueue(currPath_);
-
-    return true;
-  };
+  persistDirectoryRollup();
+  return true;
 }
 
-MetricsParser::Loc MetricsParser::getLocFromFile(model::FilePtr file_) const
+LineCounts MetricsParser::getLocFromFile(model::FilePtr file_) const
 {
-  Loc result;
-
   LOG(debug) << "Count metrics for " << file_->path;
 
   //--- Get source code ---//
 
-  std::string content
-    = file_->content ? file_->content.load()->content : std::string();
-
-  if (content.empty())
-    return result;
-
-  //--- Original lines ---//
-
-  result.originalLines = std::count(content.begin(), content.end(), '\n') + 1;
+  if (!file_->content)
+    return LineCounts();
 
-  //--- Non blank lines ---//
+  std::shared_ptr<model::FileContent> content = file_->content.load();
 
-  eraseBlankLines(content);
+  //--- Count lines ---//
 
-  result.nonblankLines = std::count(content.begin(), content.end(), '\n') + 1;
-
-  //--- Code lines ---//
-
-  std::string singleComment, multiCommentStart, multiCommentEnd;
-
-  setCommentTypes(
-    file_->type, singleComment, multiCommentStart, multiCommentEnd);
-  eraseComments(
-    content, singleComment, multiCommentStart, multiCommentEnd);
-
-  result.codeLines = std::count(content.begin(), content.end(), '\n') + 1;
-
-  return result;
+  return countLines(content->content, file_->type);
 }
 
-void MetricsParser::setCommentTypes(
-  std::string& fileType_,
-  std::string& singleComment_,
-  std::string& multiCommentStart_,
-  std::string& multiCommentEnd_) const
+void MetricsParser::persist(
+  model::FileId,
+  const std::vector<model::Metrics>& result_)
 {
-  if (
-    fileType_ == "CPP" || // Should be updated together with C++ plugin.
-    fileType_ == "Java")
-  {
-    singleComment_ = "//";
-    multiCommentStart_ = "/*";
-    multiCommentEnd_ = "*/";
-  }
-  else if (
-    fileType_ == "Erlang" ||
-    fileType_ == "Bash" ||
-    fileType_ == "Perl")
-  {
-    singleComment_ = "#";
-    multiCommentStart_ = "";  //multi line comment not exist
-    multiCommentEnd_ = "";
-  }
-  else if (fileType_ == "Python")
-  {
-    singleComment_ = "#";
-    multiCommentStart_ = R"(""")";
-    multiCommentEnd_ = R"(""")";
-  }
-  else if (fileType_ == "Sql")
-  {
-    singleComment_ = "--";
-    multiCommentStart_ = "/*";
-    multiCommentEnd_ = "*/";
-  }
-  else if (fileType_ == "Ruby")
-  {
-    singleComment_ = "#";
-    multiCommentStart_ = "=begin";
-    multiCommentEnd_ = "\n=end";  //end must be at new line
-  }
-  else //default value
-  {
-    singleComment_ = "";
-    multiCommentStart_ = "";
-    multiCommentEnd_ = "";
-  }
-}
-
-void MetricsParser::eraseBlankLines(std::string& file_) const
-{
-  std::string::iterator first = file_.begin();
-  bool isBlankLine = true;
-  for (std::string::iterator it = first; it != file_.end(); ++it)
-  {
-    if (!std::isspace(*it))
-    {
-      isBlankLine = false;
-    }
-    else if (*it == '\n')
-    {
-      if (isBlankLine && first != it)
-      {
-        it = file_.erase(first, it);
-      }
-      first = it + 1;
-      isBlankLine = true;
-    }
-  }
-
-  file_.erase(std::unique(file_.begin(), file_.end(),
-    [](char a, char b) { return a == '\n' && b == '\n'; }), file_.end());
+  for (model::Metrics metrics : result_)
+    _ctx.db->persist(metrics);
 }
 
-void MetricsParser::eraseComments(
-  std::string& file_,
-  const std::string& singleComment_,
-  const std::string& multiCommentStart_,
-  const std::string& multiCommentEnd_) const
+void MetricsParser::persistDirectoryRollup()
 {
-  const int s = multiCommentStart_.size();
-
-  // Simple line
-  if (!singleComment_.empty()) // singleComment exist
-  {
-    std::size_t start = file_.find(singleComment_);
-    for (std::size_t end = file_.find('\n', start);
-         start != std::string::npos;
-         start = file_.find(singleComment_), end = file_.find('\n', start))
-    {
-      if (end == std::string::npos) // last line case
-      {
-        end = file_.size();
-      }
-      file_.erase(start, end - start);
-    }
-  }
+  // The metric of every file is added to each of its ancestor directories,
+  // which are collected by walking up the parents in the database, so
+  // neither the files nor the metrics are loaded into memory.
+  static const char* const rollupSql =
+    "INSERT INTO \"MetricsDirectoryRollup\" "
+    "(\"directory\", \"fileType\", \"type\", \"metric\") "
+    "WITH RECURSIVE \"ancestor\" (\"file\", \"directory\") AS ("
+    "SELECT \"File\".\"id\", \"File\".\"parent\" FROM \"File\" "
+    "WHERE \"File\".\"parent\" IS NOT NULL "
+    "AND \"File\".\"id\" IN (SELECT \"file\" FROM \"Metrics\") "
+    "UNION ALL "
+    "SELECT \"ancestor\".\"file\", \"File\".\"parent\" FROM \"ancestor\" "
+    "JOIN \"File\" ON \"File\".\"id\" = \"ancestor\".\"directory\" "
+    "WHERE \"File\".\"parent\" IS NOT NULL) "
+    "SELECT \"ancestor\".\"directory\", \"File\".\"type\", "
+    "\"Metrics\".\"type\", SUM(\"Metrics\".\"metric\") "
+    "FROM \"ancestor\" "
+    "JOIN \"Metrics\" ON \"Metrics\".\"file\" = \"ancestor\".\"file\" "
+    "JOIN \"File\" ON \"File\".\"id\" = \"ancestor\".\"file\" "
+    "GROUP BY \"ancestor\".\"directory\", \"File\".\"type\", "
+    "\"Metrics\".\"type\"";
 
-  // Multiline
-  if (!multiCommentStart_.empty()) // multiComment exist
-  {
-    for (std::size_t start = file_.find(multiCommentStart_),
-                     end   = file_.find(multiCommentEnd_, start + s);
-         start != std::string::npos;
-         start = file_.find(multiCommentStart_),
-         end   = file_.find(multiCommentEnd_, start + s))
-    {
-      // Delete end comment symbol too
-      file_.erase(start, end - start + s);
-    }
-  }
-}
-
-void MetricsParser::persistLoc(const Loc& loc_, model::FileId file_)
-{
   util::OdbTransaction trans(_ctx.db);
   trans([&, this]{
-    model::Metrics metrics;
-    metrics.file = file_;
-
-    if (loc_.codeLines != 0)
-    {
-      metrics.type   = model::Metrics::CODE_LOC;
-      metrics.metric = loc_.codeLines;
-      _ctx.db->persist(metrics);
-    }
+    _ctx.db->erase_query<model::MetricsDirectoryRollup>();
 
-    if (loc_.nonblankLines != 0)
-    {
-      metrics.type   = model::Metrics::NONBLANK_LOC;
-      metrics.metric = loc_.nonblankLines;
-      _ctx.db->persist(metrics);
-    }
+    unsigned long long rows = _ctx.db->execute(rollupSql);
 
-    if (loc_.originalLines != 0)
-    {
-      metrics.type   = model::Metrics::ORIGINAL_LOC;
-      metrics.metric = loc_.originalLines;
-      _ctx.db->persist(metrics);
-    }
+    LOG(info) << "Metrics directory rollup: " << rows << " rows.";
   });
 }
 
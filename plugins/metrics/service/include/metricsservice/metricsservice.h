@@ -1,6 +1,7 @@
 #ifndef CC_SERVICE_METRICS_H
 #define CC_SERVICE_METRICS_H
 
+#include <map>
 #include <memory>
 #include <vector>
 
@@ -41,6 +42,12 @@ public:
     const std::vector<std::string>& fileTypeFilter,
     const MetricsType::type metricsType) override;
 
+  void getChildMetrics(
+    std::map<core::FileId, std::int64_t>& _return,
+    const core::FileId& fileId,
+    const std::vector<std::string>& fileTypeFilter,
+    const MetricsType::type metricsType) override;
+
   void getMetricsTypeNames(
     std::vector<MetricsTypeName>& _return) override;
 
@@ -40,6 +40,19 @@ service MetricsService
     2:list<string> fileTypeFilter,
     3:MetricsType metricsType)
 
+  /**
+   * This function returns the metric of every direct child of the given
+   * directory, keyed by file ID. For files it is the file's own metric, for
+   * directories it is the sum over all files in the subtree. Only the files of
+   * which the file type is contained by fileTypeFilter are counted. The values
+   * of directories come from a rollup computed at parse time, so the cost does
+   * not depend on the size of the subtree.
+   */
+  map<common.FileId, i64> getChildMetrics(
+    1:common.FileId fileId,
+    2:list<string> fileTypeFilter,
+    3:MetricsType metricsType)
+
   /**
    * This function returns the names of metrics.
    */
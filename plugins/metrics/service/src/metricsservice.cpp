@@ -1,8 +1,10 @@
 #include <algorithm>
+#include <iterator>
 #include <sstream>
 
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/json_parser.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include <util/jsonwriter.h>
 
 #include <metricsservice/metricsservice.h>
 
@@ -52,6 +54,51 @@ void MetricsServiceHandler::getMetricsTypeNames(
   _return.push_back(typeName);
 }
 
+void MetricsServiceHandler::getChildMetrics(
+  std::map<core::FileId, std::int64_t>& _return,
+  const core::FileId& fileId,
+  const std::vector<std::string>& fileTypeFilter,
+  const MetricsType::type metricsType)
+{
+  if (fileTypeFilter.empty())
+    return;
+
+  const model::FileId dirId = std::stoull(fileId);
+  const model::Metrics::Type type
+    = static_cast<model::Metrics::Type>(metricsType);
+
+  _transaction([&, this](){
+    typedef odb::query<model::MetricsFileView> FileMetricsQuery;
+    typedef odb::query<model::MetricsDirectoryRollupView> RollupQuery;
+
+    //--- Files directly in the directory ---//
+
+    for (const model::MetricsFileView& metric
+      : _db->query<model::MetricsFileView>(
+        FileMetricsQuery::File::parent == dirId &&
+        FileMetricsQuery::File::type.in_range(
+          fileTypeFilter.begin(), fileTypeFilter.end()) &&
+        FileMetricsQuery::Metrics::type == type))
+    {
+      _return[std::to_string(metric.file)] += metric.metric;
+    }
+
+    //--- Subdirectories, from the rollup ---//
+
+    // A subdirectory has a rollup row for each file type of the filter.
+
+    for (const model::MetricsDirectoryRollupView& rollup
+      : _db->query<model::MetricsDirectoryRollupView>(
+        RollupQuery::File::parent == dirId &&
+        RollupQuery::MetricsDirectoryRollup::fileType.in_range(
+          fileTypeFilter.begin(), fileTypeFilter.end()) &&
+        RollupQuery::MetricsDirectoryRollup::type == type))
+    {
+      _return[std::to_string(rollup.directory)] += rollup.metric;
+    }
+  });
+}
+
 std::string MetricsServiceHandler::getMetricsFromDir(
   const core::FileInfo& fileInfo,
   const MetricsType::type metricsType,
@@ -60,57 +107,79 @@ std::string MetricsServiceHandler::getMetricsFromDir(
   if (fileTypeFilter.empty())
     return "";
 
-  using ptree = boost::property_tree::ptree;
-  ptree pt;
+  //--- Get metrics of files under directory in one query ---//
+
+  std::vector<std::pair<std::string, std::uint64_t>> metrics;
 
   _transaction([&, this](){
-    typedef odb::result<model::File> FileResult;
-    typedef odb::query<model::File> FileQuery;
-    typedef odb::result<model::Metrics> MetricsResult;
-    typedef odb::query<model::Metrics> MetricsQuery;
+    typedef odb::query<model::MetricsPathView> MetricsQuery;
+
+    for (const model::MetricsPathView& metric
+      : _db->query<model::MetricsPathView>(
+        MetricsQuery::File::type.in_range(
+          fileTypeFilter.begin(), fileTypeFilter.end()) &&
+        MetricsQuery::File::path.like(fileInfo.path + '%') &&
+        MetricsQuery::Metrics::type
+          == static_cast<model::Metrics::Type>(metricsType)))
+    {
+      metrics.emplace_back(metric.path, metric.metric);
+    }
+  });
 
-    //--- Get files under directory ---//
+  // Byte-wise ordering keeps every directory's files contiguous, which is
+  // not guaranteed by the database's collation.
+  std::sort(metrics.begin(), metrics.end(),
+    [](const auto& lhs_, const auto& rhs_)
+    {
+      return lhs_.first < rhs_.first;
+    });
 
-    FileResult descendants = _db->query<model::File>(
-      FileQuery::type.in_range(
-        fileTypeFilter.begin(), fileTypeFilter.end()) &&
-      FileQuery::path.like(fileInfo.path + '%'));
+  //--- Write the directory hierarchy as nested JSON objects ---//
 
-    //--- Create a vector of these file IDs ---//
+  std::stringstream ss;
+  util::JsonWriter writer(ss);
+  writer.beginObject();
+
+  std::vector<std::string> openDirs;
+  std::vector<std::string> components;
 
-    std::vector<model::FileId> descendantFids;
-    std::transform(
-      descendants.begin(),
-      descendants.end(),
-      std::back_inserter(descendantFids),
-      [](const model::File& file) { return file.id; });
+  for (auto it = metrics.begin(); it != metrics.end(); ++it)
+  {
+    // The rows of the same path are summed, like in getChildMetrics().
+    if (std::next(it) != metrics.end() && std::next(it)->first == it->first)
+    {
+      std::next(it)->second += it->second;
+      continue;
+    }
 
-    if (descendantFids.empty())
-      return;
+    const auto& metric = *it;
 
-    //--- Get metrics for these files ---//
+    components.clear();
+    boost::split(
+      components, metric.first.substr(1), boost::is_any_of("/"));
 
-    MetricsResult metrics = _db->query<model::Metrics>(
-      MetricsQuery::type == static_cast<model::Metrics::Type>(metricsType) &&
-      MetricsQuery::file.in_range(
-        descendantFids.begin(), descendantFids.end()));
+    std::size_t common = 0;
+    while (common < openDirs.size() &&
+           common + 1 < components.size() &&
+           openDirs[common] == components[common])
+      ++common;
 
-    //--- Create a property tree ---//
+    for (; openDirs.size() > common; openDirs.pop_back())
+      writer.endObject();
 
-    for (const model::Metrics& metric : metrics)
+    for (std::size_t i = common; i + 1 < components.size(); ++i)
     {
-      core::FileId fileId = std::to_string(metric.file);
+      writer.key(components[i]).beginObject();
+      openDirs.push_back(components[i]);
+    }
 
-      core::FileInfo fileInfo;
-      _projectService.getFileInfo(fileInfo, fileId);
+    writer.key(components.back()).value(std::to_string(metric.second));
+  }
 
-      std::string path = fileInfo.path.substr(1);
-      pt.put(ptree::path_type{path, '/'}, metric.metric);
-    }
-  });
+  for (; !openDirs.empty(); openDirs.pop_back())
+    writer.endObject();
 
-  std::stringstream ss;
-  boost::property_tree::json_parser::write_json(ss, pt, false);
+  writer.endObject();
 
   return ss.str();
 }
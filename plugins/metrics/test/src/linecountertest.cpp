@@ -0,0 +1,114 @@
+#define GTEST_HAS_TR1_TUPLE 1
+#define GTEST_USE_OWN_TR1_TUPLE 0
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <metricsparser/linecounter.h>
+
+using namespace cc::parser;
+
+namespace
+{
+
+void expectCounts(
+  const LineCounts& counts_,
+  unsigned originalLines_,
+  unsigned nonblankLines_,
+  unsigned codeLines_)
+{
+  EXPECT_EQ(originalLines_, counts_.originalLines);
+  EXPECT_EQ(nonblankLines_, counts_.nonblankLines);
+  EXPECT_EQ(codeLines_, counts_.codeLines);
+}
+
+} // namespace
+
+TEST(LineCounterTest, EmptyContent)
+{
+  expectCounts(countLines("", "CPP"), 0, 0, 0);
+}
+
+TEST(LineCounterTest, WhitespaceOnlyLines)
+{
+  expectCounts(
+    countLines("int a;\n   \n\t\n \t\r\n\v\f\nint b;", "CPP"), 6, 2, 2);
+}
+
+TEST(LineCounterTest, LastLineWithoutNewline)
+{
+  expectCounts(countLines("int a;\nint b;", "CPP"), 2, 2, 2);
+  expectCounts(countLines("int a;\nint b;\n", "CPP"), 3, 2, 2);
+}
+
+TEST(LineCounterTest, SingleLineComments)
+{
+  expectCounts(countLines(
+    "// comment\n"
+    "  // indented comment\n"
+    "int a; // trailing comment\n", "CPP"), 4, 3, 1);
+}
+
+TEST(LineCounterTest, BlockCommentSpanningLines)
+{
+  expectCounts(countLines(
+    "/* first\n"
+    "\n"
+    "   inside */\n"
+    "int a; /* opened\n"
+    "   closed */ int b;\n"
+    "int c;", "CPP"), 6, 5, 3);
+}
+
+TEST(LineCounterTest, BlockCommentClosedAndReopened)
+{
+  expectCounts(countLines(
+    "/* a */ /* b\n"
+    "c */ /* d */\n"
+    "int a; /* e */", "CPP"), 3, 3, 1);
+}
+
+TEST(LineCounterTest, CommentMarkersInStringLiterals)
+{
+  // None of these lines open a comment, so the last line is code.
+  expectCounts(countLines(
+    "const char* a = \"/*\";\n"
+    "const char* b = \"//\";\n"
+    "const char* c = \"\\\" /*\";\n"
+    "char d = '\\'';\n"
+    "char e = '/'; /* comment */\n"
+    "int f;", "CPP"), 6, 6, 6);
+}
+
+TEST(LineCounterTest, StringLiteralAfterBlockComment)
+{
+  expectCounts(countLines(
+    "/* \"not a string\n"
+    "*/ int a;\n"
+    "/* comment */", "CPP"), 3, 3, 1);
+}
+
+TEST(LineCounterTest, PythonDocstring)
+{
+  expectCounts(countLines(
+    "def f():\n"
+    "    \"\"\"\n"
+    "    Docstring # with hash\n"
+    "    \"\"\"\n"
+    "    return '#'  # comment\n", "Python"), 6, 5, 2);
+}
+
+TEST(LineCounterTest, RubyBlockComment)
+{
+  expectCounts(countLines(
+    "=begin\n"
+    "puts 'inside'\n"
+    "=end\n"
+    "puts 'outside'", "Ruby"), 4, 4, 1);
+}
+
+TEST(LineCounterTest, UnknownFileType)
+{
+  expectCounts(countLines("// text\n\n/* more */", "Unknown"), 3, 2, 2);
+}
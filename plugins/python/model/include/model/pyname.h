@@ -23,10 +23,11 @@ struct PYName
     #pragma db id unique
     std::uint64_t id = 0;
 
-    #pragma db index
     std::uint64_t ref_id;
 
+    #pragma db index
     std::uint64_t parent;
+
     std::uint64_t parent_function;
 
     bool is_definition = false;
@@ -43,8 +44,36 @@ struct PYName
     std::uint64_t column_start;
     std::uint64_t column_end;
 
-    #pragma db index
     std::uint64_t file_id;
+
+#pragma db index("PYName_file_position_idx") members(file_id, line_start, column_start)
+#pragma db index("PYName_ref_definition_idx") members(ref_id, is_definition)
+};
+
+#pragma db view object(PYName)
+struct PYNameCount
+{
+    #pragma db column("count(" + PYName::id + ")")
+    std::size_t count;
+};
+
+#pragma db view object(PYName)
+struct PYNameId
+{
+    std::uint64_t id;
+};
+
+/**
+ * The columns of a PYName needed to find the node at a given position.
+ */
+#pragma db view object(PYName)
+struct PYNamePosition
+{
+    std::uint64_t id;
+    std::uint64_t line_start;
+    std::uint64_t column_start;
+    std::uint64_t column_end;
+    std::string value;
 };
 
 }
@@ -18,8 +18,6 @@ namespace parser
   
 namespace python = boost::python;
 
-typedef std::unordered_map<std::uint64_t, model::PYName> PYNameMap;
-
 class PythonParser : public AbstractParser
 {
 public:
@@ -31,10 +29,39 @@ private:
   struct ParseResultStats {
     std::uint32_t partial;
     std::uint32_t full;
+    std::uint64_t inserted;
   };
 
+  /**
+   * Number of PYNames persisted together in one transaction. Results are
+   * streamed from the Python workers, so this bounds the memory used for
+   * them regardless of the size of the project.
+   */
+  static constexpr std::size_t persistBatchSize = 10000;
+
+  /**
+   * Number of IDs looked up in one query when the PYNames already in the
+   * database are dropped from a batch.
+   */
+  static constexpr std::size_t idQueryChunkSize = 500;
+
   python::object m_py_module;
-  void processFile(const python::object& obj, PYNameMap& map, ParseResultStats& parse_result);
+
+  /**
+   * The state of the thread which initialized the interpreter. The global
+   * interpreter lock is released after the initialization and taken back
+   * before the Python objects are destroyed.
+   */
+  PyThreadState* _mainThreadState;
+
+  void processRecord(
+    const char* data,
+    std::size_t size,
+    std::vector<model::PYName>& batch,
+    ParseResultStats& parse_result);
+  void persistBatch(
+    std::vector<model::PYName>& batch,
+    ParseResultStats& parse_result);
   void parseProject(const std::string& root_path);
 };
   
@@ -79,10 +79,26 @@ def parseProject(settings, n_proc):
 
     log(f"{bcolors.OKGREEN}Using {n_proc} process to parse project")
 
+    # Results are yielded one by one as the workers finish them, so the
+    # caller can persist them while the rest of the project is being parsed.
     with multiprocessing.Pool(processes=n_proc) as pool:
-        results = pool.starmap(parse, zip(py_files, repeat(config)))
-        return results
-        
+        for record in pool.imap_unordered(parseToRecord, zip(py_files, repeat(config))):
+            yield record
+
+def parseToRecord(args) -> bytes:
+    path, config = args
+
+    # An exception raised here would be re-raised by imap_unordered in the
+    # C++ side and end the stream, so a failing file only loses its own result.
+    try:
+        return parse(path, config).encode()
+    except:
+        log(f"{bcolors.FAIL}Failed to parse file: {path}")
+        if config.stack_trace:
+            traceback.print_exc()
+
+        return ParseResult(path=path, status="none").encode()
+
 def parse(path: str, config: ParserConfig):
     result: ParseResult = ParseResult(path=path)
 
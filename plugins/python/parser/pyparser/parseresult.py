@@ -1,8 +1,58 @@
+import struct
 from dataclasses import dataclass, field
 
+# Binary record of a parsed file, streamed to the C++ side of the parser.
+# All integers are in native byte order with standard sizes:
+#
+#   record := status:u8 path:str imports:u32 str* nodes:u32 node*
+#   node   := id ref_id parent parent_function
+#             line_start line_end column_start column_end file_id :u64
+#             flags:u8 full_name:str value:str type:str type_hint:str
+#   str    := length:u32 utf-8 bytes
+#
+# The flags of a node are is_definition, is_builtin, is_import and is_call
+# from the lowest bit up.
+
+STATUS_CODES = { "none": 0, "partial": 1, "full": 2 }
+
+NODE_HEADER = struct.Struct("=9QB")
+LENGTH = struct.Struct("=I")
+
 @dataclass
 class ParseResult:
     path: str
     status: str = "full"
     nodes: list = field(default_factory=list)
     imports: list = field(default_factory=list)
+
+    def encode(self) -> bytes:
+        parts = [bytes([STATUS_CODES[self.status]])]
+        parts.append(encodeString(self.path))
+
+        parts.append(LENGTH.pack(len(self.imports)))
+        for path in self.imports:
+            parts.append(encodeString(path))
+
+        parts.append(LENGTH.pack(len(self.nodes)))
+        for node in self.nodes:
+            flags = (node.is_definition |
+                     node.is_builtin << 1 |
+                     node.is_import << 2 |
+                     node.is_call << 3)
+
+            parts.append(NODE_HEADER.pack(
+                node.id, node.ref_id, node.parent, node.parent_function,
+                node.line_start, node.line_end,
+                node.column_start, node.column_end,
+                node.file_id, flags))
+
+            parts.append(encodeString(node.full_name))
+            parts.append(encodeString(node.value))
+            parts.append(encodeString(node.type))
+            parts.append(encodeString(node.type_hint))
+
+        return b"".join(parts)
+
+def encodeString(value) -> bytes:
+    data = str(value).encode("utf-8", errors="replace")
+    return LENGTH.pack(len(data)) + data
@@ -1,5 +1,11 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_set>
+
 #include <pythonparser/pythonparser.h>
 #include <boost/filesystem.hpp>
+#include <boost/python/stl_iterator.hpp>
 #include <util/logutil.h>
 
 namespace cc
@@ -31,18 +37,23 @@ PythonParser::PythonParser(ParserContext& ctx_): AbstractParser(ctx_)
   {
     PyErr_Print();
   }
+
+  // The parse() may be called from another thread, if other plugins are
+  // parsing concurrently, so the lock is taken there when needed.
+  _mainThreadState = PyEval_SaveThread();
 }
 
 void PythonParser::parseProject(const std::string& root_path)
 {
-  PYNameMap map;
+  std::vector<model::PYName> batch;
   ParseResultStats parse_result;
   parse_result.full = 0;
   parse_result.partial = 0;
+  parse_result.inserted = 0;
 
   try {
     python::list sys_path;
-    int n_proc = _ctx.options["jobs"].as<int>();
+    int n_proc = _jobs;
 
     if(_ctx.options.count("syspath"))
     {
@@ -69,116 +80,230 @@ void PythonParser::parseProject(const std::string& root_path)
     settings["ast_function_signature"] = !(_ctx.options.count("disable-ast-function-signature"));
     settings["file_refs"] = (bool)(_ctx.options.count("file-refs"));
 
-    python::object result_list = m_py_module.attr("parseProject")(settings, n_proc);
+    // parseProject() is a generator yielding the binary record of each file
+    // as soon as a worker process has finished it.
+    python::object records = m_py_module.attr("parseProject")(settings, n_proc);
 
-    for(int i = 0; i < python::len(result_list); i++)
+    python::stl_input_iterator<python::object> it(records), end;
+    for (; it != end; ++it)
     {
-      PythonParser::processFile(result_list[i], map, parse_result);
-    }
+      python::object record = *it;
+
+      char* data;
+      Py_ssize_t size;
+      if (PyBytes_AsStringAndSize(record.ptr(), &data, &size) == -1)
+        python::throw_error_already_set();
+
+      PythonParser::processRecord(data, size, batch, parse_result);
 
-  
+      if (batch.size() >= persistBatchSize)
+        persistBatch(batch, parse_result);
+    }
   }catch (const python::error_already_set&)
   {
     PyErr_Print();
   }
 
-  // Insert into database
-  LOG(info) << "[pythonparser] Inserting PYNames to database...";
-  cc::util::OdbTransaction {_ctx.db} ([&]
-  {
-    for(const auto& e : map)
-    {
-      _ctx.db->persist(e.second);
-    }
-  });
+  persistBatch(batch, parse_result);
 
   LOG(info) << "[pythonparser] Parsing finished!";
-  LOG(info) << "[pythonparser] Inserted rows: " << map.size();
+  LOG(info) << "[pythonparser] Inserted rows: " << parse_result.inserted;
   LOG(info) << "[pythonparser] Fully parsed files: " << parse_result.full;
   LOG(info) << "[pythonparser] Partially parsed files: " << parse_result.partial;
 }
 
-void PythonParser::processFile(const python::object& obj, PYNameMap& map, ParseResultStats& parse_result)
+namespace
+{
+
+/**
+ * Reads the binary file records written by ParseResult.encode() in the
+ * Python part of the parser. See parseresult.py for the format.
+ */
+class RecordReader
+{
+public:
+  RecordReader(const char* data_, std::size_t size_)
+    : _pos(data_), _end(data_ + size_)
+  {
+  }
+
+  template <typename T>
+  T read()
+  {
+    require(sizeof(T));
+
+    T value;
+    std::memcpy(&value, _pos, sizeof(T));
+    _pos += sizeof(T);
+    return value;
+  }
+
+  std::string readString()
+  {
+    std::uint32_t length = read<std::uint32_t>();
+    require(length);
+
+    std::string value(_pos, length);
+    _pos += length;
+    return value;
+  }
+
+private:
+  void require(std::size_t size_) const
+  {
+    if (static_cast<std::size_t>(_end - _pos) < size_)
+      throw std::runtime_error("Truncated Python parse result record");
+  }
+
+  const char* _pos;
+  const char* _end;
+};
+
+} // namespace
+
+void PythonParser::processRecord(
+  const char* data,
+  std::size_t size,
+  std::vector<model::PYName>& batch,
+  ParseResultStats& parse_result)
 {
+  enum Status : std::uint8_t { None = 0, Partial = 1, Full = 2 };
+
   try {
-    python::object nodes = obj.attr("nodes");
-    const std::string status = python::extract<std::string>(obj.attr("status"));
-    const std::string path = python::extract<std::string>(obj.attr("path"));
+    RecordReader reader(data, size);
 
-    const int len = python::len(nodes);
-    for (int i = 0; i < len; i++)
-    {
-      python::object node = nodes[i];
+    const std::uint8_t status = reader.read<std::uint8_t>();
+    const std::string path = reader.readString();
 
+    // Additional paths (example: builtin definition paths)
+    // These files need to be added to db
+    std::vector<std::string> imports(reader.read<std::uint32_t>());
+    for (std::string& p : imports)
+      p = reader.readString();
+
+    const std::uint32_t len = reader.read<std::uint32_t>();
+    for (std::uint32_t i = 0; i < len; i++)
+    {
       model::PYName pyname;
-      pyname.id = python::extract<uint64_t>(node.attr("id"));
-      pyname.ref_id = python::extract<uint64_t>(node.attr("ref_id"));
-      pyname.parent = python::extract<uint64_t>(node.attr("parent"));
-      pyname.parent_function = python::extract<uint64_t>(node.attr("parent_function"));
-      pyname.full_name = python::extract<std::string>(node.attr("full_name"));
-      pyname.is_definition = python::extract<bool>(node.attr("is_definition"));
-      pyname.is_import = python::extract<bool>(node.attr("is_import"));
-      pyname.is_builtin = python::extract<bool>(node.attr("is_builtin"));
-      pyname.line_start = python::extract<uint64_t>(node.attr("line_start"));
-      pyname.line_end = python::extract<uint64_t>(node.attr("line_end"));
-      pyname.column_start = python::extract<uint64_t>(node.attr("column_start"));
-      pyname.column_end = python::extract<uint64_t>(node.attr("column_end"));
-      pyname.file_id = python::extract<uint64_t>(node.attr("file_id"));
-      pyname.value = python::extract<std::string>(node.attr("value"));
-      pyname.type = python::extract<std::string>(node.attr("type"));
-      pyname.type_hint = python::extract<std::string>(node.attr("type_hint"));
-      pyname.is_call = python::extract<bool>(node.attr("is_call"));
-
-      // Put in map
-      if(map.find(pyname.id) == map.end())
-      {
-        map[pyname.id] = pyname;
-      }
+      pyname.id = reader.read<std::uint64_t>();
+      pyname.ref_id = reader.read<std::uint64_t>();
+      pyname.parent = reader.read<std::uint64_t>();
+      pyname.parent_function = reader.read<std::uint64_t>();
+      pyname.line_start = reader.read<std::uint64_t>();
+      pyname.line_end = reader.read<std::uint64_t>();
+      pyname.column_start = reader.read<std::uint64_t>();
+      pyname.column_end = reader.read<std::uint64_t>();
+      pyname.file_id = reader.read<std::uint64_t>();
+
+      const std::uint8_t flags = reader.read<std::uint8_t>();
+      pyname.is_definition = flags & 1;
+      pyname.is_builtin = flags & 2;
+      pyname.is_import = flags & 4;
+      pyname.is_call = flags & 8;
+
+      pyname.full_name = reader.readString();
+      pyname.value = reader.readString();
+      pyname.type = reader.readString();
+      pyname.type_hint = reader.readString();
+
+      batch.push_back(std::move(pyname));
     }
 
-    if(status != "none")
+    if(status != Status::None)
     {
       model::FilePtr pyfile = _ctx.srcMgr.getFile(path);
-      
-      if(status == "full")
+
+      if(status == Status::Full)
       {
         parse_result.full++;
         pyfile->parseStatus = model::File::ParseStatus::PSFullyParsed;
-      }else if (status == "partial")
+      }else if (status == Status::Partial)
       {
         parse_result.partial++;
         pyfile->parseStatus = model::File::ParseStatus::PSPartiallyParsed;
       }
-      
+
       pyfile->type = "PY";
       _ctx.srcMgr.updateFile(*pyfile);
     }
 
-    // Additional paths (example: builtin definition paths)
-    // These files need to be added to db
-    python::object imports = obj.attr("imports");
-    for (int i = 0; i < python::len(imports); i++)
+    for (const std::string& p : imports)
     {
-      std::string p = python::extract<std::string>(imports[i]);
-
       model::FilePtr file = _ctx.srcMgr.getFile(p);
       file->type = "PY";
       _ctx.srcMgr.updateFile(*file);
     }
 
-  }catch (const python::error_already_set&)
+  }catch (const std::exception& ex)
   {
-    PyErr_Print();
+    LOG(error) << "[pythonparser] " << ex.what();
   }
 }
 
+void PythonParser::persistBatch(
+  std::vector<model::PYName>& batch,
+  ParseResultStats& parse_result)
+{
+  if (batch.empty())
+    return;
+
+  LOG(debug) << "[pythonparser] Inserting " << batch.size() << " PYNames to database...";
+  cc::util::OdbTransaction {_ctx.db} ([&]
+  {
+    typedef odb::query<model::PYNameId> IdQuery;
+
+    // Definitions in library files are reported by every file using them, so
+    // the IDs of the batch are looked up instead of remembering every ID
+    // inserted so far.
+    std::vector<std::uint64_t> ids;
+    ids.reserve(batch.size());
+    for (const model::PYName& pyname : batch)
+      ids.push_back(pyname.id);
+
+    std::unordered_set<std::uint64_t> skipped;
+    for (auto begin = ids.begin(); begin != ids.end();)
+    {
+      auto end = begin + std::min<std::size_t>(ids.end() - begin, idQueryChunkSize);
+
+      for (const model::PYNameId& existing
+        : _ctx.db->query<model::PYNameId>(IdQuery::id.in_range(begin, end)))
+        skipped.insert(existing.id);
+
+      begin = end;
+    }
+
+    for(model::PYName& pyname : batch)
+    {
+      if (!skipped.insert(pyname.id).second)
+        continue;
+
+      _ctx.db->persist(pyname);
+      parse_result.inserted++;
+    }
+  });
+
+  batch.clear();
+}
+
 bool PythonParser::parse()
 {
-  for(const std::string& path : _ctx.options["input"].as<std::vector<std::string>>())
+  PyGILState_STATE gilState = PyGILState_Ensure();
+
+  try
   {
-    PythonParser::parseProject(path);
+    for(const std::string& path : _ctx.options["input"].as<std::vector<std::string>>())
+    {
+      PythonParser::parseProject(path);
+    }
+  }
+  catch (...)
+  {
+    PyGILState_Release(gilState);
+    throw;
   }
 
+  PyGILState_Release(gilState);
+
   return true;
 }
 
@@ -197,6 +322,7 @@ bool PythonParser::cleanupDatabase()
 
 PythonParser::~PythonParser()
 {
+  PyEval_RestoreThread(_mainThreadState);
 }
 
 #pragma clang diagnostic push
@@ -2,7 +2,10 @@
 #define CC_SERVICE_PYTHON_PYTHONSERVICE_H
 
 #include <cstdint>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 #include <string>
 
@@ -15,6 +18,8 @@
 #include <LanguageService.h>
 
 #include <odb/database.hxx>
+#include <model/file.h>
+#include <model/file-odb.hxx>
 #include <model/pyname.h>
 #include <model/pyname-odb.hxx>
 
@@ -153,11 +158,54 @@ public:
   };
 
 private:
+  struct NodePosition
+  {
+    std::uint64_t id;
+    std::uint64_t line_start;
+    std::uint64_t column_start;
+    std::uint64_t column_end;
+
+    /**
+     * Size of the value of the node in bytes.
+     */
+    std::size_t value_length;
+  };
+
+  /**
+   * Position of the nodes of a file sorted by line and starting column, so
+   * the node under the cursor is found without a database query.
+   */
+  typedef std::vector<NodePosition> FilePositionIndex;
+
+  struct CachedPositionIndex
+  {
+    /**
+     * Hash of the file content the index was built from. The index is
+     * rebuilt if the file is parsed again with a different content.
+     */
+    std::string contentHash;
+    std::shared_ptr<const FilePositionIndex> index;
+  };
+
+  /**
+   * Number of files whose position index is kept in memory. The index of the
+   * least recently built file is dropped first.
+   */
+  static constexpr std::size_t positionIndexCapacity = 256;
+
   std::shared_ptr<odb::database> _db;
   util::OdbTransaction _transaction;
   std::shared_ptr<std::string> _datadir;
   const cc::webserver::ServerContext& _context;
 
+  std::mutex _positionIndexMutex;
+  std::unordered_map<std::uint64_t, CachedPositionIndex> _positionIndex;
+  std::deque<std::uint64_t> _positionIndexOrder;
+
+  std::shared_ptr<const FilePositionIndex> getPositionIndex(std::uint64_t fileId);
+  odb::query<model::PYName> referenceQuery(const model::PYName& pyname, const std::int32_t referenceId);
+  std::size_t countReferences(const core::AstNodeId& astNodeId, const std::int32_t referenceId);
+
   void setInfoProperties(AstNodeInfo& info, const model::PYName& pyname);
   model::PYName queryNodeByID(const std::string& id);
   model::PYName queryNodeByPosition(const core::FilePosition& fpos);
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include <service/pythonservice.h>
 #include <projectservice/projectservice.h>
 #include <util/dbutil.h>
@@ -131,7 +133,7 @@ void PythonServiceHandler::getDiagramTypes(
   }
 
   // Usage diagrams
-  const size_t count = PythonServiceHandler::queryReferences(astNodeId_, USAGE).size();
+  const size_t count = PythonServiceHandler::countReferences(astNodeId_, USAGE);
 
   if (count > 0 && pyname.is_definition == true) {
     if (pyname.type == "function") {
@@ -344,7 +346,7 @@ std::int32_t PythonServiceHandler::getReferenceCount(
   LOG(info) << "astNodeID: " << astNodeId_;
 #endif
 
-  return PythonServiceHandler::queryReferences(astNodeId_, referenceId_).size();
+  return PythonServiceHandler::countReferences(astNodeId_, referenceId_);
 }
 
 model::PYName PythonServiceHandler::queryNodeByID(const std::string& id)
@@ -370,36 +372,97 @@ model::PYName PythonServiceHandler::queryNodeByID(const std::string& id)
 
 model::PYName PythonServiceHandler::queryNodeByPosition(const core::FilePosition& fpos)
 {
-  return _transaction([&]()
-  {
-    model::PYName pyname;
-    odb::result<model::PYName> nodes = _db->query<model::PYName>(
-      odb::query<model::PYName>::file_id == std::stoull(fpos.file) &&
-      odb::query<model::PYName>::line_start == fpos.pos.line &&
-      odb::query<model::PYName>::column_start <= fpos.pos.column &&
-      odb::query<model::PYName>::column_end >= fpos.pos.column
-    );
+  std::shared_ptr<const FilePositionIndex> index =
+    PythonServiceHandler::getPositionIndex(std::stoull(fpos.file));
 
-    if(!nodes.empty())
+  const std::uint64_t line = fpos.pos.line;
+  const std::uint64_t column = fpos.pos.column;
+
+  auto it = std::lower_bound(index->begin(), index->end(), line,
+    [](const NodePosition& p, std::uint64_t line_)
     {
-      pyname = *nodes.begin();
+      return p.line_start < line_;
+    });
 
-      for(const model::PYName& p : nodes)
-      {
-        if(p.value.size() < pyname.value.size())
-        {
-          pyname = p;
-        }
-      }
-    }else{
-      LOG(info) << "[PYTHONSERVICE] Node not found! (line = " << fpos.pos.line << " column = " << fpos.pos.column << ")";
-      core::InvalidInput ex;
-      ex.__set_msg("Node not found!");
-      throw ex;
+  // Of the nodes containing the position, the one with the shortest value is
+  // the innermost.
+  const NodePosition* found = nullptr;
+  for (; it != index->end() && it->line_start == line && it->column_start <= column; ++it)
+  {
+    if (it->column_end >= column &&
+        (!found || it->value_length < found->value_length))
+    {
+      found = &*it;
     }
+  }
 
-    return pyname;
+  if (!found)
+  {
+    LOG(info) << "[PYTHONSERVICE] Node not found! (line = " << fpos.pos.line << " column = " << fpos.pos.column << ")";
+    core::InvalidInput ex;
+    ex.__set_msg("Node not found!");
+    throw ex;
+  }
+
+  return PythonServiceHandler::queryNodeByID(std::to_string(found->id));
+}
+
+std::shared_ptr<const PythonServiceHandler::FilePositionIndex>
+PythonServiceHandler::getPositionIndex(std::uint64_t fileId)
+{
+  // The content hash of the file is a primary key lookup, much cheaper than
+  // building the index, and it tells whether the file has been parsed again
+  // since the cached index was built.
+  std::string contentHash = _transaction([&]()
+  {
+    std::shared_ptr<model::File> file = _db->find<model::File>(fileId);
+    return file && file->content
+      ? file->content.object_id()
+      : std::string();
   });
+
+  {
+    std::lock_guard<std::mutex> lock(_positionIndexMutex);
+    auto it = _positionIndex.find(fileId);
+    if (it != _positionIndex.end() && it->second.contentHash == contentHash)
+      return it->second.index;
+  }
+
+  // The index is built outside of the lock, a concurrent request for the
+  // same file may build it too, but only one of them is kept.
+  auto index = std::make_shared<FilePositionIndex>(_transaction([&]()
+  {
+    const odb::query<model::PYNamePosition> order_by = "ORDER BY" + odb::query<model::PYNamePosition>::line_start + "," + odb::query<model::PYNamePosition>::column_start;
+    odb::result<model::PYNamePosition> nodes = _db->query<model::PYNamePosition>(
+      (odb::query<model::PYNamePosition>::file_id == fileId) + order_by);
+
+    FilePositionIndex positions;
+    for (const model::PYNamePosition& node : nodes)
+      positions.push_back({node.id, node.line_start, node.column_start,
+        node.column_end, node.value.size()});
+
+    return positions;
+  }));
+
+  std::lock_guard<std::mutex> lock(_positionIndexMutex);
+  auto it = _positionIndex.find(fileId);
+  if (it == _positionIndex.end())
+  {
+    _positionIndexOrder.push_back(fileId);
+    if (_positionIndexOrder.size() > positionIndexCapacity)
+    {
+      _positionIndex.erase(_positionIndexOrder.front());
+      _positionIndexOrder.pop_front();
+    }
+    it = _positionIndex.emplace(fileId, CachedPositionIndex()).first;
+  }
+  else if (it->second.contentHash == contentHash)
+    return it->second.index;
+
+  it->second.contentHash = contentHash;
+  it->second.index = index;
+
+  return index;
 }
 
 std::vector<model::PYName> PythonServiceHandler::queryNodes(const odb::query<model::PYName>& odb_query)
@@ -414,59 +477,66 @@ std::vector<model::PYName> PythonServiceHandler::queryNodes(const odb::query<mod
   });
 }
 
+odb::query<model::PYName> PythonServiceHandler::referenceQuery(const model::PYName& pyname, const std::int32_t referenceId)
+{
+  switch (referenceId)
+  {
+    case DEFINITION:
+      return odb::query<model::PYName>::ref_id == pyname.ref_id && odb::query<model::PYName>::is_definition == true && odb::query<model::PYName>::is_import == false;
+    case USAGE:
+      return odb::query<model::PYName>::ref_id == pyname.ref_id && odb::query<model::PYName>::is_definition == false && odb::query<model::PYName>::id != pyname.id;
+    case METHOD:
+      return odb::query<model::PYName>::parent == pyname.ref_id && odb::query<model::PYName>::type == "function" && odb::query<model::PYName>::is_definition == true;
+    case LOCAL_VAR:
+    case DATA_MEMBER:
+      return odb::query<model::PYName>::parent == pyname.ref_id && odb::query<model::PYName>::type == "statement" && odb::query<model::PYName>::is_definition == true;
+    case PARENT:
+      return odb::query<model::PYName>::id == pyname.parent;
+    case PARENT_FUNCTION:
+      return odb::query<model::PYName>::id == pyname.parent_function;
+    case PARAMETER:
+      return odb::query<model::PYName>::parent == pyname.ref_id && odb::query<model::PYName>::type == "astparam" && odb::query<model::PYName>::is_definition == true;
+    case CALLER:
+      return odb::query<model::PYName>::ref_id == pyname.ref_id && odb::query<model::PYName>::is_definition == false && odb::query<model::PYName>::is_call == true && odb::query<model::PYName>::id != pyname.id;
+    case THIS_CALLS:
+      return odb::query<model::PYName>::parent == pyname.id && odb::query<model::PYName>::is_call == true;
+    case ANNOTATION:
+      return odb::query<model::PYName>::parent == pyname.id && odb::query<model::PYName>::type == "annotation";
+    case BASE_CLASS:
+    {
+      odb::result<model::PYName> bases = _db->query<model::PYName>((odb::query<model::PYName>::parent == pyname.id && odb::query<model::PYName>::type == "baseclass"));
+      const std::vector<std::uint64_t> bases_refs = PythonServiceHandler::transformReferences(std::vector<model::PYName>(bases.begin(), bases.end()), model::REF_ID);
+
+      return odb::query<model::PYName>::ref_id.in_range(bases_refs.begin(), bases_refs.end()) && odb::query<model::PYName>::is_definition == true && odb::query<model::PYName>::is_import == false;
+    }
+  }
+
+  return odb::query<model::PYName>(false);
+}
+
 std::vector<model::PYName> PythonServiceHandler::queryReferences(const core::AstNodeId& astNodeId, const std::int32_t referenceId)
 {
   return _transaction([&](){
-    odb::result<model::PYName> nodes;
-
     const model::PYName pyname = PythonServiceHandler::queryNodeByID(astNodeId);
     const odb::query<model::PYName> order_by = "ORDER BY" + odb::query<model::PYName>::line_start + "," + odb::query<model::PYName>::column_start;
 
-    switch (referenceId)
-    {
-      case DEFINITION:
-        nodes = _db->query<model::PYName>((odb::query<model::PYName>::ref_id == pyname.ref_id && odb::query<model::PYName>::is_definition == true && odb::query<model::PYName>::is_import == false) + order_by);
-        break;
-      case USAGE:
-        nodes = _db->query<model::PYName>((odb::query<model::PYName>::ref_id == pyname.ref_id && odb::query<model::PYName>::is_definition == false && odb::query<model::PYName>::id != pyname.id) + order_by);
-        break;
-      case METHOD:
-        nodes = _db->query<model::PYName>((odb::query<model::PYName>::parent == pyname.ref_id && odb::query<model::PYName>::type == "function" && odb::query<model::PYName>::is_definition == true) + order_by);
-        break;
-      case LOCAL_VAR:
-      case DATA_MEMBER:
-        nodes = _db->query<model::PYName>((odb::query<model::PYName>::parent == pyname.ref_id && odb::query<model::PYName>::type == "statement" && odb::query<model::PYName>::is_definition == true) + order_by);
-        break;
-      case PARENT:
-        nodes = _db->query<model::PYName>((odb::query<model::PYName>::id == pyname.parent) + order_by);
-        break;
-      case PARENT_FUNCTION:
-        nodes = _db->query<model::PYName>((odb::query<model::PYName>::id == pyname.parent_function) + order_by);
-        break;
-      case PARAMETER:
-        nodes = _db->query<model::PYName>((odb::query<model::PYName>::parent == pyname.ref_id && odb::query<model::PYName>::type == "astparam" && odb::query<model::PYName>::is_definition == true) + order_by);
-        break;
-      case CALLER:
-        nodes = _db->query<model::PYName>((odb::query<model::PYName>::ref_id == pyname.ref_id && odb::query<model::PYName>::is_definition == false && odb::query<model::PYName>::is_call == true && odb::query<model::PYName>::id != pyname.id) + order_by);
-        break;
-      case THIS_CALLS:
-        nodes = _db->query<model::PYName>((odb::query<model::PYName>::parent == pyname.id && odb::query<model::PYName>::is_call == true) + order_by);
-        break;
-      case ANNOTATION:
-        nodes = _db->query<model::PYName>((odb::query<model::PYName>::parent == pyname.id && odb::query<model::PYName>::type == "annotation") + order_by);
-        break;
-      case BASE_CLASS:
-        odb::result<model::PYName> bases = _db->query<model::PYName>((odb::query<model::PYName>::parent == pyname.id && odb::query<model::PYName>::type == "baseclass"));
-        const std::vector<std::uint64_t> bases_refs = PythonServiceHandler::transformReferences(std::vector<model::PYName>(bases.begin(), bases.end()), model::REF_ID);
-
-        nodes = _db->query<model::PYName>((odb::query<model::PYName>::ref_id.in_range(bases_refs.begin(), bases_refs.end()) && odb::query<model::PYName>::is_definition == true && odb::query<model::PYName>::is_import == false) + order_by);
-        break;
-    }
+    odb::result<model::PYName> nodes = _db->query<model::PYName>(
+      PythonServiceHandler::referenceQuery(pyname, referenceId) + order_by);
 
     return std::vector<model::PYName>(nodes.begin(), nodes.end());
   });
 }
 
+std::size_t PythonServiceHandler::countReferences(const core::AstNodeId& astNodeId, const std::int32_t referenceId)
+{
+  return _transaction([&](){
+    const model::PYName pyname = PythonServiceHandler::queryNodeByID(astNodeId);
+
+    return _db->query_value<model::PYNameCount>(
+      PythonServiceHandler::referenceQuery(pyname, referenceId)).count;
+  });
+}
+
 std::vector<model::PYName> PythonServiceHandler::queryNodesInFile(const core::FileId& fileId, bool definitions)
 {
   return _transaction([&](){
@@ -1,11 +1,8 @@
 #ifndef CC_PARSER_SEARCHPARSER_H
 #define CC_PARSER_SEARCHPARSER_H
 
-#include <magic.h>
-
-#include <util/parserutil.h>
-
 #include <parser/abstractparser.h>
+#include <parser/filecatalog.h>
 #include <parser/parsercontext.h>
 
 namespace cc
@@ -25,8 +22,9 @@ public:
 
 private:
   void postParse();
-  util::DirIterCallback getParserCallback(const std::string& path_);
-  bool shouldHandle(const std::string& path_);
+  void indexFile(const FileCatalog::Entry& entry_);
+  bool isSkipped(const std::string& path_) const;
+  bool shouldHandle(const FileCatalog::Entry& entry_);
 
 private:
   /**
@@ -34,11 +32,6 @@ private:
    */
   std::unique_ptr<IndexerProcess> _indexProcess;
 
-  /**
-   * libmagic handler for mime types.
-   */
-  ::magic_t _fileMagic;
-
   /**
    * Directory of search database.
    */
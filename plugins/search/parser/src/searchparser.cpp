@@ -13,6 +13,7 @@
 #include <model/file.h>
 #include <model/file-odb.hxx>
 
+#include <parser/filecatalog.h>
 #include <parser/sourcemanager.h>
 #include <indexer/indexerprocess.h>
 #include <searchparser/searchparser.h>
@@ -31,23 +32,8 @@ std::array<const char*, 15> excludedSuffixes{{
   ".Metrics.dat", ".pp"
 }};
 
-SearchParser::SearchParser(ParserContext& ctx_) : AbstractParser(ctx_),
-  _fileMagic(::magic_open(MAGIC_MIME_TYPE | MAGIC_SYMLINK))
+SearchParser::SearchParser(ParserContext& ctx_) : AbstractParser(ctx_)
 {
-  if (!_fileMagic)
-  {
-    LOG(warning) << "Failed to create a libmagic cookie!";
-  }
-  else if (::magic_load(_fileMagic, nullptr) != 0)
-  {
-    LOG(warning)
-      << "magic_load failed! libmagic error: "
-      << ::magic_error(_fileMagic);
-
-    ::magic_close(_fileMagic);
-    _fileMagic = nullptr;
-  }
-
   std::string wsDir = ctx_.options["workspace"].as<std::string>();
   std::string projDir = wsDir + '/' + ctx_.options["name"].as<std::string>();
   _searchDatabase = projDir + "/search";
@@ -91,94 +77,75 @@ bool SearchParser::parse()
     LOG(info) << "Search database already exists, dropping.";
   }
 
-  for (const std::string& path :
-    _ctx.options["input"].as<std::vector<std::string>>())
-  {
-    LOG(info) << "Search parse path: " << path;
-
-    try
-    {
-      util::iterateDirectoryRecursive(path, getParserCallback(path));
-    }
-    catch (const std::exception& ex_)
-    {
-      LOG(warning) << "Search parser threw an exception: " << ex_.what();
-    }
-    catch (...)
+  if (!_indexProcess)
+    LOG(warning) << "Indexer process is not available, skip parsing.";
+  else
+    for (const FileCatalog::Entry& entry : _ctx.fileCatalog->entries())
     {
-      LOG(warning) << "Search parser failed with unknown exception!";
+      if (isSkipped(entry.path) || !shouldHandle(entry))
+        continue;
+
+      try
+      {
+        indexFile(entry);
+      }
+      catch (const std::exception& ex_)
+      {
+        LOG(warning) << "Search parser threw an exception: " << ex_.what();
+      }
+      catch (...)
+      {
+        LOG(warning) << "Search parser failed with unknown exception!";
+      }
     }
-  }
 
   postParse();
 
   return true;
 }
 
-util::DirIterCallback SearchParser::getParserCallback(const std::string& path_)
+void SearchParser::indexFile(const FileCatalog::Entry& entry_)
 {
-  if (!_indexProcess)
+  model::FilePtr file = _ctx.srcMgr.getFile(entry_.path);
+
+  if (file)
   {
-    LOG(warning) << "Indexer process is not available, skip path: " << path_;
-    return [](const std::string&){ return false; };
+    // The MIME type is already known from shouldHandle().
+    std::string mimeType = _ctx.fileCatalog->mimeType(entry_);
+    if (mimeType.empty())
+      mimeType = "text/plain";
+
+    file->inSearchIndex = true;
+    _ctx.srcMgr.persistFiles();
+    _indexProcess->indexFile(
+      std::to_string(file->id), file->path, mimeType);
   }
+}
 
-  return [this](const std::string& currPath_)
-  {
-    if (fs::is_directory(currPath_))
+bool SearchParser::isSkipped(const std::string& path_) const
+{
+  for (const std::string& dir : _skipDirectories)
+    if (path_.compare(0, dir.size(), dir) == 0 &&
+        (path_.size() == dir.size() || path_[dir.size()] == '/'))
     {
-      fs::path canonicalPath = fs::canonical(currPath_);
-
-      if (std::find(_skipDirectories.begin(), _skipDirectories.end(),
-            canonicalPath) != _skipDirectories.end())
-      {
-        LOG(trace) << "Skipping " << currPath_ << " because it was listed in "
-          "the skipping directory flag of the search parser.";
-        return false;
-      }
-    }
-
-    if (!shouldHandle(currPath_))
+      LOG(trace) << "Skipping " << path_ << " because it was listed in "
+        "the skipping directory flag of the search parser.";
       return true;
-
-    model::FilePtr file = _ctx.srcMgr.getFile(currPath_);
-
-    if (file)
-    {
-      std::string mimeType("text/plain");
-      if (_fileMagic)
-      {
-        const char* mimeStr = ::magic_file(_fileMagic, currPath_.c_str());
-
-        if (mimeStr)
-          mimeType = mimeStr;
-        else
-          LOG(warning)
-            << "Failed to get mime type for file '"
-            << currPath_ << "'. libmagic error: "
-            << ::magic_error(_fileMagic);
-      }
-
-      file->inSearchIndex = true;
-      _ctx.srcMgr.persistFiles();
-      _indexProcess->indexFile(
-        std::to_string(file->id), file->path, mimeType);
     }
 
-    return true;
-  };
+  return false;
 }
 
-bool SearchParser::shouldHandle(const std::string& path_)
+bool SearchParser::shouldHandle(const FileCatalog::Entry& entry_)
 {
   //--- The file is not regular. ---//
 
-  if (!fs::is_regular_file(path_))
+  if (entry_.type != util::DirEntryType::RegularFile)
     return false;
 
   //--- The file is excluded by suffix. ---//
 
-  std::string normPath(path_);
+  std::string normPath(entry_.path);
   std::transform(normPath.begin(), normPath.end(), normPath.begin(), ::tolower);
 
   for (const char* suff : excludedSuffixes)
@@ -188,25 +155,24 @@ bool SearchParser::shouldHandle(const std::string& path_)
     if (normPath.length() >= sufflen &&
         normPath.compare(normPath.length() - sufflen, sufflen, suff) == 0)
     {
-      LOG(trace) << "Skipping " << path_;
+      LOG(trace) << "Skipping " << entry_.path;
       return false;
     }
   }
 
   //--- The file is larger than one megabyte. ---//
 
-  struct stat statbuf;
-  if (::stat(path_.c_str(), &statbuf) == -1)
-    return false;
-
-  if (statbuf.st_size > (1024 * 1024))
+  if (entry_.size > (1024 * 1024))
     return false;
 
   //--- The file is not plain text. ---//
 
-  if (!_ctx.srcMgr.isPlainText(path_))
+  // libmagic is the most expensive check, so it comes last. The catalog
+  // keeps its result for indexFile() and the other plugins.
+  if (!_ctx.fileCatalog->isPlainText(entry_))
   {
-    LOG(trace) << "Skipping " << path_ << " because it is not plain text.";
+    LOG(trace) << "Skipping " << entry_.path
+      << " because it is not plain text.";
     return false;
   }
 
@@ -229,8 +195,6 @@ void SearchParser::postParse()
 
 SearchParser::~SearchParser()
 {
-  if (_fileMagic)
-    ::magic_close(_fileMagic);
 }
 
 #pragma clang diagnostic push
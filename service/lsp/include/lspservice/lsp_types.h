@@ -1,11 +1,15 @@
 #ifndef CC_MODEL_LSP_TYPES_H
 #define CC_MODEL_LSP_TYPES_H
 
+#include <memory>
+#include <sstream>
 #include <vector>
 
 #include <boost/property_tree/ptree.hpp>
 #include <boost/optional.hpp>
 
+#include <util/jsonwriter.h>
+
 namespace cc
 {
 namespace service
@@ -53,6 +57,13 @@ struct Writeable
 {
   virtual void writeNode(pt::ptree& node) const = 0;
 
+  /**
+   * Writes the structure directly as JSON. The default implementation goes
+   * through writeNode(), structures which appear in large results override
+   * it so no property tree has to be built for them.
+   */
+  virtual void writeJson(util::JsonWriter& writer) const;
+
   inline pt::ptree createNode() const
   {
     pt::ptree node;
@@ -76,6 +87,66 @@ struct ResponseError : public Writeable
   std::string message;
 
   void writeNode(pt::ptree& node) const override;
+  void writeJson(util::JsonWriter& writer) const override;
+};
+
+/**
+ * Represents the response to a single JSON RPC request. The result is
+ * serialized as soon as it is set, so large results are written with a
+ * streaming writer instead of being built as a property tree.
+ */
+class Response
+{
+public:
+  /**
+   * Sets the ID of the request. The property tree holds every value as a
+   * string, so whether the ID was a JSON number has to be told explicitly.
+   */
+  void setId(const std::string& id, bool isNumber = false);
+
+  /**
+   * Returns a writer for the result of the request. Exactly one JSON value
+   * has to be written with it. A previously set result is discarded.
+   */
+  util::JsonWriter& resultWriter();
+
+  void setResult(const std::string& value);
+  void setResult(const Writeable& value);
+
+  template <typename T>
+  void setResult(const std::vector<T>& values)
+  {
+    util::JsonWriter& writer = resultWriter();
+    writer.beginArray();
+    for (const T& value : values)
+      writeValue(writer, value);
+    writer.endArray();
+  }
+
+  void setError(const ResponseError& error);
+
+  /**
+   * Writes the complete response message. If neither a result nor an error
+   * was set, the result is null.
+   */
+  void write(util::JsonWriter& writer) const;
+
+private:
+  static void writeValue(util::JsonWriter& writer, const std::string& value)
+  {
+    writer.value(value);
+  }
+
+  static void writeValue(util::JsonWriter& writer, const Writeable& value)
+  {
+    value.writeJson(writer);
+  }
+
+  boost::optional<std::string> _id;
+  bool _idIsNumber = false;
+  boost::optional<ResponseError> _error;
+  std::ostringstream _result;
+  std::unique_ptr<util::JsonWriter> _resultWriter;
 };
 
 /**
@@ -92,6 +163,7 @@ struct TextDocumentIdentifier : public Readable, public Writeable
 
   void readNode(const pt::ptree& node) override;
   void writeNode(pt::ptree& node) const override;
+  void writeJson(util::JsonWriter& writer) const override;
 };
 
 /**
@@ -120,6 +192,7 @@ struct Position : public Readable, public Writeable
 
   void readNode(const pt::ptree& node) override;
   void writeNode(pt::ptree& node) const override;
+  void writeJson(util::JsonWriter& writer) const override;
 };
 
 /**
@@ -143,6 +216,7 @@ struct Range : public Readable, public Writeable
 
   void readNode(const pt::ptree& node) override;
   void writeNode(pt::ptree& node) const override;
+  void writeJson(util::JsonWriter& writer) const override;
 };
 
 /**
@@ -155,6 +229,7 @@ struct Location final : public Readable, public Writeable
 
   void readNode(const pt::ptree& node) override;
   void writeNode(pt::ptree& node) const override;
+  void writeJson(util::JsonWriter& writer) const override;
 };
 
 /**
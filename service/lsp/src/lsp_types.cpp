@@ -7,6 +7,47 @@ namespace service
 namespace lsp
 {
 
+namespace
+{
+
+/**
+ * Writes a property tree the same way as boost::property_tree::write_json()
+ * does: leaves are written as strings, nodes with unnamed children as arrays.
+ */
+void writeTree(util::JsonWriter& writer, const pt::ptree& node)
+{
+  if (node.empty())
+  {
+    writer.value(node.data());
+  }
+  else if (node.front().first.empty())
+  {
+    writer.beginArray();
+    for (const auto& child : node)
+      writeTree(writer, child.second);
+    writer.endArray();
+  }
+  else
+  {
+    writer.beginObject();
+    for (const auto& child : node)
+    {
+      writer.key(child.first);
+      writeTree(writer, child.second);
+    }
+    writer.endObject();
+  }
+}
+
+} // namespace
+
+//--- Writeable ---//
+
+void Writeable::writeJson(util::JsonWriter& writer) const
+{
+  writeTree(writer, createNode());
+}
+
 //--- ResponseError ---//
 
 void ResponseError::writeNode(pt::ptree& node) const
@@ -15,6 +56,70 @@ void ResponseError::writeNode(pt::ptree& node) const
   node.put("message", message);
 }
 
+void ResponseError::writeJson(util::JsonWriter& writer) const
+{
+  writer.beginObject()
+    .key("code").value(static_cast<int>(code))
+    .key("message").value(message)
+    .endObject();
+}
+
+//--- Response ---//
+
+void Response::setId(const std::string& id, bool isNumber)
+{
+  _id = id;
+  _idIsNumber = isNumber;
+}
+
+util::JsonWriter& Response::resultWriter()
+{
+  _result.str(std::string());
+  _resultWriter.reset(new util::JsonWriter(_result));
+  return *_resultWriter;
+}
+
+void Response::setResult(const std::string& value)
+{
+  resultWriter().value(value);
+}
+
+void Response::setResult(const Writeable& value)
+{
+  value.writeJson(resultWriter());
+}
+
+void Response::setError(const ResponseError& error)
+{
+  _error = error;
+}
+
+void Response::write(util::JsonWriter& writer) const
+{
+  writer.beginObject().key("jsonrpc").value("2.0");
+
+  // The request ID is echoed with its original JSON type.
+  writer.key("id");
+  if (!_id)
+    writer.null();
+  else if (_idIsNumber)
+    writer.raw(*_id);
+  else
+    writer.value(*_id);
+
+  if (_error)
+  {
+    writer.key("error");
+    _error->writeJson(writer);
+  }
+  else if (_resultWriter)
+    writer.key("result").raw(_result.str());
+  else
+    writer.key("result").null();
+
+  writer.endObject();
+}
+
 //--- TextDocumentIdentifier ---//
 
 void TextDocumentIdentifier::readNode(const pt::ptree& node)
@@ -27,6 +132,11 @@ void TextDocumentIdentifier::writeNode(pt::ptree& node) const
   node.put("uri", uri);
 }
 
+void TextDocumentIdentifier::writeJson(util::JsonWriter& writer) const
+{
+  writer.beginObject().key("uri").value(uri).endObject();
+}
+
 //--- Position ---//
 
 void Position::readNode(const pt::ptree& node)
@@ -41,6 +151,14 @@ void Position::writeNode(pt::ptree& node) const
   node.put("character", character);
 }
 
+void Position::writeJson(util::JsonWriter& writer) const
+{
+  writer.beginObject()
+    .key("line").value(line)
+    .key("character").value(character)
+    .endObject();
+}
+
 //--- Range ---//
 
 void Range::readNode(const pt::ptree& node)
@@ -55,6 +173,15 @@ void Range::writeNode(pt::ptree& node) const
   node.put_child("end", end.createNode());
 }
 
+void Range::writeJson(util::JsonWriter& writer) const
+{
+  writer.beginObject().key("start");
+  start.writeJson(writer);
+  writer.key("end");
+  end.writeJson(writer);
+  writer.endObject();
+}
+
 //--- Location ---//
 
 void Location::readNode(const pt::ptree& node)
@@ -69,6 +196,13 @@ void Location::writeNode(pt::ptree& node) const
   node.put_child("range", range.createNode());
 }
 
+void Location::writeJson(util::JsonWriter& writer) const
+{
+  writer.beginObject().key("uri").value(uri).key("range");
+  range.writeJson(writer);
+  writer.endObject();
+}
+
 //--- TextDocumentPositionParams ---//
 
 void TextDocumentPositionParams::readNode(const pt::ptree& node)
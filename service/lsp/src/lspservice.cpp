@@ -10,247 +10,255 @@ namespace lsp
 // Standard LSP methods
 
 void LspServiceHandler::getDefinition(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/definition");
+  getMethodNotFound(response_, "textDocument/definition");
 }
 
 void LspServiceHandler::getDeclaration(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/declaration");
+  getMethodNotFound(response_, "textDocument/declaration");
 }
 
 void LspServiceHandler::getImplementation(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/implementation");
+  getMethodNotFound(response_, "textDocument/implementation");
 }
 
 void LspServiceHandler::getReferences(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/references");
+  getMethodNotFound(response_, "textDocument/references");
 }
 
 // Extended LSP methods
 
 void LspServiceHandler::getDiagramTypes(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/diagramTypes");
+  getMethodNotFound(response_, "textDocument/diagramTypes");
 }
 
 void LspServiceHandler::getDiagram(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/diagram");
+  getMethodNotFound(response_, "textDocument/diagram");
 }
 
 void LspServiceHandler::getModuleDiagram(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "directory/diagram");
+  getMethodNotFound(response_, "directory/diagram");
 }
 
 void LspServiceHandler::getSignature(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/signature");
+  getMethodNotFound(response_, "textDocument/signature");
 }
 
 void LspServiceHandler::getParameters(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/parameters");
+  getMethodNotFound(response_, "textDocument/parameters");
 }
 
 void LspServiceHandler::getLocalVariables(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/localVariables");
+  getMethodNotFound(response_, "textDocument/localVariables");
 }
 
 void LspServiceHandler::getOverridden(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/overridden");
+  getMethodNotFound(response_, "textDocument/overridden");
 }
 
 void LspServiceHandler::getOverrider(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/overriders");
+  getMethodNotFound(response_, "textDocument/overriders");
 }
 
 void LspServiceHandler::getRead(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/read");
+  getMethodNotFound(response_, "textDocument/read");
 }
 
 void LspServiceHandler::getWrite(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/write");
+  getMethodNotFound(response_, "textDocument/write");
 }
 
 void LspServiceHandler::getMethods(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/methods");
+  getMethodNotFound(response_, "textDocument/methods");
 }
 
 void LspServiceHandler::getFriends(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/friends");
+  getMethodNotFound(response_, "textDocument/friends");
 }
 
 void LspServiceHandler::getEnumConstants(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/enumConstants");
+  getMethodNotFound(response_, "textDocument/enumConstants");
 }
 
 void LspServiceHandler::getExpansion(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/expansion");
+  getMethodNotFound(response_, "textDocument/expansion");
 }
 
 void LspServiceHandler::getUndefinition(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/undefinition");
+  getMethodNotFound(response_, "textDocument/undefinition");
 }
 
 void LspServiceHandler::getThisCalls(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/thisCalls");
+  getMethodNotFound(response_, "textDocument/thisCalls");
 }
 
 void LspServiceHandler::getCallsOfThis(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/callsOfThis");
+  getMethodNotFound(response_, "textDocument/callsOfThis");
 }
 
 void LspServiceHandler::getCallee(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/callee");
+  getMethodNotFound(response_, "textDocument/callee");
 }
 
 void LspServiceHandler::getCaller(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/caller");
+  getMethodNotFound(response_, "textDocument/caller");
 }
 
 void LspServiceHandler::getVirtualCall(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/virtualCall");
+  getMethodNotFound(response_, "textDocument/virtualCall");
 }
 
 void LspServiceHandler::getFunctionPointerCall(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/functionPointerCall");
+  getMethodNotFound(response_, "textDocument/functionPointerCall");
 }
 
 void LspServiceHandler::getAlias(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/alias");
+  getMethodNotFound(response_, "textDocument/alias");
 }
 
 void LspServiceHandler::getImplements(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/implements");
+  getMethodNotFound(response_, "textDocument/implements");
 }
 
 void LspServiceHandler::getDataMember(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/dataMember");
+  getMethodNotFound(response_, "textDocument/dataMember");
 }
 
 void LspServiceHandler::getUnderlyingType(
-  pt::ptree& responseTree_,
+  Response& response_,
   const pt::ptree&)
 {
-  getMethodNotFound(responseTree_, "textDocument/underlyingType");
+  getMethodNotFound(response_, "textDocument/underlyingType");
 }
 
 // Errors
 
 void LspServiceHandler::getMethodNotFound(
-  pt::ptree& responseTree_,
+  Response& response_,
   const std::string& method_)
 {
   ResponseError error;
   error.code = ErrorCode::MethodNotFound;
   error.message = std::string("Unsupported method: ").append(method_);
-  responseTree_.put_child("error", error.createNode());
+  response_.setError(error);
 }
 
 void LspServiceHandler::getParseError(
-  pt::ptree& responseTree_,
+  Response& response_,
   const std::exception& ex_)
 {
   ResponseError error;
   error.code = ErrorCode::ParseError;
   error.message = std::string("JSON RPC parsing error: ").append(ex_.what());
-  responseTree_.put_child("error", error.createNode());
+  response_.setError(error);
+}
+
+void LspServiceHandler::getInvalidRequest(Response& response_)
+{
+  ResponseError error;
+  error.code = ErrorCode::InvalidRequest;
+  error.message = "Invalid Request";
+  response_.setError(error);
 }
 
 void LspServiceHandler::getInternalError(
-  pt::ptree& responseTree_,
+  Response& response_,
   const std::exception& ex_)
 {
   ResponseError error;
   error.code = ErrorCode::InternalError;
   error.message = ex_.what();
-  responseTree_.put_child("error", error.createNode());
+  response_.setError(error);
 }
 
-void LspServiceHandler::getUnknownError(pt::ptree& responseTree_)
+void LspServiceHandler::getUnknownError(Response& response_)
 {
   ResponseError error;
   error.code = ErrorCode::UnknownError;
-  responseTree_.put_child("error", error.createNode());
+  response_.setError(error);
 }
 
 } // lsp
@@ -0,0 +1,118 @@
+#ifndef CC_UTIL_ARENA_H
+#define CC_UTIL_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace cc
+{
+namespace util
+{
+
+/**
+ * Memory for many small objects which are freed together. Allocation takes a
+ * piece of the current block, deallocation does nothing, and the blocks are
+ * freed when the arena is destroyed. The arena is not thread-safe: the objects
+ * of an arena have to be allocated on a single thread at a time.
+ */
+class Arena
+{
+public:
+  struct Statistics
+  {
+    /**
+     * The number of allocate() calls.
+     */
+    std::uint64_t allocations = 0;
+
+    /**
+     * The number of bytes requested by allocate() calls.
+     */
+    std::uint64_t bytes = 0;
+
+    /**
+     * The number of blocks allocated from the heap.
+     */
+    std::uint64_t blocks = 0;
+  };
+
+  /**
+   * @param blockSize_ The size of the first block. The following blocks are
+   * twice as large as the previous one, up to maxBlockSize.
+   */
+  explicit Arena(std::size_t blockSize_ = 64 * 1024);
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* allocate(std::size_t size_, std::size_t alignment_);
+
+  Statistics statistics() const;
+
+  static constexpr std::size_t maxBlockSize = 1024 * 1024;
+
+private:
+  std::vector<std::unique_ptr<char[]>> _blocks;
+  std::size_t _blockSize;
+  char* _current;
+  std::size_t _available;
+  Statistics _statistics;
+};
+
+/**
+ * Standard allocator which allocates from an Arena. The allocator shares the
+ * ownership of the arena, so the objects created by std::allocate_shared()
+ * keep their arena alive even if they are referred after the others are gone.
+ */
+template <typename T>
+class ArenaAllocator
+{
+public:
+  typedef T value_type;
+
+  explicit ArenaAllocator(std::shared_ptr<Arena> arena_)
+    : _arena(std::move(arena_))
+  {
+  }
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other_) : _arena(other_.arena())
+  {
+  }
+
+  T* allocate(std::size_t n_)
+  {
+    return static_cast<T*>(_arena->allocate(n_ * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T*, std::size_t)
+  {
+  }
+
+  const std::shared_ptr<Arena>& arena() const
+  {
+    return _arena;
+  }
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>& other_) const
+  {
+    return _arena == other_.arena();
+  }
+
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U>& other_) const
+  {
+    return _arena != other_.arena();
+  }
+
+private:
+  std::shared_ptr<Arena> _arena;
+};
+
+} // util
+} // cc
+
+#endif // CC_UTIL_ARENA_H
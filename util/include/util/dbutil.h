@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 #include <model/file.h>
 #include <model/file-odb.hxx>
 
@@ -36,14 +37,64 @@ std::shared_ptr<odb::database> connectDatabase(
 
 /**
  * This function adds indexes to the database. These indexes are added from the
- * .sql files which describe the model.
+ * .sql files which describe the model. The indexes of different tables are
+ * built in parallel on separate connections, foreign keys are added
+ * afterwards. The build time of each index is logged.
  * @param db_ Pointer to the ODB database.
  * @param sqlDir_ Directory path of SQL files.
+ * @param threadCount_ The number of connections building indexes at the same
+ * time. SQLite databases have a single connection, so it is ignored there.
+ * @param memoryMiB_ The memory in MiB which the index builds running at the
+ * same time may use for sorting altogether. It is only used by PostgreSQL.
  */
 void createIndexes(
+  std::shared_ptr<odb::database> db_,
+  const std::string& sqlDir_,
+  std::size_t threadCount_ = 1,
+  std::size_t memoryMiB_ = 2048);
+
+/**
+ * This function switches a freshly created database into a fast but not
+ * crash-safe mode for the initial load: PostgreSQL tables become unlogged,
+ * SQLite keeps its rollback journal in memory and doesn't sync. If the parsing
+ * is interrupted in this mode then the database has to be parsed again from
+ * scratch.
+ * @param db_ Pointer to the ODB database.
+ * @param sqlDir_ Directory path of SQL files.
+ */
+void beginBulkLoad(
   std::shared_ptr<odb::database> db_,
   const std::string& sqlDir_);
 
+/**
+ * This function switches the database back to durable mode after
+ * beginBulkLoad(). SQLite gets the journal settings it had before.
+ * @param db_ Pointer to the ODB database.
+ * @param sqlDir_ Directory path of SQL files.
+ * @param threadCount_ The number of tables converted at the same time.
+ */
+void endBulkLoad(
+  std::shared_ptr<odb::database> db_,
+  const std::string& sqlDir_,
+  std::size_t threadCount_ = 1);
+
+/**
+ * This function loads the databases of parser runs on parts of a project (see
+ * the --shard option of the parser) into a database. Objects with hash ids are
+ * stored once. Objects with auto ids get new ids, and the C++ objects which
+ * have the same natural key (e.g. the AST node of an entity) are stored once.
+ * Only SQLite databases can be merged.
+ * @param db_ Pointer to the ODB database. Its tables have to be created
+ * without indexes, see beginBulkLoad().
+ * @param sqlDir_ Directory path of SQL files.
+ * @param shards_ The connection strings of the databases to merge.
+ * @return False if the databases can't be merged.
+ */
+bool mergeDatabases(
+  std::shared_ptr<odb::database> db_,
+  const std::string& sqlDir_,
+  const std::vector<std::string>& shards_);
+
 /**
  * This function creates database tables. These tables are added from the .sql
  * files which describe the model.
@@ -1,9 +1,11 @@
 #ifndef CC_UTIL_HASH_H
 #define CC_UTIL_HASH_H
 
+#include <charconv>
 #include <cstdint>
 #include <string>
 #include <sstream>
+#include <type_traits>
 
 #include <boost/version.hpp>
 #if BOOST_VERSION >= 106800 /* 1.68.0 */
@@ -31,6 +33,64 @@ inline std::uint64_t fnvHash(const std::string& data_)
   return hash;
 }
 
+/**
+ * Computes fnvHash() of a string given in pieces without building the string.
+ * Numbers are hashed as their std::to_string() form, so
+ *
+ *   FnvHasher().add(name).add(':').addNumber(line).value()
+ *     == fnvHash(name + ':' + std::to_string(line))
+ *
+ * This doesn't allocate memory, so it is used for the identifiers computed for
+ * every AST node.
+ */
+class FnvHasher
+{
+public:
+  FnvHasher& add(const char* data_, std::size_t size_)
+  {
+    for (std::size_t i = 0; i < size_; ++i)
+    {
+      _hash ^= static_cast<std::uint64_t>(data_[i]);
+      _hash *= static_cast<std::uint64_t>(1099511628211ULL);
+    }
+
+    return *this;
+  }
+
+  FnvHasher& add(const std::string& data_)
+  {
+    return add(data_.data(), data_.size());
+  }
+
+  FnvHasher& add(char c_)
+  {
+    return add(&c_, 1);
+  }
+
+  template <typename T>
+  FnvHasher& addNumber(T value_)
+  {
+    static_assert(
+      std::is_integral<T>::value && !std::is_same<T, bool>::value,
+      "Only integers can be hashed as numbers.");
+
+    // Long enough for any 64-bit integer with its sign.
+    char buffer[24];
+    std::to_chars_result result
+      = std::to_chars(buffer, buffer + sizeof(buffer), value_);
+
+    return add(buffer, result.ptr - buffer);
+  }
+
+  std::uint64_t value() const
+  {
+    return _hash;
+  }
+
+private:
+  std::uint64_t _hash = 14695981039346656037ULL;
+};
+
 inline std::string sha1Hash(const std::string& data_)
 {
   using namespace boost::uuids::detail;
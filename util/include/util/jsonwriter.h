@@ -0,0 +1,211 @@
+#ifndef CC_UTIL_JSONWRITER_H
+#define CC_UTIL_JSONWRITER_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace cc
+{
+namespace util
+{
+
+/**
+ * Streaming JSON writer. Unlike boost::property_tree, no document is built
+ * in memory: every call writes its token to the output stream immediately,
+ * so arbitrarily large arrays and objects can be produced with constant
+ * memory. The writer only inserts separators, it is the caller's
+ * responsibility to produce a well-formed sequence of calls.
+ */
+class JsonWriter
+{
+public:
+  JsonWriter(std::ostream& out_) : _out(out_), _afterKey(false) {}
+
+  JsonWriter& beginObject()
+  {
+    separate();
+    _out.put('{');
+    _first.push_back(true);
+    return *this;
+  }
+
+  JsonWriter& endObject()
+  {
+    _out.put('}');
+    _first.pop_back();
+    return *this;
+  }
+
+  JsonWriter& beginArray()
+  {
+    separate();
+    _out.put('[');
+    _first.push_back(true);
+    return *this;
+  }
+
+  JsonWriter& endArray()
+  {
+    _out.put(']');
+    _first.pop_back();
+    return *this;
+  }
+
+  JsonWriter& key(const std::string& key_)
+  {
+    separate();
+    writeString(key_);
+    _out.put(':');
+    _afterKey = true;
+    return *this;
+  }
+
+  JsonWriter& value(const std::string& value_)
+  {
+    separate();
+    writeString(value_);
+    return *this;
+  }
+
+  JsonWriter& value(const char* value_)
+  {
+    return value(std::string(value_));
+  }
+
+  JsonWriter& value(std::int64_t value_)
+  {
+    separate();
+    _out << value_;
+    return *this;
+  }
+
+  JsonWriter& value(std::uint64_t value_)
+  {
+    separate();
+    _out << value_;
+    return *this;
+  }
+
+  JsonWriter& value(int value_)
+  {
+    return value(static_cast<std::int64_t>(value_));
+  }
+
+  JsonWriter& value(unsigned value_)
+  {
+    return value(static_cast<std::uint64_t>(value_));
+  }
+
+  /**
+   * Writes the number with enough digits to be read back exactly. JSON has no
+   * representation of infinity and NaN, these are written as null.
+   */
+  JsonWriter& value(double value_)
+  {
+    separate();
+
+    if (!std::isfinite(value_))
+    {
+      _out << "null";
+      return *this;
+    }
+
+    std::streamsize precision
+      = _out.precision(std::numeric_limits<double>::max_digits10);
+    _out << value_;
+    _out.precision(precision);
+    return *this;
+  }
+
+  JsonWriter& value(bool value_)
+  {
+    separate();
+    _out << (value_ ? "true" : "false");
+    return *this;
+  }
+
+  JsonWriter& null()
+  {
+    separate();
+    _out << "null";
+    return *this;
+  }
+
+  /**
+   * Writes an already serialized JSON value as is.
+   */
+  JsonWriter& raw(const std::string& json_)
+  {
+    separate();
+    _out << json_;
+    return *this;
+  }
+
+private:
+  void separate()
+  {
+    if (_afterKey)
+      _afterKey = false;
+    else if (!_first.empty())
+    {
+      if (!_first.back())
+        _out.put(',');
+      _first.back() = false;
+    }
+  }
+
+  void writeString(const std::string& str_)
+  {
+    _out.put('"');
+
+    std::size_t plain = 0;
+    for (std::size_t i = 0; i < str_.size(); ++i)
+    {
+      const unsigned char c = str_[i];
+      if (c >= 0x20 && c != '"' && c != '\\')
+        continue;
+
+      _out.write(str_.data() + plain, i - plain);
+      plain = i + 1;
+
+      switch (c)
+      {
+        case '"': _out << "\\\""; break;
+        case '\\': _out << "\\\\"; break;
+        case '\n': _out << "\\n"; break;
+        case '\r': _out << "\\r"; break;
+        case '\t': _out << "\\t"; break;
+        case '\b': _out << "\\b"; break;
+        case '\f': _out << "\\f"; break;
+        default:
+        {
+          char buf[7];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+          _out << buf;
+        }
+      }
+    }
+
+    _out.write(str_.data() + plain, str_.size() - plain);
+    _out.put('"');
+  }
+
+  std::ostream& _out;
+
+  /**
+   * One element for each open object or array: true until its first member
+   * is written.
+   */
+  std::vector<bool> _first;
+  bool _afterKey;
+};
+
+} // util
+} // cc
+
+#endif // CC_UTIL_JSONWRITER_H
@@ -14,7 +14,11 @@ void initConsoleLogger();
 
 std::string getLoggingBase(const std::string& path_, const std::string& name_);
 
-bool initFileLogger(const std::string& path_);
+/**
+ * Adds a log file. If append_ is true then the records are appended to the
+ * existing file, e.g. by several processes sharing it.
+ */
+bool initFileLogger(const std::string& path_, bool append_ = false);
 
 boost::log::trivial::severity_level getSeverityLevel();
 
@@ -1,6 +1,12 @@
 #ifndef CC_UTIL_PARSEUTIL_H
 #define CC_UTIL_PARSEUTIL_H
 
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+
 namespace cc
 {
 namespace util
@@ -14,6 +20,53 @@ namespace util
  */
 typedef std::function<bool (const std::string&)> DirIterCallback;
 
+/**
+ * Type of an entity found by iterateDirectoryParallel. Symbolic links are
+ * resolved, so a link to a directory is reported as a directory.
+ */
+enum class DirEntryType
+{
+  Directory,
+  RegularFile,
+  Other
+};
+
+/**
+ * Callback function type for iterateDirectoryParallel.
+ *
+ * The parameters are the full path and the type of the current entity, so
+ * the callback does not have to stat the path again. If the walk runs on
+ * several threads then the callback is called concurrently, so it has to be
+ * thread-safe. If the callback returns false on a directory, then the files
+ * under that directory won't be passed to this callback.
+ */
+typedef std::function<bool (const std::string&, DirEntryType)>
+  DirEntryCallback;
+
+/**
+ * Status of an entity found by iterateDirectoryParallel. Symbolic links are
+ * resolved, like in DirEntryType.
+ */
+struct DirEntryStat
+{
+  /**
+   * Size of the entity in bytes.
+   */
+  std::uint64_t size;
+
+  /**
+   * Last modification time.
+   */
+  std::time_t mtime;
+};
+
+/**
+ * Callback function type for iterateDirectoryParallel, which also gets the
+ * status of the entity. Otherwise the same as DirEntryCallback.
+ */
+typedef std::function<bool (const std::string&, DirEntryType,
+  const DirEntryStat&)> DirEntryStatCallback;
+
 /**
  * Recursively iterate over the given directory.
  * @param path_ Directory or a regular file.
@@ -26,6 +79,44 @@ bool iterateDirectoryRecursive(
   const std::string& path_,
   DirIterCallback callback_);
 
+/**
+ * Recursively iterate over the given directory on several threads. The
+ * directories are read with a single system call per block of entries and
+ * the entity types are taken from the directory entries, so files are only
+ * stat-ed if the file system doesn't report their type or they are symbolic
+ * links.
+ *
+ * Several callbacks can share one traversal: every callback is called on
+ * every path, except for the ones under directories on which the given
+ * callback returned false. A directory is only read while at least one
+ * callback is interested in its content.
+ *
+ * An exception thrown by a callback stops the walk and is rethrown to the
+ * caller.
+ *
+ * @param path_ Directory or a regular file.
+ * @param callbacks_ Callback functions which will be called on each existing
+ * path.
+ * @param threadCount_ The number of threads reading directories. The calling
+ * thread is one of them, so 1 means a sequential walk.
+ * @return false if all callbacks_ return false on the given path_.
+ */
+bool iterateDirectoryParallel(
+  const std::string& path_,
+  const std::vector<DirEntryCallback>& callbacks_,
+  std::size_t threadCount_);
+
+/**
+ * Same as the other iterateDirectoryParallel, but the callbacks get the
+ * status of the entities too. The entities are stat-ed relative to the
+ * descriptor of their directory, so this costs one fstatat() per entity
+ * instead of a lookup of the full path.
+ */
+bool iterateDirectoryParallel(
+  const std::string& path_,
+  const std::vector<DirEntryStatCallback>& callbacks_,
+  std::size_t threadCount_);
+
 } // util
 } // cc
 
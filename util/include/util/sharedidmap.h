@@ -0,0 +1,151 @@
+#ifndef CC_UTIL_SHAREDIDMAP_H
+#define CC_UTIL_SHAREDIDMAP_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cc
+{
+namespace util
+{
+
+/**
+ * Fixed size hash table of 64-bit ids and values in shared memory. It lets
+ * the processes which write into the same database decide which of them
+ * persists an object: the one whose insert() succeeds first.
+ *
+ * The table is created by the parent process and the child processes map it
+ * through the inherited file descriptor. Inserts and lookups are lock-free.
+ *
+ * An id inserted by a process which has an owner (see setOwner()) is only a
+ * claim until the process commits it, i.e. its object is in the database. If
+ * the process dies, its parent releases the uncommitted claims, so that the
+ * objects can be persisted by another process.
+ */
+class SharedIdMap
+{
+public:
+  SharedIdMap(const SharedIdMap&) = delete;
+  SharedIdMap& operator=(const SharedIdMap&) = delete;
+
+  /**
+   * Creates a new table in anonymous shared memory.
+   * @param maxBytes_ The size of the table. It holds a power of two number
+   * of ids which fits into this size.
+   * @return The table or nullptr if the shared memory can't be created.
+   */
+  static std::shared_ptr<SharedIdMap> create(std::uint64_t maxBytes_);
+
+  /**
+   * Maps a table created by another process.
+   * @param fd_ The file descriptor of the table, see fd().
+   * @return The table or nullptr if the descriptor can't be mapped.
+   */
+  static std::shared_ptr<SharedIdMap> open(int fd_);
+
+  ~SharedIdMap();
+
+  /**
+   * Sets the owner of the ids inserted by this process from now on, e.g. its
+   * pid. Without an owner the inserted ids are committed at once.
+   */
+  void setOwner(std::uint64_t owner_);
+
+  /**
+   * Inserts an id with a value. If the id has been released then it is
+   * claimed again.
+   * @return True if the id wasn't in the table before. If the table is full
+   * then true is returned too, so the caller rather persists a duplicate than
+   * loses an object.
+   */
+  bool insert(std::uint64_t id_, std::uint64_t value_ = 0);
+
+  /**
+   * Commits the claim of an id by this process, after its object has been
+   * persisted.
+   */
+  void commit(std::uint64_t id_);
+
+  /**
+   * Releases the claims of this process which haven't been committed, e.g.
+   * because their transaction has failed.
+   */
+  void releasePending();
+
+  /**
+   * Releases the uncommitted claims of a dead process. This reads the whole
+   * filled part of the table, so it is meant for the rare crashes only.
+   * @return The number of released ids.
+   */
+  std::uint64_t release(std::uint64_t owner_);
+
+  bool contains(std::uint64_t id_) const;
+
+  /**
+   * Looks up the value of an id. If another process is inserting the id at
+   * the same time then it waits for the value to be written.
+   * @return False if the id is not in the table or it has been released.
+   */
+  bool find(std::uint64_t id_, std::uint64_t& value_) const;
+
+  /**
+   * The number of ids in the table.
+   */
+  std::uint64_t size() const;
+
+  /**
+   * The number of inserts which have found the table full, so their objects
+   * may have been persisted by several processes.
+   */
+  std::uint64_t overflows() const;
+
+  /**
+   * The file descriptor of the shared memory. It is closed on exec(), so it
+   * has to be duplicated for the child processes.
+   */
+  int fd() const;
+
+private:
+  struct Header;
+  struct Slot;
+
+  SharedIdMap(int fd_, void* memory_, std::uint64_t bytes_);
+
+  /**
+   * Returns the slot where the probe sequence of a key starts.
+   */
+  std::uint64_t home(std::uint64_t key_) const;
+
+  /**
+   * Returns the slot of a key or nullptr if it is not in the table.
+   */
+  Slot* findSlot(std::uint64_t key_) const;
+
+  const int _fd;
+  void* const _memory;
+  const std::uint64_t _bytes;
+
+  Header* _header;
+  Slot* _slots;
+
+  /**
+   * The state of the slots claimed by this process: committed if there is no
+   * owner.
+   */
+  std::uint64_t _claimState;
+
+  /**
+   * The slots claimed by this process since the last releasePending(). Some
+   * of them may be committed already.
+   */
+  std::vector<Slot*> _pending;
+  std::mutex _pendingMutex;
+};
+
+} // util
+} // cc
+
+#endif // CC_UTIL_SHAREDIDMAP_H
@@ -0,0 +1,51 @@
+#include <algorithm>
+
+#include <util/arena.h>
+
+namespace cc
+{
+namespace util
+{
+
+constexpr std::size_t Arena::maxBlockSize;
+
+Arena::Arena(std::size_t blockSize_)
+  : _blockSize(std::max<std::size_t>(blockSize_, 1)),
+    _current(nullptr),
+    _available(0)
+{
+}
+
+void* Arena::allocate(std::size_t size_, std::size_t alignment_)
+{
+  void* memory = _current;
+
+  if (!std::align(alignment_, size_, memory, _available))
+  {
+    // Objects larger than the blocks get a block of their own.
+    std::size_t blockSize = std::max(_blockSize, size_ + alignment_);
+    _blocks.emplace_back(new char[blockSize]);
+    _blockSize = std::min(_blockSize * 2, std::max(maxBlockSize, _blockSize));
+    ++_statistics.blocks;
+
+    memory = _blocks.back().get();
+    _available = blockSize;
+    std::align(alignment_, size_, memory, _available);
+  }
+
+  _current = static_cast<char*>(memory) + size_;
+  _available -= size_;
+
+  ++_statistics.allocations;
+  _statistics.bytes += size_;
+
+  return memory;
+}
+
+Arena::Statistics Arena::statistics() const
+{
+  return _statistics;
+}
+
+} // util
+} // cc
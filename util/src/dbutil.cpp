@@ -1,5 +1,11 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <fstream>
 #include <map>
+#include <mutex>
+#include <set>
+#include <thread>
 #include <vector>
 
 #include <boost/algorithm/string.hpp>
@@ -17,6 +23,7 @@
 #endif
 
 #include <odb/connection.hxx>
+#include <odb/transaction.hxx>
 
 #include <util/logutil.h>
 #include <util/dbutil.h>
@@ -136,6 +143,80 @@ void sqliteRegexImpl(
     sqlite3_result_error(context_, msg.c_str(), msg.size());
   }
 }
+
+/**
+ * Connection factory of the SQLite databases. The journal settings are
+ * per-connection in SQLite, so the ones of beginBulkLoad() and endBulkLoad()
+ * are applied here to the connection before it is handed out to anyone.
+ */
+class SqliteConnectionFactory : public odb::sqlite::single_connection_factory
+{
+public:
+  virtual odb::sqlite::connection_ptr connect() override
+  {
+    // The single connection is locked until the caller releases it, so the
+    // settings don't change under a running transaction.
+    odb::sqlite::connection_ptr connection
+      = odb::sqlite::single_connection_factory::connect();
+
+    std::lock_guard<std::mutex> guard(_mutex);
+    for (const std::string& pragma : _pragmas)
+      connection->execute(pragma);
+    _pragmas.clear();
+
+    return connection;
+  }
+
+  /**
+   * Sets PRAGMA statements which are executed on the connection when it is
+   * next requested.
+   */
+  void setPragmas(std::vector<std::string> pragmas_)
+  {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _pragmas = std::move(pragmas_);
+  }
+
+  /**
+   * The PRAGMA statements which restore the settings changed by
+   * beginBulkLoad().
+   */
+  std::vector<std::string> restorePragmas;
+
+private:
+  std::vector<std::string> _pragmas;
+  std::mutex _mutex;
+};
+
+std::map<const odb::database*, SqliteConnectionFactory*> sqliteFactories;
+std::mutex sqliteFactoriesMutex;
+
+SqliteConnectionFactory* getSqliteFactory(const odb::database& db_)
+{
+  std::lock_guard<std::mutex> guard(sqliteFactoriesMutex);
+  auto it = sqliteFactories.find(&db_);
+  return it == sqliteFactories.end() ? nullptr : it->second;
+}
+
+/**
+ * This function returns the current value of a PRAGMA setting.
+ */
+std::string queryPragma(
+  odb::connection& connection_,
+  const std::string& name_)
+{
+  sqlite3* handle = static_cast<odb::sqlite::connection&>(connection_).handle();
+  sqlite3_stmt* stmt = nullptr;
+  std::string value;
+
+  if (sqlite3_prepare_v2(
+    handle, ("PRAGMA " + name_).c_str(), -1, &stmt, nullptr) == SQLITE_OK
+    && sqlite3_step(stmt) == SQLITE_ROW)
+    value = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+
+  sqlite3_finalize(stmt);
+  return value;
+}
 #endif
 
 #ifdef DATABASE_PGSQL
@@ -212,21 +293,21 @@ std::string removeByRegex(
 }
 
 /**
- * This function runs all .sql files which are produced by ODB.
- * @param db_ A database object.
+ * This function reads all .sql files which are produced by ODB and splits
+ * their content into SQL statements.
  * @param sqlDir_ Path of the directory containing .sql files.
  * @param replacer_ A function can be given which will be applied to the .sql
- * file content before execution.
+ * file content before splitting.
  * @param logMessage_ This log message is printed before the .sql file
- * execution followed by the file name.
+ * is read followed by the file name.
+ * @return The statements of each file.
  */
-void runSqlFiles(
-  std::shared_ptr<odb::database> db_,
+std::vector<std::vector<std::string>> readSqlFiles(
   const std::string& sqlDir_,
   std::function<std::string(const std::string&)> replacer_,
   const std::string& logMessage_)
 {
-  odb::connection_ptr connection = db_->connection();
+  std::vector<std::vector<std::string>> files;
 
   for (
     boost::filesystem::directory_iterator it(sqlDir_);
@@ -247,30 +328,58 @@ void runSqlFiles(
 
     file.close();
 
-    try
+    // In SQLite if several SQL commands are provided separated by semicolon
+    // then only the first executes. So we have to split and execute them one
+    // by one.
+    std::string sql = replacer_(fileContent);
+    std::vector<std::string> v;
+    boost::algorithm::split_regex(v, sql, boost::regex("\n\n"));
+
+#ifdef DATABASE_SQLITE
+    for (std::string& statement : v)
     {
-      // In SQLite if several SQL commands are provided separated by semicolon
-      // then only the first executes. So we have to split and execute them one
-      // by one.
-      std::string sql = replacer_(fileContent);
-      std::vector<std::string> v;
-      boost::algorithm::split_regex(v, sql, boost::regex("\n\n"));
-
-      for (std::size_t i = 0; i < v.size(); ++i)
+      // DROP TABLE SQL commands generated by ODB may contain "CASCADE"
+      // keyword which is not known by SQLITE.
+      if (statement.find("DROP TABLE") == 0)
       {
-#ifdef DATABASE_SQLITE
-        // DROP TABLE SQL commands generated by ODB may contain "CASCADE"
-        // keyword which is not known by SQLITE.
-        if (v[i].find("DROP TABLE") == 0)
-        {
-          std::size_t pos = v[i].find("CASCADE");
-          if (pos != std::string::npos)
-            v[i].erase(pos, 7); // 7 == length of "CASCADE"
-        }
-#endif
-        connection->execute(v[i]);
+        std::size_t pos = statement.find("CASCADE");
+        if (pos != std::string::npos)
+          statement.erase(pos, 7); // 7 == length of "CASCADE"
       }
     }
+#endif
+
+    files.push_back(std::move(v));
+  }
+
+  return files;
+}
+
+/**
+ * This function runs all .sql files which are produced by ODB.
+ * @param db_ A database object.
+ * @param sqlDir_ Path of the directory containing .sql files.
+ * @param replacer_ A function can be given which will be applied to the .sql
+ * file content before execution.
+ * @param logMessage_ This log message is printed before the .sql file
+ * execution followed by the file name.
+ */
+void runSqlFiles(
+  std::shared_ptr<odb::database> db_,
+  const std::string& sqlDir_,
+  std::function<std::string(const std::string&)> replacer_,
+  const std::string& logMessage_)
+{
+  odb::connection_ptr connection = db_->connection();
+
+  for (const std::vector<std::string>& statements
+    : readSqlFiles(sqlDir_, replacer_, logMessage_))
+  {
+    try
+    {
+      for (const std::string& statement : statements)
+        connection->execute(statement);
+    }
     catch (const odb::exception& ex)
     {
       LOG(warning) << "Exception when running SQL command: " << ex.what();
@@ -278,6 +387,246 @@ void runSqlFiles(
   }
 }
 
+/**
+ * This function returns the names of the tables created by the .sql files
+ * which are produced by ODB.
+ */
+std::vector<std::string> getTableNames(const std::string& sqlDir_)
+{
+  static const boost::regex tableExpr("^CREATE TABLE \"([^\"]+)\"");
+
+  std::vector<std::string> tables;
+  boost::smatch match;
+
+  for (const std::vector<std::string>& statements : readSqlFiles(
+    sqlDir_, [](const std::string& s_) { return s_; }, "Reading tables from"))
+    for (const std::string& statement : statements)
+      if (boost::regex_search(statement, match, tableExpr))
+        tables.push_back(match[1]);
+
+  return tables;
+}
+
+/**
+ * This function executes groups of SQL statements on several database
+ * connections at the same time. The statements of a group are executed one
+ * after the other on the same connection, and the time of each is logged.
+ * @param setup_ Statements executed on each connection before the groups.
+ * @param teardown_ Statements executed on each connection after the groups.
+ */
+void runStatementGroups(
+  std::shared_ptr<odb::database> db_,
+  const std::vector<std::vector<std::string>>& groups_,
+  std::size_t threadCount_,
+  const std::vector<std::string>& setup_ = {},
+  const std::vector<std::string>& teardown_ = {})
+{
+  static const boost::regex indexExpr(
+    "CREATE (UNIQUE )?INDEX \"([^\"]+)\"\\s+ON \"([^\"]+)\"");
+
+  std::atomic<std::size_t> next(0);
+
+  auto worker = [&]()
+  {
+    odb::connection_ptr connection;
+
+    try
+    {
+      connection = db_->connection();
+    }
+    catch (const odb::exception& ex)
+    {
+      LOG(error) << "Failed to open a database connection: " << ex.what();
+      return;
+    }
+
+    auto execute = [&](const std::string& statement_)
+    {
+      try
+      {
+        connection->execute(statement_);
+      }
+      catch (const odb::exception& ex)
+      {
+        LOG(warning) << "Exception when running SQL command: " << ex.what();
+      }
+    };
+
+    for (const std::string& statement : setup_)
+      execute(statement);
+
+    for (std::size_t i = next++; i < groups_.size(); i = next++)
+      for (const std::string& statement : groups_[i])
+      {
+        auto start = std::chrono::steady_clock::now();
+        execute(statement);
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - start).count();
+
+        boost::smatch match;
+        if (boost::regex_search(statement, match, indexExpr))
+          LOG(info) << "Created index " << match[2] << " on table "
+                    << match[3] << " in " << duration << " ms.";
+        else
+          LOG(info) << "Executed "
+                    << statement.substr(0, statement.find('\n'))
+                    << " in " << duration << " ms.";
+      }
+
+    for (const std::string& statement : teardown_)
+      execute(statement);
+  };
+
+#ifdef DATABASE_SQLITE
+  // The SQLite database has a single connection.
+  threadCount_ = 1;
+#endif
+
+  std::vector<std::thread> threads;
+  for (std::size_t i = 1; i < std::min(threadCount_, groups_.size()); ++i)
+    threads.emplace_back(worker);
+
+  worker();
+
+  for (std::thread& thread : threads)
+    thread.join();
+}
+
+#ifdef DATABASE_SQLITE
+/**
+ * The layout of a table as described by the .sql files of ODB.
+ */
+struct TableSchema
+{
+  std::string name;
+  std::vector<std::string> columns;
+
+  /**
+   * The primary key column. Container tables don't have one.
+   */
+  std::string primaryKey;
+
+  /**
+   * True if the primary key is assigned by the database.
+   */
+  bool autoId = false;
+
+  /**
+   * The tables referred by the foreign key columns.
+   */
+  std::map<std::string, std::string> references;
+};
+
+/**
+ * This function collects the tables, their columns and foreign keys from the
+ * .sql files which are produced by ODB.
+ */
+std::map<std::string, TableSchema> readTableSchemas(const std::string& sqlDir_)
+{
+  static const boost::regex tableExpr(
+    "^(CREATE|ALTER) TABLE \"([^\"]+)\"");
+  static const boost::regex columnExpr("^\\s*\"([^\"]+)\"\\s+(.*)$");
+  static const boost::regex foreignKeyExpr(
+    "FOREIGN KEY \\(\"([^\"]+)\"\\)\\s+REFERENCES \"([^\"]+)\"");
+
+  std::map<std::string, TableSchema> tables;
+
+  for (const std::vector<std::string>& statements : readSqlFiles(
+    sqlDir_, [](const std::string& s_) { return s_; }, "Reading tables from"))
+    for (const std::string& statement : statements)
+    {
+      std::string sql = boost::algorithm::trim_copy(statement);
+
+      boost::smatch match;
+      if (!boost::regex_search(sql, match, tableExpr))
+        continue;
+
+      TableSchema& table = tables[match[2]];
+      table.name = match[2];
+
+      // PostgreSQL foreign keys are added by ALTER TABLE statements.
+      if (match[1] == "CREATE")
+      {
+        std::vector<std::string> lines;
+        boost::algorithm::split(lines, sql, boost::is_any_of("\n"));
+
+        for (const std::string& line : lines)
+        {
+          if (!boost::regex_search(line, match, columnExpr))
+            continue;
+
+          table.columns.push_back(match[1]);
+
+          const std::string definition = match[2];
+          if (definition.find("PRIMARY KEY") != std::string::npos)
+          {
+            table.primaryKey = match[1];
+            table.autoId = definition.find("AUTOINCREMENT") != std::string::npos
+              || definition.find("SERIAL") != std::string::npos;
+          }
+        }
+      }
+
+      for (boost::sregex_iterator it(sql.begin(), sql.end(), foreignKeyExpr);
+        it != boost::sregex_iterator(); ++it)
+        table.references[(*it)[1]] = (*it)[2];
+    }
+
+  return tables;
+}
+
+/**
+ * This function returns the table which assigns the ids of the given table:
+ * the table itself if its ids are assigned by the database, or the base table
+ * if it is a derived table of a polymorphic hierarchy, whose primary key
+ * refers to the base. An empty string is returned for the tables whose ids are
+ * hashes.
+ */
+std::string idOwner(
+  const std::map<std::string, TableSchema>& tables_,
+  const std::string& table_)
+{
+  auto it = tables_.find(table_);
+
+  while (it != tables_.end() && !it->second.autoId)
+  {
+    auto ref = it->second.references.find(it->second.primaryKey);
+    if (it->second.primaryKey.empty() || ref == it->second.references.end())
+      return std::string();
+
+    it = tables_.find(ref->second);
+  }
+
+  return it == tables_.end() ? std::string() : it->first;
+}
+
+/**
+ * The columns identifying the objects with auto ids which may be stored by
+ * several shards, e.g. the entities and relations of a common header. The
+ * rows of other tables, like the build actions, each belong to the one shard
+ * which parsed them, so they are never collapsed.
+ */
+const std::map<std::string, std::vector<std::string>> mergeKeys = {
+  {"CppEntity",          {"astNodeId"}},
+  {"CppMemberType",      {"memberAstNode"}},
+  {"CppDocComment",      {"entityHash"}},
+  {"CppFriendship",      {"target", "theFriend"}},
+  {"CppHeaderInclusion", {"includer", "included"}},
+  {"CppInheritance",     {"derived", "base"}},
+  {"CppMacroExpansion",  {"astNodeId"}},
+  {"CppRelation",        {"lhs", "rhs", "kind"}},
+  {"CppTypeDependency",  {"entityHash", "dependencyHash"}}
+};
+
+/**
+ * This function quotes an SQL string literal.
+ */
+std::string quoteLiteral(const std::string& s_)
+{
+  return '\'' + boost::algorithm::replace_all_copy(s_, "'", "''") + '\'';
+}
+#endif
+
 }
 
 namespace cc
@@ -327,6 +676,9 @@ std::shared_ptr<odb::database> connectDatabase(
   {
     try
     {
+      auto factory = std::make_unique<SqliteConnectionFactory>();
+      SqliteConnectionFactory* factoryPtr = factory.get();
+
       auto sqliteDB = new odb::sqlite::database(
         optionsSize,
         cStyleOptions,
@@ -334,9 +686,14 @@ std::shared_ptr<odb::database> connectDatabase(
         SQLITE_OPEN_READWRITE | (create_ ? SQLITE_OPEN_CREATE : 0),
         true,
         "",
-        std::make_unique<odb::sqlite::single_connection_factory>());
+        std::move(factory));
       db.reset(sqliteDB, [](odb::database*){});
 
+      {
+        std::lock_guard<std::mutex> guard(sqliteFactoriesMutex);
+        sqliteFactories[sqliteDB] = factoryPtr;
+      }
+
       auto sqlitePtr = sqliteDB->connection()->handle();
       sqlite3_create_function_v2(
         sqlitePtr,
@@ -439,15 +796,385 @@ void removeTables(
 
 void createIndexes(
   std::shared_ptr<odb::database> db_,
-  const std::string& sqlDir_)
+  const std::string& sqlDir_,
+  std::size_t threadCount_,
+  std::size_t memoryMiB_)
 {
-  runSqlFiles(db_, sqlDir_,
+  static const boost::regex tableExpr(
+    "^CREATE (UNIQUE )?INDEX \"[^\"]+\"\\s+ON \"([^\"]+)\"");
+
+  //--- Group the statements by table ---//
+
+  // The indexes of different tables are built at the same time on separate
+  // connections. The indexes of one table are built one after the other, so
+  // they don't compete for the lock and the cached pages of the same table.
+  std::map<std::string, std::vector<std::string>> indexesByTable;
+  std::vector<std::string> constraints;
+
+  for (const std::vector<std::string>& statements : readSqlFiles(sqlDir_,
     [](const std::string& s_){
       return removeByRegex(removeByRegex(s_,
         "CREATE TABLE", ";"),
         "DROP", ";");
     },
-    "Creating indexes from file");
+    "Creating indexes from file"))
+  {
+    for (const std::string& statement : statements)
+    {
+      std::string sql = boost::algorithm::trim_copy(statement);
+      if (sql.empty())
+        continue;
+
+      boost::smatch match;
+      if (boost::regex_search(sql, match, tableExpr))
+        indexesByTable[match[2]].push_back(std::move(sql));
+      else
+        constraints.push_back(std::move(sql));
+    }
+  }
+
+  std::vector<std::vector<std::string>> groups;
+  for (auto& table : indexesByTable)
+    groups.push_back(std::move(table.second));
+
+  std::vector<std::string> setup, teardown;
+
+#ifdef DATABASE_PGSQL
+  if (db_->id() == odb::id_pgsql)
+  {
+    std::size_t threadCount = std::max<std::size_t>(
+      std::min(threadCount_, groups.size()), 1);
+
+    setup = {
+      "SET maintenance_work_mem = '" + std::to_string(std::max<std::size_t>(
+        memoryMiB_ / threadCount, 64)) + "MB'",
+      "SET max_parallel_maintenance_workers = " + std::to_string(
+        std::max<std::size_t>(threadCount_ / threadCount, 1) - 1)
+    };
+    teardown = {
+      "RESET maintenance_work_mem",
+      "RESET max_parallel_maintenance_workers"
+    };
+  }
+#else
+  (void)memoryMiB_;
+#endif
+
+  LOG(info) << "Building indexes of " << groups.size() << " tables on "
+            << threadCount_ << " connection(s).";
+
+  auto start = std::chrono::steady_clock::now();
+  runStatementGroups(db_, groups, threadCount_, setup, teardown);
+
+  // Foreign keys lock both tables they connect, so these are added on a
+  // single connection to avoid deadlocks.
+  runStatementGroups(db_, {constraints}, 1);
+
+  LOG(info) << "Indexes and constraints created in "
+            << std::chrono::duration_cast<std::chrono::seconds>(
+                 std::chrono::steady_clock::now() - start).count() << " s.";
+}
+
+void beginBulkLoad(
+  std::shared_ptr<odb::database> db_,
+  const std::string& sqlDir_)
+{
+  LOG(info) << "Switching the database to non-durable bulk load mode.";
+
+#ifdef DATABASE_SQLITE
+  if (db_->id() == odb::id_sqlite)
+    if (SqliteConnectionFactory* factory = getSqliteFactory(*db_))
+    {
+      // The rollback journal is kept in memory, so the transactions can
+      // still be rolled back.
+      {
+        odb::connection_ptr connection = db_->connection();
+        factory->restorePragmas.clear();
+
+        for (const char* pragma : {"journal_mode", "synchronous"})
+        {
+          std::string value = queryPragma(*connection, pragma);
+          if (!value.empty())
+            factory->restorePragmas.push_back(
+              std::string("PRAGMA ") + pragma + " = " + value);
+        }
+      }
+
+      factory->setPragmas({
+        "PRAGMA journal_mode = MEMORY",
+        "PRAGMA synchronous = OFF"});
+      db_->connection();
+    }
+#endif
+
+#ifdef DATABASE_PGSQL
+  if (db_->id() == odb::id_pgsql)
+  {
+    // The tables are empty at this point, so this is cheap.
+    std::vector<std::string> statements;
+    for (const std::string& table : getTableNames(sqlDir_))
+      statements.push_back("ALTER TABLE \"" + table + "\" SET UNLOGGED");
+
+    runStatementGroups(db_, {statements}, 1);
+  }
+#else
+  (void)sqlDir_;
+#endif
+}
+
+void endBulkLoad(
+  std::shared_ptr<odb::database> db_,
+  const std::string& sqlDir_,
+  std::size_t threadCount_)
+{
+  LOG(info) << "Switching the database back to durable mode.";
+
+#ifdef DATABASE_SQLITE
+  if (db_->id() == odb::id_sqlite)
+    if (SqliteConnectionFactory* factory = getSqliteFactory(*db_))
+    {
+      factory->setPragmas(std::move(factory->restorePragmas));
+      factory->restorePragmas.clear();
+      db_->connection();
+    }
+#endif
+
+#ifdef DATABASE_PGSQL
+  if (db_->id() == odb::id_pgsql)
+  {
+    // SET LOGGED rewrites the table into the write-ahead log, so the tables
+    // are converted in parallel.
+    std::vector<std::vector<std::string>> groups;
+    for (const std::string& table : getTableNames(sqlDir_))
+      groups.push_back({"ALTER TABLE \"" + table + "\" SET LOGGED"});
+
+    runStatementGroups(db_, groups, threadCount_);
+  }
+#else
+  (void)sqlDir_;
+  (void)threadCount_;
+#endif
+}
+
+bool mergeDatabases(
+  std::shared_ptr<odb::database> db_,
+  const std::string& sqlDir_,
+  const std::vector<std::string>& shards_)
+{
+#ifdef DATABASE_SQLITE
+  if (db_->id() == odb::id_sqlite)
+  {
+    std::map<std::string, TableSchema> tables = readTableSchemas(sqlDir_);
+
+    std::map<std::string, std::string> owners;
+    for (const auto& table : tables)
+      owners[table.first] = idOwner(tables, table.first);
+
+    // The id of a column which refers to a table with auto ids is shifted by
+    // the largest id of that table before the shard is loaded.
+    auto shifted = [&](const std::string& owner_, const std::string& column_)
+    {
+      return '"' + column_ + "\" + (SELECT \"offset\" FROM "
+        "temp.\"cc_merge_offset\" WHERE \"name\" = " + quoteLiteral(owner_)
+        + ')';
+    };
+
+    odb::connection_ptr connection = db_->connection();
+
+    try
+    {
+      connection->execute("PRAGMA foreign_keys = OFF");
+      connection->execute(
+        "CREATE TEMP TABLE \"cc_merge_offset\" "
+        "(\"name\" TEXT PRIMARY KEY, \"offset\" INTEGER)");
+
+      //--- Load the shards ---//
+
+      for (const std::string& shard : shards_)
+      {
+        std::string path = connStrComponent(shard, "database");
+        if (path.substr(0, 2) == "~/")
+          if (char* home = std::getenv("HOME"))
+            path = home + path.substr(1);
+
+        if (!boost::filesystem::is_regular_file(path))
+        {
+          LOG(error) << "Shard database " << path << " doesn't exist.";
+          return false;
+        }
+
+        LOG(info) << "Merging shard " << path;
+
+        auto start = std::chrono::steady_clock::now();
+
+        connection->execute(
+          "ATTACH DATABASE " + quoteLiteral(path) + " AS \"shard\"");
+
+        odb::transaction trans(connection->begin());
+
+        connection->execute("DELETE FROM temp.\"cc_merge_offset\"");
+        for (const auto& table : tables)
+          if (table.second.autoId)
+            connection->execute(
+              "INSERT INTO temp.\"cc_merge_offset\" SELECT "
+              + quoteLiteral(table.first) + ", COALESCE(MAX(\""
+              + table.second.primaryKey + "\"), 0) FROM main.\""
+              + table.first + '"');
+
+        // Objects with hash ids are stored once, the ones with auto ids are
+        // appended with new ids.
+        for (const auto& table : tables)
+        {
+          std::string columns, values;
+
+          for (const std::string& column : table.second.columns)
+          {
+            auto ref = table.second.references.find(column);
+            std::string owner = table.second.autoId
+              && column == table.second.primaryKey
+              ? table.first
+              : ref != table.second.references.end()
+                ? owners[ref->second]
+                : std::string();
+
+            columns += (columns.empty() ? "\"" : ", \"") + column + '"';
+            values += (values.empty() ? "" : ", ")
+              + (owner.empty() ? '"' + column + '"' : shifted(owner, column));
+          }
+
+          connection->execute(
+            "INSERT OR IGNORE INTO main.\"" + table.first + "\" (" + columns
+            + ") SELECT " + values + " FROM \"shard\".\"" + table.first + '"');
+        }
+
+        trans.commit();
+
+        connection->execute("DETACH DATABASE \"shard\"");
+
+        LOG(info) << "Merged shard " << path << " in "
+                  << std::chrono::duration_cast<std::chrono::seconds>(
+                       std::chrono::steady_clock::now() - start).count()
+                  << " s.";
+      }
+
+      //--- Remove the duplicates of objects with auto ids ---//
+
+      // An object parsed in several shards, e.g. an entity of a common
+      // header, has a copy with a different id from each of them. The copies
+      // have the same natural key (see mergeKeys), so the smallest id is kept
+      // and the references are redirected to it. The tables whose rows refer
+      // to other tables with auto ids are processed after those.
+      std::vector<std::string> order;
+      std::set<std::string> visited;
+
+      std::function<void(const std::string&)> visit =
+        [&](const std::string& owner_)
+        {
+          if (!visited.insert(owner_).second)
+            return;
+
+          const TableSchema& table = tables[owner_];
+          for (const auto& ref : table.references)
+            if (ref.first != table.primaryKey && !owners[ref.second].empty())
+              visit(owners[ref.second]);
+
+          order.push_back(owner_);
+        };
+
+      for (const auto& table : tables)
+        if (table.second.autoId)
+          visit(table.first);
+
+      odb::transaction trans(connection->begin());
+
+      for (const std::string& owner : order)
+      {
+        auto key = mergeKeys.find(owner);
+        if (key == mergeKeys.end())
+          continue;
+
+        const TableSchema& table = tables[owner];
+
+        std::string partition;
+        for (const std::string& column : key->second)
+          partition += (partition.empty() ? "\"" : ", \"") + column + '"';
+
+        connection->execute(
+          "CREATE TEMP TABLE \"cc_merge_dup\" "
+          "(\"old\" INTEGER PRIMARY KEY, \"new\" INTEGER)");
+
+        connection->execute(
+          "INSERT INTO temp.\"cc_merge_dup\" SELECT \"old\", \"new\" FROM ("
+          "SELECT \"" + table.primaryKey + "\" AS \"old\", MIN(\""
+          + table.primaryKey + "\") OVER (PARTITION BY " + partition
+          + ") AS \"new\" FROM main.\"" + owner + "\") WHERE \"old\" <> \"new\"");
+
+        const std::string duplicates
+          = "(SELECT \"old\" FROM temp.\"cc_merge_dup\")";
+
+        connection->execute(
+          "DELETE FROM main.\"" + owner + "\" WHERE \"" + table.primaryKey
+          + "\" IN " + duplicates);
+
+        for (const auto& other : tables)
+          for (const auto& ref : other.second.references)
+          {
+            if (owners[ref.second] != owner)
+              continue;
+
+            // The rows of derived tables belong to the removed copies.
+            if (ref.first == other.second.primaryKey)
+              connection->execute(
+                "DELETE FROM main.\"" + other.first + "\" WHERE \"" + ref.first
+                + "\" IN " + duplicates);
+            else
+              connection->execute(
+                "UPDATE main.\"" + other.first + "\" SET \"" + ref.first
+                + "\" = (SELECT \"new\" FROM temp.\"cc_merge_dup\" WHERE "
+                "\"old\" = \"" + other.first + "\".\"" + ref.first + "\") "
+                "WHERE \"" + ref.first + "\" IN " + duplicates);
+          }
+
+        connection->execute("DROP TABLE temp.\"cc_merge_dup\"");
+      }
+
+      // Container tables don't have a primary key, so their rows are
+      // appended from every shard.
+      for (const auto& table : tables)
+      {
+        if (!table.second.primaryKey.empty())
+          continue;
+
+        std::string columns;
+        for (const std::string& column : table.second.columns)
+          columns += (columns.empty() ? "\"" : ", \"") + column + '"';
+
+        connection->execute(
+          "DELETE FROM main.\"" + table.first + "\" WHERE rowid NOT IN ("
+          "SELECT MIN(rowid) FROM main.\"" + table.first + "\" GROUP BY "
+          + columns + ')');
+      }
+
+      trans.commit();
+
+      connection->execute("DROP TABLE temp.\"cc_merge_offset\"");
+      connection->execute("PRAGMA foreign_keys = ON");
+    }
+    catch (const odb::exception& ex)
+    {
+      LOG(error) << "Merging the shards failed: " << ex.what();
+      return false;
+    }
+
+    return true;
+  }
+#else
+  (void)sqlDir_;
+  (void)shards_;
+#endif
+
+  LOG(error) << "Shards can be merged into SQLite databases only.";
+  return false;
 }
 
 std::string updateConnectionString(
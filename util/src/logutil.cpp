@@ -121,10 +121,13 @@ std::string getLoggingBase(const std::string& path_, const std::string& name_)
   return fullpath + (fullpath.back() == '/' ? "" : "/") + name_ + '_';
 }
 
-bool initFileLogger(const std::string& path_)
+bool initFileLogger(const std::string& path_, bool append_)
 {
   auto fsSink = boost::log::add_file_log(
     boost::log::keywords::file_name = path_,
+    boost::log::keywords::open_mode = append_
+      ? std::ios_base::out | std::ios_base::app
+      : std::ios_base::out | std::ios_base::trunc,
     boost::log::keywords::auto_flush = true
     );
   fsSink->set_formatter(&fileLogFormatter);
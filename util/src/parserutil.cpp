@@ -1,96 +1,444 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
 
-#include <boost/filesystem.hpp>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <util/logutil.h>
 #include <util/parserutil.h>
 
-namespace fs = boost::filesystem;
-
 namespace
 {
 
+using cc::util::DirEntryCallback;
+using cc::util::DirEntryStat;
+using cc::util::DirEntryStatCallback;
+using cc::util::DirEntryType;
+
 /**
-* Context to iterateDirectoryRecursive.
-*/
-struct TraverseContext
+ * A directory on the path from the root of the iteration to the directory
+ * being read. Used for detecting cycles caused by symbolic links.
+ */
+struct Ancestor
 {
- /**
-  * Time of last status report.
-  */
- std::chrono::time_point<std::chrono::system_clock> lastReportTime =
-   std::chrono::system_clock::now();
- /**
-  * Total number of (regular) files visited in the iteration.
-  */
- std::size_t numFilesVisited = 0;
- /**
-  * Total number of directories visited in the iteration.
-  */
- std::size_t numDirsVisited = 0;
+  dev_t device;
+  ino_t inode;
+  std::shared_ptr<const Ancestor> parent;
 };
 
-bool iterateDirectoryRecursive(
-  TraverseContext& context_,
-  const std::string& path_,
-  cc::util::DirIterCallback callback_)
+/**
+ * A directory whose content is still to be read.
+ */
+struct DirJob
 {
-  //--- Status reporting ---//
+  std::string path;
+
+  /**
+   * The callbacks which are interested in the content of the directory.
+   */
+  std::vector<bool> active;
+
+  std::shared_ptr<const Ancestor> ancestors;
+};
 
-  auto currTime = std::chrono::system_clock::now();
-  if ((currTime - context_.lastReportTime) >= std::chrono::seconds(15))
+/**
+ * Walks a directory tree on several threads. Every thread owns a frontier of
+ * directories to read: it pushes the subdirectories it finds to the back of
+ * its own frontier and continues with the last one, so the walk stays depth
+ * first and the frontier small. Idle threads steal from the front of the
+ * other frontiers, which holds the directories closest to the root, i.e. the
+ * largest pieces of work.
+ */
+class DirectoryWalker
+{
+public:
+  /**
+   * @param withStat_ If false, the entities are only stat-ed if their type
+   * is not known from the directory entry, and the callbacks get an empty
+   * status.
+   */
+  DirectoryWalker(
+    std::vector<DirEntryStatCallback> callbacks_,
+    bool withStat_,
+    std::size_t threadCount_)
+    : _callbacks(std::move(callbacks_)),
+      _withStat(withStat_),
+      _pending(0),
+      _queued(0),
+      _sleeping(0),
+      _stop(false),
+      _numFilesVisited(0),
+      _numDirsVisited(0),
+      _lastReportTime(std::chrono::steady_clock::now())
   {
-    // It's time to report
-    LOG(info)
-      << "Recursive directory iteration: visited "
-      << context_.numFilesVisited << " files in "
-      << context_.numDirsVisited << " directories so far.";
-    context_.lastReportTime = currTime;
+    for (std::size_t i = 0; i < std::max<std::size_t>(threadCount_, 1); ++i)
+      _workers.emplace_back(new Worker);
   }
 
-  fs::path p(path_);
-
-  boost::system::error_code ec;
-  auto target = fs::canonical(p, ec);
-  if (ec)
+  bool walk(const std::string& path_)
   {
-    LOG(warning) << p << ": " << ec.message();
+    DirEntryType type;
+    DirEntryStat stat;
+    if (!getType(path_, type, stat))
+      return true;
+
+    DirJob root;
+    root.path = path_;
+    root.active.resize(_callbacks.size());
+
+    bool anyActive = false;
+    for (std::size_t i = 0; i < _callbacks.size(); ++i)
+      anyActive |= root.active[i] = _callbacks[i](path_, type, stat);
+
+    if (!anyActive)
+      return false;
+
+    if (type == DirEntryType::Directory)
+    {
+      ++_numDirsVisited;
+      push(0, std::move(root));
+
+      std::vector<std::thread> threads;
+      for (std::size_t i = 1; i < _workers.size(); ++i)
+        threads.emplace_back(&DirectoryWalker::work, this, i);
+
+      work(0);
+
+      for (std::thread& thread : threads)
+        thread.join();
+
+      if (_error)
+        std::rethrow_exception(_error);
+    }
+
     return true;
   }
 
-  if (!fs::exists(p))
+private:
+  /**
+   * Above this number of queued directories a thread reads the
+   * subdirectories it finds itself instead of queueing them.
+   */
+  static constexpr std::size_t maxFrontierSize = 4096;
+
+  struct Worker
+  {
+    std::mutex lock;
+    std::deque<DirJob> frontier;
+  };
+
+  /**
+   * Determines the type and status of the path, following symbolic links.
+   * @param dirFd_ The path is relative to this directory descriptor, or to
+   * the working directory if it is AT_FDCWD.
+   * @param path_ The path to stat, relative or absolute.
+   * @param fullPath_ The path reported in the warnings.
+   * @return False if the path doesn't exist or can't be accessed.
+   */
+  static bool getType(
+    int dirFd_,
+    const char* path_,
+    const std::string& fullPath_,
+    DirEntryType& type_,
+    DirEntryStat& stat_)
   {
-    LOG(warning) << "Not found: " << p;
+    struct stat statbuf;
+    if (::fstatat(dirFd_, path_, &statbuf, 0) == -1)
+    {
+      LOG(warning) << fullPath_ << ": " << std::strerror(errno);
+      return false;
+    }
+
+    if (S_ISDIR(statbuf.st_mode))
+      type_ = DirEntryType::Directory;
+    else if (S_ISREG(statbuf.st_mode))
+      type_ = DirEntryType::RegularFile;
+    else
+      type_ = DirEntryType::Other;
+
+    stat_.size = statbuf.st_size;
+    stat_.mtime = statbuf.st_mtime;
+
     return true;
   }
 
-  if (fs::is_directory(p))
+  static bool getType(
+    const std::string& path_,
+    DirEntryType& type_,
+    DirEntryStat& stat_)
   {
-    ++context_.numDirsVisited;
+    return getType(AT_FDCWD, path_.c_str(), path_, type_, stat_);
   }
-  else if(fs::is_regular_file(p))
+
+  void work(std::size_t id_)
   {
-    ++context_.numFilesVisited;
+    while (!_stop)
+    {
+      DirJob job;
+
+      if (take(id_, job))
+      {
+        try
+        {
+          readDirectory(id_, job);
+        }
+        catch (...)
+        {
+          std::lock_guard<std::mutex> lock(_errorLock);
+          if (!_error)
+            _error = std::current_exception();
+          _stop = true;
+        }
+
+        if (--_pending == 0 || _stop)
+        {
+          std::lock_guard<std::mutex> lock(_idleLock);
+          _idle.notify_all();
+        }
+
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(_idleLock);
+      ++_sleeping;
+      _idle.wait(lock, [this]{
+        return _queued > 0 || _pending == 0 || _stop; });
+      --_sleeping;
+
+      if (_pending == 0)
+        break;
+    }
   }
 
-  //--- Call callback ---//
+  void push(std::size_t id_, DirJob&& job_)
+  {
+    ++_pending;
+
+    {
+      // _queued is increased under the lock, otherwise another thread could
+      // take the job and decrease it first, wrapping it around.
+      std::lock_guard<std::mutex> lock(_workers[id_]->lock);
+      _workers[id_]->frontier.push_back(std::move(job_));
+      ++_queued;
+    }
+
+    if (_sleeping > 0)
+    {
+      std::lock_guard<std::mutex> lock(_idleLock);
+      _idle.notify_one();
+    }
+  }
+
+  bool take(std::size_t id_, DirJob& job_)
+  {
+    {
+      Worker& own = *_workers[id_];
+      std::lock_guard<std::mutex> lock(own.lock);
+      if (!own.frontier.empty())
+      {
+        job_ = std::move(own.frontier.back());
+        own.frontier.pop_back();
+        --_queued;
+        return true;
+      }
+    }
+
+    for (std::size_t i = 1; i < _workers.size(); ++i)
+    {
+      Worker& victim = *_workers[(id_ + i) % _workers.size()];
+      std::lock_guard<std::mutex> lock(victim.lock);
+      if (!victim.frontier.empty())
+      {
+        job_ = std::move(victim.frontier.front());
+        victim.frontier.pop_front();
+        --_queued;
+        return true;
+      }
+    }
 
-  if (!callback_(path_))
     return false;
+  }
+
+  void readDirectory(std::size_t id_, DirJob& job_)
+  {
+    int fd = ::open(job_.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+    {
+      LOG(warning) << job_.path << ": " << std::strerror(errno);
+      return;
+    }
+
+    //--- Check for symbolic link cycles ---//
+
+    struct stat statbuf;
+    if (::fstat(fd, &statbuf) == -1)
+    {
+      LOG(warning) << job_.path << ": " << std::strerror(errno);
+      ::close(fd);
+      return;
+    }
+
+    for (const Ancestor* a = job_.ancestors.get(); a; a = a->parent.get())
+      if (a->device == statbuf.st_dev && a->inode == statbuf.st_ino)
+      {
+        LOG(warning) << "Skipping " << job_.path
+          << " because it is a symbolic link to its own ancestor.";
+        ::close(fd);
+        return;
+      }
+
+    std::shared_ptr<const Ancestor> ancestors(
+      new Ancestor{statbuf.st_dev, statbuf.st_ino, job_.ancestors});
 
-  //--- Iterate over directory content ---//
+    //--- Read the entries ---//
 
-  if (fs::is_directory(p))
-    for (fs::directory_iterator it(p), end_iter; it != end_iter; ++it)
+    // readdir() fills its buffer by getdents64(), so the entries come in
+    // blocks, together with their types.
+    std::unique_ptr<DIR, int (*)(DIR*)> dir(::fdopendir(fd), &::closedir);
+    if (!dir)
     {
-      std::string path = it->path().c_str();
+      LOG(warning) << job_.path << ": " << std::strerror(errno);
+      ::close(fd);
+      return;
+    }
+
+    std::string prefix = job_.path;
+    if (prefix.empty() || prefix.back() != '/')
+      prefix += '/';
 
-      if (!iterateDirectoryRecursive(context_, path , callback_))
+    while (!_stop)
+    {
+      errno = 0;
+      const struct dirent* entry = ::readdir(dir.get());
+      if (!entry)
+      {
+        if (errno)
+          LOG(warning) << job_.path << ": " << std::strerror(errno);
+        break;
+      }
+
+      const char* name = entry->d_name;
+      if (name[0] == '.' &&
+          (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
         continue;
+
+      std::string path = prefix + name;
+
+      DirEntryType type;
+      DirEntryStat stat{0, 0};
+
+      if (_withStat ||
+          entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN)
+      {
+        if (!getType(::dirfd(dir.get()), name, path, type, stat))
+          continue;
+      }
+      else if (entry->d_type == DT_DIR)
+        type = DirEntryType::Directory;
+      else if (entry->d_type == DT_REG)
+        type = DirEntryType::RegularFile;
+      else
+        type = DirEntryType::Other;
+
+      visitEntry(id_, job_, ancestors, std::move(path), type, stat);
     }
+  }
 
-  return true;
-}
+  void visitEntry(
+    std::size_t id_,
+    const DirJob& parent_,
+    const std::shared_ptr<const Ancestor>& ancestors_,
+    std::string&& path_,
+    DirEntryType type_,
+    const DirEntryStat& stat_)
+  {
+    if (type_ == DirEntryType::Directory)
+      ++_numDirsVisited;
+    else if (type_ == DirEntryType::RegularFile)
+      ++_numFilesVisited;
+
+    reportProgress();
+
+    //--- Call callbacks ---//
+
+    DirJob job;
+    job.active.resize(_callbacks.size());
+
+    bool anyActive = false;
+    for (std::size_t i = 0; i < _callbacks.size(); ++i)
+      if (parent_.active[i])
+        anyActive |= job.active[i] = _callbacks[i](path_, type_, stat_);
+
+    if (type_ != DirEntryType::Directory || !anyActive)
+      return;
+
+    //--- Schedule the directory content ---//
+
+    job.path = std::move(path_);
+    job.ancestors = ancestors_;
+
+    if (_queued < maxFrontierSize * _workers.size())
+      push(id_, std::move(job));
+    else
+      readDirectory(id_, job);
+  }
+
+  void reportProgress()
+  {
+    std::unique_lock<std::mutex> lock(_reportLock, std::try_to_lock);
+    if (!lock)
+      return;
+
+    auto currTime = std::chrono::steady_clock::now();
+    if ((currTime - _lastReportTime) >= std::chrono::seconds(15))
+    {
+      LOG(info)
+        << "Recursive directory iteration: visited "
+        << _numFilesVisited << " files in "
+        << _numDirsVisited << " directories so far.";
+      _lastReportTime = currTime;
+    }
+  }
+
+  const std::vector<DirEntryStatCallback> _callbacks;
+  const bool _withStat;
+  std::vector<std::unique_ptr<Worker>> _workers;
+
+  /**
+   * The number of directories queued or being read. The walk is over when it
+   * drops to zero.
+   */
+  std::atomic<std::size_t> _pending;
+
+  /**
+   * The number of directories in the frontiers.
+   */
+  std::atomic<std::size_t> _queued;
+
+  std::atomic<std::size_t> _sleeping;
+  std::mutex _idleLock;
+  std::condition_variable _idle;
+
+  std::atomic<bool> _stop;
+  std::mutex _errorLock;
+  std::exception_ptr _error;
+
+  std::atomic<std::size_t> _numFilesVisited;
+  std::atomic<std::size_t> _numDirsVisited;
+  std::mutex _reportLock;
+  std::chrono::steady_clock::time_point _lastReportTime;
+};
 
 } // anonymus namespace
 
@@ -103,9 +451,42 @@ bool iterateDirectoryRecursive(
   const std::string& path_,
   DirIterCallback callback_)
 {
-  TraverseContext ctx;
-  std::string path = path_;
-  return ::iterateDirectoryRecursive(ctx, path, callback_);
+  return iterateDirectoryParallel(
+    path_,
+    {[&callback_](const std::string& currPath_, DirEntryType)
+      {
+        return callback_(currPath_);
+      }},
+    1);
+}
+
+bool iterateDirectoryParallel(
+  const std::string& path_,
+  const std::vector<DirEntryCallback>& callbacks_,
+  std::size_t threadCount_)
+{
+  std::vector<DirEntryStatCallback> callbacks;
+  callbacks.reserve(callbacks_.size());
+
+  for (const DirEntryCallback& callback : callbacks_)
+    callbacks.push_back(
+      [&callback](
+        const std::string& path_, DirEntryType type_, const DirEntryStat&)
+      {
+        return callback(path_, type_);
+      });
+
+  DirectoryWalker walker(std::move(callbacks), false, threadCount_);
+  return walker.walk(path_);
+}
+
+bool iterateDirectoryParallel(
+  const std::string& path_,
+  const std::vector<DirEntryStatCallback>& callbacks_,
+  std::size_t threadCount_)
+{
+  DirectoryWalker walker(callbacks_, true, threadCount_);
+  return walker.walk(path_);
 }
 
 }
@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <util/logutil.h>
+#include <util/sharedidmap.h>
+
+namespace
+{
+
+/**
+ * An empty slot has zero key, so the zero id is stored under this key.
+ */
+const std::uint64_t zeroKey = 0x9e3779b97f4a7c15ULL;
+
+/**
+ * The number of slots probed before the table is considered full.
+ */
+const std::uint64_t maxProbes = 4096;
+
+/**
+ * The states of a slot. The value of a slot is being written in the writing
+ * state. A claim which is not committed yet has the state ownerBase + owner.
+ */
+const std::uint64_t writing = 0;
+const std::uint64_t committed = 1;
+const std::uint64_t released = 2;
+const std::uint64_t ownerBase = 3;
+
+std::uint64_t toKey(std::uint64_t id_)
+{
+  return id_ ? id_ : zeroKey;
+}
+
+} // namespace
+
+namespace cc
+{
+namespace util
+{
+
+struct SharedIdMap::Header
+{
+  std::uint64_t capacity;
+  std::atomic<std::uint64_t> size;
+  std::atomic<std::uint64_t> overflows;
+};
+
+struct SharedIdMap::Slot
+{
+  std::atomic<std::uint64_t> key;
+  std::atomic<std::uint64_t> value;
+  std::atomic<std::uint64_t> state;
+};
+
+static_assert(
+  std::atomic<std::uint64_t>::is_always_lock_free,
+  "The shared id table needs address-free atomics.");
+
+std::shared_ptr<SharedIdMap> SharedIdMap::create(std::uint64_t maxBytes_)
+{
+  std::uint64_t capacity = 1;
+  while (sizeof(Header) + 2 * capacity * sizeof(Slot) <= maxBytes_)
+    capacity *= 2;
+
+  std::uint64_t bytes = sizeof(Header) + capacity * sizeof(Slot);
+
+  int fd = ::memfd_create("cc-shared-ids", MFD_CLOEXEC);
+  if (fd < 0)
+  {
+    LOG(error) << "Failed to create shared memory for the id table.";
+    return nullptr;
+  }
+
+  // The pages are allocated lazily, as the table is filled.
+  if (::ftruncate(fd, bytes) != 0)
+  {
+    LOG(error) << "Failed to allocate " << (bytes >> 20)
+               << " MiB shared memory for the id table.";
+    ::close(fd);
+    return nullptr;
+  }
+
+  void* memory = ::mmap(
+    nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd, 0);
+  if (memory == MAP_FAILED)
+  {
+    ::close(fd);
+    return nullptr;
+  }
+
+  std::shared_ptr<SharedIdMap> map(new SharedIdMap(fd, memory, bytes));
+  map->_header->capacity = capacity;
+
+  return map;
+}
+
+std::shared_ptr<SharedIdMap> SharedIdMap::open(int fd_)
+{
+  struct stat st;
+  if (::fstat(fd_, &st) != 0
+    || static_cast<std::uint64_t>(st.st_size) < sizeof(Header))
+    return nullptr;
+
+  void* memory = ::mmap(
+    nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE,
+    fd_, 0);
+  if (memory == MAP_FAILED)
+    return nullptr;
+
+  ::fcntl(fd_, F_SETFD, FD_CLOEXEC);
+
+  return std::shared_ptr<SharedIdMap>(
+    new SharedIdMap(fd_, memory, st.st_size));
+}
+
+SharedIdMap::SharedIdMap(int fd_, void* memory_, std::uint64_t bytes_)
+  : _fd(fd_),
+    _memory(memory_),
+    _bytes(bytes_),
+    _header(static_cast<Header*>(memory_)),
+    _slots(reinterpret_cast<Slot*>(_header + 1)),
+    _claimState(committed)
+{
+}
+
+SharedIdMap::~SharedIdMap()
+{
+  ::munmap(_memory, _bytes);
+  ::close(_fd);
+}
+
+std::uint64_t SharedIdMap::home(std::uint64_t key_) const
+{
+  // The ids are hashes already, but the low bits of some of them may repeat.
+  key_ ^= key_ >> 33;
+  key_ *= 0xff51afd7ed558ccdULL;
+  key_ ^= key_ >> 33;
+
+  return key_ & (_header->capacity - 1);
+}
+
+void SharedIdMap::setOwner(std::uint64_t owner_)
+{
+  _claimState = ownerBase + owner_;
+}
+
+bool SharedIdMap::insert(std::uint64_t id_, std::uint64_t value_)
+{
+  std::uint64_t key = toKey(id_);
+  std::uint64_t mask = _header->capacity - 1;
+  std::uint64_t pos = home(key);
+
+  for (std::uint64_t i = 0; i < maxProbes && i <= mask; ++i)
+  {
+    Slot& slot = _slots[(pos + i) & mask];
+    std::uint64_t current = slot.key.load(std::memory_order_acquire);
+
+    if (current == 0)
+    {
+      if (slot.key.compare_exchange_strong(current, key))
+      {
+        ++_header->size;
+      }
+      else if (current != key)
+      {
+        // Another process has taken the slot for another key.
+        continue;
+      }
+      else
+      {
+        // Another process has inserted the same key.
+        return false;
+      }
+    }
+    else if (current == key)
+    {
+      // The slot of a released claim is taken over.
+      std::uint64_t state = released;
+      if (!slot.state.compare_exchange_strong(state, writing))
+        return false;
+    }
+    else
+      continue;
+
+    slot.value.store(value_, std::memory_order_relaxed);
+    slot.state.store(_claimState, std::memory_order_release);
+
+    if (_claimState != committed)
+    {
+      std::lock_guard<std::mutex> guard(_pendingMutex);
+      _pending.push_back(&slot);
+    }
+
+    return true;
+  }
+
+  if (_header->overflows++ == 0)
+    LOG(warning)
+      << "The shared id table is full, objects may be persisted twice. "
+         "Increase the size of the table.";
+
+  return true;
+}
+
+void SharedIdMap::commit(std::uint64_t id_)
+{
+  if (_claimState == committed)
+    return;
+
+  Slot* slot = findSlot(toKey(id_));
+  if (!slot)
+    return;
+
+  std::uint64_t state = _claimState;
+  slot->state.compare_exchange_strong(state, committed);
+}
+
+void SharedIdMap::releasePending()
+{
+  std::lock_guard<std::mutex> guard(_pendingMutex);
+
+  for (Slot* slot : _pending)
+  {
+    std::uint64_t state = _claimState;
+    slot->state.compare_exchange_strong(state, released);
+  }
+
+  _pending.clear();
+}
+
+std::uint64_t SharedIdMap::release(std::uint64_t owner_)
+{
+  std::uint64_t count = 0;
+  std::uint64_t end = sizeof(Header) + _header->capacity * sizeof(Slot);
+  std::uint64_t offset = sizeof(Header);
+
+  // The pages which have never been written are holes of the shared memory
+  // file. These are skipped, so they are not allocated by reading them.
+  while (offset < end)
+  {
+    off_t dataBegin = ::lseek(_fd, offset, SEEK_DATA);
+    if (dataBegin < 0)
+      break;
+
+    off_t dataEnd = ::lseek(_fd, dataBegin, SEEK_HOLE);
+    if (dataEnd < 0)
+      dataEnd = end;
+
+    std::uint64_t first = (dataBegin - sizeof(Header)) / sizeof(Slot);
+    std::uint64_t last = std::min<std::uint64_t>(
+      (dataEnd - sizeof(Header) + sizeof(Slot) - 1) / sizeof(Slot),
+      _header->capacity);
+
+    for (std::uint64_t i = first; i < last; ++i)
+    {
+      std::uint64_t state = ownerBase + owner_;
+      if (_slots[i].state.compare_exchange_strong(state, released))
+        ++count;
+    }
+
+    offset = dataEnd;
+  }
+
+  return count;
+}
+
+SharedIdMap::Slot* SharedIdMap::findSlot(std::uint64_t key_) const
+{
+  std::uint64_t mask = _header->capacity - 1;
+  std::uint64_t pos = home(key_);
+
+  for (std::uint64_t i = 0; i < maxProbes && i <= mask; ++i)
+  {
+    Slot& slot = _slots[(pos + i) & mask];
+    std::uint64_t current = slot.key.load(std::memory_order_acquire);
+
+    if (current == 0)
+      return nullptr;
+
+    if (current == key_)
+      return &slot;
+  }
+
+  return nullptr;
+}
+
+bool SharedIdMap::contains(std::uint64_t id_) const
+{
+  std::uint64_t value;
+  return find(id_, value);
+}
+
+bool SharedIdMap::find(std::uint64_t id_, std::uint64_t& value_) const
+{
+  const Slot* slot = findSlot(toKey(id_));
+  if (!slot)
+    return false;
+
+  std::uint64_t state;
+  while ((state = slot->state.load(std::memory_order_acquire)) == writing)
+    std::this_thread::yield();
+
+  if (state == released)
+    return false;
+
+  value_ = slot->value.load(std::memory_order_relaxed);
+  return true;
+}
+
+std::uint64_t SharedIdMap::size() const
+{
+  return _header->size;
+}
+
+std::uint64_t SharedIdMap::overflows() const
+{
+  return _header->overflows;
+}
+
+int SharedIdMap::fd() const
+{
+  return _fd;
+}
+
+} // util
+} // cc
@@ -0,0 +1,61 @@
+#define GTEST_HAS_TR1_TUPLE 1
+#define GTEST_USE_OWN_TR1_TUPLE 0
+
+#include <cstdint>
+#include <limits>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <util/hash.h>
+
+using namespace cc;
+
+TEST(FnvHasherTest, EmptyInput)
+{
+  EXPECT_EQ(util::FnvHasher().value(), util::fnvHash(""));
+}
+
+TEST(FnvHasherTest, Strings)
+{
+  for (const std::string& str : {"a", "main.cpp", "c:@F@main#", "\xff\x80"})
+    EXPECT_EQ(util::FnvHasher().add(str).value(), util::fnvHash(str));
+}
+
+TEST(FnvHasherTest, Pieces)
+{
+  std::string path = "/home/user/project/main.cpp";
+
+  EXPECT_EQ(
+    util::FnvHasher().add(path).add(':').add("c:@F@main#").value(),
+    util::fnvHash(path + ':' + "c:@F@main#"));
+
+  EXPECT_EQ(
+    util::FnvHasher().add(path.data(), 5).add(path.data() + 5, 6).value(),
+    util::fnvHash(path.substr(0, 11)));
+}
+
+TEST(FnvHasherTest, Numbers)
+{
+  EXPECT_EQ(
+    util::FnvHasher().add("line").add(':').addNumber(42).value(),
+    util::fnvHash("line:" + std::to_string(42)));
+
+  EXPECT_EQ(
+    util::FnvHasher().addNumber(-7).value(),
+    util::fnvHash(std::to_string(-7)));
+
+  EXPECT_EQ(
+    util::FnvHasher().addNumber(0u).value(),
+    util::fnvHash(std::to_string(0u)));
+
+  EXPECT_EQ(
+    util::FnvHasher().addNumber(std::numeric_limits<std::int64_t>::min())
+      .value(),
+    util::fnvHash(std::to_string(std::numeric_limits<std::int64_t>::min())));
+
+  EXPECT_EQ(
+    util::FnvHasher().addNumber(std::numeric_limits<std::uint64_t>::max())
+      .value(),
+    util::fnvHash(std::to_string(std::numeric_limits<std::uint64_t>::max())));
+}
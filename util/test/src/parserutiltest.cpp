@@ -0,0 +1,299 @@
+#define GTEST_HAS_TR1_TUPLE 1
+#define GTEST_USE_OWN_TR1_TUPLE 0
+
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <boost/filesystem.hpp>
+
+#include <gtest/gtest.h>
+
+#include <util/parserutil.h>
+
+using namespace cc;
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+
+/**
+ * Collects the paths passed to a directory walk callback. The callback may be
+ * called from several threads.
+ */
+class PathCollector
+{
+public:
+  /**
+   * @param pruned_ The callback returns false on this path.
+   */
+  explicit PathCollector(const std::string& pruned_ = "") : _pruned(pruned_)
+  {
+  }
+
+  util::DirEntryCallback callback()
+  {
+    return [this](const std::string& path_, util::DirEntryType)
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _paths.insert(path_);
+      return path_ != _pruned;
+    };
+  }
+
+  const std::set<std::string>& paths() const { return _paths; }
+
+private:
+  std::string _pruned;
+  std::mutex _mutex;
+  std::set<std::string> _paths;
+};
+
+} // namespace
+
+class DirectoryWalkerTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    _root = fs::canonical(fs::temp_directory_path()).string() + '/'
+      + fs::unique_path("cc-parserutiltest-%%%%-%%%%").string();
+    fs::create_directories(_root);
+  }
+
+  void TearDown() override
+  {
+    boost::system::error_code ec;
+    fs::remove_all(_root, ec);
+  }
+
+  /**
+   * Creates a file and its missing parent directories.
+   * @return The full path of the file.
+   */
+  std::string createFile(const std::string& path_)
+  {
+    std::string path = _root + '/' + path_;
+    fs::create_directories(fs::path(path).parent_path());
+    std::ofstream(path) << path_;
+    return path;
+  }
+
+  /**
+   * Creates a tree of depth_ levels with width_ subdirectories and width_
+   * files in each directory.
+   */
+  void createTree(const std::string& dir_, int depth_, int width_)
+  {
+    for (int i = 0; i < width_; ++i)
+    {
+      std::string name = dir_ + '/' + std::to_string(i);
+      createFile(name + ".txt");
+      if (depth_ > 1)
+        createTree(name, depth_ - 1, width_);
+    }
+  }
+
+  /**
+   * The paths under the root found by boost, including the root.
+   */
+  std::set<std::string> baseline() const
+  {
+    std::set<std::string> paths{_root};
+    for (fs::recursive_directory_iterator it(_root), end; it != end; ++it)
+      paths.insert(it->path().string());
+    return paths;
+  }
+
+  std::string _root;
+};
+
+TEST_F(DirectoryWalkerTest, SingleFile)
+{
+  std::string file = createFile("main.cpp");
+
+  PathCollector collector;
+  EXPECT_TRUE(util::iterateDirectoryParallel(file, {collector.callback()}, 4));
+  EXPECT_EQ(collector.paths(), std::set<std::string>{file});
+}
+
+TEST_F(DirectoryWalkerTest, MissingPath)
+{
+  PathCollector collector;
+  EXPECT_TRUE(util::iterateDirectoryParallel(
+    _root + "/missing", {collector.callback()}, 1));
+  EXPECT_TRUE(collector.paths().empty());
+}
+
+TEST_F(DirectoryWalkerTest, Pruning)
+{
+  createFile("src/main.cpp");
+  createFile("build/obj/main.o");
+  createFile("build/main");
+
+  PathCollector collector(_root + "/build");
+  util::iterateDirectoryParallel(_root, {collector.callback()}, 1);
+
+  EXPECT_EQ(collector.paths(), (std::set<std::string>{
+    _root, _root + "/src", _root + "/src/main.cpp", _root + "/build"}));
+}
+
+TEST_F(DirectoryWalkerTest, PruningRoot)
+{
+  createFile("src/main.cpp");
+
+  PathCollector collector(_root);
+  EXPECT_FALSE(util::iterateDirectoryParallel(
+    _root, {collector.callback()}, 4));
+  EXPECT_EQ(collector.paths(), std::set<std::string>{_root});
+}
+
+TEST_F(DirectoryWalkerTest, MultipleCallbacks)
+{
+  createFile("src/main.cpp");
+  createFile("build/obj/main.o");
+
+  PathCollector all;
+  PathCollector pruneBuild(_root + "/build");
+  PathCollector pruneSrc(_root + "/src");
+
+  util::iterateDirectoryParallel(
+    _root,
+    {all.callback(), pruneBuild.callback(), pruneSrc.callback()},
+    4);
+
+  // A directory pruned by one callback is still read for the others.
+  EXPECT_EQ(all.paths(), baseline());
+  EXPECT_EQ(pruneBuild.paths(), (std::set<std::string>{
+    _root, _root + "/src", _root + "/src/main.cpp", _root + "/build"}));
+  EXPECT_EQ(pruneSrc.paths(), (std::set<std::string>{
+    _root, _root + "/src", _root + "/build", _root + "/build/obj",
+    _root + "/build/obj/main.o"}));
+}
+
+TEST_F(DirectoryWalkerTest, SymbolicLinkCycle)
+{
+  createFile("a/b/main.cpp");
+  fs::create_directory_symlink(_root + "/a", _root + "/a/b/loop");
+  fs::create_directory_symlink(_root, _root + "/a/root");
+
+  PathCollector collector;
+  util::iterateDirectoryParallel(_root, {collector.callback()}, 4);
+
+  // The links are reported, but their content is not read again.
+  EXPECT_EQ(collector.paths(), (std::set<std::string>{
+    _root, _root + "/a", _root + "/a/b", _root + "/a/b/main.cpp",
+    _root + "/a/b/loop", _root + "/a/root"}));
+}
+
+TEST_F(DirectoryWalkerTest, SymbolicLinkTypes)
+{
+  std::string file = createFile("src/main.cpp");
+  fs::create_symlink(file, _root + "/link.cpp");
+  fs::create_directory_symlink(_root + "/src", _root + "/srclink");
+  fs::create_symlink(_root + "/missing", _root + "/dangling");
+
+  std::mutex mutex;
+  std::set<std::pair<std::string, util::DirEntryType>> entries;
+
+  util::iterateDirectoryParallel(
+    _root,
+    {[&](const std::string& path_, util::DirEntryType type_)
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.emplace(path_, type_);
+        return true;
+      }},
+    2);
+
+  EXPECT_TRUE(entries.count({_root + "/link.cpp",
+    util::DirEntryType::RegularFile}));
+  EXPECT_TRUE(entries.count({_root + "/srclink",
+    util::DirEntryType::Directory}));
+  EXPECT_TRUE(entries.count({_root + "/srclink/main.cpp",
+    util::DirEntryType::RegularFile}));
+
+  // A dangling link can't be stat-ed, so it is skipped.
+  for (const auto& entry : entries)
+    EXPECT_NE(entry.first, _root + "/dangling");
+}
+
+TEST_F(DirectoryWalkerTest, EntryStatus)
+{
+  std::string file = createFile("src/main.cpp");
+
+  std::mutex mutex;
+  std::map<std::string, util::DirEntryStat> stats;
+
+  util::iterateDirectoryParallel(
+    _root,
+    {[&](
+      const std::string& path_,
+      util::DirEntryType,
+      const util::DirEntryStat& stat_)
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats[path_] = stat_;
+        return true;
+      }},
+    2);
+
+  ASSERT_TRUE(stats.count(file));
+  EXPECT_EQ(stats[file].size, fs::file_size(file));
+  EXPECT_EQ(stats[file].mtime, fs::last_write_time(file));
+  EXPECT_EQ(stats[_root + "/src"].mtime, fs::last_write_time(_root + "/src"));
+}
+
+TEST_F(DirectoryWalkerTest, ExceptionPropagation)
+{
+  createTree("tree", 3, 4);
+
+  for (std::size_t threadCount : {1, 4})
+    EXPECT_THROW(
+      util::iterateDirectoryParallel(
+        _root,
+        {[this](const std::string& path_, util::DirEntryType)
+          {
+            if (path_ == _root + "/tree/2/1/3.txt")
+              throw std::runtime_error("callback failure");
+            return true;
+          }},
+        threadCount),
+      std::runtime_error);
+}
+
+TEST_F(DirectoryWalkerTest, ParallelMatchesBaseline)
+{
+  createTree("tree", 4, 5);
+  createFile("empty/.hidden");
+  fs::create_directories(_root + "/empty/dir");
+
+  std::set<std::string> expected = baseline();
+
+  for (std::size_t threadCount : {1, 2, 8, 32})
+  {
+    PathCollector collector;
+    EXPECT_TRUE(util::iterateDirectoryParallel(
+      _root, {collector.callback()}, threadCount));
+    EXPECT_EQ(collector.paths(), expected) << threadCount << " threads";
+  }
+}
+
+TEST_F(DirectoryWalkerTest, RecursiveMatchesBaseline)
+{
+  createTree("tree", 3, 4);
+
+  std::set<std::string> paths;
+  util::iterateDirectoryRecursive(_root, [&paths](const std::string& path_)
+    {
+      paths.insert(path_);
+      return true;
+    });
+
+  EXPECT_EQ(paths, baseline());
+}
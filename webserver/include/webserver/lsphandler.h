@@ -1,12 +1,17 @@
 #ifndef CC_WEBSERVER_LSPHANDLER_H
 #define CC_WEBSERVER_LSPHANDLER_H
 
+#include <cctype>
+#include <istream>
 #include <memory>
+#include <streambuf>
 #include <unordered_map>
+#include <vector>
 
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
 
+#include <util/jsonwriter.h>
 #include <util/logutil.h>
 #include <webserver/requesthandler.h>
 
@@ -57,6 +62,8 @@ enum class LspMethod
 template <class LspServiceT>
 class LspHandler : public RequestHandler
 {
+  typedef typename LspServiceT::Response Response;
+
 public:
   std::string key() const override
   {
@@ -76,226 +83,424 @@ public:
   {
     try
     {
-      std::string request = getContent(conn_);
-      LOG(debug) << "[LSP] Request content:\n" << request;
+      LOG(debug) << "[LSP] Request content:\n" << getContent(conn_);
 
-      pt::ptree responseTree;
-      responseTree.put("jsonrpc", "2.0");
+      // The response is sent in chunks while it is being written, so it is
+      // never held in memory as a whole.
+      mg_send_header(conn_, "Content-Type", "application/json");
 
-      try
       {
+        ChunkBuffer chunkBuffer(conn_);
+        std::ostream responseStream(&chunkBuffer);
+        util::JsonWriter writer(responseStream);
+
         pt::ptree requestTree;
-        std::stringstream requestStream(request);
-        pt::read_json(requestStream, requestTree);
+        bool parsed = false;
 
-        std::string requestId = requestTree.get<std::string>("id");
-        responseTree.put("id", requestId);
+        try
+        {
+          ContentBuffer contentBuffer(conn_->content, conn_->content_len);
+          std::istream requestStream(&contentBuffer);
+          pt::read_json(requestStream, requestTree);
+          parsed = true;
+        }
+        catch (const pt::ptree_error& ex)
+        {
+          LOG(warning) << ex.what();
 
-        std::string method = requestTree.get<std::string>("method");
-        pt::ptree& params = requestTree.get_child("params");
+          Response response;
+          lspService->getParseError(response, ex);
+          response.write(writer);
+        }
 
-        switch (parseMethod(method))
+        if (parsed)
         {
-          case LspMethod::Signature:
-          {
-            lspService->getSignature(responseTree, params);
-            break;
-          }
-          case LspMethod::Definition:
-          {
-            lspService->getDefinition(responseTree, params);
-            break;
-          }
-          case LspMethod::Declaration:
-          {
-            lspService->getDeclaration(responseTree, params);
-            break;
-          }
-          case LspMethod::Implementation:
-          {
-            lspService->getImplementation(responseTree, params);
-            break;
-          }
-          case LspMethod::References:
-          {
-            lspService->getReferences(responseTree, params);
-            break;
-          }
-          case LspMethod::DiagramTypes:
-          {
-            lspService->getDiagramTypes(responseTree, params);
-            break;
-          }
-          case LspMethod::Diagram:
-          {
-            lspService->getDiagram(responseTree, params);
-            break;
-          }
-          case LspMethod::ModuleDiagram:
-          {
-            lspService->getModuleDiagram(responseTree, params);
-            break;
-          }
-          case LspMethod::Parameters:
-          {
-            lspService->getParameters(responseTree, params);
-            break;
-          }
-          case LspMethod::LocalVariables:
-          {
-            lspService->getLocalVariables(responseTree, params);
-            break;
-          }
-          case LspMethod::Overridden:
-          {
-            lspService->getOverridden(responseTree, params);
-            break;
-          }
-          case LspMethod::Overriders:
-          {
-            lspService->getOverrider(responseTree, params);
-            break;
-          }
-          case LspMethod::Read:
-          {
-            lspService->getRead(responseTree, params);
-            break;
-          }
-          case LspMethod::Write:
-          {
-            lspService->getWrite(responseTree, params);
-            break;
-          }
-          case LspMethod::Methods:
-          {
-            lspService->getMethods(responseTree, params);
-            break;
-          }
-          case LspMethod::Friends:
-          {
-            lspService->getFriends(responseTree, params);
-            break;
-          }
-          case LspMethod::EnumConstants:
-          {
-            lspService->getEnumConstants(responseTree, params);
-            break;
-          }
-          case LspMethod::Expansion:
-          {
-            lspService->getExpansion(responseTree, params);
-            break;
-          }
-          case LspMethod::Undefinition:
-          {
-            lspService->getUndefinition(responseTree, params);
-            break;
-          }
-          case LspMethod::ThisCalls:
-          {
-            lspService->getThisCalls(responseTree, params);
-            break;
-          }
-          case LspMethod::  CallsOfThis:
-          {
-            lspService->getCallsOfThis(responseTree, params);
-            break;
-          }
-          case LspMethod::Callee:
-          {
-            lspService->getCallee(responseTree, params);
-            break;
-          }
-          case LspMethod::Caller:
-          {
-            lspService->getCaller(responseTree, params);
-            break;
-          }
-          case LspMethod::VirtualCall:
-          {
-            lspService->getVirtualCall(responseTree, params);
-            break;
-          }
-          case LspMethod::FunctionPointerCall:
-          {
-            lspService->getFunctionPointerCall(responseTree, params);
-            break;
-          }
-          case LspMethod::Alias:
-          {
-            lspService->getAlias(responseTree, params);
-            break;
-          }
-          case LspMethod::Implements:
-          {
-            lspService->getImplements(responseTree, params);
-            break;
-          }
-          case LspMethod::DataMember:
-          {
-            lspService->getDataMember(responseTree, params);
-            break;
-          }
-          case LspMethod::UnderlyingType:
+          bool batch = isBatch(conn_);
+          std::vector<bool> numericIds = findNumericIds(
+            conn_->content, conn_->content + conn_->content_len, batch);
+
+          if (batch && requestTree.empty())
           {
-            lspService->getUnderlyingType(responseTree, params);
-            break;
+            // An empty batch is answered with a single error, not an array.
+            Response response;
+            lspService->getInvalidRequest(response);
+            response.write(writer);
           }
-          default:
+          else if (batch)
           {
-            LOG(warning) << "[LSP] Unsupported method: '" << method << "'";
-            lspService->getMethodNotFound(responseTree, method);
+            // A batch is answered with an array holding the response of each
+            // of its requests in order.
+            writer.beginArray();
+            std::size_t i = 0;
+            for (const auto& request : requestTree)
+            {
+              handleRequest(request.second,
+                i < numericIds.size() && numericIds[i], writer);
+              ++i;
+            }
+            writer.endArray();
           }
+          else
+            handleRequest(requestTree, numericIds.front(), writer);
         }
+
+        responseStream.flush();
       }
-      catch (const pt::ptree_error& ex)
-      {
-        LOG(warning) << ex.what();
-        lspService->getParseError(responseTree, ex);
-      }
-      catch (const std::exception& ex)
+
+      // Terminate the chunked content.
+      mg_send_data(conn_, "", 0);
+    }
+    catch (const std::exception& ex)
+    {
+      LOG(warning) << ex.what();
+    }
+    catch (...)
+    {
+      LOG(warning) << "Unknown exception has been caught";
+    }
+
+    // Returning non-zero tells mongoose that our function has replied to
+    // the client, and mongoose should not send client any more data.
+    return MG_TRUE;
+  }
+
+private:
+  /**
+   * Read-only stream buffer over the request body, so that the body can be
+   * parsed without copying it first.
+   */
+  struct ContentBuffer : public std::streambuf
+  {
+    ContentBuffer(const char* content_, std::size_t length_)
+    {
+      char* begin = const_cast<char*>(content_);
+      setg(begin, begin, begin + length_);
+    }
+  };
+
+  /**
+   * Write-only stream buffer which passes its content to the client in
+   * chunks of HTTP chunked transfer encoding.
+   */
+  struct ChunkBuffer : public std::streambuf
+  {
+    ChunkBuffer(mg_connection* conn_) : _conn(conn_)
+    {
+      setp(_buffer, _buffer + sizeof(_buffer));
+    }
+
+    ~ChunkBuffer()
+    {
+      sync();
+    }
+
+  protected:
+    int_type overflow(int_type ch_) override
+    {
+      sync();
+
+      if (!traits_type::eq_int_type(ch_, traits_type::eof()))
       {
-        LOG(warning) << ex.what();
-        lspService->getInternalError(responseTree, ex);
+        *pptr() = traits_type::to_char_type(ch_);
+        pbump(1);
       }
-      catch (...)
+
+      return traits_type::not_eof(ch_);
+    }
+
+    int sync() override
+    {
+      // A chunk of zero length would terminate the content.
+      int length = static_cast<int>(pptr() - pbase());
+      if (length > 0)
+        mg_send_data(_conn, pbase(), length);
+
+      setp(_buffer, _buffer + sizeof(_buffer));
+      return 0;
+    }
+
+  private:
+    mg_connection* _conn;
+    char _buffer[8192];
+  };
+
+  /**
+   * The property tree holds every value as a string, so the type of the
+   * request IDs is taken from the raw body. The returned vector tells for
+   * each request whether its ID is a JSON number.
+   */
+  static std::vector<bool> findNumericIds(
+    const char* begin_,
+    const char* end_,
+    bool batch_)
+  {
+    // In a batch the requests are the elements of the outermost array.
+    const std::size_t requestDepth = batch_ ? 2 : 1;
+
+    std::vector<bool> numericIds;
+    std::string brackets;
+
+    if (!batch_)
+      numericIds.push_back(false);
+
+    for (const char* it = begin_; it < end_; ++it)
+    {
+      switch (*it)
       {
-        LOG(warning) << "Unknown exception has been caught";
-        lspService->getUnknownError(responseTree);
+        case '{':
+        case '[':
+          brackets.push_back(*it);
+          if (batch_ && brackets.size() == 1)
+            numericIds.push_back(false);
+          break;
+
+        case '}':
+        case ']':
+          if (!brackets.empty())
+            brackets.pop_back();
+          break;
+
+        case ',':
+          if (batch_ && brackets.size() == 1)
+            numericIds.push_back(false);
+          break;
+
+        case '"':
+        {
+          const char* keyBegin = ++it;
+          while (it < end_ && *it != '"')
+            it += *it == '\\' ? 2 : 1;
+
+          if (it >= end_)
+            return numericIds;
+
+          if (brackets.size() != requestDepth || brackets.back() != '{' ||
+              std::string(keyBegin, it) != "id")
+            break;
+
+          const char* next = it + 1;
+          while (next < end_ && std::isspace(static_cast<unsigned char>(*next)))
+            ++next;
+
+          if (next == end_ || *next != ':')
+            break;
+
+          do
+            ++next;
+          while (next < end_ && std::isspace(static_cast<unsigned char>(*next)));
+
+          if (next < end_ && !numericIds.empty())
+            numericIds.back() = *next == '-' ||
+              std::isdigit(static_cast<unsigned char>(*next));
+          break;
+        }
       }
+    }
 
-      std::stringstream responseStream;
-      pt::write_json(responseStream, responseTree);
-      std::string response = responseStream.str();
+    return numericIds;
+  }
 
-      LOG(debug) << "[LSP] Response content:\n" << response << std::endl;
+  /**
+   * Handles a single JSON RPC request and writes its response.
+   */
+  void handleRequest(
+    const pt::ptree& requestTree,
+    bool numericId_,
+    util::JsonWriter& writer_)
+  {
+    Response response;
 
-      // Send HTTP reply to the client create headers
-      mg_send_header(conn_, "Content-Type", "application/json");
-      mg_send_header(
-        conn_, "Content-Length", std::to_string(response.length()).c_str());
+    try
+    {
+      response.setId(requestTree.get<std::string>("id"), numericId_);
 
-      // Terminate headers
-      mg_write(conn_, "\r\n", 2);
+      std::string method = requestTree.get<std::string>("method");
+      const pt::ptree& params = requestTree.get_child("params");
 
-      // Send content
-      mg_write(conn_, response.c_str(), response.length());
+      switch (parseMethod(method))
+      {
+        case LspMethod::Signature:
+        {
+          lspService->getSignature(response, params);
+          break;
+        }
+        case LspMethod::Definition:
+        {
+          lspService->getDefinition(response, params);
+          break;
+        }
+        case LspMethod::Declaration:
+        {
+          lspService->getDeclaration(response, params);
+          break;
+        }
+        case LspMethod::Implementation:
+        {
+          lspService->getImplementation(response, params);
+          break;
+        }
+        case LspMethod::References:
+        {
+          lspService->getReferences(response, params);
+          break;
+        }
+        case LspMethod::DiagramTypes:
+        {
+          lspService->getDiagramTypes(response, params);
+          break;
+        }
+        case LspMethod::Diagram:
+        {
+          lspService->getDiagram(response, params);
+          break;
+        }
+        case LspMethod::ModuleDiagram:
+        {
+          lspService->getModuleDiagram(response, params);
+          break;
+        }
+        case LspMethod::Parameters:
+        {
+          lspService->getParameters(response, params);
+          break;
+        }
+        case LspMethod::LocalVariables:
+        {
+          lspService->getLocalVariables(response, params);
+          break;
+        }
+        case LspMethod::Overridden:
+        {
+          lspService->getOverridden(response, params);
+          break;
+        }
+        case LspMethod::Overriders:
+        {
+          lspService->getOverrider(response, params);
+          break;
+        }
+        case LspMethod::Read:
+        {
+          lspService->getRead(response, params);
+          break;
+        }
+        case LspMethod::Write:
+        {
+          lspService->getWrite(response, params);
+          break;
+        }
+        case LspMethod::Methods:
+        {
+          lspService->getMethods(response, params);
+          break;
+        }
+        case LspMethod::Friends:
+        {
+          lspService->getFriends(response, params);
+          break;
+        }
+        case LspMethod::EnumConstants:
+        {
+          lspService->getEnumConstants(response, params);
+          break;
+        }
+        case LspMethod::Expansion:
+        {
+          lspService->getExpansion(response, params);
+          break;
+        }
+        case LspMethod::Undefinition:
+        {
+          lspService->getUndefinition(response, params);
+          break;
+        }
+        case LspMethod::ThisCalls:
+        {
+          lspService->getThisCalls(response, params);
+          break;
+        }
+        case LspMethod::CallsOfThis:
+        {
+          lspService->getCallsOfThis(response, params);
+          break;
+        }
+        case LspMethod::Callee:
+        {
+          lspService->getCallee(response, params);
+          break;
+        }
+        case LspMethod::Caller:
+        {
+          lspService->getCaller(response, params);
+          break;
+        }
+        case LspMethod::VirtualCall:
+        {
+          lspService->getVirtualCall(response, params);
+          break;
+        }
+        case LspMethod::FunctionPointerCall:
+        {
+          lspService->getFunctionPointerCall(response, params);
+          break;
+        }
+        case LspMethod::Alias:
+        {
+          lspService->getAlias(response, params);
+          break;
+        }
+        case LspMethod::Implements:
+        {
+          lspService->getImplements(response, params);
+          break;
+        }
+        case LspMethod::DataMember:
+        {
+          lspService->getDataMember(response, params);
+          break;
+        }
+        case LspMethod::UnderlyingType:
+        {
+          lspService->getUnderlyingType(response, params);
+          break;
+        }
+        default:
+        {
+          LOG(warning) << "[LSP] Unsupported method: '" << method << "'";
+          lspService->getMethodNotFound(response, method);
+        }
+      }
+    }
+    catch (const pt::ptree_error& ex)
+    {
+      LOG(warning) << ex.what();
+      lspService->getParseError(response, ex);
     }
     catch (const std::exception& ex)
     {
       LOG(warning) << ex.what();
+      lspService->getInternalError(response, ex);
     }
     catch (...)
     {
       LOG(warning) << "Unknown exception has been caught";
+      lspService->getUnknownError(response);
     }
 
-    // Returning non-zero tells mongoose that our function has replied to
-    // the client, and mongoose should not send client any more data.
-    return MG_TRUE;
+    response.write(writer_);
+  }
+
+  /**
+   * Tells whether the request body is a batch, i.e. a JSON array of requests.
+   */
+  bool isBatch(mg_connection* conn_) const
+  {
+    for (std::size_t i = 0; i < conn_->content_len; ++i)
+      if (!std::isspace(static_cast<unsigned char>(conn_->content[i])))
+        return conn_->content[i] == '[';
+    return false;
   }
 
-private:
   inline std::string getContent(mg_connection* conn_)
   {
     return std::string(conn_->content, conn_->content + conn_->content_len);